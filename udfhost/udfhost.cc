@@ -0,0 +1,1065 @@
+/***************************************************************************
+ * Copyright (c) 2020-22                                                   *
+ *      Volnei Cervi Puttini.  All rights reserved.                        *
+ *      vcputtini@gmail.com
+ *                                                                         *
+ * Redistribution and use in source and binary forms, with or without      *
+ * modification, are permitted provided that the following conditions      *
+ * are met:                                                                *
+ * 1. Redistributions of source code must retain the above copyright       *
+ *    notice, this list of conditions and the following disclaimer.        *
+ * 2. Redistributions in binary form must reproduce the above copyright    *
+ *    notice, this list of conditions and the following disclaimer in the  *
+ *    documentation and/or other materials provided with the distribution. *
+ * 4. Neither the name of the Author     nor the names of its contributors *
+ *    may be used to endorse or promote products derived from this software*
+ *    without specific prior written permission.                           *
+ *                                                                         *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND *
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR      *
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS  *
+ * BE LIABLEFOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   *
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF    *
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS*
+ * INTERRUPTION)                                                           *
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,     *
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING   *
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE      *
+ * POSSIBILITY OFSUCH DAMAGE.                                              *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "udfhost.h"
+
+#include <dlfcn.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iterator> // std::size()
+#include <limits>
+#include <new>
+#include <sstream>
+#include <thread>
+
+/* Replaced operator new/delete --------------------------------------------- */
+
+namespace {
+
+inline void*
+counted(std::size_t n_) noexcept
+{
+  udfhost::AllocCounter& c_ = udfhost::AllocCounter::local();
+  ++c_.allocs_;
+  c_.bytes_ += n_;
+  return std::malloc(n_ ? n_ : 1);
+}
+
+inline void*
+countedAligned(std::size_t n_, std::align_val_t al_) noexcept
+{
+  udfhost::AllocCounter& c_ = udfhost::AllocCounter::local();
+  ++c_.allocs_;
+  c_.bytes_ += n_;
+  const std::size_t a_ = static_cast<std::size_t>(al_);
+  return std::aligned_alloc(a_, (n_ + a_ - 1) / a_ * a_);
+}
+
+inline void
+released(void* p_) noexcept
+{
+  if (p_ != nullptr) {
+    ++udfhost::AllocCounter::local().frees_;
+    std::free(p_);
+  }
+}
+
+} // namespace
+
+void*
+operator new(std::size_t n_)
+{
+  if (void* p_ = counted(n_)) {
+    return p_;
+  }
+  throw std::bad_alloc();
+}
+
+void*
+operator new[](std::size_t n_)
+{
+  return operator new(n_);
+}
+
+void*
+operator new(std::size_t n_, const std::nothrow_t&) noexcept
+{
+  return counted(n_);
+}
+
+void*
+operator new[](std::size_t n_, const std::nothrow_t&) noexcept
+{
+  return counted(n_);
+}
+
+void*
+operator new(std::size_t n_, std::align_val_t al_)
+{
+  if (void* p_ = countedAligned(n_, al_)) {
+    return p_;
+  }
+  throw std::bad_alloc();
+}
+
+void*
+operator new[](std::size_t n_, std::align_val_t al_)
+{
+  return operator new(n_, al_);
+}
+
+void
+operator delete(void* p_) noexcept
+{
+  released(p_);
+}
+
+void
+operator delete[](void* p_) noexcept
+{
+  released(p_);
+}
+
+void
+operator delete(void* p_, std::size_t) noexcept
+{
+  released(p_);
+}
+
+void
+operator delete[](void* p_, std::size_t) noexcept
+{
+  released(p_);
+}
+
+void
+operator delete(void* p_, std::align_val_t) noexcept
+{
+  released(p_);
+}
+
+void
+operator delete[](void* p_, std::align_val_t) noexcept
+{
+  released(p_);
+}
+
+void
+operator delete(void* p_, std::size_t, std::align_val_t) noexcept
+{
+  released(p_);
+}
+
+void
+operator delete[](void* p_, std::size_t, std::align_val_t) noexcept
+{
+  released(p_);
+}
+
+namespace udfhost {
+
+AllocCounter&
+AllocCounter::local() noexcept
+{
+  thread_local AllocCounter c_;
+  return c_;
+}
+
+/* UdfLibrary --------------------------------------------------------------- */
+
+/*!
+ * \brief Loads the library and resolves the entry points of the UDF 'name_'.
+ * Only the main function is mandatory, as in the server.
+ */
+UdfLibrary::UdfLibrary(const std::string& path_, const std::string& name_)
+  : name_(name_)
+{
+  handle_ = ::dlopen(path_.c_str(), RTLD_NOW | RTLD_LOCAL);
+  if (handle_ == nullptr) {
+    const char* e_ = ::dlerror();
+    error_ = e_ ? e_ : "dlopen() failed";
+    return;
+  }
+
+  auto sym_ = [this](const std::string& suffix_) {
+    return ::dlsym(handle_, (this->name_ + suffix_).c_str());
+  };
+
+  main_ = sym_("");
+  init_ = reinterpret_cast<InitFn>(sym_("_init"));
+  deinit_ = reinterpret_cast<DeinitFn>(sym_("_deinit"));
+  clear_ = reinterpret_cast<ClearFn>(sym_("_clear"));
+  add_ = reinterpret_cast<AddFn>(sym_("_add"));
+  reset_ = reinterpret_cast<AddFn>(sym_("_reset"));
+
+  if (main_ == nullptr) {
+    error_ = "Function " + name_ + " not found in " + path_;
+  }
+}
+
+UdfLibrary::~UdfLibrary()
+{
+  if (handle_ != nullptr) {
+    ::dlclose(handle_);
+  }
+}
+
+/* ArgSpec ------------------------------------------------------------------ */
+
+/*!
+ * \brief Parses the list of arguments, separated by commas:
+ *
+ *   $N          column N (1-based) as a string
+ *   $N:i  $N:r  column N as an integer / a real
+ *   $N:x        column N as a string of bytes written in hex (a BLOB, e.g.
+ *               a sketch printed by --hex)
+ *   'text'      constant string ('' is a quote)
+ *   i:123       constant integer
+ *   r:1.5       constant real
+ *   null        constant NULL
+ */
+bool
+ArgSpec::parse(const std::string& text_,
+               std::vector<ArgSpec>& out_,
+               std::string& error_)
+{
+  size_t i_ = 0;
+  out_.clear();
+
+  while (i_ < text_.size()) {
+    ArgSpec a_;
+    if (text_[i_] == '\'') {
+      a_.const_ = true;
+      ++i_;
+      for (;;) {
+        if (i_ >= text_.size()) {
+          error_ = "Unterminated string in: " + text_;
+          return false;
+        }
+        if (text_[i_] == '\'') {
+          if (i_ + 1 < text_.size() && text_[i_ + 1] == '\'') {
+            a_.value_ += '\'';
+            i_ += 2;
+            continue;
+          }
+          ++i_;
+          break;
+        }
+        a_.value_ += text_[i_++];
+      }
+      a_.name_ = "'" + a_.value_ + "'";
+    } else {
+      const size_t end_ = std::min(text_.find(',', i_), text_.size());
+      const std::string tok_ = text_.substr(i_, end_ - i_);
+      i_ = end_;
+      a_.name_ = tok_;
+
+      if (tok_ == "null" || tok_ == "NULL") {
+        a_.const_ = true;
+        a_.null_ = true;
+      } else if (tok_.size() > 1 && tok_[0] == '$') {
+        char* e_ = nullptr;
+        const unsigned long col_ = std::strtoul(tok_.c_str() + 1, &e_, 10);
+        if (col_ == 0) {
+          error_ = "Invalid column: " + tok_;
+          return false;
+        }
+        a_.column_ = col_ - 1;
+        if (std::strcmp(e_, ":i") == 0) {
+          a_.type_ = INT_RESULT;
+        } else if (std::strcmp(e_, ":r") == 0) {
+          a_.type_ = REAL_RESULT;
+        } else if (std::strcmp(e_, ":x") == 0) {
+          a_.hex_ = true;
+        } else if (*e_ != '\0' && std::strcmp(e_, ":s") != 0) {
+          error_ = "Invalid type: " + tok_;
+          return false;
+        }
+      } else if (tok_.size() > 2 && (tok_[0] == 'i' || tok_[0] == 'r') &&
+                 tok_[1] == ':') {
+        a_.const_ = true;
+        a_.type_ = tok_[0] == 'i' ? INT_RESULT : REAL_RESULT;
+        a_.value_ = tok_.substr(2);
+      } else {
+        error_ = "Invalid argument: " + tok_;
+        return false;
+      }
+    }
+    out_.push_back(std::move(a_));
+
+    if (i_ < text_.size()) {
+      if (text_[i_] != ',') {
+        error_ = "Expected ',' at position " + std::to_string(i_);
+        return false;
+      }
+      ++i_;
+    }
+  }
+  return true;
+}
+
+/* Table -------------------------------------------------------------------- */
+
+Table::Format
+Table::formatOf(const std::string& path_)
+{
+  auto ends_ = [&path_](const char* ext_) {
+    const size_t n_ = std::strlen(ext_);
+    return path_.size() >= n_ &&
+           path_.compare(path_.size() - n_, n_, ext_) == 0;
+  };
+  return ends_(".csv") ? Format::Csv
+         : ends_(".tsv") ? Format::Tsv
+                         : Format::Lines;
+}
+
+/*!
+ * \brief Loads the rows of the file. "\N" (unquoted) is NULL.
+ * \param limit_ Maximum number of rows, 0: all.
+ */
+bool
+Table::load(const std::string& path_,
+            Format fmt_,
+            bool header_,
+            size_t limit_,
+            std::string& error_)
+{
+  std::ifstream in_(path_, std::ios::binary);
+  if (!in_) {
+    error_ = "Can't open " + path_;
+    return false;
+  }
+
+  std::string line_;
+  while (std::getline(in_, line_)) {
+    if (!line_.empty() && line_.back() == '\r') {
+      line_.pop_back();
+    }
+    if (header_) {
+      header_ = false;
+      continue;
+    }
+    Row row_;
+    switch (fmt_) {
+      case Format::Csv: {
+        splitCsv(line_, row_);
+        break;
+      }
+      case Format::Tsv: {
+        splitTsv(line_, row_);
+        break;
+      }
+      default: {
+        row_.push_back({ false, line_ });
+        break;
+      }
+    }
+    rows_.push_back(std::move(row_));
+    if (limit_ != 0 && rows_.size() >= limit_) {
+      break;
+    }
+  }
+  if (rows_.empty()) {
+    error_ = "No rows in " + path_;
+    return false;
+  }
+  return true;
+}
+
+/*!
+ * \brief Repeats the rows, so that a small file has enough rows to measure.
+ */
+void
+Table::repeat(size_t times_)
+{
+  const size_t n_ = rows_.size();
+  rows_.reserve(n_ * std::max<size_t>(times_, 1));
+  for (size_t t_ = 1; t_ < times_; ++t_) {
+    for (size_t i_ = 0; i_ < n_; ++i_) {
+      rows_.push_back(rows_[i_]);
+    }
+  }
+}
+
+/*!
+ * \brief RFC 4180 fields, without line breaks inside the quotes.
+ */
+void
+Table::splitCsv(const std::string& line_, Row& row_)
+{
+  size_t i_ = 0;
+  for (;;) {
+    Cell c_;
+    if (i_ < line_.size() && line_[i_] == '"') {
+      ++i_;
+      while (i_ < line_.size()) {
+        if (line_[i_] == '"') {
+          if (i_ + 1 < line_.size() && line_[i_ + 1] == '"') {
+            c_.text_ += '"';
+            i_ += 2;
+            continue;
+          }
+          ++i_;
+          break;
+        }
+        c_.text_ += line_[i_++];
+      }
+      const size_t comma_ = line_.find(',', i_);
+      i_ = comma_ == std::string::npos ? line_.size() : comma_;
+    } else {
+      const size_t comma_ = std::min(line_.find(',', i_), line_.size());
+      c_.text_ = line_.substr(i_, comma_ - i_);
+      c_.null_ = c_.text_ == "\\N";
+      i_ = comma_;
+    }
+    row_.push_back(std::move(c_));
+    if (i_ >= line_.size()) {
+      break;
+    }
+    ++i_; // ','
+  }
+}
+
+void
+Table::splitTsv(const std::string& line_, Row& row_)
+{
+  size_t i_ = 0;
+  for (;;) {
+    const size_t tab_ = std::min(line_.find('\t', i_), line_.size());
+    Cell c_;
+    c_.text_ = line_.substr(i_, tab_ - i_);
+    c_.null_ = c_.text_ == "\\N";
+    row_.push_back(std::move(c_));
+    if (tab_ >= line_.size()) {
+      break;
+    }
+    i_ = tab_ + 1;
+  }
+}
+
+/* UdfArgs ------------------------------------------------------------------ */
+
+namespace {
+
+/*!
+ * \brief Bytes of the hex text_ (either case), like UNHEX().
+ * \return false if text_ isn't hex.
+ */
+bool
+unhex(const std::string& text_, std::string& out_)
+{
+  auto digit_ = [](char c_) -> int {
+    return c_ >= '0' && c_ <= '9'   ? c_ - '0'
+           : c_ >= 'a' && c_ <= 'f' ? c_ - 'a' + 10
+           : c_ >= 'A' && c_ <= 'F' ? c_ - 'A' + 10
+                                    : -1;
+  };
+  out_.clear();
+  if (text_.size() % 2 != 0) {
+    return false;
+  }
+  for (size_t i_ = 0; i_ < text_.size(); i_ += 2) {
+    const int hi_ = digit_(text_[i_]);
+    const int lo_ = digit_(text_[i_ + 1]);
+    if (hi_ < 0 || lo_ < 0) {
+      return false;
+    }
+    out_ += static_cast<char>(hi_ << 4 | lo_);
+  }
+  return true;
+}
+
+} // namespace
+
+UdfArgs::UdfArgs(const std::vector<ArgSpec>& specs_)
+  : specs_(specs_)
+  , types_(specs_.size())
+  , ptrs_(specs_.size(), nullptr)
+  , lengths_(specs_.size(), 0)
+  , maybeNull_(specs_.size(), 0)
+  , attrs_(specs_.size(), nullptr)
+  , attrLengths_(specs_.size(), 0)
+  , strings_(specs_.size())
+  , ints_(specs_.size(), 0)
+  , reals_(specs_.size(), 0.0)
+{
+  for (size_t i_ = 0; i_ < specs_.size(); ++i_) {
+    types_[i_] = specs_[i_].type_;
+    maybeNull_[i_] = specs_[i_].const_ ? specs_[i_].null_ : 1;
+    attrs_[i_] = specs_[i_].name_.c_str();
+    attrLengths_[i_] = specs_[i_].name_.size();
+  }
+
+  args_.arg_count = static_cast<unsigned int>(specs_.size());
+  args_.arg_type = types_.data();
+  args_.args = ptrs_.data();
+  args_.lengths = lengths_.data();
+  args_.maybe_null = maybeNull_.data();
+  args_.attributes = const_cast<decltype(args_.attributes)>(attrs_.data());
+  args_.attribute_lengths = attrLengths_.data();
+  args_.extension = nullptr;
+}
+
+/*!
+ * \brief As in the server, only the constant arguments have a value in
+ * _init. The others are NULL pointers.
+ */
+UDF_ARGS*
+UdfArgs::forInit() noexcept
+{
+  for (size_t i_ = 0; i_ < specs_.size(); ++i_) {
+    if (specs_[i_].const_) {
+      set(i_, specs_[i_].null_, specs_[i_].value_);
+    } else {
+      ptrs_[i_] = nullptr;
+      lengths_[i_] = 0;
+    }
+  }
+  return &args_;
+}
+
+/*!
+ * \brief Binds the columns of the row. Missing columns are NULL.
+ */
+void
+UdfArgs::bind(const Table::Row& row_)
+{
+  for (size_t i_ = 0; i_ < specs_.size(); ++i_) {
+    const ArgSpec& s_ = specs_[i_];
+    if (s_.const_) {
+      set(i_, s_.null_, s_.value_);
+    } else if (s_.column_ < row_.size()) {
+      set(i_, row_[s_.column_].null_, row_[s_.column_].text_);
+    } else {
+      set(i_, true, {});
+    }
+  }
+}
+
+void
+UdfArgs::set(size_t i_, bool null_, const std::string& text_)
+{
+  if (null_) {
+    ptrs_[i_] = nullptr;
+    lengths_[i_] = 0;
+    return;
+  }
+  switch (types_[i_]) {
+    case INT_RESULT: {
+      ints_[i_] = std::strtoll(text_.c_str(), nullptr, 10);
+      ptrs_[i_] = reinterpret_cast<char*>(&ints_[i_]);
+      lengths_[i_] = sizeof(long long);
+      break;
+    }
+    case REAL_RESULT: {
+      reals_[i_] = std::strtod(text_.c_str(), nullptr);
+      ptrs_[i_] = reinterpret_cast<char*>(&reals_[i_]);
+      lengths_[i_] = sizeof(double);
+      break;
+    }
+    default: {
+      // Invalid hex is NULL, as UNHEX() returns.
+      if (specs_[i_].hex_ && !unhex(text_, strings_[i_])) {
+        ptrs_[i_] = nullptr;
+        lengths_[i_] = 0;
+        return;
+      }
+      if (!specs_[i_].hex_) {
+        strings_[i_].assign(text_); // reuses the capacity
+      }
+      ptrs_[i_] = strings_[i_].data();
+      lengths_[i_] = strings_[i_].size();
+      break;
+    }
+  }
+}
+
+/* Report ------------------------------------------------------------------- */
+
+namespace {
+
+constexpr const char* phaseNames_[Report::nPhases] = { "init",
+                                                       "row",
+                                                       "clear",
+                                                       "result",
+                                                       "deinit" };
+constexpr double quantiles_[] = { 0.50, 0.90, 0.99, 0.999 };
+constexpr const char* quantileNames_[] = { "p50", "p90", "p99", "p999" };
+
+} // namespace
+
+void
+Report::merge(const Report& other_)
+{
+  for (size_t i_ = 0; i_ < nPhases; ++i_) {
+    PhaseData& d_ = phases_[i_];
+    const PhaseData& o_ = other_.phases_[i_];
+    d_.ns_.insert(d_.ns_.end(), o_.ns_.begin(), o_.ns_.end());
+    d_.allocs_ += o_.allocs_;
+    d_.bytes_ += o_.bytes_;
+  }
+  rows_ += other_.rows_;
+  nulls_ += other_.nulls_;
+  errors_ += other_.errors_;
+  bytesOut_ += other_.bytesOut_;
+  seconds_ = std::max(seconds_, other_.seconds_);
+  if (initError_.empty()) {
+    initError_ = other_.initError_;
+  }
+}
+
+/*!
+ * \brief Nearest-rank percentile. The vector is partially sorted.
+ */
+uint32_t
+Report::percentile(std::vector<uint32_t>& v_, double p_)
+{
+  if (v_.empty()) {
+    return 0;
+  }
+  size_t k_ = static_cast<size_t>(p_ * static_cast<double>(v_.size()));
+  k_ = std::min(k_, v_.size() - 1);
+  std::nth_element(v_.begin(), v_.begin() + static_cast<long>(k_), v_.end());
+  return v_[k_];
+}
+
+std::string
+Report::toText(const std::string& title_)
+{
+  std::stringstream ss;
+  ss << title_ << ": " << rows_ << " rows, " << nulls_ << " NULL, "
+     << errors_ << " errors, " << std::fixed << std::setprecision(3)
+     << seconds_ << " s";
+  if (seconds_ > 0) {
+    ss << ", " << std::setprecision(0)
+       << static_cast<double>(rows_) / seconds_ << " rows/s";
+  }
+  ss << "\n";
+  if (!initError_.empty()) {
+    ss << "  _init failed: " << initError_ << "\n";
+    return ss.str();
+  }
+
+  ss << "  " << std::left << std::setw(8) << "phase" << std::right
+     << std::setw(10) << "calls";
+  for (const char* q_ : quantileNames_) {
+    ss << std::setw(9) << q_;
+  }
+  ss << std::setw(10) << "max(ns)" << std::setw(13) << "allocs/call"
+     << std::setw(13) << "bytes/call" << "\n";
+
+  ss << std::setprecision(2);
+  for (size_t i_ = 0; i_ < nPhases; ++i_) {
+    PhaseData& d_ = phases_[i_];
+    if (d_.ns_.empty()) {
+      continue;
+    }
+    const double calls_ = static_cast<double>(d_.ns_.size());
+    ss << "  " << std::left << std::setw(8) << phaseNames_[i_] << std::right
+       << std::setw(10) << d_.ns_.size();
+    for (double q_ : quantiles_) {
+      ss << std::setw(9) << percentile(d_.ns_, q_);
+    }
+    ss << std::setw(10) << *std::max_element(d_.ns_.begin(), d_.ns_.end())
+       << std::setw(13) << static_cast<double>(d_.allocs_) / calls_
+       << std::setw(13) << static_cast<double>(d_.bytes_) / calls_ << "\n";
+  }
+  return ss.str();
+}
+
+std::string
+Report::toJson(const std::string& title_)
+{
+  std::stringstream ss;
+  ss << "{\"udf\":\"" << title_ << "\",\"rows\":" << rows_
+     << ",\"nulls\":" << nulls_ << ",\"errors\":" << errors_
+     << ",\"seconds\":" << seconds_
+     << ",\"rows_per_s\":"
+     << (seconds_ > 0 ? static_cast<double>(rows_) / seconds_ : 0.0);
+  if (!initError_.empty()) {
+    ss << ",\"init_error\":\"";
+    for (char c_ : initError_) {
+      if (c_ == '"' || c_ == '\\') {
+        ss << '\\';
+      }
+      ss << c_;
+    }
+    ss << "\"}";
+    return ss.str();
+  }
+  ss << ",\"phases\":{";
+  const char* sep_ = "";
+  for (size_t i_ = 0; i_ < nPhases; ++i_) {
+    PhaseData& d_ = phases_[i_];
+    if (d_.ns_.empty()) {
+      continue;
+    }
+    const double calls_ = static_cast<double>(d_.ns_.size());
+    ss << sep_ << "\"" << phaseNames_[i_] << "\":{\"calls\":"
+       << d_.ns_.size();
+    for (size_t q_ = 0; q_ < std::size(quantiles_); ++q_) {
+      ss << ",\"" << quantileNames_[q_]
+         << "_ns\":" << percentile(d_.ns_, quantiles_[q_]);
+    }
+    ss << ",\"max_ns\":" << *std::max_element(d_.ns_.begin(), d_.ns_.end())
+       << ",\"allocs_per_call\":" << static_cast<double>(d_.allocs_) / calls_
+       << ",\"bytes_per_call\":" << static_cast<double>(d_.bytes_) / calls_
+       << "}";
+    sep_ = ",";
+  }
+  ss << "}}";
+  return ss.str();
+}
+
+/* UdfHost ------------------------------------------------------------------ */
+
+namespace {
+
+using Phase = Report::Phase;
+
+/*!
+ * \brief Times one call and counts the allocations made by it.
+ */
+template<typename TFunc>
+inline void
+timed(Report& rep_, Phase p_, TFunc&& f_)
+{
+  using clock_ = std::chrono::steady_clock;
+  AllocCounter& c_ = AllocCounter::local();
+  const uint64_t allocs_ = c_.allocs_;
+  const uint64_t bytes_ = c_.bytes_;
+
+  const auto start_ = clock_::now();
+  f_();
+  const auto ns_ = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     clock_::now() - start_)
+                     .count();
+
+  Report::PhaseData& d_ = rep_.phases_[static_cast<size_t>(p_)];
+  d_.allocs_ += c_.allocs_ - allocs_;
+  d_.bytes_ += c_.bytes_ - bytes_;
+  d_.ns_.push_back(static_cast<uint32_t>(
+    std::min<int64_t>(ns_, std::numeric_limits<uint32_t>::max())));
+}
+
+// Size of the result buffer of the string functions in the server
+// (MAX_FIELD_WIDTH).
+constexpr unsigned long resultSize_ = 766;
+
+} // namespace
+
+UdfHost::UdfHost(const UdfLibrary& lib_, const Job& job_)
+  : lib_(lib_)
+  , job_(job_)
+{}
+
+/*!
+ * \brief Runs the rows [begin_, end_) in one "connection": one UDF_INIT,
+ * _init ... _deinit, as the server does for one statement.
+ *
+ * Simple functions: _init, main per row, _deinit.
+ * Aggregates: _init, per group (of 'groupRows_' rows): _clear and _add per
+ * row (or, without _clear, _reset on the first row and _add on the others)
+ * and main at the end of the group, then _deinit.
+ */
+Report
+UdfHost::run(const Table& rows_, size_t begin_, size_t end_)
+{
+  Report rep_;
+  UDF_INIT initid_ = {};
+  initid_.maybe_null = 1;
+  initid_.decimals = 31; // NOT_FIXED_DEC
+  initid_.max_length = resultSize_;
+  char message_[512] = {}; // MYSQL_ERRMSG_SIZE
+
+  UdfArgs args_(job_.args_);
+  const auto start_ = std::chrono::steady_clock::now();
+
+  if (lib_.init_ != nullptr) {
+    my_bool failed_ = 0;
+    UDF_ARGS* a_ = args_.forInit();
+    timed(rep_, Phase::Init, [&]() {
+      failed_ = lib_.init_(&initid_, a_, message_);
+    });
+    if (failed_) {
+      rep_.initError_ = message_[0] ? message_ : "_init failed";
+      return rep_;
+    }
+  }
+
+  if (!job_.aggregate_) {
+    for (size_t i_ = begin_; i_ < end_; ++i_) {
+      args_.bind(rows_[i_]);
+      result(&initid_, args_.get(), rep_);
+    }
+  } else {
+    const size_t group_ = job_.groupRows_ ? job_.groupRows_ : end_ - begin_;
+    for (size_t g_ = begin_; g_ < end_; g_ += group_) {
+      char isNull_ = 0;
+      char error_ = 0;
+      if (lib_.clear_ != nullptr) {
+        timed(rep_, Phase::Clear, [&]() {
+          lib_.clear_(&initid_, &isNull_, &error_);
+        });
+      }
+      const size_t last_ = std::min(end_, g_ + group_);
+      for (size_t i_ = g_; i_ < last_; ++i_) {
+        args_.bind(rows_[i_]);
+        const bool reset_ =
+          i_ == g_ && lib_.clear_ == nullptr && lib_.reset_ != nullptr;
+        timed(rep_, Phase::Row, [&]() {
+          if (reset_) {
+            lib_.reset_(&initid_, args_.get(), &isNull_, &error_);
+          } else if (lib_.add_ != nullptr) {
+            lib_.add_(&initid_, args_.get(), &isNull_, &error_);
+          }
+        });
+        ++rep_.rows_;
+      }
+      rep_.errors_ += error_ ? 1 : 0;
+      result(&initid_, args_.get(), rep_);
+    }
+  }
+
+  if (lib_.deinit_ != nullptr) {
+    timed(rep_, Phase::Deinit, [&]() { lib_.deinit_(&initid_); });
+  }
+
+  rep_.seconds_ = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start_)
+                    .count();
+  return rep_;
+}
+
+/*!
+ * \brief Calls the main function, according to its return type.
+ */
+void
+UdfHost::result(UDF_INIT* initid_, UDF_ARGS* args_, Report& rep_)
+{
+  const Phase p_ = job_.aggregate_ ? Phase::Result : Phase::Row;
+  char isNull_ = 0;
+  char error_ = 0;
+
+  switch (job_.returns_) {
+    case ReturnType::String: {
+      char buf_[resultSize_];
+      unsigned long length_ = resultSize_;
+      char* res_ = nullptr;
+      const auto fn_ = reinterpret_cast<UdfLibrary::StrFn>(lib_.main_);
+      timed(rep_, p_, [&]() {
+        res_ = fn_(initid_, args_, buf_, &length_, &isNull_, &error_);
+      });
+      const bool null_ = isNull_ || res_ == nullptr;
+      rep_.bytesOut_ += null_ ? 0 : length_;
+      print(res_, length_, null_, error_);
+      break;
+    }
+    case ReturnType::Int: {
+      long long res_ = 0;
+      const auto fn_ = reinterpret_cast<UdfLibrary::IntFn>(lib_.main_);
+      timed(rep_, p_, [&]() { res_ = fn_(initid_, args_, &isNull_, &error_); });
+      const std::string s_ = std::to_string(res_);
+      print(s_.c_str(), s_.size(), isNull_, error_);
+      break;
+    }
+    case ReturnType::Real: {
+      double res_ = 0.0;
+      const auto fn_ = reinterpret_cast<UdfLibrary::RealFn>(lib_.main_);
+      timed(rep_, p_, [&]() { res_ = fn_(initid_, args_, &isNull_, &error_); });
+      char s_[64];
+      const int n_ = std::snprintf(s_, sizeof(s_), "%.17g", res_);
+      print(s_, static_cast<size_t>(n_), isNull_, error_);
+      break;
+    }
+  }
+
+  if (!job_.aggregate_) {
+    ++rep_.rows_;
+  }
+  rep_.nulls_ += isNull_ ? 1 : 0;
+  rep_.errors_ += error_ ? 1 : 0;
+}
+
+void
+UdfHost::print(const char* s_, size_t n_, bool null_, bool error_)
+{
+  if (printed_ >= job_.print_) {
+    return;
+  }
+  ++printed_;
+  if (error_) {
+    std::fputs("ERROR\n", stdout);
+  } else if (null_) {
+    std::fputs("NULL\n", stdout);
+  } else if (job_.hex_) {
+    static constexpr char digits_[] = "0123456789ABCDEF";
+    for (size_t i_ = 0; i_ < n_; ++i_) {
+      const unsigned char c_ = static_cast<unsigned char>(s_[i_]);
+      std::fputc(digits_[c_ >> 4], stdout);
+      std::fputc(digits_[c_ & 0x0f], stdout);
+    }
+    std::fputc('\n', stdout);
+  } else {
+    std::fwrite(s_, 1, n_, stdout);
+    std::fputc('\n', stdout);
+  }
+}
+
+/* Scaling ------------------------------------------------------------------ */
+
+Scaling::Scaling(const UdfLibrary& lib_, const Job& job_)
+  : lib_(lib_)
+  , job_(job_)
+{
+  this->job_.print_ = 0;
+}
+
+/*!
+ * \brief Runs 'threads_' connections at the same time, each one with its own
+ * UDF_INIT and a partition of the rows. The threads start together and the
+ * wall time is taken from the start until the last one finishes.
+ */
+Report
+Scaling::runThreads(const Table& rows_, size_t threads_)
+{
+  threads_ = std::max<size_t>(threads_, 1);
+  std::vector<Report> reports_(threads_);
+  std::vector<std::thread> pool_;
+  std::atomic<size_t> ready_ = { 0 };
+  std::atomic<bool> go_ = { false };
+
+  for (size_t t_ = 0; t_ < threads_; ++t_) {
+    const size_t begin_ = rows_.size() * t_ / threads_;
+    const size_t end_ = rows_.size() * (t_ + 1) / threads_;
+    pool_.emplace_back([&, t_, begin_, end_]() {
+      UdfHost host_(lib_, job_);
+      ready_.fetch_add(1);
+      while (!go_.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+      }
+      reports_[t_] = host_.run(rows_, begin_, end_);
+    });
+  }
+
+  while (ready_.load() < threads_) {
+    std::this_thread::yield();
+  }
+  const auto start_ = std::chrono::steady_clock::now();
+  go_.store(true, std::memory_order_release);
+  for (std::thread& th_ : pool_) {
+    th_.join();
+  }
+  const double wall_ = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start_)
+                         .count();
+
+  Report total_;
+  for (const Report& r_ : reports_) {
+    total_.merge(r_);
+  }
+  total_.seconds_ = wall_;
+  return total_;
+}
+
+/*!
+ * \brief Runs with 1, 2, 4, ... threads up to 'maxThreads_' (always
+ * included). The efficiency is the throughput divided by 'threads_' times
+ * the throughput of one thread: 1.0 means linear scaling.
+ */
+std::vector<ScalingPoint>
+Scaling::run(const Table& rows_, size_t maxThreads_)
+{
+  std::vector<size_t> levels_;
+  for (size_t t_ = 1; t_ < maxThreads_; t_ *= 2) {
+    levels_.push_back(t_);
+  }
+  levels_.push_back(std::max<size_t>(maxThreads_, 1));
+
+  std::vector<ScalingPoint> points_;
+  for (size_t t_ : levels_) {
+    ScalingPoint p_;
+    p_.threads_ = t_;
+    p_.report_ = runThreads(rows_, t_);
+    if (p_.report_.seconds_ > 0) {
+      p_.rowsPerSec_ =
+        static_cast<double>(p_.report_.rows_) / p_.report_.seconds_;
+    }
+    const double base_ = points_.empty() ? p_.rowsPerSec_
+                                         : points_.front().rowsPerSec_;
+    p_.speedup_ = base_ > 0 ? p_.rowsPerSec_ / base_ : 0.0;
+    p_.efficiency_ = p_.speedup_ / static_cast<double>(t_);
+    points_.push_back(std::move(p_));
+    if (!points_.back().report_.initError_.empty()) {
+      break;
+    }
+  }
+  return points_;
+}
+
+std::string
+Scaling::toText(const std::string& title_, std::vector<ScalingPoint>& points_)
+{
+  std::stringstream ss;
+  ss << title_ << ":\n";
+  if (!points_.empty() && !points_.front().report_.initError_.empty()) {
+    ss << "  _init failed: " << points_.front().report_.initError_ << "\n";
+    return ss.str();
+  }
+  ss << "  " << std::setw(7) << "threads" << std::setw(14) << "rows/s"
+     << std::setw(9) << "speedup" << std::setw(11) << "efficiency"
+     << std::setw(9) << "p50(ns)" << std::setw(9) << "p99(ns)"
+     << std::setw(13) << "allocs/row" << "\n";
+  ss << std::fixed;
+  for (ScalingPoint& p_ : points_) {
+    Report::PhaseData& d_ =
+      p_.report_.phases_[static_cast<size_t>(Report::Phase::Row)];
+    const double rows_ = static_cast<double>(std::max<uint64_t>(
+      p_.report_.rows_, 1));
+    ss << "  " << std::setw(7) << p_.threads_ << std::setw(14)
+       << std::setprecision(0) << p_.rowsPerSec_ << std::setw(9)
+       << std::setprecision(2) << p_.speedup_ << std::setw(11)
+       << p_.efficiency_ << std::setw(9) << Report::percentile(d_.ns_, 0.5)
+       << std::setw(9) << Report::percentile(d_.ns_, 0.99) << std::setw(13)
+       << static_cast<double>(d_.allocs_) / rows_ << "\n";
+  }
+  return ss.str();
+}
+
+std::string
+Scaling::toJson(const std::string& title_, std::vector<ScalingPoint>& points_)
+{
+  std::stringstream ss;
+  ss << "{\"udf\":\"" << title_ << "\",\"scaling\":[";
+  for (size_t i_ = 0; i_ < points_.size(); ++i_) {
+    ScalingPoint& p_ = points_[i_];
+    ss << (i_ ? "," : "") << "{\"threads\":" << p_.threads_
+       << ",\"rows_per_s\":" << p_.rowsPerSec_
+       << ",\"speedup\":" << p_.speedup_
+       << ",\"efficiency\":" << p_.efficiency_
+       << ",\"report\":" << p_.report_.toJson(title_) << "}";
+  }
+  ss << "]}";
+  return ss.str();
+}
+
+} // namespace udfhost
@@ -0,0 +1,316 @@
+/***************************************************************************
+ * Copyright (c) 2020-22                                                   *
+ *      Volnei Cervi Puttini.  All rights reserved.                        *
+ *      vcputtini@gmail.com
+ *                                                                         *
+ * Redistribution and use in source and binary forms, with or without      *
+ * modification, are permitted provided that the following conditions      *
+ * are met:                                                                *
+ * 1. Redistributions of source code must retain the above copyright       *
+ *    notice, this list of conditions and the following disclaimer.        *
+ * 2. Redistributions in binary form must reproduce the above copyright    *
+ *    notice, this list of conditions and the following disclaimer in the  *
+ *    documentation and/or other materials provided with the distribution. *
+ * 4. Neither the name of the Author     nor the names of its contributors *
+ *    may be used to endorse or promote products derived from this software*
+ *    without specific prior written permission.                           *
+ *                                                                         *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND *
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR      *
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS  *
+ * BE LIABLEFOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   *
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF    *
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS*
+ * INTERRUPTION)                                                           *
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,     *
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING   *
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE      *
+ * POSSIBILITY OFSUCH DAMAGE.                                              *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*!
+ * \brief How this file is organized:
+ *
+ * Host of the UDF's, used to run them outside of mysqld (e.g. under perf or
+ * valgrind).
+ *
+ * class UdfLibrary: dlopen() of the library and the entry points of one UDF.
+ * struct ArgSpec: an argument of the call, a column of the input or a
+ *                 constant. E.g.: 'squid',$1,'url' or $2:r,i:3 or $1:x (a
+ *                 BLOB written in hex, like UNHEX())
+ * class Table: rows of a CSV, TSV or plain log file.
+ * class UdfArgs: storage of the real UDF_ARGS passed to the UDF.
+ * struct Report: latency percentiles and allocation counts per phase.
+ * class UdfHost: calls the entry points in the same order as the server.
+ * class Scaling: runs the same UDF in 1..N threads, each one with its own
+ *                UDF_INIT and a partition of the rows, as N connections.
+ *
+ * The allocations are counted by replacing the global operator new. The
+ * executable exports it (ENABLE_EXPORTS), so the libraries use it too.
+ */
+
+#ifndef UDFHOST_H
+#define UDFHOST_H
+
+#include <mysql.h>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace udfhost {
+
+enum class ReturnType
+{
+  String = 0x00,
+  Int,
+  Real
+};
+
+/* AllocCounter ------------------------------------------------------------- */
+
+/*!
+ * \brief Counters of the replaced operator new/delete of the calling thread.
+ */
+struct AllocCounter
+{
+  uint64_t allocs_ = 0;
+  uint64_t bytes_ = 0;
+  uint64_t frees_ = 0;
+
+  static AllocCounter& local() noexcept;
+};
+
+/* UdfLibrary --------------------------------------------------------------- */
+
+class UdfLibrary
+{
+public:
+  using InitFn = my_bool (*)(UDF_INIT*, UDF_ARGS*, char*);
+  using DeinitFn = void (*)(UDF_INIT*);
+  using ClearFn = void (*)(UDF_INIT*, char*, char*);
+  using AddFn = void (*)(UDF_INIT*, UDF_ARGS*, char*, char*);
+  using StrFn =
+    char* (*)(UDF_INIT*, UDF_ARGS*, char*, unsigned long*, char*, char*);
+  using IntFn = long long (*)(UDF_INIT*, UDF_ARGS*, char*, char*);
+  using RealFn = double (*)(UDF_INIT*, UDF_ARGS*, char*, char*);
+
+  UdfLibrary(const std::string& path_, const std::string& name_);
+  ~UdfLibrary();
+
+  UdfLibrary(const UdfLibrary&) = delete;
+  UdfLibrary& operator=(const UdfLibrary&) = delete;
+
+  bool ok() const noexcept { return error_.empty(); }
+  const std::string& error() const noexcept { return error_; }
+  const std::string& name() const noexcept { return name_; }
+
+  InitFn init_ = nullptr;
+  DeinitFn deinit_ = nullptr;
+  ClearFn clear_ = nullptr;
+  AddFn add_ = nullptr;
+  AddFn reset_ = nullptr; // same signature as _add
+  void* main_ = nullptr;
+
+private:
+  void* handle_ = nullptr;
+  std::string name_;
+  std::string error_ = {};
+};
+
+/* ArgSpec ------------------------------------------------------------------ */
+
+struct ArgSpec
+{
+  Item_result type_ = STRING_RESULT;
+  bool const_ = false;
+  bool null_ = false;    // constant NULL
+  bool hex_ = false;     // column of bytes written in hex, see $N:x
+  size_t column_ = 0;    // 0-based, when it isn't a constant
+  std::string value_ = {}; // constant
+  std::string name_ = {};  // attribute, e.g. $1 or 'squid'
+
+  static bool parse(const std::string& text_,
+                    std::vector<ArgSpec>& out_,
+                    std::string& error_);
+};
+
+/* Table -------------------------------------------------------------------- */
+
+class Table
+{
+public:
+  enum class Format
+  {
+    Csv = 0x00,
+    Tsv,
+    Lines // each line is a single column
+  };
+
+  struct Cell
+  {
+    bool null_ = false;
+    std::string text_ = {};
+  };
+  using Row = std::vector<Cell>;
+
+  bool load(const std::string& path_,
+            Format fmt_,
+            bool header_,
+            size_t limit_,
+            std::string& error_);
+
+  static Format formatOf(const std::string& path_);
+  void repeat(size_t times_);
+
+  size_t size() const noexcept { return rows_.size(); }
+  const Row& operator[](size_t i_) const { return rows_[i_]; }
+
+private:
+  std::vector<Row> rows_ = {};
+
+  static void splitCsv(const std::string& line_, Row& row_);
+  static void splitTsv(const std::string& line_, Row& row_);
+};
+
+/* UdfArgs ------------------------------------------------------------------ */
+
+/*!
+ * \brief Keeps the arrays pointed to by UDF_ARGS. The numeric arguments are
+ * converted when the row is bound, before the call is timed, as the server
+ * does.
+ */
+class UdfArgs
+{
+public:
+  explicit UdfArgs(const std::vector<ArgSpec>& specs_);
+
+  UDF_ARGS* forInit() noexcept;
+  void bind(const Table::Row& row_);
+  UDF_ARGS* get() noexcept { return &args_; }
+
+private:
+  const std::vector<ArgSpec>& specs_;
+  UDF_ARGS args_ = {};
+
+  std::vector<Item_result> types_;
+  std::vector<char*> ptrs_;
+  std::vector<unsigned long> lengths_;
+  std::vector<char> maybeNull_;
+  std::vector<const char*> attrs_;
+  std::vector<unsigned long> attrLengths_;
+
+  std::vector<std::string> strings_;
+  std::vector<long long> ints_;
+  std::vector<double> reals_;
+
+  void set(size_t i_, bool null_, const std::string& text_);
+};
+
+/* Report ------------------------------------------------------------------- */
+
+struct Report
+{
+  enum class Phase
+  {
+    Init = 0x00,
+    Row, // main of the simple UDF's or _add/_reset of the aggregates
+    Clear,
+    Result, // main of the aggregates
+    Deinit,
+    Unknown
+  };
+  static constexpr size_t nPhases = static_cast<size_t>(Phase::Unknown);
+
+  struct PhaseData
+  {
+    std::vector<uint32_t> ns_ = {};
+    uint64_t allocs_ = 0;
+    uint64_t bytes_ = 0;
+  };
+
+  std::array<PhaseData, nPhases> phases_ = {};
+  uint64_t rows_ = 0;
+  uint64_t nulls_ = 0;
+  uint64_t errors_ = 0;
+  uint64_t bytesOut_ = 0;
+  double seconds_ = 0.0; // wall time of the run
+  std::string initError_ = {};
+
+  void merge(const Report& other_);
+  static uint32_t percentile(std::vector<uint32_t>& v_, double p_);
+  std::string toText(const std::string& title_);
+  std::string toJson(const std::string& title_);
+};
+
+/* UdfHost ------------------------------------------------------------------ */
+
+struct Job
+{
+  std::string lib_ = {};
+  std::string udf_ = {};
+  ReturnType returns_ = ReturnType::String;
+  bool aggregate_ = false;
+  size_t groupRows_ = 0; // 0: a single group
+  std::vector<ArgSpec> args_ = {};
+  size_t print_ = 0; // results printed to stdout
+  bool hex_ = false; // the strings printed in hex, like HEX()
+};
+
+class UdfHost
+{
+public:
+  UdfHost(const UdfLibrary& lib_, const Job& job_);
+
+  Report run(const Table& rows_, size_t begin_, size_t end_);
+
+private:
+  const UdfLibrary& lib_;
+  const Job& job_;
+  size_t printed_ = 0;
+
+  void result(UDF_INIT* initid_, UDF_ARGS* args_, Report& rep_);
+  void print(const char* s_, size_t n_, bool null_, bool error_);
+};
+
+/* Scaling ------------------------------------------------------------------ */
+
+struct ScalingPoint
+{
+  size_t threads_ = 0;
+  Report report_ = {};
+  double rowsPerSec_ = 0.0;
+  double speedup_ = 0.0;    // relative to 1 thread
+  double efficiency_ = 0.0; // speedup_ / threads_
+};
+
+class Scaling
+{
+public:
+  Scaling(const UdfLibrary& lib_, const Job& job_);
+
+  Report runThreads(const Table& rows_, size_t threads_);
+  std::vector<ScalingPoint> run(const Table& rows_, size_t maxThreads_);
+
+  static std::string toText(const std::string& title_,
+                            std::vector<ScalingPoint>& points_);
+  static std::string toJson(const std::string& title_,
+                            std::vector<ScalingPoint>& points_);
+
+private:
+  const UdfLibrary& lib_;
+  Job job_; // copy: nothing is printed by the threads
+};
+
+} // namespace udfhost
+
+#endif // UDFHOST_H
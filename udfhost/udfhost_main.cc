@@ -0,0 +1,336 @@
+/***************************************************************************
+ * Copyright (c) 2020-22                                                   *
+ *      Volnei Cervi Puttini.  All rights reserved.                        *
+ *      vcputtini@gmail.com
+ *                                                                         *
+ * Redistribution and use in source and binary forms, with or without      *
+ * modification, are permitted provided that the following conditions      *
+ * are met:                                                                *
+ * 1. Redistributions of source code must retain the above copyright       *
+ *    notice, this list of conditions and the following disclaimer.        *
+ * 2. Redistributions in binary form must reproduce the above copyright    *
+ *    notice, this list of conditions and the following disclaimer in the  *
+ *    documentation and/or other materials provided with the distribution. *
+ * 4. Neither the name of the Author     nor the names of its contributors *
+ *    may be used to endorse or promote products derived from this software*
+ *    without specific prior written permission.                           *
+ *                                                                         *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND *
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR      *
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS  *
+ * BE LIABLEFOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   *
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF    *
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS*
+ * INTERRUPTION)                                                           *
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,     *
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING   *
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE      *
+ * POSSIBILITY OFSUCH DAMAGE.                                              *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*!
+ * \brief udfhost: runs the UDF's of the libraries outside of mysqld.
+ *
+ * E.g.:
+ * udfhost --lib libvcpsquidlogparser.so --udf slp_str --returns string
+ *         --args "'squid',\$1,'url'" --input access.log
+ * udfhost --lib libvcputilities.so --udf sum_if --returns real --aggregate
+ *         --args "\$1:r,'>',r:10" --input values.csv
+ *
+ * With --threads N the UDF is run by 1, 2, 4 ... N threads (connections) and
+ * the scaling efficiency is reported. With --suite FILE each line of the file
+ * is one UDF to run, with the same options, e.g. suites/all.suite.
+ */
+
+#include "udfhost.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+
+using namespace udfhost;
+
+namespace {
+
+void
+usage()
+{
+  std::fprintf(
+    stderr,
+    "Usage: udfhost --lib FILE.so --udf NAME --args SPEC --input FILE "
+    "[options]\n"
+    "       udfhost --suite FILE [--libdir DIR] [options]\n"
+    "  --returns string|int|real   type of the function (default: string)\n"
+    "  --aggregate                 call _clear/_add (or _reset) and main per "
+    "group\n"
+    "  --group N                   rows per group of the aggregate "
+    "(default: all)\n"
+    "  --args SPEC                 arguments, separated by commas:\n"
+    "                              $N, $N:i, $N:r  column N (1-based)\n"
+    "                              $N:x  column N, a BLOB written in hex\n"
+    "                              'text', i:123, r:1.5, null  constants\n"
+    "  --input FILE                rows: .csv, .tsv or one column per line\n"
+    "  --csv | --tsv | --lines     format of the input (default: by the "
+    "extension)\n"
+    "  --header                    skip the first line of the input\n"
+    "  --rows N                    read at most N rows\n"
+    "  --repeat N                  repeat the rows N times\n"
+    "  --print N                   print the first N results to stdout\n"
+    "  --hex                       print the strings in hex (BLOB's)\n"
+    "  --threads N                 scaling from 1 to N threads\n"
+    "  --suite FILE                one UDF per line; paths are relative to "
+    "FILE\n"
+    "  --libdir DIR                directory of the libraries of the suite\n"
+    "  --json                      print the report as JSON\n");
+}
+
+/*!
+ * \brief One UDF to run and its input.
+ */
+struct Task
+{
+  Job job_ = {};
+  std::string args_ = {};
+  std::string input_ = {};
+  Table::Format fmt_ = Table::Format::Lines;
+  bool fmtSet_ = false;
+  bool header_ = false;
+  size_t limit_ = 0;
+  size_t repeat_ = 1;
+};
+
+struct Options
+{
+  size_t threads_ = 0; // 0: a single run, without scaling
+  std::string suite_ = {};
+  std::string libdir_ = {};
+  bool json_ = false;
+};
+
+/*!
+ * \brief Parses the options of the command line or of one line of a suite
+ * (only the options of the task are allowed there).
+ */
+bool
+parseOptions(const std::vector<std::string>& argv_, Task& t_, Options* opt_)
+{
+  for (size_t i_ = 0; i_ < argv_.size(); ++i_) {
+    const std::string& arg_ = argv_[i_];
+    const bool hasValue_ = i_ + 1 < argv_.size();
+    auto value_ = [&]() -> const std::string& { return argv_[++i_]; };
+
+    if (arg_ == "--lib" && hasValue_) {
+      t_.job_.lib_ = value_();
+    } else if (arg_ == "--udf" && hasValue_) {
+      t_.job_.udf_ = value_();
+    } else if (arg_ == "--returns" && hasValue_) {
+      const std::string& r_ = value_();
+      if (r_ == "string") {
+        t_.job_.returns_ = ReturnType::String;
+      } else if (r_ == "int") {
+        t_.job_.returns_ = ReturnType::Int;
+      } else if (r_ == "real") {
+        t_.job_.returns_ = ReturnType::Real;
+      } else {
+        return false;
+      }
+    } else if (arg_ == "--aggregate") {
+      t_.job_.aggregate_ = true;
+    } else if (arg_ == "--group" && hasValue_) {
+      t_.job_.groupRows_ = std::strtoul(value_().c_str(), nullptr, 10);
+    } else if (arg_ == "--args" && hasValue_) {
+      t_.args_ = value_();
+    } else if (arg_ == "--input" && hasValue_) {
+      t_.input_ = value_();
+    } else if (arg_ == "--csv" || arg_ == "--tsv" || arg_ == "--lines") {
+      t_.fmt_ = arg_ == "--csv"   ? Table::Format::Csv
+                : arg_ == "--tsv" ? Table::Format::Tsv
+                                  : Table::Format::Lines;
+      t_.fmtSet_ = true;
+    } else if (arg_ == "--header") {
+      t_.header_ = true;
+    } else if (arg_ == "--rows" && hasValue_) {
+      t_.limit_ = std::strtoul(value_().c_str(), nullptr, 10);
+    } else if (arg_ == "--repeat" && hasValue_) {
+      t_.repeat_ = std::strtoul(value_().c_str(), nullptr, 10);
+    } else if (arg_ == "--print" && hasValue_) {
+      t_.job_.print_ = std::strtoul(value_().c_str(), nullptr, 10);
+    } else if (arg_ == "--hex") {
+      t_.job_.hex_ = true;
+    } else if (opt_ != nullptr && arg_ == "--threads" && hasValue_) {
+      opt_->threads_ = std::strtoul(value_().c_str(), nullptr, 10);
+    } else if (opt_ != nullptr && arg_ == "--suite" && hasValue_) {
+      opt_->suite_ = value_();
+    } else if (opt_ != nullptr && arg_ == "--libdir" && hasValue_) {
+      opt_->libdir_ = value_();
+    } else if (opt_ != nullptr && arg_ == "--json") {
+      opt_->json_ = true;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*!
+ * \brief Splits a line of the suite into words. Double quotes group words
+ * (single quotes are kept, they delimit the constants of --args).
+ */
+std::vector<std::string>
+splitWords(const std::string& line_)
+{
+  std::vector<std::string> words_;
+  std::string w_;
+  bool quoted_ = false;
+  bool inWord_ = false;
+
+  for (char c_ : line_) {
+    if (c_ == '"') {
+      quoted_ = !quoted_;
+      inWord_ = true;
+    } else if (!quoted_ && (c_ == ' ' || c_ == '\t')) {
+      if (inWord_) {
+        words_.push_back(std::move(w_));
+        w_.clear();
+        inWord_ = false;
+      }
+    } else {
+      w_ += c_;
+      inWord_ = true;
+    }
+  }
+  if (inWord_) {
+    words_.push_back(std::move(w_));
+  }
+  return words_;
+}
+
+std::string
+relativeTo(const std::string& dir_, const std::string& path_)
+{
+  if (dir_.empty() || path_.empty() || path_[0] == '/') {
+    return path_;
+  }
+  return dir_ + "/" + path_;
+}
+
+/*!
+ * \brief Runs one task: a single run or, with --threads, the scaling.
+ * \return bool false if it couldn't be run.
+ */
+bool
+runTask(Task& t_, const Options& opt_)
+{
+  std::string error_;
+  if (t_.job_.lib_.empty() || t_.job_.udf_.empty() || t_.input_.empty()) {
+    std::fprintf(stderr, "udfhost: --lib, --udf and --input are required\n");
+    return false;
+  }
+  if (!ArgSpec::parse(t_.args_, t_.job_.args_, error_)) {
+    std::fprintf(stderr, "udfhost: %s\n", error_.c_str());
+    return false;
+  }
+
+  Table rows_;
+  if (!rows_.load(t_.input_,
+                  t_.fmtSet_ ? t_.fmt_ : Table::formatOf(t_.input_),
+                  t_.header_,
+                  t_.limit_,
+                  error_)) {
+    std::fprintf(stderr, "udfhost: %s\n", error_.c_str());
+    return false;
+  }
+  rows_.repeat(t_.repeat_);
+
+  UdfLibrary lib_(t_.job_.lib_, t_.job_.udf_);
+  if (!lib_.ok()) {
+    std::fprintf(stderr, "udfhost: %s\n", lib_.error().c_str());
+    return false;
+  }
+  if (t_.job_.aggregate_ && lib_.add_ == nullptr) {
+    std::fprintf(stderr, "udfhost: %s_add not found\n", t_.job_.udf_.c_str());
+    return false;
+  }
+
+  std::string out_;
+  bool ok_ = true;
+  if (opt_.threads_ > 0) {
+    Scaling scaling_(lib_, t_.job_);
+    std::vector<ScalingPoint> points_ = scaling_.run(rows_, opt_.threads_);
+    ok_ = points_.front().report_.initError_.empty();
+    out_ = opt_.json_ ? Scaling::toJson(t_.job_.udf_, points_) + "\n"
+                      : Scaling::toText(t_.job_.udf_, points_);
+  } else {
+    UdfHost host_(lib_, t_.job_);
+    Report rep_ = host_.run(rows_, 0, rows_.size());
+    std::fflush(stdout);
+    ok_ = rep_.initError_.empty();
+    out_ = opt_.json_ ? rep_.toJson(t_.job_.udf_) + "\n"
+                      : rep_.toText(t_.job_.udf_);
+  }
+  std::fputs(out_.c_str(), opt_.json_ ? stdout : stderr);
+  return ok_;
+}
+
+/*!
+ * \brief Runs each line of the suite. Empty lines and lines starting with
+ * '#' are ignored.
+ */
+bool
+runSuite(const Options& opt_)
+{
+  std::ifstream in_(opt_.suite_);
+  if (!in_) {
+    std::fprintf(stderr, "udfhost: can't open %s\n", opt_.suite_.c_str());
+    return false;
+  }
+  const size_t slash_ = opt_.suite_.rfind('/');
+  const std::string dir_ =
+    slash_ == std::string::npos ? std::string() : opt_.suite_.substr(0, slash_);
+
+  std::string line_;
+  size_t n_ = 0;
+  bool ok_ = true;
+  while (std::getline(in_, line_)) {
+    ++n_;
+    const std::vector<std::string> words_ = splitWords(line_);
+    if (words_.empty() || words_[0][0] == '#') {
+      continue;
+    }
+    Task t_;
+    if (!parseOptions(words_, t_, nullptr)) {
+      std::fprintf(stderr, "udfhost: %s:%zu: invalid options\n",
+                   opt_.suite_.c_str(), n_);
+      ok_ = false;
+      continue;
+    }
+    t_.job_.lib_ = relativeTo(opt_.libdir_, t_.job_.lib_);
+    t_.input_ = relativeTo(dir_, t_.input_);
+    ok_ = runTask(t_, opt_) && ok_;
+  }
+  return ok_;
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+  Task t_;
+  Options opt_;
+
+  if (!parseOptions(std::vector<std::string>(argv + 1, argv + argc), t_,
+                    &opt_)) {
+    usage();
+    return EXIT_FAILURE;
+  }
+
+  const bool ok_ = opt_.suite_.empty() ? runTask(t_, opt_) : runSuite(opt_);
+  return ok_ ? EXIT_SUCCESS : EXIT_FAILURE;
+}
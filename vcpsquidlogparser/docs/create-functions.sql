@@ -17,9 +17,31 @@ CREATE OR REPLACE FUNCTION slp_str RETURNS STRING SONAME 'libvcpsquidlogparser.s
 
 CREATE OR REPLACE FUNCTION slp_urldecode RETURNS STRING SONAME 'libvcpsquidlogparser.so';
 CREATE OR REPLACE FUNCTION slp_urlparts RETURNS STRING SONAME 'libvcpsquidlogparser.so';
+CREATE OR REPLACE FUNCTION slp_urlparam RETURNS STRING SONAME 'libvcpsquidlogparser.so';
 CREATE OR REPLACE FUNCTION slp_toUnixTs RETURNS INTEGER SONAME 'libvcpsquidlogparser.so';
 CREATE OR REPLACE FUNCTION slp_toSquidTs RETURNS STRING SONAME 'libvcpsquidlogparser.so';
 
+CREATE OR REPLACE FUNCTION slp_file_agg RETURNS REAL SONAME 'libvcpsquidlogparser.so';
+
+CREATE OR REPLACE FUNCTION slp_stats RETURNS STRING SONAME 'libvcpsquidlogparser.so';
+CREATE OR REPLACE FUNCTION slp_stats_reset RETURNS INTEGER SONAME 'libvcpsquidlogparser.so';
+
 CREATE OR REPLACE AGGREGATE FUNCTION slp_sum RETURNS INTEGER SONAME 'libvcpsquidlogparser.so';
 CREATE OR REPLACE AGGREGATE FUNCTION slp_countbyrm RETURNS INTEGER SONAME 'libvcpsquidlogparser.so';
 CREATE OR REPLACE AGGREGATE FUNCTION slp_countbyhttpcode RETURNS INTEGER SONAME 'libvcpsquidlogparser.so';
+CREATE OR REPLACE AGGREGATE FUNCTION slp_method_histogram RETURNS STRING SONAME 'libvcpsquidlogparser.so';
+CREATE OR REPLACE AGGREGATE FUNCTION slp_status_histogram RETURNS STRING SONAME 'libvcpsquidlogparser.so';
+CREATE OR REPLACE AGGREGATE FUNCTION slp_hit_ratio RETURNS STRING SONAME 'libvcpsquidlogparser.so';
+CREATE OR REPLACE AGGREGATE FUNCTION slp_percentile RETURNS REAL SONAME 'libvcpsquidlogparser.so';
+CREATE OR REPLACE AGGREGATE FUNCTION slp_percentiles RETURNS STRING SONAME 'libvcpsquidlogparser.so';
+CREATE OR REPLACE AGGREGATE FUNCTION slp_timeseries RETURNS STRING SONAME 'libvcpsquidlogparser.so';
+CREATE OR REPLACE AGGREGATE FUNCTION slp_sessions RETURNS STRING SONAME 'libvcpsquidlogparser.so';
+CREATE OR REPLACE AGGREGATE FUNCTION slp_approx_distinct RETURNS INTEGER SONAME 'libvcpsquidlogparser.so';
+CREATE OR REPLACE AGGREGATE FUNCTION slp_hll_export RETURNS STRING SONAME 'libvcpsquidlogparser.so';
+CREATE OR REPLACE AGGREGATE FUNCTION slp_hll_merge RETURNS STRING SONAME 'libvcpsquidlogparser.so';
+CREATE OR REPLACE FUNCTION slp_hll_count RETURNS INTEGER SONAME 'libvcpsquidlogparser.so';
+CREATE OR REPLACE AGGREGATE FUNCTION slp_cms_build RETURNS STRING SONAME 'libvcpsquidlogparser.so';
+CREATE OR REPLACE AGGREGATE FUNCTION slp_cms_merge RETURNS STRING SONAME 'libvcpsquidlogparser.so';
+CREATE OR REPLACE FUNCTION slp_cms_estimate RETURNS INTEGER SONAME 'libvcpsquidlogparser.so';
+CREATE OR REPLACE AGGREGATE FUNCTION slp_topk RETURNS STRING SONAME 'libvcpsquidlogparser.so';
+CREATE OR REPLACE AGGREGATE FUNCTION slp_bytes_by RETURNS STRING SONAME 'libvcpsquidlogparser.so';
@@ -0,0 +1,1444 @@
+/***************************************************************************
+ * Copyright (c) 2020-22                                                   *
+ *      Volnei Cervi Puttini.  All rights reserved.                        *
+ *      vcputtini@gmail.com
+ *                                                                         *
+ * Redistribution and use in source and binary forms, with or without      *
+ * modification, are permitted provided that the following conditions      *
+ * are met:                                                                *
+ * 1. Redistributions of source code must retain the above copyright       *
+ *    notice, this list of conditions and the following disclaimer.        *
+ * 2. Redistributions in binary form must reproduce the above copyright    *
+ *    notice, this list of conditions and the following disclaimer in the  *
+ *    documentation and/or other materials provided with the distribution. *
+ * 4. Neither the name of the Author     nor the names of its contributors *
+ *    may be used to endorse or promote products derived from this software*
+ *    without specific prior written permission.                           *
+ *                                                                         *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND *
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR      *
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS  *
+ * BE LIABLEFOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   *
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF    *
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS*
+ * INTERRUPTION)                                                           *
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,     *
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING   *
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE      *
+ * POSSIBILITY OFSUCH DAMAGE.                                              *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "slpaggs.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iterator> // std::size()
+#include <limits>
+#include <sstream>
+
+namespace squidlogparser {
+
+namespace {
+
+/*!
+ * \internal
+ * \brief Squid result codes (%Ss, without the /%03>Hs and the _ABORTED,
+ * _TIMEDOUT and _IGNORED suffixes), of Squid 2 to 6.
+ */
+struct HitCode
+{
+  std::string_view name_;
+  SLPHitRatio::Result result_;
+};
+
+constexpr HitCode hitCodes_[] = {
+  { "TCP_HIT", SLPHitRatio::Result::Hit },
+  { "TCP_MEM_HIT", SLPHitRatio::Result::Hit },
+  { "TCP_IMS_HIT", SLPHitRatio::Result::Hit },
+  { "TCP_INM_HIT", SLPHitRatio::Result::Hit },
+  { "TCP_NEGATIVE_HIT", SLPHitRatio::Result::Hit },
+  { "TCP_OFFLINE_HIT", SLPHitRatio::Result::Hit },
+  { "TCP_STALE_HIT", SLPHitRatio::Result::Hit },
+  { "TCP_CF_HIT", SLPHitRatio::Result::Hit },
+  { "TCP_REFRESH_UNMODIFIED", SLPHitRatio::Result::Hit },
+  { "TCP_REFRESH_FAIL_OLD", SLPHitRatio::Result::Hit },
+  { "TCP_REFRESH_HIT", SLPHitRatio::Result::Hit },
+  { "TCP_REF_FAIL_HIT", SLPHitRatio::Result::Hit },
+  { "UDP_HIT", SLPHitRatio::Result::Hit },
+  { "TCP_MISS", SLPHitRatio::Result::Miss },
+  { "TCP_REFRESH_MODIFIED", SLPHitRatio::Result::Miss },
+  { "TCP_REFRESH_FAIL_ERR", SLPHitRatio::Result::Miss },
+  { "TCP_REFRESH_MISS", SLPHitRatio::Result::Miss },
+  { "TCP_REFRESH", SLPHitRatio::Result::Miss },
+  { "TCP_CLIENT_REFRESH_MISS", SLPHitRatio::Result::Miss },
+  { "TCP_CLIENT_REFRESH", SLPHitRatio::Result::Miss },
+  { "TCP_SWAPFAIL_MISS", SLPHitRatio::Result::Miss },
+  { "TCP_CF_MISS", SLPHitRatio::Result::Miss },
+  { "UDP_MISS", SLPHitRatio::Result::Miss },
+  { "UDP_MISS_NOFETCH", SLPHitRatio::Result::Miss },
+  { "TCP_DENIED", SLPHitRatio::Result::Other },
+  { "TCP_DENIED_REPLY", SLPHitRatio::Result::Other },
+  { "TCP_TUNNEL", SLPHitRatio::Result::Other },
+  { "TCP_REDIRECT", SLPHitRatio::Result::Other },
+  { "NONE", SLPHitRatio::Result::Other },
+  { "NONE_NONE", SLPHitRatio::Result::Other },
+  { "TAG_NONE", SLPHitRatio::Result::Other },
+  { "UDP_DENIED", SLPHitRatio::Result::Other },
+  { "UDP_INVALID", SLPHitRatio::Result::Other }
+};
+
+constexpr size_t hitSlots_ = 64;
+constexpr uint32_t hitSeed_ = 13411; // the first seed without collisions
+
+/*!
+ * \internal
+ * \brief FNV-1a of the code, folded into the slots of the table.
+ */
+constexpr size_t
+hitHash(std::string_view s_) noexcept
+{
+  uint32_t h_ = hitSeed_;
+  for (const char c_ : s_) {
+    h_ = (h_ ^ static_cast<unsigned char>(c_)) * 16777619u;
+  }
+  return (h_ >> 16) % hitSlots_;
+}
+
+/*!
+ * \internal
+ * \brief Perfect hash table of hitCodes_: slot -> index in hitCodes_, or -1.
+ * Built at compile time; a collision (after a change of hitCodes_) doesn't
+ * compile, then look for another hitSeed_.
+ */
+struct HitTable
+{
+  std::array<int8_t, hitSlots_> slot_ = {};
+
+  constexpr HitTable()
+  {
+    for (size_t i_ = 0; i_ < hitSlots_; ++i_) {
+      slot_[i_] = -1;
+    }
+    for (size_t i_ = 0; i_ < std::size(hitCodes_); ++i_) {
+      int8_t& s_ = slot_[hitHash(hitCodes_[i_].name_)];
+      if (s_ != -1) {
+        throw "hitSeed_: two codes in the same slot";
+      }
+      s_ = static_cast<int8_t>(i_);
+    }
+  }
+};
+
+constexpr HitTable hitTable_;
+
+/*!
+ * \internal
+ * \brief Counters of the BLOB's of the sketches, in little-endian.
+ */
+uint64_t
+loadLE(const char* p_) noexcept
+{
+  uint64_t v_ = 0;
+  for (int i_ = 7; i_ >= 0; --i_) {
+    v_ = (v_ << 8) | static_cast<unsigned char>(p_[i_]);
+  }
+  return v_;
+}
+
+void
+storeLE(char* p_, uint64_t v_) noexcept
+{
+  for (int i_ = 0; i_ < 8; ++i_, v_ >>= 8) {
+    p_[i_] = static_cast<char>(v_ & 0xff);
+  }
+}
+
+} // namespace
+
+/* SLPMethodHistogram ------------------------------------------------------- */
+
+/*!
+ * \brief Counts one request.
+ * \param method_ Request method, as in the log line.
+ * \param size_ Size of the reply. Negative sizes (i.e. '-') count as 0.
+ */
+void
+SLPMethodHistogram::add(std::string_view method_, int64_t size_) noexcept
+{
+  const size_t m_ = static_cast<size_t>(methodOf(method_));
+  ++requests_[m_];
+  bytes_[m_] += size_ > 0 ? static_cast<uint64_t>(size_) : 0;
+}
+
+void
+SLPMethodHistogram::clear() noexcept
+{
+  requests_.fill(0);
+  bytes_.fill(0);
+  rejected_ = 0;
+}
+
+uint64_t
+SLPMethodHistogram::requests(MethodType m_) const noexcept
+{
+  return requests_[static_cast<size_t>(m_)];
+}
+
+uint64_t
+SLPMethodHistogram::bytes(MethodType m_) const noexcept
+{
+  return bytes_[static_cast<size_t>(m_)];
+}
+
+/*!
+ * \brief {"requests":{"GET":n,...},"bytes":{"GET":n,...},"rejected":n}, with
+ * all the methods, in the order of MethodType. "bytes" only if withBytes_.
+ */
+std::string
+SLPMethodHistogram::toJson(bool withBytes_) const
+{
+  auto object_ = [](std::stringstream& ss_,
+                    const std::array<uint64_t, nMethods>& a_) {
+    ss_ << "{";
+    for (size_t i_ = 0; i_ < nMethods; ++i_) {
+      ss_ << (i_ ? "," : "") << "\"" << nameOf(static_cast<MethodType>(i_))
+          << "\":" << a_[i_];
+    }
+    ss_ << "}";
+  };
+
+  std::stringstream ss;
+  ss << "{\"requests\":";
+  object_(ss, requests_);
+  if (withBytes_) {
+    ss << ",\"bytes\":";
+    object_(ss, bytes_);
+  }
+  ss << ",\"rejected\":" << rejected_ << "}";
+  return ss.str();
+}
+
+/*!
+ * \brief Request method of the token. The first byte (and the length, for
+ * the methods starting with 'P') selects the only candidate, which is then
+ * confirmed, so a token is compared at most once.
+ * \return MethodType::MTOthers if it isn't one of the methods of MethodType.
+ * \note The methods are case-sensitive (RFC 9110), as in the log.
+ */
+SLPMethodHistogram::MethodType
+SLPMethodHistogram::methodOf(std::string_view method_) noexcept
+{
+  auto is_ = [&method_](std::string_view name_, MethodType m_) {
+    return method_ == name_ ? m_ : MethodType::MTOthers;
+  };
+
+  if (method_.empty()) {
+    return MethodType::MTOthers;
+  }
+  switch (method_[0]) {
+    case 'G':
+      return is_("GET", MethodType::MTGet);
+    case 'P':
+      switch (method_.size()) {
+        case 3:
+          return is_("PUT", MethodType::MTPut);
+        case 4:
+          return is_("POST", MethodType::MTPost);
+        case 5:
+          return is_("PATCH", MethodType::MTPatch);
+        default:
+          return MethodType::MTOthers;
+      }
+    case 'C':
+      return is_("CONNECT", MethodType::MTConnect);
+    case 'H':
+      return is_("HEAD", MethodType::MTHead);
+    case 'D':
+      return is_("DELETE", MethodType::MTDelete);
+    case 'O':
+      return is_("OPTIONS", MethodType::MTOptions);
+    case 'T':
+      return is_("TRACE", MethodType::MTTrace);
+    default:
+      return MethodType::MTOthers;
+  }
+}
+
+std::string_view
+SLPMethodHistogram::nameOf(MethodType m_) noexcept
+{
+  static constexpr std::string_view names_[nMethods] = {
+    "GET",    "PUT",     "POST",  "CONNECT", "HEAD",
+    "DELETE", "OPTIONS", "PATCH", "TRACE",   "OTHERS"
+  };
+  return names_[static_cast<size_t>(m_)];
+}
+
+/* SLPStatusHistogram ------------------------------------------------------- */
+
+/*!
+ * \brief Counts one request.
+ * \param code_ HTTP status, -1 if the line has none.
+ */
+void
+SLPStatusHistogram::add(int code_) noexcept
+{
+  if (code_ >= 0 && static_cast<size_t>(code_) < nCodes) {
+    ++requests_[static_cast<size_t>(code_)];
+  } else {
+    ++other_;
+  }
+}
+
+void
+SLPStatusHistogram::clear() noexcept
+{
+  requests_.fill(0);
+  other_ = 0;
+  rejected_ = 0;
+}
+
+uint64_t
+SLPStatusHistogram::requests(int code_) const noexcept
+{
+  return code_ >= 0 && static_cast<size_t>(code_) < nCodes
+           ? requests_[static_cast<size_t>(code_)]
+           : 0;
+}
+
+/*!
+ * \brief {"codes":{"200":n,...},"other":n,"rejected":n}, only the codes
+ * with requests, in ascending order. With byClass_ the codes are summed by
+ * class instead: {"classes":{"1xx":n,...,"5xx":n},...}, all of them, and the
+ * codes below 100 go to "other".
+ */
+std::string
+SLPStatusHistogram::toJson(bool byClass_) const
+{
+  std::stringstream ss;
+  uint64_t other_ = this->other_;
+
+  if (byClass_) {
+    std::array<uint64_t, 6> classes_ = {};
+    for (size_t i_ = 0; i_ < nCodes; ++i_) {
+      classes_[i_ / 100] += requests_[i_];
+    }
+    other_ += classes_[0];
+    ss << "{\"classes\":{";
+    for (size_t c_ = 1; c_ < classes_.size(); ++c_) {
+      ss << (c_ > 1 ? "," : "") << "\"" << c_ << "xx\":" << classes_[c_];
+    }
+  } else {
+    ss << "{\"codes\":{";
+    bool first_ = true;
+    for (size_t i_ = 0; i_ < nCodes; ++i_) {
+      if (requests_[i_] != 0) {
+        ss << (first_ ? "" : ",") << "\"" << std::setw(3) << std::setfill('0')
+           << i_ << "\":" << requests_[i_];
+        first_ = false;
+      }
+    }
+  }
+  ss << "},\"other\":" << other_ << ",\"rejected\":" << rejected_ << "}";
+  return ss.str();
+}
+
+/* SLPHitRatio -------------------------------------------------------------- */
+
+/*!
+ * \brief Counts one request.
+ * \param code_ Result code, as in the log (e.g. TCP_MEM_HIT/200).
+ * \param size_ Size of the reply. Negative sizes (i.e. '-') count as 0.
+ */
+void
+SLPHitRatio::add(std::string_view code_, int64_t size_) noexcept
+{
+  const size_t r_ = static_cast<size_t>(resultOf(code_));
+  ++requests_[r_];
+  bytes_[r_] += size_ > 0 ? static_cast<uint64_t>(size_) : 0;
+}
+
+void
+SLPHitRatio::clear() noexcept
+{
+  requests_.fill(0);
+  bytes_.fill(0);
+  rejected_ = 0;
+}
+
+uint64_t
+SLPHitRatio::requests(Result r_) const noexcept
+{
+  return requests_[static_cast<size_t>(r_)];
+}
+
+uint64_t
+SLPHitRatio::bytes(Result r_) const noexcept
+{
+  return bytes_[static_cast<size_t>(r_)];
+}
+
+/*!
+ * \brief Hits / (hits + misses). The other requests are never served from
+ * nor stored in the cache, so they don't count.
+ * \return NaN if there's no hit nor miss.
+ */
+double
+SLPHitRatio::hitRatio() const noexcept
+{
+  const uint64_t n_ = requests(Result::Hit) + requests(Result::Miss);
+  return n_ ? static_cast<double>(requests(Result::Hit)) / n_
+            : std::numeric_limits<double>::quiet_NaN();
+}
+
+/*!
+ * \brief Bytes of the hits / bytes of the hits and misses.
+ * \return NaN if there's no byte of a hit or miss.
+ */
+double
+SLPHitRatio::byteHitRatio() const noexcept
+{
+  const uint64_t n_ = bytes(Result::Hit) + bytes(Result::Miss);
+  return n_ ? static_cast<double>(bytes(Result::Hit)) / n_
+            : std::numeric_limits<double>::quiet_NaN();
+}
+
+/*!
+ * \brief {"requests":n,"hits":n,"misses":n,"other":n,"hit_ratio":x,
+ * "byte_hit_ratio":x,"rejected":n}. The ratios are null if undefined.
+ * withBytes_ adds "hit_bytes", "miss_bytes" and "other_bytes".
+ */
+std::string
+SLPHitRatio::toJson(bool withBytes_) const
+{
+  auto ratio_ = [](std::stringstream& ss_, double r_) {
+    if (std::isnan(r_)) {
+      ss_ << "null";
+    } else {
+      ss_ << std::fixed << std::setprecision(6) << r_;
+    }
+  };
+
+  std::stringstream ss;
+  ss << "{\"requests\":"
+     << requests(Result::Hit) + requests(Result::Miss) +
+          requests(Result::Other)
+     << ",\"hits\":" << requests(Result::Hit)
+     << ",\"misses\":" << requests(Result::Miss)
+     << ",\"other\":" << requests(Result::Other) << ",\"hit_ratio\":";
+  ratio_(ss, hitRatio());
+  ss << ",\"byte_hit_ratio\":";
+  ratio_(ss, byteHitRatio());
+  if (withBytes_) {
+    ss << ",\"hit_bytes\":" << bytes(Result::Hit)
+       << ",\"miss_bytes\":" << bytes(Result::Miss)
+       << ",\"other_bytes\":" << bytes(Result::Other);
+  }
+  ss << ",\"rejected\":" << rejected_ << "}";
+  return ss.str();
+}
+
+/*!
+ * \brief Class of a squid result code, with one lookup in a perfect hash
+ * table built at compile time.
+ * \param code_ %Ss or %Ss/%03>Hs, e.g. TCP_REFRESH_UNMODIFIED_ABORTED/304.
+ * \return Result::Other if the code isn't known.
+ */
+SLPHitRatio::Result
+SLPHitRatio::resultOf(std::string_view code_) noexcept
+{
+  if (const size_t slash_ = code_.find('/'); slash_ != code_.npos) {
+    code_.remove_suffix(code_.size() - slash_);
+  }
+  // Squid 3.5+ appends the details of the transaction to the code.
+  for (bool more_ = true; more_;) {
+    more_ = false;
+    for (const std::string_view s_ : { "_ABORTED", "_TIMEDOUT", "_IGNORED" }) {
+      if (code_.size() > s_.size() &&
+          code_.substr(code_.size() - s_.size()) == s_) {
+        code_.remove_suffix(s_.size());
+        more_ = true;
+      }
+    }
+  }
+
+  const int8_t i_ = hitTable_.slot_[hitHash(code_)];
+  return i_ >= 0 && hitCodes_[i_].name_ == code_ ? hitCodes_[i_].result_
+                                                 : Result::Other;
+}
+
+/* SLPLogHistogram ---------------------------------------------------------- */
+
+/*!
+ * \brief Counts one value. Negative values (i.e. '-') aren't counted.
+ */
+void
+SLPLogHistogram::add(int64_t v_) noexcept
+{
+  if (v_ < 0) {
+    return;
+  }
+  ++counts_[bucketOf(static_cast<uint64_t>(v_))];
+  min_ = count_ ? std::min(min_, v_) : v_;
+  max_ = count_ ? std::max(max_, v_) : v_;
+  ++count_;
+}
+
+void
+SLPLogHistogram::clear() noexcept
+{
+  counts_.fill(0);
+  count_ = 0;
+  min_ = 0;
+  max_ = 0;
+}
+
+/*!
+ * \brief Quantile q_ of the values, by nearest rank: the value of rank
+ * ceil(q_ * count()). The exact minimum and maximum are kept, so q_ = 0 and
+ * q_ = 1 are exact and the others are clamped to [min(), max()].
+ * \return NaN if there's no value or q_ isn't in [0, 1].
+ */
+double
+SLPLogHistogram::quantile(double q_) const noexcept
+{
+  if (count_ == 0 || !(q_ >= 0.0 && q_ <= 1.0)) {
+    return std::numeric_limits<double>::quiet_NaN();
+  }
+  const uint64_t rank_ = std::max<uint64_t>(
+    1, static_cast<uint64_t>(std::ceil(q_ * static_cast<double>(count_))));
+  if (rank_ == 1 && q_ == 0.0) {
+    return static_cast<double>(min_);
+  }
+  if (rank_ >= count_) {
+    return static_cast<double>(max_);
+  }
+
+  uint64_t seen_ = 0;
+  size_t b_ = 0;
+  for (; b_ < nBuckets - 1; ++b_) {
+    seen_ += counts_[b_];
+    if (seen_ >= rank_) {
+      break;
+    }
+  }
+  const double lower_ = static_cast<double>(lowerOf(b_));
+  const double upper_ = b_ + 1 < nBuckets
+                          ? static_cast<double>(lowerOf(b_ + 1))
+                          : std::ldexp(1.0, 64);
+  const double v_ = b_ < (size_t(1) << precisionBits)
+                      ? lower_
+                      : lower_ + (upper_ - lower_ - 1.0) / 2.0;
+  return std::clamp(v_, static_cast<double>(min_), static_cast<double>(max_));
+}
+
+/*!
+ * \brief Bucket of the value: the value itself below 2^precisionBits, else
+ * its power of two and its next (precisionBits - 1) bits.
+ */
+size_t
+SLPLogHistogram::bucketOf(uint64_t v_) noexcept
+{
+  constexpr uint64_t exact_ = uint64_t(1) << precisionBits;
+  if (v_ < exact_) {
+    return static_cast<size_t>(v_);
+  }
+  const unsigned e_ = 63 - static_cast<unsigned>(__builtin_clzll(v_));
+  const unsigned shift_ = e_ - (precisionBits - 1);
+  const uint64_t m_ = (v_ >> shift_) - (exact_ >> 1); // [0, 2^(p-1))
+  return static_cast<size_t>(exact_ +
+                             (e_ - precisionBits) * (exact_ >> 1) + m_);
+}
+
+/*!
+ * \brief Smallest value of the bucket.
+ */
+uint64_t
+SLPLogHistogram::lowerOf(size_t b_) noexcept
+{
+  constexpr uint64_t exact_ = uint64_t(1) << precisionBits;
+  if (b_ < exact_) {
+    return b_;
+  }
+  const size_t e_ = (b_ - exact_) / (exact_ >> 1) + precisionBits;
+  const uint64_t m_ = (b_ - exact_) % (exact_ >> 1) + (exact_ >> 1);
+  return m_ << (e_ - (precisionBits - 1));
+}
+
+/* SLPTimeSeries ------------------------------------------------------------ */
+
+/*!
+ * \brief Sets the width of the intervals, at least 1 s, and empties the
+ * series.
+ */
+void
+SLPTimeSeries::setSeconds(uint32_t seconds_) noexcept
+{
+  this->seconds_ = std::max<uint32_t>(seconds_, 1);
+  clear();
+}
+
+/*!
+ * \brief Counts one request at the Unix time ts_.
+ * \param status_ HTTP status, or -1 if the line has none.
+ */
+void
+SLPTimeSeries::add(uint32_t ts_,
+                   int64_t bytes_,
+                   int status_,
+                   int64_t responseTime_)
+{
+  const uint64_t b_ = ts_ / seconds_;
+  if (buckets_.empty()) {
+    first_ = b_;
+    buckets_.resize(1);
+  } else if (b_ < first_) {
+    const size_t n_ = static_cast<size_t>(first_ - b_);
+    if (buckets_.size() + n_ > maxBuckets) {
+      ++dropped_;
+      return;
+    }
+    buckets_.insert(buckets_.begin(), n_, Bucket{});
+    first_ = b_;
+  } else if (b_ - first_ >= buckets_.size()) {
+    if (b_ - first_ >= maxBuckets) {
+      ++dropped_;
+      return;
+    }
+    buckets_.resize(static_cast<size_t>(b_ - first_ + 1));
+  }
+
+  Bucket& k_ = buckets_[static_cast<size_t>(b_ - first_)];
+  ++k_.requests_;
+  k_.bytes_ += static_cast<uint64_t>(std::max<int64_t>(bytes_, 0));
+  k_.status4xx_ += status_ >= 400 && status_ < 500;
+  k_.status5xx_ += status_ >= 500 && status_ < 600;
+  k_.responseTime_ +=
+    static_cast<uint64_t>(std::max<int64_t>(responseTime_, 0));
+}
+
+void
+SLPTimeSeries::clear() noexcept
+{
+  buckets_.clear();
+  first_ = 0;
+  dropped_ = 0;
+  rejected_ = 0;
+}
+
+/*!
+ * \return JSON-formated string: {"seconds":n,"series":[{"t":n,"requests":n,
+ * "bytes":n,"4xx":n,"5xx":n,"response_time":n},...],"dropped":n,
+ * "rejected":n}, t the Unix time of the start of the interval. The empty
+ * intervals between the first and the last are in the series, with zeros.
+ */
+std::string
+SLPTimeSeries::toJson() const
+{
+  std::stringstream ss;
+  ss << "{\"seconds\":" << seconds_ << ",\"series\":[";
+  for (size_t i_ = 0; i_ < buckets_.size(); ++i_) {
+    const Bucket& k_ = buckets_[i_];
+    ss << (i_ ? "," : "") << "{\"t\":" << (first_ + i_) * seconds_
+       << ",\"requests\":" << k_.requests_ << ",\"bytes\":" << k_.bytes_
+       << ",\"4xx\":" << k_.status4xx_ << ",\"5xx\":" << k_.status5xx_
+       << ",\"response_time\":" << k_.responseTime_ << "}";
+  }
+  ss << "],\"dropped\":" << dropped_ << ",\"rejected\":" << rejected_
+     << "}";
+  return ss.str();
+}
+
+/* SLPSessions -------------------------------------------------------------- */
+
+/*!
+ * \brief Sets the idle gap that ends a session, in seconds, and empties the
+ * sessions.
+ */
+void
+SLPSessions::setGap(uint32_t gap_) noexcept
+{
+  this->gap_ = gap_;
+  clear();
+}
+
+/*!
+ * \brief Counts a request of the client, by the hash of its key.
+ * \param ts_ Unix time of the request.
+ */
+void
+SLPSessions::add(uint64_t hash_, uint32_t ts_, int64_t bytes_)
+{
+  hash_ = hash_ ? hash_ : 1; // 0 is an empty slot
+  if (2 * (used_ + 1) > slots_.size()) {
+    grow();
+  }
+
+  Slot& s_ = find(hash_);
+  if (s_.hash_ == 0) {
+    s_.hash_ = hash_;
+    s_.first_ = ts_;
+    s_.last_ = ts_;
+    ++used_;
+  } else if (ts_ > s_.last_ && ts_ - s_.last_ > gap_) {
+    closed_.close(s_);
+    s_.first_ = ts_;
+    s_.last_ = ts_;
+    s_.requests_ = 0;
+    s_.bytes_ = 0;
+  } else {
+    s_.first_ = std::min(s_.first_, ts_);
+    s_.last_ = std::max(s_.last_, ts_);
+  }
+  ++s_.requests_;
+  s_.bytes_ += static_cast<uint64_t>(std::max<int64_t>(bytes_, 0));
+}
+
+void
+SLPSessions::clear() noexcept
+{
+  slots_.clear();
+  used_ = 0;
+  closed_ = {};
+  rejected_ = 0;
+}
+
+/*!
+ * \return JSON-formated string: {"sessions":n,"clients":n,
+ * "mean_duration":x,"requests_per_session":x,"bytes_per_session":x,
+ * "rejected":n}, the duration in seconds, from the first to the last request
+ * of the session. The sessions still open are counted as ended.
+ */
+std::string
+SLPSessions::toJson() const
+{
+  Totals t_ = closed_;
+  for (const Slot& s_ : slots_) {
+    if (s_.hash_ != 0) {
+      t_.close(s_);
+    }
+  }
+  auto mean_ = [&t_](std::stringstream& ss_, uint64_t sum_) {
+    if (t_.sessions_ == 0) {
+      ss_ << "null";
+    } else {
+      ss_ << std::fixed << std::setprecision(1)
+          << static_cast<double>(sum_) / t_.sessions_;
+    }
+  };
+
+  std::stringstream ss;
+  ss << "{\"sessions\":" << t_.sessions_ << ",\"clients\":" << used_
+     << ",\"mean_duration\":";
+  mean_(ss, t_.duration_);
+  ss << ",\"requests_per_session\":";
+  mean_(ss, t_.requests_);
+  ss << ",\"bytes_per_session\":";
+  mean_(ss, t_.bytes_);
+  ss << ",\"rejected\":" << rejected_ << "}";
+  return ss.str();
+}
+
+void
+SLPSessions::Totals::close(const Slot& s_) noexcept
+{
+  ++sessions_;
+  duration_ += s_.last_ - s_.first_;
+  requests_ += s_.requests_;
+  bytes_ += s_.bytes_;
+}
+
+/*!
+ * \brief Slot of the client, or the empty slot where it goes.
+ */
+SLPSessions::Slot&
+SLPSessions::find(uint64_t hash_) noexcept
+{
+  const size_t mask_ = slots_.size() - 1;
+  size_t i_ = static_cast<size_t>(hash_) & mask_;
+  while (slots_[i_].hash_ != 0 && slots_[i_].hash_ != hash_) {
+    i_ = (i_ + 1) & mask_;
+  }
+  return slots_[i_];
+}
+
+/*!
+ * \brief Doubles the table (at least 1024 slots), so it's at most half full.
+ */
+void
+SLPSessions::grow()
+{
+  std::vector<Slot> old_(std::max<size_t>(slots_.size() * 2, 1024));
+  old_.swap(slots_);
+  for (const Slot& s_ : old_) {
+    if (s_.hash_ != 0) {
+      find(s_.hash_) = s_;
+    }
+  }
+}
+
+/* SLPHash ------------------------------------------------------------------ */
+
+/*!
+ * \brief FNV-1a of the bytes, mixed: FNV-1a alone is weak in the high bits,
+ * which the sketches use.
+ */
+uint64_t
+SLPHash::of(std::string_view s_) noexcept
+{
+  uint64_t h_ = 0xcbf29ce484222325ULL;
+  for (const char c_ : s_) {
+    h_ = (h_ ^ static_cast<unsigned char>(c_)) * 0x100000001b3ULL;
+  }
+  return mix(h_);
+}
+
+/* SLPHyperLogLog ----------------------------------------------------------- */
+
+/*!
+ * \brief Counts a key, by its hash (SLPHash). The first bits of the hash
+ * select the register, which keeps the maximum rank (position of the first
+ * 1 bit) of the other bits.
+ */
+void
+SLPHyperLogLog::add(uint64_t hash_) noexcept
+{
+  const size_t r_ = static_cast<size_t>(hash_ >> (64 - precision));
+  const uint64_t w_ = hash_ << precision;
+  const uint8_t rank_ =
+    w_ ? static_cast<uint8_t>(__builtin_clzll(w_) + 1) : 64 - precision + 1;
+  registers_[r_] = std::max(registers_[r_], rank_);
+}
+
+void
+SLPHyperLogLog::merge(const SLPHyperLogLog& rhs_) noexcept
+{
+  for (size_t i_ = 0; i_ < nRegisters; ++i_) {
+    registers_[i_] = std::max(registers_[i_], rhs_.registers_[i_]);
+  }
+}
+
+/*!
+ * \brief Merges a sketch exported by toBlob().
+ * \return false if the BLOB isn't a sketch of the same precision.
+ */
+bool
+SLPHyperLogLog::merge(std::string_view blob_) noexcept
+{
+  if (!valid(blob_)) {
+    return false;
+  }
+  const uint8_t* r_ =
+    reinterpret_cast<const uint8_t*>(blob_.data() + headerSize);
+  for (size_t i_ = 0; i_ < nRegisters; ++i_) {
+    registers_[i_] = std::max(registers_[i_], r_[i_]);
+  }
+  return true;
+}
+
+void
+SLPHyperLogLog::clear() noexcept
+{
+  registers_.fill(0);
+}
+
+/*!
+ * \brief Estimate of the number of distinct keys, by the improved estimator
+ * of Ertl (2017), from the histogram of the registers. It has no bias at
+ * small counts, where the raw estimator of Flajolet et al. (2007) needs
+ * linear counting and an empirical correction around the switch.
+ */
+uint64_t
+SLPHyperLogLog::estimate() const noexcept
+{
+  constexpr unsigned q_ = 64 - precision;
+  constexpr double m_ = static_cast<double>(nRegisters);
+
+  std::array<uint32_t, q_ + 2> c_ = {};
+  for (const uint8_t r_ : registers_) {
+    ++c_[r_];
+  }
+
+  // sigma(x) = x + sum(x^(2^k) * 2^(k-1)), k >= 1
+  auto sigma_ = [](double x_) {
+    if (x_ == 1.0) {
+      return std::numeric_limits<double>::infinity();
+    }
+    double y_ = 1.0, z_ = x_, prev_ = 0.0;
+    do {
+      x_ *= x_;
+      prev_ = z_;
+      z_ += x_ * y_;
+      y_ += y_;
+    } while (z_ != prev_);
+    return z_;
+  };
+  // tau(x) = (1 - x - sum((1 - x^(2^-k))^2 * 2^-k)) / 3, k >= 1
+  auto tau_ = [](double x_) {
+    if (x_ == 0.0 || x_ == 1.0) {
+      return 0.0;
+    }
+    double y_ = 1.0, z_ = 1.0 - x_, prev_ = 0.0;
+    do {
+      x_ = std::sqrt(x_);
+      prev_ = z_;
+      y_ *= 0.5;
+      z_ -= (1.0 - x_) * (1.0 - x_) * y_;
+    } while (z_ != prev_);
+    return z_ / 3.0;
+  };
+
+  double z_ = m_ * tau_(1.0 - c_[q_ + 1] / m_);
+  for (unsigned k_ = q_; k_ >= 1; --k_) {
+    z_ = 0.5 * (z_ + c_[k_]);
+  }
+  z_ += m_ * sigma_(c_[0] / m_);
+  constexpr double alpha_ = 0.5 / 0.69314718055994530942; // 1 / (2 ln 2)
+  return static_cast<uint64_t>(std::llround(alpha_ * m_ * m_ / z_));
+}
+
+std::string
+SLPHyperLogLog::toBlob() const
+{
+  std::string b_ = {
+    'S', 'L', 'P', 'H', 1, static_cast<char>(precision), 0, 0
+  };
+  b_.append(reinterpret_cast<const char*>(registers_.data()), nRegisters);
+  return b_;
+}
+
+/*!
+ * \brief Replaces the sketch by one exported by toBlob().
+ * \return false (and the sketch isn't changed) if the BLOB isn't a sketch
+ * of the same precision.
+ */
+bool
+SLPHyperLogLog::fromBlob(std::string_view blob_) noexcept
+{
+  if (!valid(blob_)) {
+    return false;
+  }
+  std::memcpy(registers_.data(), blob_.data() + headerSize, nRegisters);
+  return true;
+}
+
+bool
+SLPHyperLogLog::valid(std::string_view blob_) noexcept
+{
+  if (blob_.size() != blobSize || blob_.substr(0, 4) != "SLPH" ||
+      blob_[4] != 1 || static_cast<unsigned char>(blob_[5]) != precision) {
+    return false;
+  }
+  // A register can't be greater than the rank of a hash of 0.
+  for (size_t i_ = headerSize; i_ < blobSize; ++i_) {
+    if (static_cast<unsigned char>(blob_[i_]) > 64 - precision + 1) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* SLPCountMin -------------------------------------------------------------- */
+
+/*!
+ * \brief Counts a key, by its hash (SLPHash), with the conservative update:
+ * only the counters below the new estimate are raised, to it.
+ */
+void
+SLPCountMin::add(uint64_t hash_, uint64_t count_) noexcept
+{
+  std::array<size_t, depth> slots_ = {};
+  uint64_t min_ = std::numeric_limits<uint64_t>::max();
+  for (unsigned r_ = 0; r_ < depth; ++r_) {
+    slots_[r_] = r_ * width + slotOf(r_, hash_);
+    min_ = std::min(min_, counters_[slots_[r_]]);
+  }
+  min_ += count_;
+  for (const size_t s_ : slots_) {
+    counters_[s_] = std::max(counters_[s_], min_);
+  }
+  total_ += count_;
+}
+
+/*!
+ * \brief Merges a sketch exported by toBlob().
+ * \return false if the BLOB isn't a sketch of the same dimensions.
+ */
+bool
+SLPCountMin::merge(std::string_view blob_) noexcept
+{
+  if (!valid(blob_)) {
+    return false;
+  }
+  total_ += loadLE(blob_.data() + 8);
+  const char* p_ = blob_.data() + headerSize;
+  for (uint64_t& c_ : counters_) {
+    c_ += loadLE(p_);
+    p_ += 8;
+  }
+  return true;
+}
+
+void
+SLPCountMin::clear() noexcept
+{
+  counters_.fill(0);
+  total_ = 0;
+}
+
+uint64_t
+SLPCountMin::estimate(uint64_t hash_) const noexcept
+{
+  uint64_t min_ = std::numeric_limits<uint64_t>::max();
+  for (unsigned r_ = 0; r_ < depth; ++r_) {
+    min_ = std::min(min_, counters_[r_ * width + slotOf(r_, hash_)]);
+  }
+  return min_;
+}
+
+std::string
+SLPCountMin::toBlob() const
+{
+  std::string b_(blobSize, '\0');
+  b_.replace(0, 4, "SLPC");
+  b_[4] = 1;
+  b_[5] = static_cast<char>(depth);
+  b_[6] = static_cast<char>(widthBits);
+  storeLE(b_.data() + 8, total_);
+  char* p_ = b_.data() + headerSize;
+  for (const uint64_t c_ : counters_) {
+    storeLE(p_, c_);
+    p_ += 8;
+  }
+  return b_;
+}
+
+/*!
+ * \brief Estimate of the count of a key, read from a sketch exported by
+ * toBlob(), without loading it: depth counters are read.
+ * \return false if the BLOB isn't a sketch of the same dimensions.
+ */
+bool
+SLPCountMin::estimate(std::string_view blob_,
+                      uint64_t hash_,
+                      uint64_t& count_) noexcept
+{
+  if (!valid(blob_)) {
+    return false;
+  }
+  const char* p_ = blob_.data() + headerSize;
+  count_ = std::numeric_limits<uint64_t>::max();
+  for (unsigned r_ = 0; r_ < depth; ++r_) {
+    count_ =
+      std::min(count_, loadLE(p_ + 8 * (r_ * width + slotOf(r_, hash_))));
+  }
+  return true;
+}
+
+/*!
+ * \brief Counter of the key in the row: the hash is split in two halves,
+ * combined as h1 + row * h2 (Kirsch and Mitzenmacher, 2006), which is as
+ * good as depth independent hashes.
+ */
+size_t
+SLPCountMin::slotOf(unsigned row_, uint64_t hash_) noexcept
+{
+  const uint32_t h1_ = static_cast<uint32_t>(hash_);
+  const uint32_t h2_ = static_cast<uint32_t>(hash_ >> 32) | 1;
+  return (h1_ + row_ * h2_) & (width - 1);
+}
+
+bool
+SLPCountMin::valid(std::string_view blob_) noexcept
+{
+  return blob_.size() == blobSize && blob_.substr(0, 4) == "SLPC" &&
+         blob_[4] == 1 && static_cast<unsigned char>(blob_[5]) == depth &&
+         static_cast<unsigned char>(blob_[6]) == widthBits;
+}
+
+/* SLPSpaceSaving ----------------------------------------------------------- */
+
+/*!
+ * \brief Empties the summary and sets its capacity, up to maxCapacity. The
+ * memory of the counters is allocated here, once.
+ */
+void
+SLPSpaceSaving::reserve(size_t n_)
+{
+  capacity_ = std::min(n_, maxCapacity);
+  counters_.resize(capacity_);
+  heap_.clear();
+  heap_.reserve(capacity_);
+  pos_.assign(capacity_, 0);
+
+  size_t width_ = capacity_ ? 2 : 0;
+  while (width_ < 2 * capacity_) {
+    width_ <<= 1;
+  }
+  slots_.assign(width_, empty_);
+  total_ = 0;
+}
+
+/*!
+ * \brief Counts the key, with its hash (SLPHash) and its weight (1 to count
+ * the rows). The keys of weight 0 aren't counted.
+ */
+void
+SLPSpaceSaving::add(std::string_view key_,
+                    uint64_t hash_,
+                    uint64_t weight_)
+{
+  if (capacity_ == 0 || weight_ == 0) {
+    return;
+  }
+  total_ += weight_;
+
+  uint32_t c_ = find(key_, hash_);
+  if (c_ != empty_) {
+    counters_[c_].count_ += weight_;
+    siftDown(pos_[c_]);
+    return;
+  }
+
+  if (heap_.size() < capacity_) {
+    c_ = static_cast<uint32_t>(heap_.size());
+    Counter& n_ = counters_[c_];
+    n_.key_.assign(key_);
+    n_.hash_ = hash_;
+    n_.count_ = weight_;
+    n_.error_ = 0;
+    pos_[c_] = static_cast<uint32_t>(heap_.size());
+    heap_.push_back(c_);
+    insert(c_);
+    siftUp(pos_[c_]);
+    return;
+  }
+
+  // The key replaces the one of the lowest count, at the top of the heap.
+  c_ = heap_.front();
+  erase(c_);
+  Counter& m_ = counters_[c_];
+  m_.key_.assign(key_);
+  m_.hash_ = hash_;
+  m_.error_ = m_.count_;
+  m_.count_ += weight_;
+  insert(c_);
+  siftDown(0);
+}
+
+void
+SLPSpaceSaving::clear() noexcept
+{
+  heap_.clear();
+  std::fill(slots_.begin(), slots_.end(), empty_);
+  total_ = 0;
+}
+
+/*!
+ * \brief The k_ counters of the highest counts, in descending order of the
+ * count (then of the key).
+ */
+std::vector<const SLPSpaceSaving::Counter*>
+SLPSpaceSaving::top(size_t k_) const
+{
+  std::vector<const Counter*> top_;
+  top_.reserve(heap_.size());
+  for (const uint32_t c_ : heap_) {
+    top_.push_back(&counters_[c_]);
+  }
+  k_ = std::min(k_, top_.size());
+  std::partial_sort(top_.begin(),
+                    top_.begin() + static_cast<std::ptrdiff_t>(k_),
+                    top_.end(),
+                    [](const Counter* a_, const Counter* b_) {
+                      return a_->count_ != b_->count_
+                               ? a_->count_ > b_->count_
+                               : a_->key_ < b_->key_;
+                    });
+  top_.resize(k_);
+  return top_;
+}
+
+/*!
+ * \return JSON-formated string: [{"key":"...","count":n,"error":n},...]
+ */
+std::string
+SLPSpaceSaving::toJson(size_t k_) const
+{
+  std::string out_ = "[";
+  for (const Counter* c_ : top(k_)) {
+    out_ += out_.size() > 1 ? ",{\"key\":" : "{\"key\":";
+    SLPJson::quote(out_, c_->key_);
+    out_ += ",\"count\":" + std::to_string(c_->count_) +
+            ",\"error\":" + std::to_string(c_->error_) + "}";
+  }
+  out_ += "]";
+  return out_;
+}
+
+uint32_t
+SLPSpaceSaving::find(std::string_view key_, uint64_t hash_) const noexcept
+{
+  const size_t mask_ = slots_.size() - 1;
+  for (size_t i_ = hash_ & mask_; slots_[i_] != empty_;
+       i_ = (i_ + 1) & mask_) {
+    const Counter& c_ = counters_[slots_[i_]];
+    if (c_.hash_ == hash_ && c_.key_ == key_) {
+      return slots_[i_];
+    }
+  }
+  return empty_;
+}
+
+void
+SLPSpaceSaving::insert(uint32_t c_) noexcept
+{
+  const size_t mask_ = slots_.size() - 1;
+  size_t i_ = counters_[c_].hash_ & mask_;
+  while (slots_[i_] != empty_) {
+    i_ = (i_ + 1) & mask_;
+  }
+  slots_[i_] = c_;
+}
+
+/*!
+ * \brief Removes the counter from the table, shifting back the counters
+ * after it that would no longer be found (no tombstones).
+ */
+void
+SLPSpaceSaving::erase(uint32_t c_) noexcept
+{
+  const size_t mask_ = slots_.size() - 1;
+  size_t i_ = counters_[c_].hash_ & mask_;
+  while (slots_[i_] != c_) {
+    i_ = (i_ + 1) & mask_;
+  }
+  for (size_t j_ = (i_ + 1) & mask_; slots_[j_] != empty_;
+       j_ = (j_ + 1) & mask_) {
+    // The counter at j_ moves to i_ if its home slot isn't in (i_, j_].
+    const size_t k_ = counters_[slots_[j_]].hash_ & mask_;
+    if (i_ < j_ ? (k_ <= i_ || k_ > j_) : (k_ <= i_ && k_ > j_)) {
+      slots_[i_] = slots_[j_];
+      i_ = j_;
+    }
+  }
+  slots_[i_] = empty_;
+}
+
+void
+SLPSpaceSaving::siftUp(size_t i_) noexcept
+{
+  while (i_ > 0) {
+    const size_t parent_ = (i_ - 1) / 2;
+    if (counters_[heap_[parent_]].count_ <= counters_[heap_[i_]].count_) {
+      break;
+    }
+    std::swap(heap_[parent_], heap_[i_]);
+    pos_[heap_[parent_]] = static_cast<uint32_t>(parent_);
+    pos_[heap_[i_]] = static_cast<uint32_t>(i_);
+    i_ = parent_;
+  }
+}
+
+void
+SLPSpaceSaving::siftDown(size_t i_) noexcept
+{
+  const size_t n_ = heap_.size();
+  for (;;) {
+    size_t min_ = i_;
+    for (const size_t child_ : { 2 * i_ + 1, 2 * i_ + 2 }) {
+      if (child_ < n_ && counters_[heap_[child_]].count_ <
+                           counters_[heap_[min_]].count_) {
+        min_ = child_;
+      }
+    }
+    if (min_ == i_) {
+      return;
+    }
+    std::swap(heap_[min_], heap_[i_]);
+    pos_[heap_[min_]] = static_cast<uint32_t>(min_);
+    pos_[heap_[i_]] = static_cast<uint32_t>(i_);
+    i_ = min_;
+  }
+}
+
+/* SLPBytesBy --------------------------------------------------------------- */
+
+/*!
+ * \brief Empties the table and sets its capacity, up to maxCapacity. The
+ * counters are allocated as the keys come.
+ */
+void
+SLPBytesBy::reserve(size_t n_) noexcept
+{
+  capacity_ = std::min(n_, maxCapacity);
+  clear();
+}
+
+/*!
+ * \brief Counts a request of the key, with its hash (SLPHash) and the bytes
+ * of the reply. The negative sizes are counted as 0 bytes.
+ */
+void
+SLPBytesBy::add(std::string_view key_, uint64_t hash_, int64_t bytes_)
+{
+  if (used_ < capacity_ && 2 * (used_ + 1) > slots_.size()) {
+    grow();
+  }
+
+  Counter* c_ = &overflow_;
+  if (!slots_.empty()) {
+    uint32_t& s_ = find(key_, hash_);
+    if (s_ == empty_ && used_ < capacity_) {
+      if (used_ == counters_.size()) {
+        counters_.emplace_back();
+      }
+      s_ = static_cast<uint32_t>(used_++);
+      Counter& n_ = counters_[s_];
+      n_.key_.assign(key_);
+      n_.hash_ = hash_;
+      n_.bytes_ = 0;
+      n_.requests_ = 0;
+    }
+    if (s_ != empty_) {
+      c_ = &counters_[s_];
+    }
+  }
+  c_->bytes_ += static_cast<uint64_t>(std::max<int64_t>(bytes_, 0));
+  ++c_->requests_;
+}
+
+void
+SLPBytesBy::clear() noexcept
+{
+  used_ = 0;
+  std::fill(slots_.begin(), slots_.end(), empty_);
+  overflow_ = {};
+  rejected_ = 0;
+}
+
+/*!
+ * \return JSON-formated string: {"keys":n,"bytes":n,"requests":n,
+ * "top":[{"key":"...","bytes":n,"requests":n},...],
+ * "other":{"keys":n,"bytes":n,"requests":n},
+ * "overflow":{"bytes":n,"requests":n},"rejected":n}. "top" has the n_ keys
+ * of the most bytes, in descending order, "other" the sums of the keys after
+ * them and "overflow" the sums of the keys that didn't fit in the table.
+ */
+std::string
+SLPBytesBy::toJson(size_t n_) const
+{
+  std::vector<const Counter*> top_;
+  top_.reserve(used_);
+  Counter all_ = overflow_;
+  for (size_t i_ = 0; i_ < used_; ++i_) {
+    top_.push_back(&counters_[i_]);
+    all_.bytes_ += counters_[i_].bytes_;
+    all_.requests_ += counters_[i_].requests_;
+  }
+  n_ = std::min(n_, top_.size());
+  std::partial_sort(top_.begin(),
+                    top_.begin() + static_cast<std::ptrdiff_t>(n_),
+                    top_.end(),
+                    [](const Counter* a_, const Counter* b_) {
+                      return a_->bytes_ != b_->bytes_
+                               ? a_->bytes_ > b_->bytes_
+                               : a_->key_ < b_->key_;
+                    });
+
+  Counter other_ = {};
+  for (size_t i_ = n_; i_ < top_.size(); ++i_) {
+    other_.bytes_ += top_[i_]->bytes_;
+    other_.requests_ += top_[i_]->requests_;
+  }
+
+  std::string out_ = "{\"keys\":" + std::to_string(used_) +
+                     ",\"bytes\":" + std::to_string(all_.bytes_) +
+                     ",\"requests\":" + std::to_string(all_.requests_) +
+                     ",\"top\":[";
+  for (size_t i_ = 0; i_ < n_; ++i_) {
+    out_ += i_ ? ",{\"key\":" : "{\"key\":";
+    SLPJson::quote(out_, top_[i_]->key_);
+    out_ += ",\"bytes\":" + std::to_string(top_[i_]->bytes_) +
+            ",\"requests\":" + std::to_string(top_[i_]->requests_) + "}";
+  }
+  out_ += "],\"other\":{\"keys\":" + std::to_string(top_.size() - n_) +
+          ",\"bytes\":" + std::to_string(other_.bytes_) +
+          ",\"requests\":" + std::to_string(other_.requests_) +
+          "},\"overflow\":{\"bytes\":" + std::to_string(overflow_.bytes_) +
+          ",\"requests\":" + std::to_string(overflow_.requests_) +
+          "},\"rejected\":" + std::to_string(rejected_) + "}";
+  return out_;
+}
+
+/*!
+ * \brief Slot of the key, or the empty slot where it goes.
+ */
+uint32_t&
+SLPBytesBy::find(std::string_view key_, uint64_t hash_) noexcept
+{
+  const size_t mask_ = slots_.size() - 1;
+  size_t i_ = hash_ & mask_;
+  while (slots_[i_] != empty_) {
+    const Counter& c_ = counters_[slots_[i_]];
+    if (c_.hash_ == hash_ && c_.key_ == key_) {
+      break;
+    }
+    i_ = (i_ + 1) & mask_;
+  }
+  return slots_[i_];
+}
+
+/*!
+ * \brief Doubles the table (at least 256 slots), so it's at most half full.
+ */
+void
+SLPBytesBy::grow()
+{
+  slots_.assign(std::max<size_t>(slots_.size() * 2, 256), empty_);
+  const size_t mask_ = slots_.size() - 1;
+  for (size_t c_ = 0; c_ < used_; ++c_) {
+    size_t i_ = counters_[c_].hash_ & mask_;
+    while (slots_[i_] != empty_) {
+      i_ = (i_ + 1) & mask_;
+    }
+    slots_[i_] = static_cast<uint32_t>(c_);
+  }
+}
+
+/* SLPJson ------------------------------------------------------------------ */
+
+/*!
+ * \brief Appends s_ to out_ as a JSON string: quoted, with the quotes, the
+ * backslashes and the control characters escaped.
+ */
+void
+SLPJson::quote(std::string& out_, std::string_view s_)
+{
+  static constexpr char hex_[] = "0123456789abcdef";
+  out_ += '"';
+  for (const char c_ : s_) {
+    const unsigned char u_ = static_cast<unsigned char>(c_);
+    if (c_ == '"' || c_ == '\\') {
+      out_ += '\\';
+      out_ += c_;
+    } else if (u_ < 0x20) {
+      out_ += "\\u00";
+      out_ += hex_[u_ >> 4];
+      out_ += hex_[u_ & 0x0f];
+    } else {
+      out_ += c_;
+    }
+  }
+  out_ += '"';
+}
+
+} // namespace squidlogparser
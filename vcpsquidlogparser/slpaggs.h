@@ -0,0 +1,524 @@
+/***************************************************************************
+ * Copyright (c) 2020-22                                                   *
+ *      Volnei Cervi Puttini.  All rights reserved.                        *
+ *      vcputtini@gmail.com
+ *                                                                         *
+ * Redistribution and use in source and binary forms, with or without      *
+ * modification, are permitted provided that the following conditions      *
+ * are met:                                                                *
+ * 1. Redistributions of source code must retain the above copyright       *
+ *    notice, this list of conditions and the following disclaimer.        *
+ * 2. Redistributions in binary form must reproduce the above copyright    *
+ *    notice, this list of conditions and the following disclaimer in the  *
+ *    documentation and/or other materials provided with the distribution. *
+ * 4. Neither the name of the Author     nor the names of its contributors *
+ *    may be used to endorse or promote products derived from this software*
+ *    without specific prior written permission.                           *
+ *                                                                         *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND *
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR      *
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS  *
+ * BE LIABLEFOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   *
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF    *
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS*
+ * INTERRUPTION)                                                           *
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,     *
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING   *
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE      *
+ * POSSIBILITY OFSUCH DAMAGE.                                              *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*!
+ * \brief How this file is organized:
+ *
+ * States of the aggregate UDF's that return a whole breakdown of the rows in
+ * one pass, instead of one value per scan of the table.
+ *
+ * They don't parse: the UDF parses the row once, with its long-lived parser,
+ * and hands the fields to add(). They don't allocate per row either, so the
+ * cost of a row is the parsing.
+ *
+ * class SLPMethodHistogram: requests (and bytes) per request method.
+ * class SLPStatusHistogram: requests per HTTP status (or status class).
+ * class SLPHitRatio: request and byte hit ratios of the cache, from the
+ *                    squid result codes (%Ss).
+ * class SLPLogHistogram: log-linear (HDR-style) histogram of non-negative
+ *                    integers, for the quantiles, in a fixed 30 KB.
+ * class SLPTimeSeries: requests, bytes, errors and response time per
+ *                    interval of time.
+ * class SLPSessions: sessions of the clients, split by an idle gap.
+ *
+ * Sketches, whose state can be exported as a BLOB and merged later:
+ *
+ * struct SLPHash: 64-bit hash of the keys of the sketches.
+ * class SLPHyperLogLog: approximate count of distinct keys in 16 KB.
+ * class SLPCountMin: approximate count of each key in 128 KB.
+ *
+ * Summaries of the keys, whose memory is bounded by their capacity:
+ *
+ * class SLPSpaceSaving: heavy hitters (top-k) by count or by weight.
+ * class SLPBytesBy: exact bytes and requests per key, up to a number of keys.
+ *
+ * struct SLPJson: quoting of the keys in the JSON results.
+ */
+
+#ifndef SLPAGGS_H
+#define SLPAGGS_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "squidlogparser.h"
+
+namespace squidlogparser {
+
+/* SLPMethodHistogram ------------------------------------------------------- */
+
+class SquidLogParser_EXPORT SLPMethodHistogram
+{
+public:
+  using MethodType = SquidLogData::MethodType;
+
+  static constexpr size_t nMethods =
+    static_cast<size_t>(MethodType::MTOthers) + 1;
+
+  void add(std::string_view method_, int64_t size_) noexcept;
+  void reject() noexcept { ++rejected_; }
+  void clear() noexcept;
+
+  uint64_t requests(MethodType m_) const noexcept;
+  uint64_t bytes(MethodType m_) const noexcept;
+  uint64_t rejected() const noexcept { return rejected_; }
+
+  std::string toJson(bool withBytes_) const;
+
+  static MethodType methodOf(std::string_view method_) noexcept;
+  static std::string_view nameOf(MethodType m_) noexcept;
+
+private:
+  std::array<uint64_t, nMethods> requests_ = {};
+  std::array<uint64_t, nMethods> bytes_ = {};
+  uint64_t rejected_ = 0; // lines that don't parse
+};
+
+/* SLPStatusHistogram ------------------------------------------------------- */
+
+class SquidLogParser_EXPORT SLPStatusHistogram
+{
+public:
+  static constexpr size_t nCodes = 600; // 000 .. 599
+
+  void add(int code_) noexcept;
+  void reject() noexcept { ++rejected_; }
+  void clear() noexcept;
+
+  uint64_t requests(int code_) const noexcept;
+  uint64_t other() const noexcept { return other_; }
+  uint64_t rejected() const noexcept { return rejected_; }
+
+  std::string toJson(bool byClass_) const;
+
+private:
+  std::array<uint64_t, nCodes> requests_ = {};
+  uint64_t other_ = 0;    // lines without a status in [0, nCodes)
+  uint64_t rejected_ = 0; // lines that don't parse
+};
+
+/* SLPHitRatio -------------------------------------------------------------- */
+
+class SquidLogParser_EXPORT SLPHitRatio
+{
+public:
+  /*!
+   * \warning Do not change the order of the objects defined below.
+   */
+  enum class Result
+  {
+    Hit = 0x00, // served from the cache
+    Miss,       // fetched from the origin (cacheable)
+    Other,      // denied, tunnels, redirects, NONE, unknown codes
+    Unknown
+  };
+
+  static constexpr size_t nResults = static_cast<size_t>(Result::Unknown);
+
+  void add(std::string_view code_, int64_t size_) noexcept;
+  void reject() noexcept { ++rejected_; }
+  void clear() noexcept;
+
+  uint64_t requests(Result r_) const noexcept;
+  uint64_t bytes(Result r_) const noexcept;
+  uint64_t rejected() const noexcept { return rejected_; }
+
+  double hitRatio() const noexcept;
+  double byteHitRatio() const noexcept;
+
+  std::string toJson(bool withBytes_) const;
+
+  static Result resultOf(std::string_view code_) noexcept;
+
+private:
+  std::array<uint64_t, nResults> requests_ = {};
+  std::array<uint64_t, nResults> bytes_ = {};
+  uint64_t rejected_ = 0; // lines that don't parse
+};
+
+/* SLPLogHistogram ---------------------------------------------------------- */
+
+/*!
+ * \brief The values below 2^precisionBits have a bucket each; above, each
+ * power of two is split in 2^(precisionBits - 1) buckets of equal width.
+ * A quantile is the middle of its bucket, so its relative error is at most
+ * relativeError (0.78%), whatever the range of the values.
+ */
+class SquidLogParser_EXPORT SLPLogHistogram
+{
+public:
+  static constexpr unsigned precisionBits = 7;
+  static constexpr size_t nBuckets =
+    (size_t(1) << precisionBits) +
+    (64 - precisionBits) * (size_t(1) << (precisionBits - 1));
+  static constexpr double relativeError = 1.0 / (1 << precisionBits);
+
+  void add(int64_t v_) noexcept;
+  void clear() noexcept;
+
+  uint64_t count() const noexcept { return count_; }
+  int64_t min() const noexcept { return min_; }
+  int64_t max() const noexcept { return max_; }
+  double quantile(double q_) const noexcept;
+
+  static size_t bucketOf(uint64_t v_) noexcept;
+  static uint64_t lowerOf(size_t b_) noexcept;
+
+private:
+  std::array<uint64_t, nBuckets> counts_ = {};
+  uint64_t count_ = 0;
+  int64_t min_ = 0;
+  int64_t max_ = 0;
+};
+
+/* SLPTimeSeries ------------------------------------------------------------ */
+
+/*!
+ * \brief Counters per interval of seconds() seconds, in a dense array from
+ * the interval of the first line to the one of the last. The lines are
+ * expected in time order, so the array grows at its end; a line before the
+ * first interval moves the array. A line that would make it longer than
+ * maxBuckets is counted in dropped().
+ */
+class SquidLogParser_EXPORT SLPTimeSeries
+{
+public:
+  struct Bucket
+  {
+    uint64_t requests_ = 0;
+    uint64_t bytes_ = 0;
+    uint64_t status4xx_ = 0;
+    uint64_t status5xx_ = 0;
+    uint64_t responseTime_ = 0; // sum
+  };
+
+  static constexpr size_t maxBuckets = 100000; // 4 MB
+
+  void setSeconds(uint32_t seconds_) noexcept;
+  void add(uint32_t ts_, int64_t bytes_, int status_, int64_t responseTime_);
+  void reject() noexcept { ++rejected_; }
+  void clear() noexcept;
+
+  uint32_t seconds() const noexcept { return seconds_; }
+  uint64_t dropped() const noexcept { return dropped_; }
+  uint64_t rejected() const noexcept { return rejected_; }
+
+  std::string toJson() const;
+
+private:
+  std::vector<Bucket> buckets_ = {};
+  uint64_t first_ = 0; // interval of buckets_[0]
+  uint32_t seconds_ = 60;
+  uint64_t dropped_ = 0;
+  uint64_t rejected_ = 0; // lines that don't parse
+};
+
+/* SLPSessions -------------------------------------------------------------- */
+
+/*!
+ * \brief Sessions of the clients: a client's session ends when it makes no
+ * request for more than gap() seconds. Each client has a slot of 32 bytes,
+ * in an open-addressing table of their hashes (SLPHash), with its last
+ * request and its current session; the sessions that end are only summed.
+ *
+ * The lines are expected in time order, but not strictly: a line older than
+ * the last request of its client is counted in the current session. The
+ * clients are told apart by their 64-bit hash only.
+ */
+class SquidLogParser_EXPORT SLPSessions
+{
+public:
+  void setGap(uint32_t gap_) noexcept;
+  void add(uint64_t hash_, uint32_t ts_, int64_t bytes_);
+  void reject() noexcept { ++rejected_; }
+  void clear() noexcept;
+
+  uint32_t gap() const noexcept { return gap_; }
+  uint64_t clients() const noexcept { return used_; }
+  uint64_t rejected() const noexcept { return rejected_; }
+
+  std::string toJson() const;
+
+private:
+  struct Slot
+  {
+    uint64_t hash_ = 0; // 0: empty
+    uint32_t first_ = 0;
+    uint32_t last_ = 0;
+    uint64_t requests_ = 0;
+    uint64_t bytes_ = 0;
+  };
+
+  // Sums of the sessions
+  struct Totals
+  {
+    uint64_t sessions_ = 0;
+    uint64_t duration_ = 0;
+    uint64_t requests_ = 0;
+    uint64_t bytes_ = 0;
+
+    void close(const Slot& s_) noexcept;
+  };
+
+  std::vector<Slot> slots_ = {};
+  size_t used_ = 0;
+  Totals closed_ = {};
+  uint32_t gap_ = 1800;
+  uint64_t rejected_ = 0; // lines that don't parse
+
+  Slot& find(uint64_t hash_) noexcept;
+  void grow();
+};
+
+/* SLPHash ------------------------------------------------------------------ */
+
+struct SquidLogParser_EXPORT SLPHash
+{
+  /*!
+   * \brief Finalizer of MurmurHash3: every bit of the input flips each bit
+   * of the output with a probability of about 1/2.
+   */
+  static constexpr uint64_t mix(uint64_t h_) noexcept
+  {
+    h_ ^= h_ >> 33;
+    h_ *= 0xff51afd7ed558ccdULL;
+    h_ ^= h_ >> 33;
+    h_ *= 0xc4ceb9fe1a85ec53ULL;
+    h_ ^= h_ >> 33;
+    return h_;
+  }
+
+  static uint64_t of(std::string_view s_) noexcept;
+  static uint64_t of(uint64_t v_) noexcept { return mix(v_); }
+};
+
+/* SLPHyperLogLog ----------------------------------------------------------- */
+
+/*!
+ * \brief HyperLogLog of 2^precision one-byte registers. The standard error
+ * of the estimate is 1.04 / sqrt(2^precision), i.e. 0.81%, from a few keys
+ * to billions (see estimate()).
+ *
+ * The BLOB (toBlob()) is a header of 8 bytes, "SLPH", the version and the
+ * precision, followed by the registers. Two sketches are merged by the
+ * maximum of each register, so a merge is the sketch of the union.
+ */
+class SquidLogParser_EXPORT SLPHyperLogLog
+{
+public:
+  static constexpr unsigned precision = 14;
+  static constexpr size_t nRegisters = size_t(1) << precision;
+  static constexpr size_t headerSize = 8;
+  static constexpr size_t blobSize = headerSize + nRegisters;
+
+  void add(uint64_t hash_) noexcept;
+  void merge(const SLPHyperLogLog& rhs_) noexcept;
+  bool merge(std::string_view blob_) noexcept;
+  void clear() noexcept;
+
+  uint64_t estimate() const noexcept;
+
+  std::string toBlob() const;
+  bool fromBlob(std::string_view blob_) noexcept;
+
+private:
+  std::array<uint8_t, nRegisters> registers_ = {};
+
+  static bool valid(std::string_view blob_) noexcept;
+};
+
+/* SLPCountMin -------------------------------------------------------------- */
+
+/*!
+ * \brief Count-Min sketch (Cormode and Muthukrishnan, 2005) of depth rows of
+ * width 64-bit counters. The count of a key is never under-estimated, and
+ * is over-estimated by at most e / width (0.066%) of the total with a
+ * probability of 1 - e^-depth (98%). With the conservative update of add(),
+ * the errors are usually much smaller.
+ *
+ * The BLOB (toBlob()) is a header of 16 bytes, "SLPC", the version, the
+ * depth, log2(width) and the total (little-endian), followed by the counters
+ * (little-endian), row by row. Two sketches are merged by the sum of each
+ * counter, so a merge is the sketch of both streams of keys.
+ */
+class SquidLogParser_EXPORT SLPCountMin
+{
+public:
+  static constexpr unsigned depth = 4;
+  static constexpr unsigned widthBits = 12;
+  static constexpr size_t width = size_t(1) << widthBits;
+  static constexpr size_t headerSize = 16;
+  static constexpr size_t blobSize = headerSize + depth * width * 8;
+
+  void add(uint64_t hash_, uint64_t count_ = 1) noexcept;
+  bool merge(std::string_view blob_) noexcept;
+  void clear() noexcept;
+
+  uint64_t estimate(uint64_t hash_) const noexcept;
+  uint64_t total() const noexcept { return total_; }
+
+  std::string toBlob() const;
+  static bool estimate(std::string_view blob_,
+                       uint64_t hash_,
+                       uint64_t& count_) noexcept;
+
+private:
+  std::array<uint64_t, depth * width> counters_ = {};
+  uint64_t total_ = 0;
+
+  static size_t slotOf(unsigned row_, uint64_t hash_) noexcept;
+  static bool valid(std::string_view blob_) noexcept;
+};
+
+/* SLPSpaceSaving ----------------------------------------------------------- */
+
+/*!
+ * \brief Space-Saving summary (Metwally et al., 2005) of at most capacity()
+ * keys: a key that isn't in a full summary replaces the one of the lowest
+ * count, and inherits its count as its error. The count of a key is then
+ * over-estimated by at most its error, which is at most total() /
+ * capacity(), and every key whose real count is above that is in the
+ * summary.
+ *
+ * The counts can be weights (e.g. bytes): a key is added with its weight.
+ *
+ * The counters are in a min-heap, so a row costs O(log capacity()), and are
+ * found by an open-addressing table of their indexes. A key is only copied
+ * when it enters the summary, into the memory of the key it replaces.
+ */
+class SquidLogParser_EXPORT SLPSpaceSaving
+{
+public:
+  struct Counter
+  {
+    std::string key_ = {};
+    uint64_t hash_ = 0;
+    uint64_t count_ = 0;
+    uint64_t error_ = 0; // count_ - error_ <= real count <= count_
+  };
+
+  static constexpr size_t maxCapacity = size_t(1) << 20;
+
+  void reserve(size_t n_);
+  void add(std::string_view key_, uint64_t hash_, uint64_t weight_);
+  void clear() noexcept;
+
+  size_t capacity() const noexcept { return capacity_; }
+  size_t size() const noexcept { return heap_.size(); }
+  uint64_t total() const noexcept { return total_; }
+
+  std::vector<const Counter*> top(size_t k_) const;
+  std::string toJson(size_t k_) const;
+
+private:
+  static constexpr uint32_t empty_ = UINT32_MAX;
+
+  std::vector<Counter> counters_ = {}; // never reallocated after reserve()
+  std::vector<uint32_t> heap_ = {};    // indexes of counters_, by count_
+  std::vector<uint32_t> pos_ = {};     // position in heap_ of each counter
+  std::vector<uint32_t> slots_ = {};   // indexes of counters_, by hash_
+  size_t capacity_ = 0;
+  uint64_t total_ = 0;
+
+  uint32_t find(std::string_view key_, uint64_t hash_) const noexcept;
+  void insert(uint32_t c_) noexcept;
+  void erase(uint32_t c_) noexcept;
+  void siftUp(size_t i_) noexcept;
+  void siftDown(size_t i_) noexcept;
+};
+
+/* SLPBytesBy --------------------------------------------------------------- */
+
+/*!
+ * \brief Bytes and requests of each key (e.g. mime type, client), exact, in
+ * 64-bit totals, up to capacity() keys. The rows of the keys that come after
+ * the table is full are summed in an overflow bucket, so the totals of the
+ * whole are still exact.
+ *
+ * The counters are found by an open-addressing table of their indexes, which
+ * grows with the keys, at most half full. The memory of the keys is kept by
+ * clear(), for the next group.
+ */
+class SquidLogParser_EXPORT SLPBytesBy
+{
+public:
+  struct Counter
+  {
+    std::string key_ = {};
+    uint64_t hash_ = 0;
+    uint64_t bytes_ = 0;
+    uint64_t requests_ = 0;
+  };
+
+  static constexpr size_t maxCapacity = size_t(1) << 20;
+
+  void reserve(size_t n_) noexcept;
+  void add(std::string_view key_, uint64_t hash_, int64_t bytes_);
+  void reject() noexcept { ++rejected_; }
+  void clear() noexcept;
+
+  size_t capacity() const noexcept { return capacity_; }
+  size_t size() const noexcept { return used_; }
+
+  std::string toJson(size_t n_) const;
+
+private:
+  static constexpr uint32_t empty_ = UINT32_MAX;
+
+  std::vector<Counter> counters_ = {}; // [0, used_) are in use
+  std::vector<uint32_t> slots_ = {};   // indexes of counters_, by hash_
+  size_t used_ = 0;
+  size_t capacity_ = 0;
+  Counter overflow_ = {}; // keys that didn't fit
+  uint64_t rejected_ = 0; // lines that don't parse
+
+  uint32_t& find(std::string_view key_, uint64_t hash_) noexcept;
+  void grow();
+};
+
+/* SLPJson ------------------------------------------------------------------ */
+
+struct SquidLogParser_EXPORT SLPJson
+{
+  static void quote(std::string& out_, std::string_view s_);
+};
+
+} // namespace squidlogparser
+
+#endif // SLPAGGS_H
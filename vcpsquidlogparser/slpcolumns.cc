@@ -0,0 +1,467 @@
+/***************************************************************************
+ * Copyright (c) 2020-22                                                   *
+ *      Volnei Cervi Puttini.  All rights reserved.                        *
+ *      vcputtini@gmail.com
+ *                                                                         *
+ * Redistribution and use in source and binary forms, with or without      *
+ * modification, are permitted provided that the following conditions      *
+ * are met:                                                                *
+ * 1. Redistributions of source code must retain the above copyright       *
+ *    notice, this list of conditions and the following disclaimer.        *
+ * 2. Redistributions in binary form must reproduce the above copyright    *
+ *    notice, this list of conditions and the following disclaimer in the  *
+ *    documentation and/or other materials provided with the distribution. *
+ * 4. Neither the name of the Author     nor the names of its contributors *
+ *    may be used to endorse or promote products derived from this software*
+ *    without specific prior written permission.                           *
+ *                                                                         *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND *
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR      *
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS  *
+ * BE LIABLEFOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   *
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF    *
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS*
+ * INTERRUPTION)                                                           *
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,     *
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING   *
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE      *
+ * POSSIBILITY OFSUCH DAMAGE.                                              *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "slpcolumns.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <numeric>
+#include <type_traits>
+#include <unistd.h>
+
+namespace squidlogparser {
+
+/* Dict --------------------------------------------------------------------- */
+
+uint32_t
+SLPColumnStore::Dict::intern(std::string_view s_)
+{
+  if (const auto it_ = index_.find(s_); it_ != index_.end()) {
+    return it_->second;
+  }
+  const auto code_ = static_cast<uint32_t>(values_.size());
+  values_.emplace_back(s_);
+  index_.emplace(values_.back(), code_);
+  return code_;
+}
+
+std::string_view
+SLPColumnStore::Dict::at(uint32_t c_) const noexcept
+{
+  if (offsets_ != nullptr) {
+    return { text_ + offsets_[c_],
+             static_cast<size_t>(offsets_[c_ + 1] - offsets_[c_]) };
+  }
+  return values_[c_];
+}
+
+/* SLPColumnStore ----------------------------------------------------------- */
+
+SLPColumnStore::SLPColumnStore(LogFormat f_)
+  : fmt_(f_)
+{}
+
+/*!
+ * \brief Appends the line just parsed by p_.
+ * \warning Only while building, not to a store loaded from a file.
+ */
+void
+SLPColumnStore::append(const SLPRowParser& p_)
+{
+  const uint32_t ts_ = p_.timestamp();
+  if (!this->ts_.own_.empty() && ts_ < this->ts_.own_.back()) {
+    sorted_ = false;
+  }
+  this->ts_.own_.push_back(ts_);
+  ip_.own_.push_back(p_.getPartUInt(Fields::CliSrcIpAddr));
+  rt_.own_.push_back(p_.getPartInt(Fields::ResponseTime));
+  status_.own_.push_back(p_.httpStatus());
+  bytes_.own_.push_back(p_.getPartInt(Fields::TotalSizeReply));
+
+  for (size_t c_ = 0; c_ < nColumns; ++c_) {
+    const std::string s_ = p_.getPartStr(fieldOf(static_cast<Column>(c_)));
+    codes_[c_].own_.push_back(dicts_[c_].intern(s_));
+  }
+}
+
+/*!
+ * \brief Appends all the rows of rhs_ (e.g. the batch of another thread).
+ * The codes of rhs_ are translated to the dictionaries of this store.
+ * \warning Only while building, not to a store loaded from a file.
+ */
+void
+SLPColumnStore::append(const SLPColumnStore& rhs_)
+{
+  const size_t n_ = rhs_.size();
+  if (n_ == 0) {
+    return;
+  }
+  sorted_ = sorted_ && rhs_.sorted_ &&
+            (ts_.own_.empty() || ts_.own_.back() <= rhs_.timestamp(0));
+
+  auto copy_ = [n_](auto& dst_, const auto& src_) {
+    dst_.own_.insert(dst_.own_.end(), src_.data(), src_.data() + n_);
+  };
+  copy_(ts_, rhs_.ts_);
+  copy_(ip_, rhs_.ip_);
+  copy_(rt_, rhs_.rt_);
+  copy_(status_, rhs_.status_);
+  copy_(bytes_, rhs_.bytes_);
+
+  std::vector<uint32_t> map_;
+  for (size_t c_ = 0; c_ < nColumns; ++c_) {
+    const Dict& from_ = rhs_.dicts_[c_];
+    map_.resize(from_.size());
+    for (size_t k_ = 0; k_ < map_.size(); ++k_) {
+      map_[k_] = dicts_[c_].intern(from_.at(static_cast<uint32_t>(k_)));
+    }
+    const uint32_t* src_ = rhs_.codes_[c_].data();
+    std::vector<uint32_t>& dst_ = codes_[c_].own_;
+    dst_.reserve(dst_.size() + n_);
+    for (size_t i_ = 0; i_ < n_; ++i_) {
+      dst_.push_back(map_[src_[i_]]);
+    }
+  }
+}
+
+/*!
+ * \brief Sorts the rows by timestamp. The sort is stable, so the rows of the
+ * same second stay in the order they were appended.
+ */
+void
+SLPColumnStore::sort()
+{
+  if (sorted_ || mapped()) {
+    return;
+  }
+
+  std::vector<uint32_t> order_(size());
+  std::iota(order_.begin(), order_.end(), 0U);
+  const uint32_t* ts_ = this->ts_.own_.data();
+  std::stable_sort(
+    order_.begin(), order_.end(), [ts_](uint32_t a_, uint32_t b_) {
+      return ts_[a_] < ts_[b_];
+    });
+
+  auto permute_ = [&order_](auto& col_) {
+    auto tmp_ = col_.own_;
+    for (size_t i_ = 0; i_ < order_.size(); ++i_) {
+      tmp_[i_] = col_.own_[order_[i_]];
+    }
+    col_.own_.swap(tmp_);
+  };
+  permute_(this->ts_);
+  permute_(ip_);
+  permute_(rt_);
+  permute_(status_);
+  permute_(bytes_);
+  for (auto& c_ : codes_) {
+    permute_(c_);
+  }
+  sorted_ = true;
+}
+
+void
+SLPColumnStore::clear()
+{
+  auto reset_ = [](auto& col_) {
+    col_.own_.clear();
+    col_.view_ = nullptr;
+    col_.count_ = 0;
+  };
+  reset_(ts_);
+  reset_(ip_);
+  reset_(rt_);
+  reset_(status_);
+  reset_(bytes_);
+  for (size_t c_ = 0; c_ < nColumns; ++c_) {
+    reset_(codes_[c_]);
+    dicts_[c_] = Dict();
+  }
+  map_.close();
+  sorted_ = true;
+  error_.clear();
+}
+
+/*!
+ * \brief Writes the store to path_ (to a temporary file renamed into place).
+ * \note It's usually sorted first, see range().
+ */
+bool
+SLPColumnStore::save(const std::string& path_) const
+{
+  const size_t n_ = size();
+  std::vector<std::string_view> parts_; // in the order of the sections
+  std::vector<std::vector<uint64_t>> offsets_(nColumns);
+  std::vector<std::string> text_(nColumns);
+
+  parts_.emplace_back(reinterpret_cast<const char*>(ts_.data()), n_ * 4);
+  parts_.emplace_back(reinterpret_cast<const char*>(ip_.data()), n_ * 4);
+  parts_.emplace_back(reinterpret_cast<const char*>(rt_.data()), n_ * 4);
+  parts_.emplace_back(reinterpret_cast<const char*>(status_.data()), n_ * 4);
+  parts_.emplace_back(reinterpret_cast<const char*>(bytes_.data()), n_ * 8);
+
+  for (size_t c_ = 0; c_ < nColumns; ++c_) {
+    const Dict& d_ = dicts_[c_];
+    offsets_[c_].push_back(0);
+    for (size_t k_ = 0; k_ < d_.size(); ++k_) {
+      text_[c_] += d_.at(static_cast<uint32_t>(k_));
+      offsets_[c_].push_back(text_[c_].size());
+    }
+    parts_.emplace_back(reinterpret_cast<const char*>(codes_[c_].data()),
+                        n_ * 4);
+    parts_.emplace_back(reinterpret_cast<const char*>(offsets_[c_].data()),
+                        offsets_[c_].size() * 8);
+    parts_.emplace_back(text_[c_]);
+  }
+
+  auto align_ = [](uint64_t v_) {
+    return (v_ + alignment - 1) / alignment * alignment;
+  };
+
+  Header h_ = {};
+  std::memcpy(h_.magic_, magic, sizeof(magic));
+  h_.format_ = static_cast<uint32_t>(fmt_);
+  h_.sorted_ = sorted_ ? 1 : 0;
+  h_.rows_ = n_;
+  uint64_t at_ = align_(sizeof(Header));
+  for (size_t s_ = 0; s_ < nSections; ++s_) {
+    h_.sections_[s_] = { at_, parts_[s_].size() };
+    at_ = align_(at_ + parts_[s_].size());
+  }
+
+  const std::string tmp_ = path_ + ".tmp";
+  FILE* f_ = std::fopen(tmp_.c_str(), "wb");
+  if (f_ == nullptr) {
+    error_ = tmp_ + ": " + std::strerror(errno);
+    return false;
+  }
+  static const char zeros_[alignment] = {};
+  uint64_t pos_ = sizeof(Header);
+  bool ok_ = std::fwrite(&h_, sizeof(h_), 1, f_) == 1;
+  for (size_t s_ = 0; ok_ && s_ < nSections; ++s_) {
+    const size_t pad_ = static_cast<size_t>(h_.sections_[s_].offset_ - pos_);
+    ok_ = std::fwrite(zeros_, 1, pad_, f_) == pad_ &&
+          std::fwrite(parts_[s_].data(), 1, parts_[s_].size(), f_) ==
+            parts_[s_].size();
+    pos_ = h_.sections_[s_].offset_ + parts_[s_].size();
+  }
+  ok_ = ok_ && std::fflush(f_) == 0 && ::fsync(::fileno(f_)) == 0;
+  ok_ = std::fclose(f_) == 0 && ok_;
+  if (!ok_ || std::rename(tmp_.c_str(), path_.c_str()) != 0) {
+    error_ = path_ + ": " + std::strerror(errno);
+    std::remove(tmp_.c_str());
+    return false;
+  }
+  return true;
+}
+
+/*!
+ * \brief Maps a file written by save(). The columns are used in place, so
+ * the store is read-only until clear(). The sections and the codes are
+ * checked, so a corrupted file is rejected rather than read out of bounds.
+ * \return false if it can't be read or isn't a valid store, see error().
+ */
+bool
+SLPColumnStore::load(const std::string& path_)
+{
+  clear();
+  if (!map_.open(path_)) {
+    error_ = map_.error();
+    return false;
+  }
+
+  const std::string_view all_ = map_.view();
+  Header h_ = {};
+  if (all_.size() >= sizeof(Header)) {
+    std::memcpy(&h_, all_.data(), sizeof(Header));
+  }
+  if (std::memcmp(h_.magic_, magic, sizeof(magic)) != 0) {
+    error_ = path_ + ": not a column store";
+    map_.close();
+    return false;
+  }
+
+  const uint64_t n_ = h_.rows_;
+  size_t s_ = 0;
+  bool ok_ = true;
+  // bytes_ / width_: width_ * count_ wraps for a hostile rows_ (2^62 * 4).
+  auto section_ = [&](size_t width_, uint64_t count_) -> const char* {
+    const Section& x_ = h_.sections_[s_++];
+    ok_ = ok_ && x_.offset_ % alignment == 0 && x_.offset_ <= all_.size() &&
+          x_.bytes_ <= all_.size() - x_.offset_ &&
+          x_.bytes_ % width_ == 0 && x_.bytes_ / width_ == count_;
+    return ok_ ? all_.data() + x_.offset_ : nullptr;
+  };
+  auto bind_ = [&](auto& col_) {
+    using T = std::remove_const_t<
+      std::remove_pointer_t<decltype(col_.view_)>>;
+    col_.view_ = reinterpret_cast<const T*>(section_(sizeof(T), n_));
+    col_.count_ = n_;
+  };
+
+  bind_(ts_);
+  bind_(ip_);
+  bind_(rt_);
+  bind_(status_);
+  bind_(bytes_);
+  for (size_t c_ = 0; c_ < nColumns && ok_; ++c_) {
+    bind_(codes_[c_]);
+    const uint64_t offsets_bytes_ = h_.sections_[s_].bytes_;
+    if (offsets_bytes_ < 8 || offsets_bytes_ % 8 != 0) {
+      ok_ = false;
+      break;
+    }
+    Dict& d_ = dicts_[c_];
+    d_.count_ = offsets_bytes_ / 8 - 1;
+    d_.offsets_ =
+      reinterpret_cast<const uint64_t*>(section_(8, d_.count_ + 1));
+    if (!ok_) {
+      break;
+    }
+    d_.text_ = section_(1, d_.offsets_[d_.count_]);
+    for (size_t k_ = 0; ok_ && k_ < d_.count_; ++k_) {
+      ok_ = d_.offsets_[k_] <= d_.offsets_[k_ + 1];
+    }
+    // str() doesn't check the codes: every one must be in the dictionary.
+    const uint32_t* codes_of_ = codes_[c_].data();
+    for (uint64_t i_ = 0; ok_ && i_ < n_; ++i_) {
+      ok_ = codes_of_[i_] < d_.count_;
+    }
+  }
+  ok_ = ok_ && h_.format_ < static_cast<uint32_t>(LogFormat::Unknown);
+
+  if (!ok_) {
+    clear();
+    error_ = path_ + ": corrupted column store";
+    return false;
+  }
+  fmt_ = static_cast<LogFormat>(h_.format_);
+  sorted_ = h_.sorted_ != 0;
+  return true;
+}
+
+const uint32_t*
+SLPColumnStore::codes(Column c_) const noexcept
+{
+  return codes_[static_cast<size_t>(c_)].data();
+}
+
+std::string_view
+SLPColumnStore::str(Column c_, size_t i_) const noexcept
+{
+  const size_t k_ = static_cast<size_t>(c_);
+  return dicts_[k_].at(codes_[k_].data()[i_]);
+}
+
+size_t
+SLPColumnStore::cardinality(Column c_) const noexcept
+{
+  return dicts_[static_cast<size_t>(c_)].size();
+}
+
+std::string_view
+SLPColumnStore::value(Column c_, uint32_t code_) const noexcept
+{
+  return dicts_[static_cast<size_t>(c_)].at(code_);
+}
+
+/*!
+ * \brief Code of a value, to compare the column as integers.
+ * \return false if no row has the value.
+ */
+bool
+SLPColumnStore::find(Column c_, std::string_view s_, uint32_t& code_) const
+{
+  const Dict& d_ = dicts_[static_cast<size_t>(c_)];
+  if (d_.offsets_ == nullptr) {
+    const auto it_ = d_.index_.find(s_);
+    if (it_ == d_.index_.end()) {
+      return false;
+    }
+    code_ = it_->second;
+    return true;
+  }
+  for (size_t k_ = 0; k_ < d_.count_; ++k_) {
+    if (d_.at(static_cast<uint32_t>(k_)) == s_) {
+      code_ = static_cast<uint32_t>(k_);
+      return true;
+    }
+  }
+  return false;
+}
+
+/*!
+ * \brief Rows [first, second) of the time window [from_, to_], by binary
+ * search.
+ * \note If the store isn't sorted(), all the rows.
+ */
+std::pair<size_t, size_t>
+SLPColumnStore::range(uint32_t from_, uint32_t to_) const
+{
+  if (!sorted_) {
+    return { 0, size() };
+  }
+  const uint32_t* b_ = ts_.data();
+  const uint32_t* e_ = b_ + size();
+  const uint32_t* lo_ = std::lower_bound(b_, e_, from_);
+  const uint32_t* hi_ = std::upper_bound(lo_, e_, to_);
+  return { static_cast<size_t>(lo_ - b_), static_cast<size_t>(hi_ - b_) };
+}
+
+SLPColumnStore::Fields
+SLPColumnStore::fieldOf(Column c_) noexcept
+{
+  switch (c_) {
+    case Column::Method: {
+      return Fields::ReqMethod;
+    }
+    case Column::Url: {
+      return Fields::ReqURL;
+    }
+    case Column::ProtoVersion: {
+      return Fields::ReqProtoVersion;
+    }
+    case Column::User: {
+      return Fields::UserName;
+    }
+    case Column::UserIdent: {
+      return Fields::UserNameIdent;
+    }
+    case Column::ReqStatus: {
+      return Fields::ReqStatusHierStatus;
+    }
+    case Column::HierStatus: {
+      return Fields::HierStatusIpAddress;
+    }
+    case Column::MimeType: {
+      return Fields::MimeContentType;
+    }
+    case Column::Referrer: {
+      return Fields::Referrer;
+    }
+    case Column::UserAgent: {
+      return Fields::UserAgent;
+    }
+    default: {
+      return Fields::Unknown;
+    }
+  }
+}
+
+} // namespace squidlogparser
@@ -0,0 +1,234 @@
+/***************************************************************************
+ * Copyright (c) 2020-22                                                   *
+ *      Volnei Cervi Puttini.  All rights reserved.                        *
+ *      vcputtini@gmail.com
+ *                                                                         *
+ * Redistribution and use in source and binary forms, with or without      *
+ * modification, are permitted provided that the following conditions      *
+ * are met:                                                                *
+ * 1. Redistributions of source code must retain the above copyright       *
+ *    notice, this list of conditions and the following disclaimer.        *
+ * 2. Redistributions in binary form must reproduce the above copyright    *
+ *    notice, this list of conditions and the following disclaimer in the  *
+ *    documentation and/or other materials provided with the distribution. *
+ * 4. Neither the name of the Author     nor the names of its contributors *
+ *    may be used to endorse or promote products derived from this software*
+ *    without specific prior written permission.                           *
+ *                                                                         *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND *
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR      *
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS  *
+ * BE LIABLEFOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   *
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF    *
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS*
+ * INTERRUPTION)                                                           *
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,     *
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING   *
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE      *
+ * POSSIBILITY OFSUCH DAMAGE.                                              *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*!
+ * \brief How this file is organized:
+ *
+ * Columnar store of parsed log lines, for batch use of the parser.
+ *
+ * SquidLogParser keeps its entries in a multimap: a tree node and seventeen
+ * strings per line. That's what the per-row UDF's need (one line at a time),
+ * but for millions of lines it's pointer chasing and allocations. The store
+ * keeps the lines as a struct of arrays instead:
+ * - the numeric fields in contiguous arrays;
+ * - the string fields as 32-bit codes into a dictionary per column, so a
+ *   repeated value (method, status, user, mime type ...) is kept once and
+ *   compared as an integer.
+ *
+ * Sorted by timestamp (stable, i.e. in the order of the input for the same
+ * second, like the multimap) it can be saved to a file, which is loaded by
+ * mapping it: the arrays are used where they are in the mapping, so loading
+ * takes no time and no memory of its own.
+ *
+ * Layout of the file (native byte order, every section aligned to 64 bytes):
+ * \verbatim
+ * Header:  magic "SLPCOLS1", format, rows, sorted, (offset, bytes) of each
+ *          section
+ * Numeric: one section per column
+ * String:  codes (uint32), dictionary offsets (uint64, count + 1) and
+ *          dictionary text, per column
+ * \endverbatim
+ *
+ * class SLPColumnStore
+ */
+
+#ifndef SLPCOLUMNS_H
+#define SLPCOLUMNS_H
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "slpscan.h"
+#include "squidlogparser.h"
+
+namespace squidlogparser {
+
+class SquidLogParser_EXPORT SLPColumnStore
+{
+public:
+  using LogFormat = SquidLogData::LogFormat;
+  using Fields = SquidLogData::Fields;
+
+  /*!
+   * \brief String columns.
+   * \warning Do not change the order of the objects defined below.
+   */
+  enum class Column
+  {
+    Method = 0x00,
+    Url,
+    ProtoVersion,
+    User,
+    UserIdent,
+    ReqStatus,
+    HierStatus,
+    MimeType,
+    Referrer,
+    UserAgent,
+    Unknown
+  };
+
+  static constexpr size_t nColumns = static_cast<size_t>(Column::Unknown);
+
+  explicit SLPColumnStore(LogFormat f_ = LogFormat::Squid);
+
+  SLPColumnStore(const SLPColumnStore&) = delete;
+  SLPColumnStore& operator=(const SLPColumnStore&) = delete;
+  SLPColumnStore(SLPColumnStore&&) = default;
+  SLPColumnStore& operator=(SLPColumnStore&&) = default;
+
+  void append(const SLPRowParser& p_);
+  void append(const SLPColumnStore& rhs_);
+  void sort();
+  void clear();
+
+  bool save(const std::string& path_) const;
+  bool load(const std::string& path_);
+
+  LogFormat format() const noexcept { return fmt_; }
+  size_t size() const noexcept { return ts_.size(); }
+  bool empty() const noexcept { return size() == 0; }
+  bool sorted() const noexcept { return sorted_; }
+  bool mapped() const noexcept { return map_.isOpen(); }
+  const std::string& error() const noexcept { return error_; }
+
+  // Whole columns, for the scans.
+  const uint32_t* timestamps() const noexcept { return ts_.data(); }
+  const uint32_t* clientIps() const noexcept { return ip_.data(); }
+  const int32_t* responseTimes() const noexcept { return rt_.data(); }
+  const int32_t* httpStatuses() const noexcept { return status_.data(); }
+  const int64_t* sizes() const noexcept { return bytes_.data(); }
+  const uint32_t* codes(Column c_) const noexcept;
+
+  // One row.
+  uint32_t timestamp(size_t i_) const noexcept { return ts_.data()[i_]; }
+  uint32_t clientIp(size_t i_) const noexcept { return ip_.data()[i_]; }
+  int32_t responseTime(size_t i_) const noexcept { return rt_.data()[i_]; }
+  int32_t httpStatus(size_t i_) const noexcept { return status_.data()[i_]; }
+  int64_t totalSizeReply(size_t i_) const noexcept
+  {
+    return bytes_.data()[i_];
+  }
+  std::string_view str(Column c_, size_t i_) const noexcept;
+
+  // Dictionaries.
+  size_t cardinality(Column c_) const noexcept;
+  std::string_view value(Column c_, uint32_t code_) const noexcept;
+  bool find(Column c_, std::string_view s_, uint32_t& code_) const;
+
+  std::pair<size_t, size_t> range(uint32_t from_, uint32_t to_) const;
+
+  static Fields fieldOf(Column c_) noexcept;
+
+private:
+  /*!
+   * \brief Array that is either owned (while building) or a view into the
+   * mapping of a loaded file.
+   */
+  template<typename T>
+  struct Array
+  {
+    std::vector<T> own_ = {};
+    const T* view_ = nullptr;
+    size_t count_ = 0;
+
+    const T* data() const noexcept { return view_ ? view_ : own_.data(); }
+    size_t size() const noexcept { return view_ ? count_ : own_.size(); }
+  };
+
+  struct Dict
+  {
+    // Building: the values (stable addresses, the index points into them).
+    std::deque<std::string> values_ = {};
+    std::unordered_map<std::string_view, uint32_t> index_ = {};
+
+    // Loaded: offsets (count + 1) into the text.
+    const uint64_t* offsets_ = nullptr;
+    const char* text_ = nullptr;
+    size_t count_ = 0;
+
+    uint32_t intern(std::string_view s_);
+    std::string_view at(uint32_t c_) const noexcept;
+    size_t size() const noexcept
+    {
+      return offsets_ ? count_ : values_.size();
+    }
+  };
+
+  struct Section
+  {
+    uint64_t offset_;
+    uint64_t bytes_;
+  };
+
+  static constexpr size_t nNumeric = 5;
+  static constexpr size_t nSections = nNumeric + 3 * nColumns;
+  static constexpr size_t alignment = 64;
+
+  struct Header
+  {
+    char magic_[8];
+    uint32_t format_;
+    uint32_t sorted_;
+    uint64_t rows_;
+    Section sections_[nSections];
+  };
+
+  static constexpr char magic[8] = { 'S', 'L', 'P', 'C', 'O', 'L', 'S', '1' };
+
+  LogFormat fmt_;
+  bool sorted_ = true;
+
+  Array<uint32_t> ts_;
+  Array<uint32_t> ip_;
+  Array<int32_t> rt_;
+  Array<int32_t> status_;
+  Array<int64_t> bytes_;
+  Array<uint32_t> codes_[nColumns];
+  Dict dicts_[nColumns];
+
+  SLPMappedFile map_;
+  mutable std::string error_ = {};
+};
+
+} // namespace squidlogparser
+
+#endif // SLPCOLUMNS_H
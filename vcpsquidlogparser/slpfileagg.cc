@@ -0,0 +1,668 @@
+/***************************************************************************
+ * Copyright (c) 2020-22                                                   *
+ *      Volnei Cervi Puttini.  All rights reserved.                        *
+ *      vcputtini@gmail.com
+ *                                                                         *
+ * Redistribution and use in source and binary forms, with or without      *
+ * modification, are permitted provided that the following conditions      *
+ * are met:                                                                *
+ * 1. Redistributions of source code must retain the above copyright       *
+ *    notice, this list of conditions and the following disclaimer.        *
+ * 2. Redistributions in binary form must reproduce the above copyright    *
+ *    notice, this list of conditions and the following disclaimer in the  *
+ *    documentation and/or other materials provided with the distribution. *
+ * 4. Neither the name of the Author     nor the names of its contributors *
+ *    may be used to endorse or promote products derived from this software*
+ *    without specific prior written permission.                           *
+ *                                                                         *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND *
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR      *
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS  *
+ * BE LIABLEFOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   *
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF    *
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS*
+ * INTERRUPTION)                                                           *
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,     *
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING   *
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE      *
+ * POSSIBILITY OFSUCH DAMAGE.                                              *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "slpfileagg.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <sys/stat.h>
+#include <thread>
+
+#include "slpstats.h"
+#include "slpzonemap.h"
+
+/*!
+ * \brief Directory of the files of slp_file_agg(), unless SLP_FILE_DIR is
+ * set in the environment of the server. Empty: disabled.
+ * \note Defined in CMakeLists.txt
+ */
+#ifndef SLP_FILE_DIR
+#define SLP_FILE_DIR ""
+#endif
+
+namespace squidlogparser {
+
+/* SLPFileFilter ------------------------------------------------------------ */
+
+/*!
+ * \brief Splits "field OP value", e.g. "http_status>=500" or
+ * "request_method = 'POST'". The quotes around the value are optional.
+ * \return false if there's no valid operator.
+ */
+bool
+SLPFileFilter::split(std::string_view expr_,
+                     std::string& name_,
+                     Op& op_,
+                     std::string& value_)
+{
+  static constexpr std::string_view ops_ = "=!<>";
+  static constexpr std::string_view blanks_ = " \t";
+
+  const size_t begin_ = expr_.find_first_of(ops_);
+  if (begin_ == std::string_view::npos) {
+    return false;
+  }
+  size_t end_ = expr_.find_first_not_of(ops_, begin_);
+  if (end_ == std::string_view::npos) {
+    end_ = expr_.size();
+  }
+
+  const std::string_view op_text_ = expr_.substr(begin_, end_ - begin_);
+  if (op_text_ == "=" || op_text_ == "==") {
+    op_ = Op::Eq;
+  } else if (op_text_ == "!=" || op_text_ == "<>") {
+    op_ = Op::Ne;
+  } else if (op_text_ == "<") {
+    op_ = Op::Lt;
+  } else if (op_text_ == "<=") {
+    op_ = Op::Le;
+  } else if (op_text_ == ">") {
+    op_ = Op::Gt;
+  } else if (op_text_ == ">=") {
+    op_ = Op::Ge;
+  } else {
+    return false;
+  }
+
+  auto trim_ = [](std::string_view s_) {
+    const size_t b_ = s_.find_first_not_of(blanks_);
+    if (b_ == std::string_view::npos) {
+      return std::string_view{};
+    }
+    return s_.substr(b_, s_.find_last_not_of(blanks_) - b_ + 1);
+  };
+
+  name_ = std::string(trim_(expr_.substr(0, begin_)));
+  std::string_view value_text_ = trim_(expr_.substr(end_));
+  if (value_text_.size() >= 2 &&
+      (value_text_.front() == '\'' || value_text_.front() == '"') &&
+      value_text_.back() == value_text_.front()) {
+    value_text_ = value_text_.substr(1, value_text_.size() - 2);
+  }
+  value_ = std::string(value_text_);
+  return !name_.empty();
+}
+
+/* SLPFileAgg --------------------------------------------------------------- */
+
+void
+SLPFileAgg::Result::merge(const Result& rhs_) noexcept
+{
+  lines_ += rhs_.lines_;
+  rejected_ += rhs_.rejected_;
+  matched_ += rhs_.matched_;
+  values_ += rhs_.values_;
+  bytes_ += rhs_.bytes_;
+  sum_ += rhs_.sum_;
+  min_ = std::min(min_, rhs_.min_);
+  max_ = std::max(max_, rhs_.max_);
+}
+
+SLPFileAgg::SLPFileAgg(LogFormat f_, Agg a_, Fields field_)
+  : fmt_(f_)
+  , agg_(a_)
+  , field_(field_)
+{}
+
+/*!
+ * \brief Adds a condition that all the lines aggregated must meet.
+ * \param value_ Number for the numeric fields (the client address can also
+ * be dotted-decimal), text for the others.
+ * \return false if the value isn't valid for the field, see error().
+ */
+bool
+SLPFileAgg::addFilter(Fields f_, Op op_, const std::string& value_)
+{
+  SLPFileFilter flt_;
+  flt_.field_ = f_;
+  flt_.op_ = op_;
+  flt_.text_ = value_;
+
+  if (isNumeric(f_)) {
+    if (f_ == Fields::CliSrcIpAddr &&
+        value_.find('.') != std::string::npos) {
+      flt_.num_ = IPv4Addr::iptol(value_);
+    } else {
+      errno = 0;
+      char* end_ = nullptr;
+      const long long n_ = std::strtoll(value_.c_str(), &end_, 10);
+      if (value_.empty() || *end_ != '\0' || errno == ERANGE) {
+        error_ = "Not a number: '" + value_ + "'";
+        return false;
+      }
+      flt_.num_ = n_;
+    }
+  }
+
+  filters_.push_back(std::move(flt_));
+  return true;
+}
+
+/*!
+ * \brief Scans the whole file.
+ * \param path_ Absolute, or relative to directory().
+ * \param threads_ 0: threads()
+ * \return false if the file isn't allowed or can't be read, see error().
+ * The lines that don't parse aren't an error, they're counted in
+ * result().rejected_.
+ */
+bool
+SLPFileAgg::run(const std::string& path_, size_t threads_)
+{
+  result_ = {};
+  error_.clear();
+
+  std::string real_;
+  if (!allowed(path_, real_, error_)) {
+    return false;
+  }
+
+  SLPReadFile file_;
+  if (!file_.open(real_)) {
+    error_ = file_.error();
+    return false;
+  }
+  if (file_.size() == 0) {
+    return true;
+  }
+
+  // About 8 chunks per thread, so the stealing can even out the threads.
+  threads_ = threads_ == 0 ? threads() : threads_;
+  const size_t target_ =
+    std::max<size_t>(file_.size() / (threads_ * 8), size_t{ 1 } << 20);
+  const std::vector<Range> chunks_ = plan(file_, real_, target_);
+  if (chunks_.empty()) {
+    return !truncated(file_, real_);
+  }
+  threads_ = std::min(threads_, chunks_.size());
+
+  // The parsers are built before the run: a task must not throw (see
+  // SLPWorkPool::run()), so it only catches the errors of its own chunk.
+  struct alignas(64) Part
+  {
+    std::unique_ptr<SLPRowParser> parser_ = {};
+    std::string buf_ = {};
+    Result result_ = {};
+    bool failed_ = false;
+  };
+  std::vector<Part> parts_(threads_);
+  for (Part& p_ : parts_) {
+    p_.parser_ = std::make_unique<SLPRowParser>(fmt_);
+  }
+
+  SLPWorkPool pool_(threads_);
+  pool_.run(chunks_.size(), [&](size_t task_, size_t worker_) {
+    Part& p_ = parts_[worker_];
+    const Range& c_ = chunks_[task_];
+    try {
+      if (!p_.failed_ &&
+          file_.lines(c_.offset_, c_.offset_ + c_.bytes_, p_.buf_)) {
+        scan(p_.buf_, *p_.parser_, p_.result_);
+      }
+    } catch (...) {
+      p_.failed_ = true; // e.g. std::bad_alloc of a very long line
+    }
+  });
+
+  if (truncated(file_, real_)) {
+    return false;
+  }
+  for (const Part& p_ : parts_) {
+    if (p_.failed_) {
+      error_ = real_ + ": out of memory";
+      return false;
+    }
+    result_.merge(p_.result_);
+  }
+  return true;
+}
+
+/*!
+ * \internal
+ * \brief Chunks to scan: the whole file, or only the ranges of its zone map
+ * that may have lines of the time window of the filters.
+ */
+std::vector<SLPFileAgg::Range>
+SLPFileAgg::plan(const SLPReadFile& file_,
+                 const std::string& real_,
+                 size_t target_)
+{
+  uint32_t from_ = 0;
+  uint32_t to_ = 0;
+  SLPZoneMap map_(fmt_);
+  std::vector<Range> chunks_;
+
+  // The bytes appended after the zone map must begin a line.
+  char last_ = '\n';
+  if (!window(from_, to_) || !map_.load(real_) ||
+      (map_.covered() > 0 &&
+       (!file_.byteAt(map_.covered() - 1, last_) || last_ != '\n'))) {
+    result_.bytes_ = file_.size();
+    cut({ 0, file_.size() }, target_, chunks_);
+    return chunks_;
+  }
+
+  result_.zoneMap_ = true;
+  if (from_ > to_) {
+    return chunks_; // e.g. timestamp > 10 and timestamp < 5
+  }
+  for (const Range& r_ : map_.ranges(from_, to_, file_.size())) {
+    cut(r_, target_, chunks_);
+    result_.bytes_ += r_.bytes_;
+  }
+  return chunks_;
+}
+
+/*!
+ * \internal
+ * \brief Cuts r_ in chunks of target_ bytes. They don't need to be cut at a
+ * newline: each line is read by the chunk where it begins (see
+ * SLPReadFile::lines()).
+ */
+void
+SLPFileAgg::cut(const Range& r_, size_t target_, std::vector<Range>& out_)
+{
+  for (uint64_t at_ = 0; at_ < r_.bytes_; at_ += target_) {
+    out_.push_back(
+      { r_.offset_ + at_, std::min<uint64_t>(target_, r_.bytes_ - at_) });
+  }
+}
+
+/*!
+ * \internal
+ * \brief Whether the file shrank while it was read (e.g. rotated by
+ * copytruncate): the result would miss lines, so it's an error.
+ */
+bool
+SLPFileAgg::truncated(const SLPReadFile& file_, const std::string& real_)
+{
+  if (!file_.truncated()) {
+    return false;
+  }
+  error_ = real_ + ": truncated while it was read";
+  return true;
+}
+
+/*!
+ * \brief NULL for min, max and avg when no line has the field.
+ */
+bool
+SLPFileAgg::isNull() const noexcept
+{
+  switch (agg_) {
+    case Agg::Min:
+    case Agg::Max:
+    case Agg::Avg: {
+      return result_.values_ == 0;
+    }
+    default: {
+      return false;
+    }
+  }
+}
+
+double
+SLPFileAgg::value() const noexcept
+{
+  switch (agg_) {
+    case Agg::Count: {
+      return static_cast<double>(result_.matched_);
+    }
+    case Agg::Sum: {
+      return static_cast<double>(result_.sum_);
+    }
+    case Agg::Min: {
+      return isNull() ? 0.0 : static_cast<double>(result_.min_);
+    }
+    case Agg::Max: {
+      return isNull() ? 0.0 : static_cast<double>(result_.max_);
+    }
+    case Agg::Avg: {
+      return isNull() ? 0.0
+                      : static_cast<double>(result_.sum_) /
+                          static_cast<double>(result_.values_);
+    }
+    default: {
+      return 0.0;
+    }
+  }
+}
+
+SLPFileAgg::Agg
+SLPFileAgg::aggOf(std::string_view name_)
+{
+  std::string s_(name_);
+  std::transform(s_.begin(), s_.end(), s_.begin(), ::tolower);
+  if (s_ == "count") {
+    return Agg::Count;
+  } else if (s_ == "sum") {
+    return Agg::Sum;
+  } else if (s_ == "min") {
+    return Agg::Min;
+  } else if (s_ == "max") {
+    return Agg::Max;
+  } else if (s_ == "avg") {
+    return Agg::Avg;
+  }
+  return Agg::Unknown;
+}
+
+bool
+SLPFileAgg::isNumeric(Fields f_) noexcept
+{
+  switch (f_) {
+    case Fields::Timestamp:
+    case Fields::CliSrcIpAddr:
+    case Fields::ResponseTime:
+    case Fields::HttpStatus:
+    case Fields::TotalSizeReply: {
+      return true;
+    }
+    default: {
+      return false;
+    }
+  }
+}
+
+/*!
+ * \brief The directory the files must be in.
+ */
+std::string
+SLPFileAgg::directory()
+{
+  const char* env_ = std::getenv("SLP_FILE_DIR");
+  return env_ != nullptr ? std::string(env_) : std::string(SLP_FILE_DIR);
+}
+
+/*!
+ * \brief Checks that the file is a regular file inside directory(). Both
+ * paths are resolved first, so neither "..", nor a symbolic link, can point
+ * outside of it.
+ * \param real_ Resolved path of the file.
+ */
+bool
+SLPFileAgg::allowed(const std::string& path_,
+                    std::string& real_,
+                    std::string& error_)
+{
+  const std::string dir_ = directory();
+  if (dir_.empty()) {
+    error_ = "Disabled: the directory of the files (SLP_FILE_DIR) is empty";
+    return false;
+  }
+
+  char buf_[PATH_MAX];
+  if (::realpath(dir_.c_str(), buf_) == nullptr) {
+    error_ = dir_ + ": " + std::strerror(errno);
+    return false;
+  }
+  std::string base_(buf_);
+  if (base_.back() != '/') {
+    base_ += '/';
+  }
+
+  const std::string full_ =
+    !path_.empty() && path_.front() == '/' ? path_ : dir_ + "/" + path_;
+  if (::realpath(full_.c_str(), buf_) == nullptr) {
+    error_ = path_ + ": " + std::strerror(errno);
+    return false;
+  }
+  real_ = buf_;
+  if (real_.compare(0, base_.size(), base_) != 0) {
+    error_ = path_ + ": not under " + dir_;
+    return false;
+  }
+
+  struct stat st_;
+  if (::stat(real_.c_str(), &st_) != 0 || !S_ISREG(st_.st_mode)) {
+    error_ = path_ + ": not a regular file";
+    return false;
+  }
+  return true;
+}
+
+/*!
+ * \brief Threads of a scan: SLP_FILE_THREADS, from the environment of the
+ * server, or all the cores.
+ */
+size_t
+SLPFileAgg::threads()
+{
+  if (const char* env_ = std::getenv("SLP_FILE_THREADS"); env_ != nullptr) {
+    const long n_ = std::strtol(env_, nullptr, 10);
+    if (n_ > 0) {
+      return static_cast<size_t>(std::min(n_, 256L));
+    }
+  }
+  return std::max(1U, std::thread::hardware_concurrency());
+}
+
+/*!
+ * \internal
+ * \brief Time window of the filters on the timestamp.
+ * \return false if there's none.
+ */
+bool
+SLPFileAgg::window(uint32_t& from_, uint32_t& to_) const noexcept
+{
+  constexpr int64_t max_ = std::numeric_limits<uint32_t>::max();
+  int64_t lo_ = 0;
+  int64_t hi_ = max_;
+  bool bounded_ = false;
+
+  for (const SLPFileFilter& f_ : filters_) {
+    if (f_.field_ != Fields::Timestamp) {
+      continue;
+    }
+    // The timestamps are uint32_t: clamped, n_ - 1 and n_ + 1 can't overflow
+    // (strtoll() gives INT64_MIN and INT64_MAX for the numbers out of range).
+    const int64_t n_ = std::clamp<int64_t>(f_.num_, -1, max_ + 1);
+    switch (f_.op_) {
+      case Op::Eq: {
+        lo_ = std::max(lo_, n_);
+        hi_ = std::min(hi_, n_);
+        break;
+      }
+      case Op::Lt: {
+        hi_ = std::min(hi_, n_ - 1);
+        break;
+      }
+      case Op::Le: {
+        hi_ = std::min(hi_, n_);
+        break;
+      }
+      case Op::Gt: {
+        lo_ = std::max(lo_, n_ + 1);
+        break;
+      }
+      case Op::Ge: {
+        lo_ = std::max(lo_, n_);
+        break;
+      }
+      default: {
+        continue; // != doesn't bound the window
+      }
+    }
+    bounded_ = true;
+  }
+
+  if (lo_ > hi_ || lo_ > max_ || hi_ < 0) {
+    from_ = 1; // empty window
+    to_ = 0;
+  } else {
+    from_ = static_cast<uint32_t>(std::max<int64_t>(lo_, 0));
+    to_ = static_cast<uint32_t>(std::min(hi_, max_));
+  }
+  return bounded_;
+}
+
+/*!
+ * \internal
+ * \brief Cheap test before the regular expression: a line can't have a
+ * field equal to a text that isn't in the line at all.
+ * \note Only for texts without blanks, because the parser squeezes the
+ * runs of blanks of the line.
+ */
+bool
+SLPFileAgg::skip(std::string_view line_) const noexcept
+{
+  for (const SLPFileFilter& f_ : filters_) {
+    if (f_.op_ == Op::Eq && !isNumeric(f_.field_) && !f_.text_.empty() &&
+        f_.text_.find_first_of(" \t") == std::string::npos &&
+        line_.find(f_.text_) == std::string_view::npos) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool
+SLPFileAgg::match(const SLPRowParser& p_) const
+{
+  for (const SLPFileFilter& f_ : filters_) {
+    int cmp_ = 0;
+    if (isNumeric(f_.field_)) {
+      const int64_t v_ = number(p_, f_.field_);
+      cmp_ = v_ < f_.num_ ? -1 : (v_ > f_.num_ ? 1 : 0);
+    } else {
+      cmp_ = p_.getPartStr(f_.field_).compare(f_.text_);
+    }
+
+    bool ok_ = false;
+    switch (f_.op_) {
+      case Op::Eq: {
+        ok_ = cmp_ == 0;
+        break;
+      }
+      case Op::Ne: {
+        ok_ = cmp_ != 0;
+        break;
+      }
+      case Op::Lt: {
+        ok_ = cmp_ < 0;
+        break;
+      }
+      case Op::Le: {
+        ok_ = cmp_ <= 0;
+        break;
+      }
+      case Op::Gt: {
+        ok_ = cmp_ > 0;
+        break;
+      }
+      case Op::Ge: {
+        ok_ = cmp_ >= 0;
+        break;
+      }
+      default: {
+        break;
+      }
+    }
+    if (!ok_) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*!
+ * \internal
+ * \brief Aggregates the lines of one chunk into the partial result of the
+ * thread.
+ * \note It runs on the threads of the pool, so nothing can escape from it.
+ */
+void
+SLPFileAgg::scan(std::string_view chunk_, SLPRowParser& p_, Result& r_) const
+{
+  std::string_view line_;
+  while (SLPMappedFile::nextLine(chunk_, line_)) {
+    if (line_.empty()) {
+      continue;
+    }
+    ++r_.lines_;
+    if (skip(line_)) {
+      continue;
+    }
+    try {
+      if (!p_.parse(line_)) {
+        ++r_.rejected_;
+        continue;
+      }
+      if (!match(p_)) {
+        continue;
+      }
+      ++r_.matched_;
+      if (agg_ == Agg::Count) {
+        continue;
+      }
+      const int64_t v_ = number(p_, field_);
+      if (field_ == Fields::HttpStatus && v_ < 0) {
+        continue; // no status
+      }
+      ++r_.values_;
+      r_.sum_ += v_;
+      r_.min_ = std::min(r_.min_, v_);
+      r_.max_ = std::max(r_.max_, v_);
+    } catch (...) {
+      ++r_.rejected_;
+    }
+  }
+}
+
+int64_t
+SLPFileAgg::number(const SLPRowParser& p_, Fields f_)
+{
+  switch (f_) {
+    case Fields::Timestamp: {
+      return p_.timestamp();
+    }
+    case Fields::CliSrcIpAddr: {
+      return p_.getPartUInt(f_);
+    }
+    case Fields::HttpStatus: {
+      return p_.httpStatus();
+    }
+    default: {
+      return p_.getPartInt(f_);
+    }
+  }
+}
+
+} // namespace squidlogparser
@@ -0,0 +1,189 @@
+/***************************************************************************
+ * Copyright (c) 2020-22                                                   *
+ *      Volnei Cervi Puttini.  All rights reserved.                        *
+ *      vcputtini@gmail.com
+ *                                                                         *
+ * Redistribution and use in source and binary forms, with or without      *
+ * modification, are permitted provided that the following conditions      *
+ * are met:                                                                *
+ * 1. Redistributions of source code must retain the above copyright       *
+ *    notice, this list of conditions and the following disclaimer.        *
+ * 2. Redistributions in binary form must reproduce the above copyright    *
+ *    notice, this list of conditions and the following disclaimer in the  *
+ *    documentation and/or other materials provided with the distribution. *
+ * 4. Neither the name of the Author     nor the names of its contributors *
+ *    may be used to endorse or promote products derived from this software*
+ *    without specific prior written permission.                           *
+ *                                                                         *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND *
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR      *
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS  *
+ * BE LIABLEFOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   *
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF    *
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS*
+ * INTERRUPTION)                                                           *
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,     *
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING   *
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE      *
+ * POSSIBILITY OFSUCH DAMAGE.                                              *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*!
+ * \brief How this file is organized:
+ *
+ * Aggregates computed straight over an access-log file, without loading it
+ * into a table: slp_file_agg().
+ *
+ * The file is split in chunks of bytes, which are read with pread() (see
+ * SLPReadFile, a log can be truncated while it's scanned) and parsed on a
+ * SLPWorkPool, one long-lived parser per thread. Each thread keeps its own
+ * partial result, so nothing is shared while scanning, and the partials are
+ * combined at the end.
+ *
+ * The files are restricted to one directory (and its subdirectories), the
+ * same way secure_file_priv restricts LOAD DATA INFILE:
+ * - SLP_FILE_DIR, from the environment of the server, or
+ * - the directory given to CMake (VCPSQUIDLOGPARSER_FILE_DIR).
+ * An empty directory disables the function.
+ *
+ * With a filter on the timestamp, a zone map of the file (see SLPZoneMap)
+ * limits the scan to the blocks that may have lines of the time window.
+ *
+ * struct SLPFileFilter: one condition "field OP value" on the lines.
+ * class SLPFileAgg: the scan.
+ */
+
+#ifndef SLPFILEAGG_H
+#define SLPFILEAGG_H
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "slpscan.h"
+#include "slpzonemap.h"
+#include "squidlogparser.h"
+
+namespace squidlogparser {
+
+/* SLPFileFilter ------------------------------------------------------------ */
+
+struct SquidLogParser_EXPORT SLPFileFilter
+{
+  using Fields = SquidLogData::Fields;
+
+  /*!
+   * \warning Do not change the order of the objects defined below.
+   */
+  enum class Op
+  {
+    Eq = 0x00, // =
+    Ne,        // != or <>
+    Lt,        // <
+    Le,        // <=
+    Gt,        // >
+    Ge,        // >=
+    Unknown
+  };
+
+  Fields field_ = Fields::Unknown;
+  Op op_ = Op::Unknown;
+  std::string text_ = {}; // value of the string fields
+  int64_t num_ = 0;       // value of the numeric fields
+
+  static bool split(std::string_view expr_,
+                    std::string& name_,
+                    Op& op_,
+                    std::string& value_);
+};
+
+/* SLPFileAgg --------------------------------------------------------------- */
+
+class SquidLogParser_EXPORT SLPFileAgg
+{
+public:
+  using LogFormat = SquidLogData::LogFormat;
+  using Fields = SquidLogData::Fields;
+  using Op = SLPFileFilter::Op;
+
+  /*!
+   * \warning Do not change the order of the objects defined below.
+   */
+  enum class Agg
+  {
+    Count = 0x00,
+    Sum,
+    Min,
+    Max,
+    Avg,
+    Unknown
+  };
+
+  struct Result
+  {
+    uint64_t lines_ = 0;    // lines read
+    uint64_t rejected_ = 0; // lines that don't parse
+    uint64_t matched_ = 0;  // lines that passed the filters
+    uint64_t values_ = 0;   // of them, lines with the field aggregated
+    uint64_t bytes_ = 0;    // scanned
+    bool zoneMap_ = false;  // the scan was limited by the zone map
+    int64_t sum_ = 0;
+    int64_t min_ = std::numeric_limits<int64_t>::max();
+    int64_t max_ = std::numeric_limits<int64_t>::min();
+
+    void merge(const Result& rhs_) noexcept;
+  };
+
+  explicit SLPFileAgg(LogFormat f_, Agg a_, Fields field_);
+
+  bool addFilter(Fields f_, Op op_, const std::string& value_);
+  bool run(const std::string& path_, size_t threads_ = 0);
+
+  const Result& result() const noexcept { return result_; }
+  bool isNull() const noexcept;
+  double value() const noexcept;
+  const std::string& error() const noexcept { return error_; }
+
+  static Agg aggOf(std::string_view name_);
+  static bool isNumeric(Fields f_) noexcept;
+
+  static std::string directory();
+  static bool allowed(const std::string& path_,
+                      std::string& real_,
+                      std::string& error_);
+  static size_t threads();
+
+private:
+  LogFormat fmt_;
+  Agg agg_;
+  Fields field_;
+  std::vector<SLPFileFilter> filters_ = {};
+  Result result_ = {};
+  std::string error_ = {};
+
+  using Range = SLPZoneMap::Range;
+
+  bool window(uint32_t& from_, uint32_t& to_) const noexcept;
+  std::vector<Range> plan(const SLPReadFile& file_,
+                          const std::string& real_,
+                          size_t target_);
+  bool truncated(const SLPReadFile& file_, const std::string& real_);
+  bool skip(std::string_view line_) const noexcept;
+  bool match(const SLPRowParser& p_) const;
+  void scan(std::string_view chunk_, SLPRowParser& p_, Result& r_) const;
+
+  static int64_t number(const SLPRowParser& p_, Fields f_);
+  static void cut(const Range& r_, size_t target_, std::vector<Range>& out_);
+};
+
+} // namespace squidlogparser
+
+#endif // SLPFILEAGG_H
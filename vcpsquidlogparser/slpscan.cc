@@ -0,0 +1,488 @@
+/***************************************************************************
+ * Copyright (c) 2020-22                                                   *
+ *      Volnei Cervi Puttini.  All rights reserved.                        *
+ *      vcputtini@gmail.com
+ *                                                                         *
+ * Redistribution and use in source and binary forms, with or without      *
+ * modification, are permitted provided that the following conditions      *
+ * are met:                                                                *
+ * 1. Redistributions of source code must retain the above copyright       *
+ *    notice, this list of conditions and the following disclaimer.        *
+ * 2. Redistributions in binary form must reproduce the above copyright    *
+ *    notice, this list of conditions and the following disclaimer in the  *
+ *    documentation and/or other materials provided with the distribution. *
+ * 4. Neither the name of the Author     nor the names of its contributors *
+ *    may be used to endorse or promote products derived from this software*
+ *    without specific prior written permission.                           *
+ *                                                                         *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND *
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR      *
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS  *
+ * BE LIABLEFOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   *
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF    *
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS*
+ * INTERRUPTION)                                                           *
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,     *
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING   *
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE      *
+ * POSSIBILITY OFSUCH DAMAGE.                                              *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "slpscan.h"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace squidlogparser {
+
+/* SLPRowParser ------------------------------------------------------------- */
+
+SLPRowParser::SLPRowParser(LogFormat f_)
+  : SquidLogParser(f_)
+{}
+
+/*!
+ * \brief Parses one line. The regular expressions are compiled once, by the
+ * constructor, and the entry is dropped (timestamp() keeps its time), so the
+ * parser doesn't grow with the input.
+ * \return false if the line doesn't parse, see lastError().
+ */
+bool
+SLPRowParser::parse(std::string_view line_)
+{
+  this->line_.assign(line_.data(), line_.size());
+  append(this->line_);
+  const bool ok_ = errorNum() == SLPError::SLP_SUCCESS && !mEntry.empty();
+  clear();
+  return ok_;
+}
+
+/* SLPMappedFile ------------------------------------------------------------ */
+
+SLPMappedFile::SLPMappedFile(const std::string& path_)
+{
+  open(path_);
+}
+
+SLPMappedFile::~SLPMappedFile()
+{
+  close();
+}
+
+SLPMappedFile::SLPMappedFile(SLPMappedFile&& rhs_) noexcept
+{
+  *this = std::move(rhs_);
+}
+
+SLPMappedFile&
+SLPMappedFile::operator=(SLPMappedFile&& rhs_) noexcept
+{
+  if (this != &rhs_) {
+    close();
+    path_ = std::move(rhs_.path_);
+    error_ = std::move(rhs_.error_);
+    data_ = std::exchange(rhs_.data_, nullptr);
+    size_ = std::exchange(rhs_.size_, 0);
+    open_ = std::exchange(rhs_.open_, false);
+  }
+  return *this;
+}
+
+/*!
+ * \brief Maps the whole file read-only.
+ * \return false on error, see error(). An empty file is open with size() 0.
+ * \warning If the file is truncated while it's mapped, reading the pages
+ * past its new end raises SIGBUS. Use SLPReadFile for the files that may
+ * still be written to, inside the server.
+ */
+bool
+SLPMappedFile::open(const std::string& path_)
+{
+  close();
+  this->path_ = path_;
+  error_.clear();
+
+  const int fd_ = ::open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd_ < 0) {
+    error_ = path_ + ": " + std::strerror(errno);
+    return false;
+  }
+
+  struct stat st_ = {};
+  if (::fstat(fd_, &st_) != 0 || !S_ISREG(st_.st_mode)) {
+    error_ = path_ + ": not a regular file";
+    ::close(fd_);
+    return false;
+  }
+
+  size_ = static_cast<size_t>(st_.st_size);
+  if (size_ > 0) {
+    void* p_ = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+    if (p_ == MAP_FAILED) {
+      error_ = path_ + ": " + std::strerror(errno);
+      size_ = 0;
+      ::close(fd_);
+      return false;
+    }
+    // The chunks are read from the start to the end, once.
+    ::madvise(p_, size_, MADV_SEQUENTIAL);
+    data_ = static_cast<const char*>(p_);
+  }
+  ::close(fd_); // the mapping keeps its own reference
+
+  open_ = true;
+  return true;
+}
+
+void
+SLPMappedFile::close() noexcept
+{
+  if (data_ != nullptr) {
+    ::munmap(const_cast<char*>(data_), size_);
+  }
+  data_ = nullptr;
+  size_ = 0;
+  open_ = false;
+}
+
+/*!
+ * \brief Chunks of about target_ bytes of the mapped file.
+ */
+std::vector<std::string_view>
+SLPMappedFile::chunks(size_t target_) const
+{
+  return split(view(), target_);
+}
+
+/*!
+ * \brief Splits data_ in chunks of about target_ bytes. Each chunk, but the
+ * last, ends just after a '\n', so no line is split between two chunks.
+ *
+ * A line longer than target_ makes its chunk longer, never shorter.
+ */
+std::vector<std::string_view>
+SLPMappedFile::split(std::string_view data_, size_t target_)
+{
+  std::vector<std::string_view> out_;
+  target_ = std::max<size_t>(target_, 1);
+  out_.reserve(data_.size() / target_ + 1);
+
+  size_t begin_ = 0;
+  while (begin_ < data_.size()) {
+    size_t end_ = begin_ + target_;
+    if (end_ >= data_.size()) {
+      end_ = data_.size();
+    } else {
+      const size_t nl_ = data_.find('\n', end_ - 1);
+      end_ = nl_ == std::string_view::npos ? data_.size() : nl_ + 1;
+    }
+    out_.emplace_back(data_.substr(begin_, end_ - begin_));
+    begin_ = end_;
+  }
+  return out_;
+}
+
+/*!
+ * \brief Takes the next line of rest_, without its "\n" or "\r\n".
+ * \return false when rest_ is empty.
+ *
+ * The last line doesn't need a '\n'.
+ */
+bool
+SLPMappedFile::nextLine(std::string_view& rest_, std::string_view& line_)
+{
+  if (rest_.empty()) {
+    return false;
+  }
+  const size_t nl_ = rest_.find('\n');
+  if (nl_ == std::string_view::npos) {
+    line_ = rest_;
+    rest_ = {};
+  } else {
+    line_ = rest_.substr(0, nl_);
+    rest_.remove_prefix(nl_ + 1);
+  }
+  if (!line_.empty() && line_.back() == '\r') {
+    line_.remove_suffix(1);
+  }
+  return true;
+}
+
+/* SLPReadFile -------------------------------------------------------------- */
+
+SLPReadFile::~SLPReadFile()
+{
+  close();
+}
+
+/*!
+ * \brief Opens the file and takes its size: the bytes appended later aren't
+ * read.
+ * \return false on error, see error().
+ */
+bool
+SLPReadFile::open(const std::string& path_)
+{
+  close();
+  error_.clear();
+  truncated_ = false;
+
+  const int fd_ = ::open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd_ < 0) {
+    error_ = path_ + ": " + std::strerror(errno);
+    return false;
+  }
+
+  struct stat st_ = {};
+  if (::fstat(fd_, &st_) != 0 || !S_ISREG(st_.st_mode)) {
+    error_ = path_ + ": not a regular file";
+    ::close(fd_);
+    return false;
+  }
+  // The ranges are read from the start to the end, once.
+  ::posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  this->fd_ = fd_;
+  size_ = static_cast<uint64_t>(st_.st_size);
+  return true;
+}
+
+void
+SLPReadFile::close() noexcept
+{
+  if (fd_ >= 0) {
+    ::close(fd_);
+  }
+  fd_ = -1;
+  size_ = 0;
+}
+
+/*!
+ * \brief Reads into buf_ the lines that begin in [begin_, end_), the last
+ * one up to its '\n' (or up to size()), which can be after end_.
+ * \return false if the file was truncated, see truncated(); buf_ is then
+ * empty.
+ */
+bool
+SLPReadFile::lines(uint64_t begin_, uint64_t end_, std::string& buf_) const
+{
+  buf_.clear();
+  end_ = std::min(end_, size_);
+  if (begin_ >= end_) {
+    return true;
+  }
+
+  // A line begins at begin_ only if the byte before it is a '\n'.
+  const uint64_t from_ = begin_ > 0 ? begin_ - 1 : 0;
+  buf_.resize(static_cast<size_t>(end_ - from_));
+  if (!read(buf_.data(), buf_.size(), from_)) {
+    buf_.clear();
+    return false;
+  }
+  if (begin_ > 0) {
+    const size_t nl_ = buf_.find('\n');
+    if (nl_ == std::string::npos || nl_ + 1 == buf_.size()) {
+      buf_.clear(); // no line begins in the range
+      return true;
+    }
+    buf_.erase(0, nl_ + 1);
+  }
+
+  for (uint64_t at_ = end_; buf_.back() != '\n' && at_ < size_;) {
+    const size_t n_ =
+      static_cast<size_t>(std::min<uint64_t>(stepSize, size_ - at_));
+    const size_t old_ = buf_.size();
+    buf_.resize(old_ + n_);
+    if (!read(buf_.data() + old_, n_, at_)) {
+      buf_.clear();
+      return false;
+    }
+    if (const size_t nl_ = buf_.find('\n', old_); nl_ != std::string::npos) {
+      buf_.resize(nl_ + 1);
+    }
+    at_ += n_;
+  }
+  return true;
+}
+
+/*!
+ * \brief The byte at offset_.
+ * \return false if it's past size() or the file was truncated.
+ */
+bool
+SLPReadFile::byteAt(uint64_t offset_, char& c_) const noexcept
+{
+  return offset_ < size_ && read(&c_, 1, offset_);
+}
+
+/*!
+ * \internal
+ * \brief Reads n_ bytes, or fails if the file ends before them (truncated).
+ */
+bool
+SLPReadFile::read(char* p_, size_t n_, uint64_t offset_) const noexcept
+{
+  while (n_ > 0) {
+    const ssize_t r_ = ::pread(fd_, p_, n_, static_cast<off_t>(offset_));
+    if (r_ < 0 && errno == EINTR) {
+      continue;
+    }
+    if (r_ <= 0) {
+      truncated_ = true;
+      return false;
+    }
+    p_ += r_;
+    n_ -= static_cast<size_t>(r_);
+    offset_ += static_cast<uint64_t>(r_);
+  }
+  return true;
+}
+
+/* SLPWorkPool -------------------------------------------------------------- */
+
+/*!
+ * \brief Starts the threads. If one can't be started (std::system_error), the
+ * ones already running are stopped and joined before the exception leaves.
+ */
+SLPWorkPool::SLPWorkPool(size_t threads_)
+{
+  if (threads_ == 0) {
+    threads_ = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+  }
+  queues_ = std::make_unique<Queue[]>(threads_);
+  this->threads_.reserve(threads_);
+  try {
+    for (size_t i_ = 0; i_ < threads_; ++i_) {
+      this->threads_.emplace_back(&SLPWorkPool::worker, this, i_);
+    }
+  } catch (...) {
+    {
+      std::lock_guard<std::mutex> guard_(lock_);
+      stop_ = true;
+    }
+    start_.notify_all();
+    for (auto& t_ : this->threads_) {
+      t_.join();
+    }
+    throw;
+  }
+}
+
+SLPWorkPool::~SLPWorkPool()
+{
+  {
+    std::lock_guard<std::mutex> guard_(lock_);
+    stop_ = true;
+  }
+  start_.notify_all();
+  for (auto& t_ : threads_) {
+    t_.join();
+  }
+}
+
+/*!
+ * \brief Runs fn_(task, worker) for every task in [0, tasks_) and returns
+ * when all of them are done.
+ *
+ * The tasks are dealt in contiguous blocks, so each thread starts with
+ * neighbouring chunks of the file. A thread whose queue is empty steals from
+ * the back of the queue of another one.
+ *
+ * \warning fn_ must not throw. run() must not be called by a task.
+ */
+void
+SLPWorkPool::run(size_t tasks_, const Task& fn_)
+{
+  if (tasks_ == 0) {
+    return;
+  }
+
+  const size_t n_ = threads_.size();
+  for (size_t w_ = 0; w_ < n_; ++w_) {
+    std::lock_guard<std::mutex> guard_(queues_[w_].lock_);
+    for (size_t t_ = tasks_ * w_ / n_; t_ < tasks_ * (w_ + 1) / n_; ++t_) {
+      queues_[w_].tasks_.push_back(t_);
+    }
+  }
+
+  std::unique_lock<std::mutex> lock_(this->lock_);
+  this->fn_ = &fn_;
+  busy_ = n_;
+  ++generation_;
+  start_.notify_all();
+  done_.wait(lock_, [this] { return busy_ == 0; });
+  this->fn_ = nullptr;
+}
+
+void
+SLPWorkPool::worker(size_t self_)
+{
+  uint64_t seen_ = 0;
+  for (;;) {
+    const Task* fn_ = nullptr;
+    {
+      std::unique_lock<std::mutex> lock_(this->lock_);
+      start_.wait(lock_, [&] { return stop_ || generation_ != seen_; });
+      if (stop_) {
+        return;
+      }
+      seen_ = generation_;
+      fn_ = this->fn_;
+    }
+
+    size_t task_ = 0;
+    bool stolen_ = false;
+    uint64_t steals_ = 0;
+    while (take(self_, task_, stolen_)) {
+      steals_ += stolen_ ? 1 : 0;
+      (*fn_)(task_, self_);
+    }
+
+    std::lock_guard<std::mutex> guard_(this->lock_);
+    this->steals_ += steals_;
+    if (--busy_ == 0) {
+      done_.notify_one();
+    }
+  }
+}
+
+/*!
+ * \internal
+ * \brief Pops the front of the own queue or steals the back of another one.
+ *
+ * No task is added during a run, so when every queue is empty the run is
+ * over for this thread.
+ */
+bool
+SLPWorkPool::take(size_t self_, size_t& task_, bool& stolen_)
+{
+  const size_t n_ = threads_.size();
+  for (size_t i_ = 0; i_ < n_; ++i_) {
+    Queue& q_ = queues_[(self_ + i_) % n_];
+    std::lock_guard<std::mutex> guard_(q_.lock_);
+    if (q_.tasks_.empty()) {
+      continue;
+    }
+    if (i_ == 0) {
+      task_ = q_.tasks_.front();
+      q_.tasks_.pop_front();
+    } else {
+      task_ = q_.tasks_.back();
+      q_.tasks_.pop_back();
+    }
+    stolen_ = i_ != 0;
+    return true;
+  }
+  return false;
+}
+
+} // namespace squidlogparser
@@ -0,0 +1,436 @@
+/***************************************************************************
+ * Copyright (c) 2020-22                                                   *
+ *      Volnei Cervi Puttini.  All rights reserved.                        *
+ *      vcputtini@gmail.com
+ *                                                                         *
+ * Redistribution and use in source and binary forms, with or without      *
+ * modification, are permitted provided that the following conditions      *
+ * are met:                                                                *
+ * 1. Redistributions of source code must retain the above copyright       *
+ *    notice, this list of conditions and the following disclaimer.        *
+ * 2. Redistributions in binary form must reproduce the above copyright    *
+ *    notice, this list of conditions and the following disclaimer in the  *
+ *    documentation and/or other materials provided with the distribution. *
+ * 4. Neither the name of the Author     nor the names of its contributors *
+ *    may be used to endorse or promote products derived from this software*
+ *    without specific prior written permission.                           *
+ *                                                                         *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND *
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR      *
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS  *
+ * BE LIABLEFOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   *
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF    *
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS*
+ * INTERRUPTION)                                                           *
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,     *
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING   *
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE      *
+ * POSSIBILITY OFSUCH DAMAGE.                                              *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*!
+ * \brief How this file is organized:
+ *
+ * Building blocks to scan whole access-log files in parallel, outside of the
+ * per-row path of the UDF's: the bulk loader and the file aggregates.
+ *
+ * class SLPRowParser: long-lived SquidLogParser that parses one line at a
+ *                     time and doesn't keep the entries.
+ * class SLPMappedFile: read-only memory mapping of a file, split in chunks
+ *                      at newline boundaries.
+ * class SLPReadFile: positioned reads (pread) of the lines of a byte range of
+ *                    a file, safe when the file shrinks while it's read.
+ * class SLPWorkPool: fixed pool of threads. The tasks of a run are dealt to
+ *                    one queue per thread and an idle thread steals from the
+ *                    others, so uneven chunks don't leave threads idle.
+ * class SLPSpscRing, SLPMpmcRing: bounded lock-free rings that connect the
+ *                    stages of a pipeline. A full ring makes its producer
+ *                    wait (back-pressure), so the memory in flight is bounded.
+ */
+
+#ifndef SLPSCAN_H
+#define SLPSCAN_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "squidlogparser.h"
+
+namespace squidlogparser {
+
+/* SLPRowParser ------------------------------------------------------------- */
+
+class SquidLogParser_EXPORT SLPRowParser : public SquidLogParser
+{
+public:
+  explicit SLPRowParser(LogFormat f_);
+
+  bool parse(std::string_view line_);
+
+private:
+  std::string line_ = {};
+};
+
+/* SLPMappedFile ------------------------------------------------------------ */
+
+class SquidLogParser_EXPORT SLPMappedFile
+{
+public:
+  explicit SLPMappedFile() = default;
+  explicit SLPMappedFile(const std::string& path_);
+  ~SLPMappedFile();
+
+  SLPMappedFile(const SLPMappedFile&) = delete;
+  SLPMappedFile& operator=(const SLPMappedFile&) = delete;
+  SLPMappedFile(SLPMappedFile&& rhs_) noexcept;
+  SLPMappedFile& operator=(SLPMappedFile&& rhs_) noexcept;
+
+  bool open(const std::string& path_);
+  void close() noexcept;
+
+  bool isOpen() const noexcept { return open_; }
+  const std::string& error() const noexcept { return error_; }
+  const std::string& path() const noexcept { return path_; }
+
+  std::string_view view() const noexcept { return { data_, size_ }; }
+  size_t size() const noexcept { return size_; }
+
+  std::vector<std::string_view> chunks(size_t target_) const;
+
+  static std::vector<std::string_view> split(std::string_view data_,
+                                             size_t target_);
+  static bool nextLine(std::string_view& rest_, std::string_view& line_);
+
+private:
+  std::string path_ = {};
+  std::string error_ = {};
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+  bool open_ = false;
+};
+
+/* SLPReadFile -------------------------------------------------------------- */
+
+/*!
+ * \brief File read by ranges of bytes with pread(), for the files that may be
+ * truncated while they're scanned (e.g. a log rotated by copytruncate): the
+ * pages of a mapping past the new end raise SIGBUS, a read just comes short.
+ *
+ * A line belongs to the range where it begins, so ranges cut anywhere give
+ * every line once. Only the bytes up to size(), as of open(), are read.
+ */
+class SquidLogParser_EXPORT SLPReadFile
+{
+public:
+  explicit SLPReadFile() = default;
+  ~SLPReadFile();
+
+  SLPReadFile(const SLPReadFile&) = delete;
+  SLPReadFile& operator=(const SLPReadFile&) = delete;
+
+  bool open(const std::string& path_);
+  void close() noexcept;
+
+  bool isOpen() const noexcept { return fd_ >= 0; }
+  const std::string& error() const noexcept { return error_; }
+  uint64_t size() const noexcept { return size_; }
+  bool truncated() const noexcept { return truncated_.load(); }
+
+  bool lines(uint64_t begin_, uint64_t end_, std::string& buf_) const;
+  bool byteAt(uint64_t offset_, char& c_) const noexcept;
+
+  static constexpr size_t stepSize = 64 * 1024; // reads past the range
+
+private:
+  std::string error_ = {};
+  int fd_ = -1;
+  uint64_t size_ = 0;
+  mutable std::atomic<bool> truncated_ = { false };
+
+  bool read(char* p_, size_t n_, uint64_t offset_) const noexcept;
+};
+
+/* SLPWorkPool -------------------------------------------------------------- */
+
+class SquidLogParser_EXPORT SLPWorkPool
+{
+public:
+  // fn_(task, worker): worker is in [0, size()), one per thread.
+  using Task = std::function<void(size_t, size_t)>;
+
+  explicit SLPWorkPool(size_t threads_ = 0); // 0: hardware_concurrency()
+  ~SLPWorkPool();
+
+  SLPWorkPool(const SLPWorkPool&) = delete;
+  SLPWorkPool& operator=(const SLPWorkPool&) = delete;
+
+  size_t size() const noexcept { return threads_.size(); }
+  uint64_t steals() const noexcept { return steals_; }
+
+  void run(size_t tasks_, const Task& fn_);
+
+private:
+  struct alignas(64) Queue
+  {
+    std::mutex lock_;
+    std::deque<size_t> tasks_;
+  };
+
+  std::vector<std::thread> threads_ = {};
+  std::unique_ptr<Queue[]> queues_ = {};
+
+  std::mutex lock_;
+  std::condition_variable start_;
+  std::condition_variable done_;
+  const Task* fn_ = nullptr;
+  uint64_t generation_ = 0;
+  size_t busy_ = 0;
+  uint64_t steals_ = 0;
+  bool stop_ = false;
+
+  void worker(size_t self_);
+  bool take(size_t self_, size_t& task_, bool& stolen_);
+};
+
+/* SLPBackoff --------------------------------------------------------------- */
+
+/*!
+ * \brief Wait of the rings: spins a little, then yields, then sleeps, so a
+ * stage that waits for a long time doesn't burn its core.
+ */
+class SLPBackoff
+{
+public:
+  void pause() noexcept
+  {
+    if (n_ < 64) {
+      ++n_;
+#if defined(__x86_64__) || defined(__i386__)
+      __builtin_ia32_pause();
+#endif
+    } else if (n_ < 128) {
+      ++n_;
+      std::this_thread::yield();
+    } else {
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+  }
+
+private:
+  unsigned n_ = 0;
+};
+
+/* SLPSpscRing -------------------------------------------------------------- */
+
+/*!
+ * \brief Bounded ring of one producer and one consumer.
+ *
+ * The capacity is rounded up to a power of 2. The indexes are on their own
+ * cache lines and each side caches the index of the other one, so the shared
+ * lines are only read when the ring looks full or empty.
+ */
+template<typename T>
+class SLPSpscRing
+{
+public:
+  explicit SLPSpscRing(size_t capacity_)
+    : slots_(roundUp(capacity_))
+    , mask_(slots_.size() - 1)
+  {}
+
+  bool tryPush(const T& v_) noexcept
+  {
+    const size_t tail_ = this->tail_.load(std::memory_order_relaxed);
+    if (tail_ - headCache_ == slots_.size()) {
+      headCache_ = head_.load(std::memory_order_acquire);
+      if (tail_ - headCache_ == slots_.size()) {
+        return false;
+      }
+    }
+    slots_[tail_ & mask_] = v_;
+    this->tail_.store(tail_ + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool tryPop(T& v_) noexcept
+  {
+    const size_t head_ = this->head_.load(std::memory_order_relaxed);
+    if (head_ == tailCache_) {
+      tailCache_ = tail_.load(std::memory_order_acquire);
+      if (head_ == tailCache_) {
+        return false;
+      }
+    }
+    v_ = slots_[head_ & mask_];
+    this->head_.store(head_ + 1, std::memory_order_release);
+    return true;
+  }
+
+  void push(const T& v_) noexcept
+  {
+    SLPBackoff b_;
+    while (!tryPush(v_)) {
+      b_.pause();
+    }
+  }
+
+  void pop(T& v_) noexcept
+  {
+    SLPBackoff b_;
+    while (!tryPop(v_)) {
+      b_.pause();
+    }
+  }
+
+  size_t capacity() const noexcept { return slots_.size(); }
+
+private:
+  std::vector<T> slots_;
+  const size_t mask_;
+
+  alignas(64) std::atomic<size_t> head_ = { 0 }; // consumer
+  size_t tailCache_ = 0;
+  alignas(64) std::atomic<size_t> tail_ = { 0 }; // producer
+  size_t headCache_ = 0;
+
+  static size_t roundUp(size_t n_) noexcept
+  {
+    size_t p_ = 2;
+    while (p_ < n_) {
+      p_ <<= 1;
+    }
+    return p_;
+  }
+};
+
+/* SLPMpmcRing -------------------------------------------------------------- */
+
+/*!
+ * \brief Bounded ring of many producers and many consumers.
+ *
+ * Each cell has a sequence number that tells whether it's free for the
+ * producer of a lap or full for its consumer, so producers and consumers
+ * only contend on their own index.
+ * \note Based on: D. Vyukov, Bounded MPMC queue.
+ * https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+ */
+template<typename T>
+class SLPMpmcRing
+{
+public:
+  explicit SLPMpmcRing(size_t capacity_)
+    : cells_(roundUp(capacity_))
+    , mask_(roundUp(capacity_) - 1)
+  {
+    for (size_t i_ = 0; i_ <= mask_; ++i_) {
+      cells_[i_].seq_.store(i_, std::memory_order_relaxed);
+    }
+  }
+
+  bool tryPush(const T& v_) noexcept
+  {
+    size_t pos_ = tail_.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell& c_ = cells_[pos_ & mask_];
+      const size_t seq_ = c_.seq_.load(std::memory_order_acquire);
+      const auto dif_ =
+        static_cast<std::intptr_t>(seq_) - static_cast<std::intptr_t>(pos_);
+      if (dif_ == 0) {
+        if (tail_.compare_exchange_weak(
+              pos_, pos_ + 1, std::memory_order_relaxed)) {
+          c_.value_ = v_;
+          c_.seq_.store(pos_ + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (dif_ < 0) {
+        return false; // full
+      } else {
+        pos_ = tail_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  bool tryPop(T& v_) noexcept
+  {
+    size_t pos_ = head_.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell& c_ = cells_[pos_ & mask_];
+      const size_t seq_ = c_.seq_.load(std::memory_order_acquire);
+      const auto dif_ = static_cast<std::intptr_t>(seq_) -
+                        static_cast<std::intptr_t>(pos_ + 1);
+      if (dif_ == 0) {
+        if (head_.compare_exchange_weak(
+              pos_, pos_ + 1, std::memory_order_relaxed)) {
+          v_ = c_.value_;
+          c_.seq_.store(pos_ + mask_ + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (dif_ < 0) {
+        return false; // empty
+      } else {
+        pos_ = head_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  void push(const T& v_) noexcept
+  {
+    SLPBackoff b_;
+    while (!tryPush(v_)) {
+      b_.pause();
+    }
+  }
+
+  void pop(T& v_) noexcept
+  {
+    SLPBackoff b_;
+    while (!tryPop(v_)) {
+      b_.pause();
+    }
+  }
+
+  size_t capacity() const noexcept { return mask_ + 1; }
+
+private:
+  struct alignas(64) Cell
+  {
+    std::atomic<size_t> seq_;
+    T value_;
+  };
+
+  std::vector<Cell> cells_;
+  const size_t mask_;
+
+  alignas(64) std::atomic<size_t> head_ = { 0 };
+  alignas(64) std::atomic<size_t> tail_ = { 0 };
+
+  static size_t roundUp(size_t n_) noexcept
+  {
+    size_t p_ = 2;
+    while (p_ < n_) {
+      p_ <<= 1;
+    }
+    return p_;
+  }
+};
+
+} // namespace squidlogparser
+
+#endif // SLPSCAN_H
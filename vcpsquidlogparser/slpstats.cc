@@ -0,0 +1,521 @@
+/***************************************************************************
+ * Copyright (c) 2020-22                                                   *
+ *      Volnei Cervi Puttini.  All rights reserved.                        *
+ *      vcputtini@gmail.com
+ *                                                                         *
+ * Redistribution and use in source and binary forms, with or without      *
+ * modification, are permitted provided that the following conditions      *
+ * are met:                                                                *
+ * 1. Redistributions of source code must retain the above copyright       *
+ *    notice, this list of conditions and the following disclaimer.        *
+ * 2. Redistributions in binary form must reproduce the above copyright    *
+ *    notice, this list of conditions and the following disclaimer in the  *
+ *    documentation and/or other materials provided with the distribution. *
+ * 4. Neither the name of the Author     nor the names of its contributors *
+ *    may be used to endorse or promote products derived from this software*
+ *    without specific prior written permission.                           *
+ *                                                                         *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND *
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR      *
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS  *
+ * BE LIABLEFOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   *
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF    *
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS*
+ * INTERRUPTION)                                                           *
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,     *
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING   *
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE      *
+ * POSSIBILITY OFSUCH DAMAGE.                                              *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "slpstats.h"
+
+#include <array>
+#include <cstdio>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+namespace squidlogparser {
+
+/*!
+ * \internal
+ * \brief Block of counters of one thread. Only its thread writes to it.
+ *
+ * The increments are relaxed and the block is aligned to a cache line, so
+ * the threads never share a line of counters.
+ */
+struct alignas(64) StatsBlock
+{
+  using counter_t = std::atomic<uint64_t>;
+
+  std::array<counter_t, SLPStats::nFormats> lines_ = {};
+  std::array<counter_t, SLPStats::nErrors> failures_ = {};
+  counter_t bytes_ = {};
+
+  std::array<counter_t, SLPStats::nUdfs> calls_ = {};
+  std::array<counter_t, SLPStats::nUdfs> hits_ = {};
+  std::array<counter_t, SLPStats::nUdfs> misses_ = {};
+  std::array<counter_t, SLPStats::nUdfs> fallbacks_ = {};
+
+  std::array<counter_t, SLPStats::nStages> stageCalls_ = {};
+  std::array<counter_t, SLPStats::nStages> stageCycles_ = {};
+
+  template<typename TFunc>
+  void forEach(TFunc&& f_)
+  {
+    auto each_ = [&f_](auto& arr_) {
+      for (auto& c_ : arr_) {
+        f_(c_);
+      }
+    };
+    each_(lines_);
+    each_(failures_);
+    f_(bytes_);
+    each_(calls_);
+    each_(hits_);
+    each_(misses_);
+    each_(fallbacks_);
+    each_(stageCalls_);
+    each_(stageCycles_);
+  }
+};
+
+/*!
+ * \internal
+ * \brief Keeps the blocks of the live threads. The counters of the threads
+ * that have finished are moved to 'retired_'.
+ *
+ * The mutex is only taken when a thread starts or finishes and when the
+ * counters are read or reset, never on the per-row path.
+ */
+class StatsRegistry
+{
+public:
+  static StatsRegistry& instance()
+  {
+    static StatsRegistry reg_;
+    return reg_;
+  }
+
+  void attach(StatsBlock* b_)
+  {
+    std::lock_guard<std::mutex> lock_(mtx_);
+    live_.push_back(b_);
+  }
+
+  void detach(StatsBlock* b_)
+  {
+    std::lock_guard<std::mutex> lock_(mtx_);
+    add(retired_, *b_);
+    live_.erase(std::remove(live_.begin(), live_.end(), b_), live_.end());
+  }
+
+  size_t snapshot(StatsBlock& out_)
+  {
+    std::lock_guard<std::mutex> lock_(mtx_);
+    add(out_, retired_);
+    for (StatsBlock* b_ : live_) {
+      add(out_, *b_);
+    }
+    return live_.size();
+  }
+
+  void reset()
+  {
+    std::lock_guard<std::mutex> lock_(mtx_);
+    auto zero_ = [](StatsBlock::counter_t& c_) {
+      c_.exchange(0, std::memory_order_relaxed);
+    };
+    retired_.forEach(zero_);
+    for (StatsBlock* b_ : live_) {
+      b_->forEach(zero_);
+    }
+  }
+
+private:
+  std::mutex mtx_;
+  std::vector<StatsBlock*> live_;
+  StatsBlock retired_;
+
+  static void add(StatsBlock& dst_, StatsBlock& src_)
+  {
+    std::vector<uint64_t> values_;
+    src_.forEach([&values_](StatsBlock::counter_t& c_) {
+      values_.push_back(c_.load(std::memory_order_relaxed));
+    });
+    size_t i_ = 0;
+    dst_.forEach([&values_, &i_](StatsBlock::counter_t& c_) {
+      c_.fetch_add(values_[i_++], std::memory_order_relaxed);
+    });
+  }
+};
+
+/*!
+ * \internal
+ * \brief Registers the block of the thread on its first use and moves its
+ * counters to the registry when the thread finishes.
+ */
+struct ThreadStats
+{
+  StatsBlock block_;
+
+  ThreadStats() { StatsRegistry::instance().attach(&block_); }
+  ~ThreadStats() { StatsRegistry::instance().detach(&block_); }
+};
+
+static inline StatsBlock&
+local()
+{
+  thread_local ThreadStats ts_;
+  return ts_.block_;
+}
+
+static inline void
+bump(StatsBlock::counter_t& c_, uint64_t n_ = 1) noexcept
+{
+  c_.fetch_add(n_, std::memory_order_relaxed);
+}
+
+/*!
+ * \internal
+ * \brief Position of the error code in the array of failures.
+ */
+static constexpr size_t
+errorSlot(SLPStats::SLPError e_)
+{
+  const size_t slot_ = static_cast<size_t>(e_);
+  return slot_ < SLPStats::nErrors - 1 ? slot_ : SLPStats::nErrors - 1;
+}
+
+/* SLPStats ----------------------------------------------------------------- */
+
+/*!
+ * \brief Counts a line parsed successfully and the bytes scanned.
+ */
+void
+SLPStats::lineParsed(LogFormat f_, size_t bytes_) noexcept
+{
+  StatsBlock& b_ = local();
+  bump(b_.lines_[static_cast<size_t>(f_)]);
+  bump(b_.bytes_, bytes_);
+}
+
+/*!
+ * \brief Counts a failure by its error code.
+ */
+void
+SLPStats::parseFailed(SLPError e_) noexcept
+{
+  bump(local().failures_[errorSlot(e_)]);
+}
+
+/*!
+ * \brief Counts a call to the row function of the UDF.
+ */
+void
+SLPStats::udfCall(Udf u_) noexcept
+{
+  bump(local().calls_[static_cast<size_t>(u_)]);
+}
+
+/*!
+ * \brief The UDF reused the parser kept between rows.
+ */
+void
+SLPStats::cacheHit(Udf u_) noexcept
+{
+  bump(local().hits_[static_cast<size_t>(u_)]);
+}
+
+/*!
+ * \brief The UDF had to construct a new parser.
+ */
+void
+SLPStats::cacheMiss(Udf u_) noexcept
+{
+  bump(local().misses_[static_cast<size_t>(u_)]);
+}
+
+/*!
+ * \brief The UDF couldn't take its fast path and used the alternative, e.g.
+ * slp_str() returning the raw log line after a parsing error.
+ */
+void
+SLPStats::fallback(Udf u_) noexcept
+{
+  bump(local().fallbacks_[static_cast<size_t>(u_)]);
+}
+
+/*!
+ * \brief Accumulates the cycles spent in one stage of the parser.
+ */
+void
+SLPStats::stageCycles(Stage s_, uint64_t cycles_) noexcept
+{
+  StatsBlock& b_ = local();
+  bump(b_.stageCalls_[static_cast<size_t>(s_)]);
+  bump(b_.stageCycles_[static_cast<size_t>(s_)], cycles_);
+}
+
+/*!
+ * \brief Returns the sum of the counters of all threads.
+ * \return std::string JSON-formated, e.g.:
+ * \verbatim
+ * {"enabled":true,"threads":2,"bytes_scanned":1024,
+ *  "lines":{"squid":10,...},
+ *  "failures":{"SLP_ERR_PARSER_FAILED":1,...},
+ *  "udf":{"slp_int":{"calls":10,"cache_hits":9,"cache_misses":1,
+ *         "fallbacks":0},...},
+ *  "stages":{"match":{"calls":10,"cycles":123456},...}}
+ * \endverbatim
+ * \note Only the failures, the UDF's and the stages with non-zero counters are
+ * listed. "stages" is present only if it was built with SLP_WITH_STATS_CYCLES.
+ */
+std::string
+SLPStats::toJson()
+{
+  static constexpr const char* formats_[nFormats] = {
+    "squid", "common", "combined", "referrer", "useragent", "unknown"
+  };
+  static constexpr const char* errors_[nErrors] = {
+    "SLP_SUCCESS",
+    "SLP_ERR_PARSER_FAILED",
+    "SLP_ERR_INVALID_TIMESTAMP",
+    "SLP_ERR_INCOMPLETE_NUM_ARGS",
+    "SLP_ERR_INVALID_DATE",
+    "SLP_ERR_INVALID_TIME",
+    "SLP_ERR_INVALID_TS_OR_IP",
+    "SLP_ERR_XML_FILE_NOT_SAVE",
+    "SLP_ERR_XML_FILE_NAME_INCONSISTENT",
+    "SLP_ERR_REGEX_COLLATE",
+    "SLP_ERR_REGEX_CTYPE",
+    "SLP_ERR_REGEX_ESCAPE",
+    "SLP_ERR_REGEX_BACKREF",
+    "SLP_ERR_REGEX_BRACK",
+    "SLP_ERR_REGEX_PAREN",
+    "SLP_ERR_REGEX_BRACE",
+    "SLP_ERR_REGEX_BADBRACE",
+    "SLP_ERR_REGEX_RANGE",
+    "SLP_ERR_REGEX_SPACE",
+    "SLP_ERR_REGEX_BADREPEAT",
+    "SLP_ERR_REGEX_COMPLEXITY",
+    "SLP_ERR_REGEX_STACK",
+    "SLP_ERR_UNKNOWN"
+  };
+  static constexpr const char* udfs_[nUdfs] = {
+    "slp_int",       "slp_str",     "slp_urldecode", "slp_urlparts",
+    "slp_urlparam",  "slp_toUnixTs", "slp_toSquidTs", "slp_sum",
+    "slp_countbyrm", "slp_countbyhttpcode", "slp_file_agg",
+    "slp_method_histogram", "slp_status_histogram", "slp_hit_ratio",
+    "slp_percentile", "slp_timeseries", "slp_sessions",
+    "slp_approx_distinct", "slp_cms_build", "slp_topk", "slp_bytes_by"
+  };
+  static constexpr const char* stages_[nStages] = {
+    "normalize", "match", "extract", "insert"
+  };
+
+  if (!enabled()) {
+    return "{\"enabled\":false}";
+  }
+
+  StatsBlock sum_;
+  const size_t threads_ = StatsRegistry::instance().snapshot(sum_);
+  auto get_ = [](const StatsBlock::counter_t& c_) {
+    return c_.load(std::memory_order_relaxed);
+  };
+
+  std::stringstream ss;
+  ss << "{\"enabled\":true"
+     << ",\"threads\":" << threads_
+     << ",\"bytes_scanned\":" << get_(sum_.bytes_);
+
+  ss << ",\"lines\":{";
+  for (size_t i_ = 0; i_ < nFormats; ++i_) {
+    ss << (i_ ? "," : "") << "\"" << formats_[i_]
+       << "\":" << get_(sum_.lines_[i_]);
+  }
+  ss << "}";
+
+  ss << ",\"failures\":{";
+  const char* sep_ = "";
+  for (size_t i_ = 0; i_ < nErrors; ++i_) {
+    if (const uint64_t n_ = get_(sum_.failures_[i_]); n_ != 0) {
+      ss << sep_ << "\"" << errors_[i_] << "\":" << n_;
+      sep_ = ",";
+    }
+  }
+  ss << "}";
+
+  ss << ",\"udf\":{";
+  sep_ = "";
+  for (size_t i_ = 0; i_ < nUdfs; ++i_) {
+    if (get_(sum_.calls_[i_]) == 0) {
+      continue;
+    }
+    ss << sep_ << "\"" << udfs_[i_] << "\":{"
+       << "\"calls\":" << get_(sum_.calls_[i_])
+       << ",\"cache_hits\":" << get_(sum_.hits_[i_])
+       << ",\"cache_misses\":" << get_(sum_.misses_[i_])
+       << ",\"fallbacks\":" << get_(sum_.fallbacks_[i_]) << "}";
+    sep_ = ",";
+  }
+  ss << "}";
+
+#ifdef SLP_WITH_STATS_CYCLES
+  ss << ",\"stages\":{";
+  sep_ = "";
+  for (size_t i_ = 0; i_ < nStages; ++i_) {
+    if (get_(sum_.stageCalls_[i_]) == 0) {
+      continue;
+    }
+    ss << sep_ << "\"" << stages_[i_] << "\":{"
+       << "\"calls\":" << get_(sum_.stageCalls_[i_])
+       << ",\"cycles\":" << get_(sum_.stageCycles_[i_]) << "}";
+    sep_ = ",";
+  }
+  ss << "}";
+#else
+  (void)stages_;
+#endif
+
+  ss << "}";
+  return ss.str();
+}
+
+/*!
+ * \brief Zeroes the counters of all threads.
+ */
+void
+SLPStats::reset() noexcept
+{
+  StatsRegistry::instance().reset();
+}
+
+/* SLPErrorLog -------------------------------------------------------------- */
+
+/*!
+ * \internal
+ * \brief Samples of the errors, kept in fixed-size buffers so that record()
+ * never allocates. When the ring is full the oldest sample is overwritten.
+ */
+struct ErrorSample
+{
+  SLPStats::SLPError code_ = SLPStats::SLPError::SLP_SUCCESS;
+  const char* where_ = "";
+  std::array<char, 128> what_ = {};
+  std::array<char, SLPErrorLog::maxLine + 1> line_ = {};
+};
+
+class ErrorRing
+{
+public:
+  static ErrorRing& instance()
+  {
+    static ErrorRing ring_;
+    return ring_;
+  }
+
+  /*!
+   * \brief Token bucket of 'maxPerSecond' samples, shared by all threads.
+   */
+  bool admit() noexcept
+  {
+    const int64_t now_ =
+      std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+    int64_t seen_ = window_.load(std::memory_order_relaxed);
+    if (now_ != seen_ &&
+        window_.compare_exchange_strong(seen_, now_,
+                                        std::memory_order_relaxed)) {
+      taken_.store(0, std::memory_order_relaxed);
+    }
+    return taken_.fetch_add(1, std::memory_order_relaxed) <
+           SLPErrorLog::maxPerSecond;
+  }
+
+  void push(const SLPErrorLog::LastError& e_, std::string_view line_) noexcept
+  {
+    // Never waits: if another thread is pushing or flushing, the sample is
+    // dropped.
+    std::unique_lock<std::mutex> lock_(mtx_, std::try_to_lock);
+    if (!lock_.owns_lock()) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    ErrorSample& s_ = samples_[next_ % SLPErrorLog::maxSamples];
+    s_.code_ = e_.code_;
+    s_.where_ = e_.where_;
+    s_.what_ = e_.what_;
+    const size_t n_ = std::min(line_.size(), SLPErrorLog::maxLine);
+    std::memcpy(s_.line_.data(), line_.data(), n_);
+    s_.line_[n_] = '\0';
+    ++next_;
+  }
+
+  void dropped() noexcept { dropped_.fetch_add(1, std::memory_order_relaxed); }
+
+  void flush() noexcept
+  {
+    std::lock_guard<std::mutex> lock_(mtx_);
+    const size_t n_ = std::min(next_, SLPErrorLog::maxSamples);
+    for (size_t i_ = next_ - n_; i_ < next_; ++i_) {
+      const ErrorSample& s_ = samples_[i_ % SLPErrorLog::maxSamples];
+      std::fprintf(stderr,
+                   "squidlogparser: %s: error %d: %s [%s]\n",
+                   s_.where_,
+                   static_cast<int>(s_.code_),
+                   s_.what_.data(),
+                   s_.line_.data());
+    }
+    if (const uint64_t d_ = dropped_.exchange(0, std::memory_order_relaxed);
+        d_ != 0) {
+      std::fprintf(stderr, "squidlogparser: %llu samples dropped\n",
+                   static_cast<unsigned long long>(d_));
+    }
+    next_ = 0;
+  }
+
+private:
+  std::mutex mtx_;
+  std::array<ErrorSample, SLPErrorLog::maxSamples> samples_ = {};
+  size_t next_ = 0;
+  std::atomic<int64_t> window_ = { 0 };
+  std::atomic<uint32_t> taken_ = { 0 };
+  std::atomic<uint64_t> dropped_ = { 0 };
+};
+
+/*!
+ * \brief Keeps a sample of the error, if the rate limit allows it.
+ * \param e_ Last error of the parser.
+ * \param line_ Log line that failed. Only a prefix of it is kept.
+ */
+void
+SLPErrorLog::record(const LastError& e_, std::string_view line_) noexcept
+{
+  ErrorRing& ring_ = ErrorRing::instance();
+  if (!ring_.admit()) {
+    ring_.dropped();
+    return;
+  }
+  ring_.push(e_, line_);
+}
+
+/*!
+ * \brief Writes the samples kept so far to stderr and discards them.
+ * \note Called when the UDF's finish (_deinit), never on the per-row path.
+ */
+void
+SLPErrorLog::flush() noexcept
+{
+  ErrorRing::instance().flush();
+}
+
+} // namespace squidlogparser
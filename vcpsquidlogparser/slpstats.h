@@ -0,0 +1,226 @@
+/***************************************************************************
+ * Copyright (c) 2020-22                                                   *
+ *      Volnei Cervi Puttini.  All rights reserved.                        *
+ *      vcputtini@gmail.com
+ *                                                                         *
+ * Redistribution and use in source and binary forms, with or without      *
+ * modification, are permitted provided that the following conditions      *
+ * are met:                                                                *
+ * 1. Redistributions of source code must retain the above copyright       *
+ *    notice, this list of conditions and the following disclaimer.        *
+ * 2. Redistributions in binary form must reproduce the above copyright    *
+ *    notice, this list of conditions and the following disclaimer in the  *
+ *    documentation and/or other materials provided with the distribution. *
+ * 4. Neither the name of the Author     nor the names of its contributors *
+ *    may be used to endorse or promote products derived from this software*
+ *    without specific prior written permission.                           *
+ *                                                                         *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND *
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR      *
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS  *
+ * BE LIABLEFOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   *
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF    *
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS*
+ * INTERRUPTION)                                                           *
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,     *
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING   *
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE      *
+ * POSSIBILITY OFSUCH DAMAGE.                                              *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*!
+ * \brief How this file is organized:
+ *
+ * Hot-path counters of the parser and of the UDF layer.
+ *
+ * Each thread (i.e. each MariaDB connection) increments its own block of
+ * counters, so there's no lock and no shared cache line on the per-row path.
+ * The blocks are only summed when they are read: slp_stats().
+ *
+ * The counters are compiled in only if SLP_WITH_STATS is defined and the
+ * cycle counts per stage only if SLP_WITH_STATS_CYCLES is also defined.
+ * Otherwise the SLP_STATS*() macros expand to nothing.
+ *
+ * SLPErrorLog keeps a rate-limited sample of the parsing errors, which is
+ * written to stderr (the MariaDB error log) when the UDF finishes, never on
+ * the per-row path. It's compiled in only if SLP_WITH_ERROR_LOG is defined.
+ *
+ * \note The constants above are defined in CMakeLists.txt
+ */
+
+#ifndef SLPSTATS_H
+#define SLPSTATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#if defined(SLP_WITH_STATS_CYCLES) &&                                         \
+  (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h> // __rdtsc()
+#endif
+
+#include "squidlogparser.h"
+
+namespace squidlogparser {
+
+class SquidLogParser_EXPORT SLPStats
+{
+public:
+  using LogFormat = SquidLogData::LogFormat;
+  using SLPError = SquidLogData::SLPError;
+
+  /*!
+   * \brief Stages of SquidLogParser::append().
+   * \warning Do not change the order of the objects defined below.
+   */
+  enum class Stage
+  {
+    Normalize = 0x00, // removeExtraWhiteSpaces()
+    Match,            // regular expression
+    Extract,          // conversion of the fields
+    Insert,           // timestamp and insertion into the entries
+    Unknown
+  };
+
+  /*!
+   * \brief UDF's with counters of their own.
+   * \warning Do not change the order of the objects defined below.
+   */
+  enum class Udf
+  {
+    Int = 0x00,
+    Str,
+    UrlDecode,
+    UrlParts,
+    UrlParam,
+    ToUnixTs,
+    ToSquidTs,
+    Sum,
+    CountByRm,
+    CountByHttpCode,
+    FileAgg,
+    MethodHistogram,
+    StatusHistogram,
+    HitRatio,
+    Percentile,
+    TimeSeries,
+    Sessions,
+    ApproxDistinct,
+    CountMin,
+    TopK,
+    BytesBy,
+    Unknown
+  };
+
+  static constexpr size_t nFormats =
+    static_cast<size_t>(LogFormat::Unknown) + 1;
+  static constexpr size_t nErrors =
+    static_cast<size_t>(SLPError::SLP_ERR_REGEX_STACK) + 2; // + UNKNOWN
+  static constexpr size_t nStages = static_cast<size_t>(Stage::Unknown);
+  static constexpr size_t nUdfs = static_cast<size_t>(Udf::Unknown);
+
+  static void lineParsed(LogFormat f_, size_t bytes_) noexcept;
+  static void parseFailed(SLPError e_) noexcept;
+
+  static void udfCall(Udf u_) noexcept;
+  static void cacheHit(Udf u_) noexcept;
+  static void cacheMiss(Udf u_) noexcept;
+  static void fallback(Udf u_) noexcept;
+
+  static void stageCycles(Stage s_, uint64_t cycles_) noexcept;
+
+  static std::string toJson();
+  static void reset() noexcept;
+
+  static constexpr bool enabled() noexcept
+  {
+#ifdef SLP_WITH_STATS
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  /*!
+   * \brief Time-stamp counter, or nanoseconds where there's no TSC.
+   */
+  static inline uint64_t cycles() noexcept
+  {
+#ifndef SLP_WITH_STATS_CYCLES
+    return 0;
+#elif defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>(
+      std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+  }
+
+  /*!
+   * \brief Accumulates the cycles spent in the scope where it was declared.
+   */
+  class StageTimer
+  {
+  public:
+    explicit StageTimer(Stage s_) noexcept
+      : stage_(s_)
+      , start_(cycles())
+    {}
+    ~StageTimer() { stageCycles(stage_, cycles() - start_); }
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+  private:
+    Stage stage_;
+    uint64_t start_;
+  };
+};
+
+/* SLPErrorLog -------------------------------------------------------------- */
+
+class SquidLogParser_EXPORT SLPErrorLog
+{
+public:
+  using LastError = SquidLogData::LastError;
+
+  static constexpr size_t maxSamples = 64;     // kept until flush()
+  static constexpr uint32_t maxPerSecond = 10; // rate limit of the samples
+  static constexpr size_t maxLine = 96;        // prefix of the log line kept
+
+  static void record(const LastError& e_, std::string_view line_) noexcept;
+  static void flush() noexcept;
+};
+
+} // namespace squidlogparser
+
+#ifdef SLP_WITH_ERROR_LOG
+#define SLP_ERROR_LOG(call_) squidlogparser::SLPErrorLog::call_
+#else
+#define SLP_ERROR_LOG(call_) ((void)0)
+#endif
+
+#ifdef SLP_WITH_STATS
+#define SLP_STATS(call_) squidlogparser::SLPStats::call_
+#else
+#define SLP_STATS(call_) ((void)0)
+#endif
+
+#if defined(SLP_WITH_STATS) && defined(SLP_WITH_STATS_CYCLES)
+#define SLP_STATS_STAGE(stage_)                                                \
+  squidlogparser::SLPStats::StageTimer slp_stage_timer_(                       \
+    squidlogparser::SLPStats::Stage::stage_)
+#else
+#define SLP_STATS_STAGE(stage_) ((void)0)
+#endif
+
+#endif // SLPSTATS_H
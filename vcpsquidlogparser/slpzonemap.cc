@@ -0,0 +1,228 @@
+/***************************************************************************
+ * Copyright (c) 2020-22                                                   *
+ *      Volnei Cervi Puttini.  All rights reserved.                        *
+ *      vcputtini@gmail.com
+ *                                                                         *
+ * Redistribution and use in source and binary forms, with or without      *
+ * modification, are permitted provided that the following conditions      *
+ * are met:                                                                *
+ * 1. Redistributions of source code must retain the above copyright       *
+ *    notice, this list of conditions and the following disclaimer.        *
+ * 2. Redistributions in binary form must reproduce the above copyright    *
+ *    notice, this list of conditions and the following disclaimer in the  *
+ *    documentation and/or other materials provided with the distribution. *
+ * 4. Neither the name of the Author     nor the names of its contributors *
+ *    may be used to endorse or promote products derived from this software*
+ *    without specific prior written permission.                           *
+ *                                                                         *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND *
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR      *
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS  *
+ * BE LIABLEFOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   *
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF    *
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS*
+ * INTERRUPTION)                                                           *
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,     *
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING   *
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE      *
+ * POSSIBILITY OFSUCH DAMAGE.                                              *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "slpzonemap.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace squidlogparser {
+
+static_assert(sizeof(SLPZoneMap::Zone) == 32, "layout of the sidecar");
+
+SLPZoneMap::SLPZoneMap(LogFormat f_)
+  : fmt_(f_)
+{}
+
+/*!
+ * \brief Appends the next block of the file. The blocks must be added in
+ * order and without gaps.
+ */
+void
+SLPZoneMap::add(const Zone& z_)
+{
+  zones_.push_back(z_);
+  covered_ = z_.offset_ + z_.bytes_;
+}
+
+void
+SLPZoneMap::clear() noexcept
+{
+  zones_.clear();
+  covered_ = 0;
+  error_.clear();
+}
+
+/*!
+ * \brief Writes the sidecar of log_ (to a temporary file renamed into place,
+ * so a reader never sees half of it).
+ */
+bool
+SLPZoneMap::save(const std::string& log_)
+{
+  struct stat st_;
+  if (::stat(log_.c_str(), &st_) != 0) {
+    error_ = log_ + ": " + std::strerror(errno);
+    return false;
+  }
+
+  Header h_ = {};
+  std::memcpy(h_.magic_, magic, sizeof(magic));
+  h_.format_ = static_cast<uint32_t>(fmt_);
+  h_.zones_ = zones_.size();
+  h_.covered_ = covered_;
+  h_.dev_ = static_cast<uint64_t>(st_.st_dev);
+  h_.ino_ = static_cast<uint64_t>(st_.st_ino);
+
+  const std::string path_ = sidecarOf(log_);
+  const std::string tmp_ = path_ + ".tmp";
+  FILE* f_ = std::fopen(tmp_.c_str(), "wb");
+  if (f_ == nullptr) {
+    error_ = tmp_ + ": " + std::strerror(errno);
+    return false;
+  }
+  bool ok_ = std::fwrite(&h_, sizeof(h_), 1, f_) == 1 &&
+             std::fwrite(zones_.data(), sizeof(Zone), zones_.size(), f_) ==
+               zones_.size() &&
+             std::fflush(f_) == 0 && ::fsync(::fileno(f_)) == 0;
+  ok_ = std::fclose(f_) == 0 && ok_;
+  if (!ok_ || std::rename(tmp_.c_str(), path_.c_str()) != 0) {
+    error_ = path_ + ": " + std::strerror(errno);
+    std::remove(tmp_.c_str());
+    return false;
+  }
+  return true;
+}
+
+/*!
+ * \brief Reads the sidecar of log_.
+ * \return false if there's none, or if it's not of this format, of this
+ * file (inode) or of all of its bytes (truncated), see error().
+ */
+bool
+SLPZoneMap::load(const std::string& log_)
+{
+  clear();
+
+  struct stat st_;
+  if (::stat(log_.c_str(), &st_) != 0) {
+    error_ = log_ + ": " + std::strerror(errno);
+    return false;
+  }
+
+  const std::string path_ = sidecarOf(log_);
+  FILE* f_ = std::fopen(path_.c_str(), "rb");
+  if (f_ == nullptr) {
+    error_ = path_ + ": " + std::strerror(errno);
+    return false;
+  }
+
+  Header h_ = {};
+  struct stat side_ = {};
+  bool ok_ = std::fread(&h_, sizeof(h_), 1, f_) == 1 &&
+             std::memcmp(h_.magic_, magic, sizeof(magic)) == 0;
+  if (!ok_) {
+    error_ = path_ + ": not a zone map";
+  } else if (::fstat(::fileno(f_), &side_) != 0 ||
+             static_cast<uint64_t>(side_.st_size) < sizeof(Header) ||
+             h_.zones_ != (static_cast<uint64_t>(side_.st_size) -
+                           sizeof(Header)) / sizeof(Zone) ||
+             (static_cast<uint64_t>(side_.st_size) - sizeof(Header)) %
+                 sizeof(Zone) !=
+               0) {
+    // The zones are only allocated if the sidecar has all of them.
+    error_ = path_ + ": corrupted (size)";
+    ok_ = false;
+  } else if (h_.format_ != static_cast<uint32_t>(fmt_)) {
+    error_ = path_ + ": of another log format";
+    ok_ = false;
+  } else if (h_.dev_ != static_cast<uint64_t>(st_.st_dev) ||
+             h_.ino_ != static_cast<uint64_t>(st_.st_ino) ||
+             h_.covered_ > static_cast<uint64_t>(st_.st_size)) {
+    error_ = path_ + ": stale (the log was rotated or truncated)";
+    ok_ = false;
+  } else if (h_.zones_ > h_.covered_) { // at least a byte per zone
+    error_ = path_ + ": corrupted";
+    ok_ = false;
+  }
+
+  if (ok_) {
+    zones_.resize(h_.zones_);
+    ok_ = std::fread(zones_.data(), sizeof(Zone), zones_.size(), f_) ==
+          zones_.size();
+    // The zones must tile [0, covered).
+    uint64_t next_ = 0;
+    for (size_t i_ = 0; ok_ && i_ < zones_.size(); ++i_) {
+      ok_ = zones_[i_].offset_ == next_;
+      next_ += zones_[i_].bytes_;
+    }
+    ok_ = ok_ && next_ == h_.covered_;
+    if (!ok_) {
+      error_ = path_ + ": corrupted";
+    }
+  }
+  std::fclose(f_);
+
+  if (!ok_) {
+    zones_.clear();
+    return false;
+  }
+  covered_ = h_.covered_;
+  return true;
+}
+
+/*!
+ * \brief Byte ranges of the file that may have lines of [from_, to_]: the
+ * zones that meet the window, merged when adjacent, and the bytes appended
+ * after the zone map (size_ is the current size of the file).
+ */
+std::vector<SLPZoneMap::Range>
+SLPZoneMap::ranges(uint32_t from_, uint32_t to_, uint64_t size_) const
+{
+  std::vector<Range> out_;
+  auto push_ = [&out_](uint64_t offset_, uint64_t bytes_) {
+    if (bytes_ == 0) {
+      return;
+    }
+    if (!out_.empty() &&
+        out_.back().offset_ + out_.back().bytes_ == offset_) {
+      out_.back().bytes_ += bytes_;
+    } else {
+      out_.push_back({ offset_, bytes_ });
+    }
+  };
+
+  for (const Zone& z_ : zones_) {
+    if (!z_.empty() && z_.maxTs_ >= from_ && z_.minTs_ <= to_) {
+      push_(z_.offset_, z_.bytes_);
+    }
+  }
+  if (size_ > covered_) {
+    push_(covered_, size_ - covered_);
+  }
+  return out_;
+}
+
+std::string
+SLPZoneMap::sidecarOf(const std::string& log_)
+{
+  return log_ + ".slpz";
+}
+
+} // namespace squidlogparser
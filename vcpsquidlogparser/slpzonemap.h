@@ -0,0 +1,140 @@
+/***************************************************************************
+ * Copyright (c) 2020-22                                                   *
+ *      Volnei Cervi Puttini.  All rights reserved.                        *
+ *      vcputtini@gmail.com
+ *                                                                         *
+ * Redistribution and use in source and binary forms, with or without      *
+ * modification, are permitted provided that the following conditions      *
+ * are met:                                                                *
+ * 1. Redistributions of source code must retain the above copyright       *
+ *    notice, this list of conditions and the following disclaimer.        *
+ * 2. Redistributions in binary form must reproduce the above copyright    *
+ *    notice, this list of conditions and the following disclaimer in the  *
+ *    documentation and/or other materials provided with the distribution. *
+ * 4. Neither the name of the Author     nor the names of its contributors *
+ *    may be used to endorse or promote products derived from this software*
+ *    without specific prior written permission.                           *
+ *                                                                         *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND *
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR      *
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS  *
+ * BE LIABLEFOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   *
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF    *
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS*
+ * INTERRUPTION)                                                           *
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,     *
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING   *
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE      *
+ * POSSIBILITY OFSUCH DAMAGE.                                              *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*!
+ * \brief How this file is organized:
+ *
+ * Zone map of an access-log file: a sidecar (FILE.slpz) with, for every
+ * block of the file (about 1 MB, cut at a newline), its byte offset, its
+ * number of lines and the min and max timestamp of its lines.
+ *
+ * The logs are written in time order, so a time window falls on a few
+ * contiguous blocks, and the scans of the file read only the blocks whose
+ * [min, max] meets the window. The timestamp is the one of DataKey (%ts, or
+ * %tl for the formats without %ts).
+ *
+ * The sidecar is written by slpload --zonemap. It's tied to the inode of the
+ * file and only used while the file still has every byte it covers, so a log
+ * that is appended to keeps its zone map (the bytes after it are scanned in
+ * full) and a rotated or truncated one doesn't.
+ *
+ * Layout (native byte order):
+ * \verbatim
+ * Header: magic "SLPZMAP1", format, zones, covered bytes, dev, ino (48 bytes)
+ * Zone:   offset, bytes, lines, min ts, max ts (32 bytes), in offset order
+ * \endverbatim
+ */
+
+#ifndef SLPZONEMAP_H
+#define SLPZONEMAP_H
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "squidlogparser.h"
+
+namespace squidlogparser {
+
+class SquidLogParser_EXPORT SLPZoneMap
+{
+public:
+  using LogFormat = SquidLogData::LogFormat;
+
+  struct Zone
+  {
+    uint64_t offset_ = 0;
+    uint64_t bytes_ = 0;
+    uint32_t lines_ = 0;
+    uint32_t minTs_ = std::numeric_limits<uint32_t>::max();
+    uint32_t maxTs_ = 0;
+    uint32_t reserved_ = 0;
+
+    // No line of the zone has a timestamp.
+    bool empty() const noexcept { return minTs_ > maxTs_; }
+  };
+
+  // Bytes of the file to read.
+  struct Range
+  {
+    uint64_t offset_ = 0;
+    uint64_t bytes_ = 0;
+  };
+
+  explicit SLPZoneMap(LogFormat f_ = LogFormat::Squid);
+
+  void add(const Zone& z_);
+  void clear() noexcept;
+
+  bool save(const std::string& log_);
+  bool load(const std::string& log_);
+
+  std::vector<Range> ranges(uint32_t from_,
+                            uint32_t to_,
+                            uint64_t size_) const;
+
+  const std::vector<Zone>& zones() const noexcept { return zones_; }
+  uint64_t covered() const noexcept { return covered_; }
+  const std::string& error() const noexcept { return error_; }
+
+  static std::string sidecarOf(const std::string& log_);
+
+  static constexpr size_t blockSize = 1 << 20;
+
+private:
+  struct Header
+  {
+    char magic_[8];
+    uint32_t format_;
+    uint32_t reserved_;
+    uint64_t zones_;
+    uint64_t covered_;
+    uint64_t dev_;
+    uint64_t ino_;
+  };
+
+  static constexpr char magic[8] = { 'S', 'L', 'P', 'Z', 'M', 'A', 'P', '1' };
+
+  LogFormat fmt_;
+  std::vector<Zone> zones_ = {};
+  uint64_t covered_ = 0;
+  std::string error_ = {};
+};
+
+} // namespace squidlogparser
+
+#endif // SLPZONEMAP_H
@@ -35,6 +35,7 @@
  ***************************************************************************/
 
 #include "squidlogparser.h"
+#include "slpstats.h"
 
 namespace squidlogparser {
 
@@ -309,57 +310,57 @@ SquidLogParser::append(const std::string& raw_log_)
 {
   try {
     std::string tmp_(std::move(raw_log_), raw_log_.size());
-    removeExtraWhiteSpaces(raw_log_, tmp_);
+    {
+      SLP_STATS_STAGE(Normalize);
+      removeExtraWhiteSpaces(raw_log_, tmp_);
+    }
     rawLog_.resize(tmp_.size());
     rawLog_ = tmp_;
     switch (logFmt_) {
       case LogFormat::Squid: {
         if (parserSquid() == SLPError::SLP_SUCCESS) {
-          mEntry.insert({ DataKey(ds_squid_.timeStamp, ds_squid_.cliSrcIpAddr),
-                          ds_squid_ });
+          insertEntry();
         }
         break;
       }
       case LogFormat::Common: {
         if (parserCommon() == SLPError::SLP_SUCCESS) {
-          mEntry.insert({ DataKey(unixTimestamp(ds_squid_.localTime),
-                                  ds_squid_.cliSrcIpAddr),
-                          ds_squid_ });
+          insertEntry();
         }
         break;
       }
       case LogFormat::Combined: {
         if (parserCombined() == SLPError::SLP_SUCCESS) {
-          mEntry.insert({ DataKey(unixTimestamp(ds_squid_.localTime),
-                                  ds_squid_.cliSrcIpAddr),
-                          ds_squid_ });
+          insertEntry();
         }
         break;
       }
       case LogFormat::Referrer: {
         if (parserReferrer() == SLPError::SLP_SUCCESS) {
-          mEntry.insert({ DataKey(ds_squid_.timeStamp, ds_squid_.cliSrcIpAddr),
-                          ds_squid_ });
+          insertEntry();
         }
         break;
       }
       case LogFormat::UserAgent: {
         if (parserUserAgent() == SLPError::SLP_SUCCESS) {
-          mEntry.insert({ DataKey(unixTimestamp(ds_squid_.localTime),
-                                  ds_squid_.cliSrcIpAddr),
-                          ds_squid_ });
+          insertEntry();
         }
+        break;
       }
       default: {
-        ;
+        fail(SLPError::SLP_ERR_PARSER_FAILED, __func__, "Unknown log format.");
       }
     }
   } catch (const std::exception& e) {
-    std::cout << "\n"
-              << __FUNCTION__ << ": [" << __LINE__ << "] "
-              << __FILE__ ": An exception occurred: " << e.what() << "\n\n";
+    fail(SLPError::SLP_ERR_PARSER_FAILED, __func__, e.what());
   };
 
+  if (slpError_ == SLPError::SLP_SUCCESS) {
+    SLP_STATS(lineParsed(logFmt_, raw_log_.size()));
+  } else {
+    SLP_STATS(parseFailed(slpError_));
+  }
+
   return *this;
 }
 
@@ -380,14 +381,73 @@ void
 SquidLogParser::clear()
 {
   mEntry.clear();
+  mByClient.clear();
+}
+
+/*!
+ * \brief Entries of the time window [from_, to_], in the order of mEntry.
+ * \return [first, second), in O(log n): the entries are ordered by timestamp
+ * (see DataKey::operator<).
+ */
+std::pair<SquidLogParser::Entry, SquidLogParser::Entry>
+SquidLogParser::range(uint32_t from_, uint32_t to_) const
+{
+  if (from_ > to_) {
+    return { mEntry.cend(), mEntry.cend() };
+  }
+  const Entry first_ = mEntry.lower_bound(DataKey(from_, 0));
+  return { first_, mEntry.upper_bound(DataKey(to_, 0)) };
+}
+
+/*!
+ * \brief Turns on (or off) the index of the entries by client address,
+ * which append() keeps from then on. Turning it on indexes the entries
+ * already kept.
+ */
+void
+SquidLogParser::indexClients(bool on_)
+{
+  indexClients_ = on_;
+  mByClient.clear();
+  if (on_) {
+    for (Entry it_ = mEntry.cbegin(); it_ != mEntry.cend(); ++it_) {
+      mByClient[it_->first.getIp()].push_back(it_);
+    }
+  }
+}
+
+/*!
+ * \brief Entries of one client in the time window [from_, to_], in
+ * O(log n) once the postings of the client are found.
+ * \return [first, second) of Entry, in timestamp order. Empty if the
+ * client has no entry or the index is off, see indexClients().
+ */
+SquidLogParser::PostingsRange
+SquidLogParser::byClient(uint32_t ip_, uint32_t from_, uint32_t to_) const
+{
+  const auto it_ = mByClient.find(ip_);
+  if (it_ == mByClient.end() || from_ > to_) {
+    static const Postings none_;
+    return { none_.cbegin(), none_.cend() };
+  }
+  const Postings& p_ = it_->second;
+  const auto first_ =
+    std::lower_bound(p_.cbegin(), p_.cend(), from_, [](Entry e_, uint32_t t_) {
+      return e_->first.getTs() < t_;
+    });
+  const auto last_ =
+    std::upper_bound(first_, p_.cend(), to_, [](uint32_t t_, Entry e_) {
+      return t_ < e_->first.getTs();
+    });
+  return { first_, last_ };
 }
 
 /*!
  * \brief SquidLogParser::getPartInt
  * \param f_
- * \return int
+ * \return int64_t
  */
-int
+int64_t
 SquidLogParser::getPartInt(Fields f_) const
 {
   return intFields(f_, ds_squid_);
@@ -415,6 +475,32 @@ SquidLogParser::getPartStr(Fields f_) const
   return strFields(f_, ds_squid_);
 }
 
+/*!
+ * \brief HTTP status of the last line parsed, of any format. The squid
+ * format only has it after the '/' of %Ss/%03>Hs (e.g. TCP_MISS/200).
+ * \return -1 if the line has no status.
+ */
+int
+SquidLogParser::httpStatus() const noexcept
+{
+  if (logFmt_ != LogFormat::Squid) {
+    return intFields(Fields::HttpStatus, ds_squid_);
+  }
+  const std::string& s_ = ds_squid_.reqStatusHierStatus;
+  const size_t slash_ = s_.rfind('/');
+  if (slash_ == std::string::npos || slash_ + 1 == s_.size()) {
+    return -1;
+  }
+  int code_ = 0;
+  for (size_t i_ = slash_ + 1; i_ < s_.size(); ++i_) {
+    if (s_[i_] < '0' || s_[i_] > '9' || code_ > 99999) {
+      return -1;
+    }
+    code_ = code_ * 10 + (s_[i_] - '0');
+  }
+  return code_;
+}
+
 /*!
  * \brief SquidLogParser::getUrlParts
  * \return
@@ -480,7 +566,8 @@ uint32_t
 SquidLogParser::unixTimestamp(const std::string d_) const
 {
   if (!d_.empty()) {
-    boost::regex re_(cp_fmt_squid_date);
+    // Compiled once: matching a shared const regex is thread-safe.
+    static const boost::regex re_(cp_fmt_squid_date);
     boost::match_results<std::string::const_iterator> match;
     boost::regex_match(d_, match, re_);
     if (!match.empty()) {
@@ -512,7 +599,8 @@ std::string
 SquidLogParser::unixToSquidDate(std::time_t uts_) const
 {
   char buf_[27];
-  struct std::tm tm_ = { *std::localtime(&uts_) };
+  struct std::tm tm_ = {};
+  ::localtime_r(&uts_, &tm_); // std::localtime() shares a static buffer
   ::strftime(buf_, sizeof(buf_), "%d/%b/%Y:%H:%M:%S %z", &tm_);
   return std::string(buf_);
 }
@@ -650,6 +738,41 @@ SquidLogParser::setError(SLPError e_)
   slpError_ = e_;
 }
 
+/*!
+ * \internal
+ * \brief Records the error in the last-error record of the parser, without
+ * any I/O. If the sampled error log was compiled in, the error may also be
+ * queued to be written later, outside the per-row path.
+ *
+ * \param e_ Error code
+ * \param where_ Function where the error happened.
+ * \param what_ Description, e.g. std::exception::what(). It's truncated.
+ * \return SLPError The same error code, for convenience.
+ */
+SquidLogParser::SLPError
+SquidLogParser::fail(SLPError e_, const char* where_, const char* what_)
+{
+  setError(e_);
+  lastError_.code_ = e_;
+  lastError_.where_ = where_;
+  std::strncpy(lastError_.what_.data(), what_, lastError_.what_.size() - 1);
+  lastError_.what_.back() = '\0';
+  ++lastError_.count_;
+  SLP_ERROR_LOG(record(lastError_, rawLog_));
+  return e_;
+}
+
+/*!
+ * \brief Returns the record of the last error of the parser.
+ * \return LastError Code, function, description and the number of errors
+ * since the parser was constructed.
+ */
+const SquidLogParser::LastError&
+SquidLogParser::lastError() const noexcept
+{
+  return lastError_;
+}
+
 std::string
 SquidLogParser::getErrorRE(boost::regex_error& e_) const
 {
@@ -731,9 +854,9 @@ SquidLogParser::getErrorRE(boost::regex_error& e_) const
  * \brief Returns the value of integer fields
  * \param f_ Field Id
  * \param d_ Data
- * \return int
+ * \return int64_t
  */
-constexpr int
+constexpr int64_t
 SquidLogParser::intFields(Fields f_, const DataSet_Squid& d_) const
 {
 
@@ -959,18 +1082,23 @@ SquidLogParser::parserSquid()
 
   try {
     boost::match_results<std::string::const_iterator> match;
-    boost::regex_match(rawLog_, match, re_id_fmt_squid_);
-    if (match.empty()) {
-      setError(SLPError::SLP_ERR_PARSER_FAILED);
-      return SLPError::SLP_ERR_PARSER_FAILED;
+    bool matched_ = false;
+    {
+      SLP_STATS_STAGE(Match);
+      matched_ = boost::regex_match(rawLog_, match, re_id_fmt_squid_);
+    }
+    if (!matched_ || match.empty()) {
+      return fail(
+        SLPError::SLP_ERR_PARSER_FAILED, __func__, "Line doesn't match.");
     }
 
+    SLP_STATS_STAGE(Extract);
     ds_squid_ = {};
     ds_squid_.timeStamp = std::move(std::stod(match[1]));
     ds_squid_.responseTime = std::move(std::stoi(match[2]));
     ds_squid_.cliSrcIpAddr = std::move(IPv4Addr::iptol(match[3]));
     ds_squid_.reqStatusHierStatus = std::move(match[4]);
-    ds_squid_.totalSizeReply = std::move(std::stoi(match[5]));
+    ds_squid_.totalSizeReply = std::move(std::stoll(match[5]));
     ds_squid_.reqMethod = std::move(match[6]);
     ds_squid_.reqURL = std::move(match[7]);
     ds_squid_.userName = std::move(match[8]);
@@ -994,12 +1122,10 @@ SquidLogParser::parserSquid()
     }
 #endif
   } catch (boost::regex_error& e_) {
-    std::cout << "Parser PFLogentry regex error = " << e_.what() << "\n";
-    setError(SLPError::SLP_ERR_PARSER_FAILED);
-    return SLPError::SLP_ERR_PARSER_FAILED;
+    getErrorRE(e_);
+    return fail(errorNum(), __func__, e_.what());
   } catch (const std::exception& e) {
-    std::cout << "[" << __LINE__ << "] "
-              << __FILE__ ": An exception occurred: " << e.what() << "\n";
+    return fail(SLPError::SLP_ERR_PARSER_FAILED, __func__, e.what());
   };
 
   setError(SLPError::SLP_SUCCESS);
@@ -1021,12 +1147,17 @@ SquidLogParser::parserCommon()
 
   try {
     boost::match_results<std::string::const_iterator> match;
-    boost::regex_match(rawLog_, match, re_id_fmt_common_);
-    if (match.empty()) {
-      setError(SLPError::SLP_ERR_PARSER_FAILED);
-      return SLPError::SLP_ERR_PARSER_FAILED;
+    bool matched_ = false;
+    {
+      SLP_STATS_STAGE(Match);
+      matched_ = boost::regex_match(rawLog_, match, re_id_fmt_common_);
+    }
+    if (!matched_ || match.empty()) {
+      return fail(
+        SLPError::SLP_ERR_PARSER_FAILED, __func__, "Line doesn't match.");
     }
 
+    SLP_STATS_STAGE(Extract);
     ds_squid_ = {};
     ds_squid_.cliSrcIpAddr = std::move(IPv4Addr::iptol(match[1]));
     ds_squid_.userNameIdent = std::move(match[2]);
@@ -1036,7 +1167,7 @@ SquidLogParser::parserCommon()
     ds_squid_.reqURL = std::move(match[6]);
     ds_squid_.reqProtoVersion = std::move(match[7]);
     ds_squid_.httpStatus = std::move(std::stoi(match[8]));
-    ds_squid_.totalSizeReply = std::move(std::stoi(match[9]));
+    ds_squid_.totalSizeReply = std::move(std::stoll(match[9]));
     ds_squid_.reqStatusHierStatus = std::move(match[10]);
 
 #ifdef DEBUG_PARSER_COMMON
@@ -1057,12 +1188,10 @@ SquidLogParser::parserCommon()
     }
 #endif
   } catch (boost::regex_error& e_) {
-    std::cout << "Parser PFLogentry regex error = " << e_.what() << "\n";
-    setError(SLPError::SLP_ERR_PARSER_FAILED);
-    return SLPError::SLP_ERR_PARSER_FAILED;
+    getErrorRE(e_);
+    return fail(errorNum(), __func__, e_.what());
   } catch (const std::exception& e) {
-    std::cout << "[" << __LINE__ << "] "
-              << __FILE__ ": An exception occurred: " << e.what() << "\n";
+    return fail(SLPError::SLP_ERR_PARSER_FAILED, __func__, e.what());
   };
 
   setError(SLPError::SLP_SUCCESS);
@@ -1083,12 +1212,17 @@ SquidLogParser::parserCombined()
 
   try {
     boost::match_results<std::string::const_iterator> match;
-    boost::regex_match(rawLog_, match, re_id_fmt_combined_);
-    if (match.empty()) {
-      setError(SLPError::SLP_ERR_PARSER_FAILED);
-      return SLPError::SLP_ERR_PARSER_FAILED;
+    bool matched_ = false;
+    {
+      SLP_STATS_STAGE(Match);
+      matched_ = boost::regex_match(rawLog_, match, re_id_fmt_combined_);
+    }
+    if (!matched_ || match.empty()) {
+      return fail(
+        SLPError::SLP_ERR_PARSER_FAILED, __func__, "Line doesn't match.");
     }
 
+    SLP_STATS_STAGE(Extract);
     ds_squid_ = {};
     ds_squid_.cliSrcIpAddr = std::move(IPv4Addr::iptol(match[1]));
     ds_squid_.userNameIdent = std::move(match[2]);
@@ -1098,7 +1232,7 @@ SquidLogParser::parserCombined()
     ds_squid_.reqURL = std::move(match[6]);
     ds_squid_.reqProtoVersion = std::move(match[7]);
     ds_squid_.httpStatus = std::move(std::stoi(match[8]));
-    ds_squid_.totalSizeReply = std::move(std::stoi(match[9]));
+    ds_squid_.totalSizeReply = std::move(std::stoll(match[9]));
     ds_squid_.referrer = std::move(match[10]);
     ds_squid_.userAgent = std::move(match[11]);
     ds_squid_.reqStatusHierStatus = std::move(match[12]);
@@ -1124,12 +1258,10 @@ SquidLogParser::parserCombined()
     }
 #endif
   } catch (boost::regex_error& e_) {
-    std::cout << "Parser PFLogentry regex error = " << e_.what() << "\n";
-    setError(SLPError::SLP_ERR_PARSER_FAILED);
-    return SLPError::SLP_ERR_PARSER_FAILED;
+    getErrorRE(e_);
+    return fail(errorNum(), __func__, e_.what());
   } catch (const std::exception& e) {
-    std::cout << "[" << __LINE__ << "] "
-              << __FILE__ ": An exception occurred: " << e.what() << "\n";
+    return fail(SLPError::SLP_ERR_PARSER_FAILED, __func__, e.what());
   };
 
   setError(SLPError::SLP_SUCCESS);
@@ -1150,12 +1282,17 @@ SquidLogParser::parserReferrer()
 
   try {
     boost::match_results<std::string::const_iterator> match;
-    boost::regex_match(rawLog_, match, re_id_fmt_referrer_);
-    if (match.empty()) {
-      setError(SLPError::SLP_ERR_PARSER_FAILED);
-      return SLPError::SLP_ERR_PARSER_FAILED;
+    bool matched_ = false;
+    {
+      SLP_STATS_STAGE(Match);
+      matched_ = boost::regex_match(rawLog_, match, re_id_fmt_referrer_);
+    }
+    if (!matched_ || match.empty()) {
+      return fail(
+        SLPError::SLP_ERR_PARSER_FAILED, __func__, "Line doesn't match.");
     }
 
+    SLP_STATS_STAGE(Extract);
     ds_squid_ = {};
     ds_squid_.timeStamp = std::move(std::stoul(match[1]));
     ds_squid_.cliSrcIpAddr = std::move(IPv4Addr::iptol(match[2]));
@@ -1174,12 +1311,10 @@ SquidLogParser::parserReferrer()
     }
 #endif
   } catch (boost::regex_error& e_) {
-    std::cout << "Parser PFLogentry regex error = " << e_.what() << "\n";
-    setError(SLPError::SLP_ERR_PARSER_FAILED);
-    return SLPError::SLP_ERR_PARSER_FAILED;
+    getErrorRE(e_);
+    return fail(errorNum(), __func__, e_.what());
   } catch (const std::exception& e) {
-    std::cout << "[" << __LINE__ << "] "
-              << __FILE__ ": An exception occurred: " << e.what() << "\n";
+    return fail(SLPError::SLP_ERR_PARSER_FAILED, __func__, e.what());
   };
 
   setError(SLPError::SLP_SUCCESS);
@@ -1201,12 +1336,17 @@ SquidLogParser::parserUserAgent()
 
   try {
     boost::match_results<std::string::const_iterator> match;
-    boost::regex_match(rawLog_, match, re_id_fmt_useragent_);
-    if (match.empty()) {
-      setError(SLPError::SLP_ERR_PARSER_FAILED);
-      return SLPError::SLP_ERR_PARSER_FAILED;
+    bool matched_ = false;
+    {
+      SLP_STATS_STAGE(Match);
+      matched_ = boost::regex_match(rawLog_, match, re_id_fmt_useragent_);
+    }
+    if (!matched_ || match.empty()) {
+      return fail(
+        SLPError::SLP_ERR_PARSER_FAILED, __func__, "Line doesn't match.");
     }
 
+    SLP_STATS_STAGE(Extract);
     ds_squid_ = {};
     ds_squid_.cliSrcIpAddr = std::move(IPv4Addr::iptol(match[1]));
     ds_squid_.localTime = std::move(match[2]);
@@ -1224,18 +1364,59 @@ SquidLogParser::parserUserAgent()
     }
 #endif
   } catch (boost::regex_error& e_) {
-    std::cout << "Parser PFLogentry regex error = " << e_.what() << "\n";
-    setError(SLPError::SLP_ERR_PARSER_FAILED);
-    return SLPError::SLP_ERR_PARSER_FAILED;
+    getErrorRE(e_);
+    return fail(errorNum(), __func__, e_.what());
   } catch (const std::exception& e) {
-    std::cout << "[" << __LINE__ << "] "
-              << __FILE__ ": An exception occurred: " << e.what() << "\n";
+    return fail(SLPError::SLP_ERR_PARSER_FAILED, __func__, e.what());
   };
 
   setError(SLPError::SLP_SUCCESS);
   return SLPError::SLP_SUCCESS;
 }
 
+/*!
+ * \internal
+ * \brief Inserts the entry just parsed. The formats without the %ts field
+ * are indexed by the timestamp of their local time, which is kept for
+ * timestamp().
+ */
+void
+SquidLogParser::insertEntry()
+{
+  SLP_STATS_STAGE(Insert);
+  switch (logFmt_) {
+    case LogFormat::Common:
+    case LogFormat::Combined:
+    case LogFormat::UserAgent: {
+      timestamp_ = unixTimestamp(ds_squid_.localTime);
+      break;
+    }
+    default: {
+      timestamp_ = ds_squid_.timeStamp;
+    }
+  }
+  const Entry it_ = mEntry.insert(
+    { DataKey(timestamp_, ds_squid_.cliSrcIpAddr), ds_squid_ });
+
+  if (indexClients_) {
+    // The multimap inserts after the entries of the same second, and so do
+    // the postings. A line out of time order is inserted in its place.
+    Postings& p_ = mByClient[it_->first.getIp()];
+    const uint32_t ts_ = it_->first.getTs();
+    if (p_.empty() || p_.back()->first.getTs() <= ts_) {
+      p_.push_back(it_);
+    } else {
+      p_.insert(std::upper_bound(p_.begin(),
+                                 p_.end(),
+                                 ts_,
+                                 [](uint32_t t_, Entry e_) {
+                                   return t_ < e_->first.getTs();
+                                 }),
+                it_);
+    }
+  }
+}
+
 /*!
  * \internal
  * \brief  Normalize a string removing the extra white spaces between words.
@@ -1458,8 +1639,6 @@ SLPUrlParts::hasEscape(const std::string text_)
 bool
 SLPUrlParts::getUserInfo(size_t& pos_)
 {
-  SquidLogParser slp;
-
   if (size_t at_sign_pos_ = url_t.domain_.find_first_of("@");
       at_sign_pos_ != std::string::npos) {
     std::string userinfo_ = url_t.domain_.substr(0, at_sign_pos_);
@@ -1467,7 +1646,7 @@ SLPUrlParts::getUserInfo(size_t& pos_)
     size_t f_ = { 0 };
     std::string temp_ = {};
     if (hasEscape(userinfo_)) {
-      temp_ = slp.UrlDecode(userinfo_);
+      temp_ = SquidLogParser::UrlDecode(userinfo_);
     } else {
       temp_ = userinfo_;
     }
@@ -1481,4 +1660,187 @@ SLPUrlParts::getUserInfo(size_t& pos_)
   return false;
 }
 
+/* SLPUrlParam-------------------------------------------------------------- */
+
+/*!
+ * \internal
+ * \brief Returns the value of a hexadecimal digit or -1 if it isn't one.
+ */
+static inline int
+hexValue(const char c_)
+{
+  if (c_ >= '0' && c_ <= '9') {
+    return c_ - '0';
+  }
+  if (c_ >= 'a' && c_ <= 'f') {
+    return c_ - 'a' + 10;
+  }
+  if (c_ >= 'A' && c_ <= 'F') {
+    return c_ - 'A' + 10;
+  }
+  return -1;
+}
+
+/*!
+ * \brief Binds a key to be searched. The key is stored decoded.
+ * \param key_ Parameter name, e.g.: "q", "utm_source".
+ * \return false if the key is empty or the limit of keys was reached.
+ */
+bool
+SLPUrlParam::bind(std::string_view key_)
+{
+  if (key_.empty() || count_ == maxKeys) {
+    return false;
+  }
+  std::string& k_ = keys_[count_];
+  k_.resize(key_.size());
+  k_.resize(decode(key_, k_.data()));
+  ++count_;
+  return true;
+}
+
+/*!
+ * \brief Removes all bound keys.
+ */
+void
+SLPUrlParam::clear() noexcept
+{
+  count_ = 0;
+}
+
+/*!
+ * \brief Returns the number of bound keys.
+ */
+size_t
+SLPUrlParam::size() const noexcept
+{
+  return count_;
+}
+
+/*!
+ * \brief Returns the query portion of the URL, without '?' and the fragment.
+ *
+ * \param url_ A complete URL or only its query string (e.g. the result of
+ * slp_urlparts(url, "query")).
+ * \return std::string_view Empty if the URL doesn't have a query.
+ */
+std::string_view
+SLPUrlParam::queryOf(std::string_view url_)
+{
+  if (size_t p_frag_ = url_.find('#'); p_frag_ != std::string_view::npos) {
+    url_ = url_.substr(0, p_frag_);
+  }
+  if (size_t p_query_ = url_.find('?'); p_query_ != std::string_view::npos) {
+    return url_.substr(p_query_ + 1);
+  }
+  // Without '?' only a bare query string ("a=1&b=2") is accepted.
+  if (url_.find("://") != std::string_view::npos ||
+      url_.find('=') == std::string_view::npos) {
+    return std::string_view();
+  }
+  return url_;
+}
+
+/*!
+ * \brief Decodes a URL-encoded text ('%XX' and '+').
+ *
+ * Malformed escapes are copied as they are.
+ *
+ * \param raw_ Encoded text.
+ * \param out_ Destination, at least raw_.size() bytes long. The decoded text
+ * is never longer than the encoded one.
+ * \return size_t Number of bytes written to out_.
+ */
+size_t
+SLPUrlParam::decode(std::string_view raw_, char* out_)
+{
+  size_t n_ = 0;
+  for (size_t i_ = 0; i_ < raw_.size(); ++i_) {
+    const char c_ = raw_[i_];
+    if (c_ == '%' && i_ + 2 < raw_.size()) {
+      const int hi_ = hexValue(raw_[i_ + 1]);
+      const int lo_ = hexValue(raw_[i_ + 2]);
+      if (hi_ >= 0 && lo_ >= 0) {
+        out_[n_++] = static_cast<char>((hi_ << 4) | lo_);
+        i_ += 2;
+        continue;
+      }
+    }
+    out_[n_++] = (c_ == '+') ? ' ' : c_;
+  }
+  return n_;
+}
+
+/*!
+ * \brief Searches the query of the URL for the bound keys.
+ *
+ * \param url_ URL or query string.
+ * \param value_ Raw (still encoded) value of the key found. Use decode() to
+ * write it to the destination buffer.
+ * \return true if one of the keys was found.
+ */
+bool
+SLPUrlParam::find(std::string_view url_, std::string_view& value_) const
+{
+  const std::string_view query_ = queryOf(url_);
+  size_t best_ = count_;
+
+  size_t pos_ = 0;
+  while (pos_ < query_.size() && best_ != 0) {
+    size_t end_ = query_.find('&', pos_);
+    if (end_ == std::string_view::npos) {
+      end_ = query_.size();
+    }
+    const std::string_view pair_ = query_.substr(pos_, end_ - pos_);
+    const size_t eq_ = pair_.find('=');
+    const std::string_view key_ = pair_.substr(0, eq_);
+
+    for (size_t k_ = 0; k_ < best_; ++k_) {
+      if (keyEquals(key_, keys_[k_])) {
+        best_ = k_;
+        value_ = (eq_ == std::string_view::npos) ? std::string_view()
+                                                 : pair_.substr(eq_ + 1);
+        break;
+      }
+    }
+    pos_ = end_ + 1;
+  }
+  return best_ != count_;
+}
+
+/*!
+ * \internal
+ * \brief Compares a raw key of the query with a bound (decoded) key. The raw
+ * key is only decoded if it contains an escape.
+ */
+bool
+SLPUrlParam::keyEquals(std::string_view raw_, const std::string& key_) const
+{
+  if (raw_.find_first_of("%+") == std::string_view::npos) {
+    return raw_ == key_;
+  }
+  if (raw_.size() < key_.size()) {
+    return false; // decoding never makes the text longer
+  }
+  // Decodes on the fly, one byte at a time, without any copy.
+  size_t k_ = 0;
+  for (size_t i_ = 0; i_ < raw_.size(); ++i_, ++k_) {
+    char c_ = raw_[i_];
+    if (c_ == '%' && i_ + 2 < raw_.size()) {
+      const int hi_ = hexValue(raw_[i_ + 1]);
+      const int lo_ = hexValue(raw_[i_ + 2]);
+      if (hi_ >= 0 && lo_ >= 0) {
+        c_ = static_cast<char>((hi_ << 4) | lo_);
+        i_ += 2;
+      }
+    } else if (c_ == '+') {
+      c_ = ' ';
+    }
+    if (k_ == key_.size() || key_[k_] != c_) {
+      return false;
+    }
+  }
+  return k_ == key_.size();
+}
+
 } // namespace squidlogparser
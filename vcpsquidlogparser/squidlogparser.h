@@ -52,7 +52,9 @@
  * ----------------------------------------------------------------------------
  * struct SquidLogData
  * class DataKey
- * class SquidLogParser
+ * class SquidLogParser: the entries are kept in timestamp order, range()
+ * looks up a time window and, if indexClients() is on, byClient() the
+ * entries of one client address.
  * class SLPUrlParts
  */
 
@@ -277,7 +279,7 @@ struct SquidLogParser_EXPORT SquidLogData
     int httpStatus = 0;
     std::string reqStatusHierStatus = {};
 
-    int totalSizeReply = 0;
+    int64_t totalSizeReply = 0; // > 2 GB downloads
 
     std::string hierStatusIpAddress = {};
     std::string mimeTypeContent = {};
@@ -394,6 +396,22 @@ struct SquidLogParser_EXPORT SquidLogData
 
     { SLPError::SLP_ERR_UNKNOWN, "Unknown Error." }
   };
+
+  // --------------------------------------------------------------------------
+
+  /*!
+   * \brief Record of the last error of a parser.
+   *
+   * It's filled without any allocation or I/O, so it can be used on the
+   * per-row path of the UDF's.
+   */
+  struct LastError
+  {
+    SLPError code_ = SLPError::SLP_SUCCESS;
+    const char* where_ = ""; // function
+    std::array<char, 128> what_ = {};
+    uint64_t count_ = 0; // errors since the parser was constructed
+  };
 };
 
 /* ------------------------------------------------------------------------- */
@@ -438,19 +456,44 @@ class SquidLogParser_EXPORT SquidLogParser
   , public Visitor
 {
 public:
+  using Entries = std::multimap<DataKey, DataSet_Squid>;
+  using Entry = Entries::const_iterator;
+  using Postings = std::vector<Entry>; // of one client, in timestamp order
+  using PostingsRange =
+    std::pair<Postings::const_iterator, Postings::const_iterator>;
+
   explicit SquidLogParser(LogFormat log_fmt_ = LogFormat::Squid);
   explicit SquidLogParser(const std::string_view&& log_fmt_);
 
+  // mByClient keeps iterators into mEntry: a copy would point into the
+  // entries of the original. A move takes the nodes of mEntry with it, so
+  // the iterators stay valid. (SquidLogData can't be assigned.)
+  SquidLogParser(const SquidLogParser&) = delete;
+  SquidLogParser& operator=(const SquidLogParser&) = delete;
+  SquidLogParser(SquidLogParser&&) = default;
+
   SquidLogParser& append(const std::string& raw_log_);
 
+  // Lookups over the entries kept by append(), see indexClients().
+  std::pair<Entry, Entry> range(uint32_t from_, uint32_t to_) const;
+  void indexClients(bool on_);
+  bool indexingClients() const noexcept { return indexClients_; }
+  PostingsRange byClient(uint32_t ip_,
+                         uint32_t from_ = 0,
+                         uint32_t to_ = UINT32_MAX) const;
+  size_t clients() const noexcept { return mByClient.size(); }
+
   SLPError errorNum() const noexcept;
   std::string getErrorText() const;
+  const LastError& lastError() const noexcept;
   size_t size() const;
   void clear();
 
-  int getPartInt(Fields f_) const;
+  int64_t getPartInt(Fields f_) const;
   uint32_t getPartUInt(Fields f_) const;
   std::string getPartStr(Fields f_) const;
+  int httpStatus() const noexcept;
+  uint32_t timestamp() const noexcept { return timestamp_; } // any format
   std::string getUrlParts(const std::string part_) const;
 
   // Convenience functions
@@ -468,8 +511,15 @@ public:
 
 protected:
   SLPError slpError_ = SLPError::SLP_SUCCESS;
+  LastError lastError_ = {};
 
   std::multimap<DataKey, DataSet_Squid> mEntry;
+  uint32_t timestamp_ = 0; // of the last entry, kept by clear()
+
+  // Secondary index: client address -> its entries. Off by default, the
+  // UDF's parse one line at a time and never look the entries up.
+  std::unordered_map<uint32_t, Postings> mByClient;
+  bool indexClients_ = false;
 
   template<typename TString = std::string, typename TSize = size_t>
   TString toLower(TString s_, TSize sz_ = 0);
@@ -480,9 +530,10 @@ protected:
   std::tm mkTime(const std::string d_) const;
 
   void setError(SLPError e_);
+  SLPError fail(SLPError e_, const char* where_, const char* what_);
   std::string getErrorRE(boost::regex_error& e_) const;
 
-  constexpr int intFields(Fields f_, const DataSet_Squid& d_) const;
+  constexpr int64_t intFields(Fields f_, const DataSet_Squid& d_) const;
   constexpr uint32_t uint32Fields(Fields f_, const DataSet_Squid& d_) const;
   std::string strFields(Fields f_, const DataSet_Squid& d_) const;
 
@@ -539,6 +590,7 @@ private:
   SLPError parserReferrer();
   SLPError parserUserAgent();
 
+  void insertEntry();
   void removeExtraWhiteSpaces(const std::string& input_, std::string& output_);
 };
 
@@ -587,6 +639,44 @@ private:
   bool hasEscape(const std::string text_);
 };
 
+/* SLPUrlParam -------------------------------------------------------------- */
+
+/*!
+ * \brief Extracts the value of query-string parameters from a URL.
+ *
+ * The keys are bound once (e.g. in the UDF's _init) and the query portion of
+ * each URL is then scanned a single time, without copying it. Keys of the
+ * query are only decoded when they contain an escape ('%' or '+'), and the
+ * value found is decoded directly into the buffer supplied by the caller.
+ *
+ * When more than one key is bound, the value of the first bound key present
+ * in the query is returned, i.e. the keys are searched in order of priority.
+ *
+ * protocol://DOMAIN:PORT/path?key=value&key=value#fragment
+ */
+class SLPUrlParam
+{
+public:
+  static constexpr size_t maxKeys = 16;
+
+  explicit SLPUrlParam() = default;
+
+  bool bind(std::string_view key_);
+  void clear() noexcept;
+  size_t size() const noexcept;
+
+  bool find(std::string_view url_, std::string_view& value_) const;
+
+  static std::string_view queryOf(std::string_view url_);
+  static size_t decode(std::string_view raw_, char* out_);
+
+private:
+  std::array<std::string, maxKeys> keys_ = {};
+  size_t count_ = 0;
+
+  bool keyEquals(std::string_view raw_, const std::string& key_) const;
+};
+
 } // namespace squidlogparser
 
 #endif // SQUIDLOGPARSER_H
@@ -34,6 +34,17 @@
  *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
  ***************************************************************************/
 
+/*!
+ * \brief How this file is organized:
+ *
+ * Utilities: checks and binding of the arguments, shared by the functions.
+ * extern "C": the functions, each with its xxx_init(), xxx_deinit() and, for
+ *             the aggregates, xxx_clear() and xxx_add().
+ *
+ * The server doesn't call xxx_deinit() if xxx_init() fails, so an _init
+ * checks (and binds) all of its arguments before it allocates initid->ptr.
+ */
+
 #include "squidlogparser_udf.h"
 
 #ifdef HAVE_DLOPEN
@@ -102,6 +113,49 @@ Utilities::checkArgs([[maybe_unused]] UDF_INIT* initid,
   return MY_TRUE;
 }
 
+/*!
+ * \internal
+ * \brief Checks the arguments ("LOG_FORMAT", FIELD_NAME[, ...]) of the
+ * aggregates that take the whole log line. The arguments after the 2nd are
+ * checked by each function.
+ * \param min_ Minimum number of arguments.
+ * \param max_ Maximum number of arguments.
+ * \param e_ Error of a wrong number of arguments.
+ */
+my_bool
+Utilities::checkLineArgs(UDF_ARGS* args,
+                         char* message,
+                         unsigned int min_,
+                         unsigned int max_,
+                         ErrorID e_)
+{
+  UTIL::ResultErr r = {};
+  if (args->arg_count < min_ || args->arg_count > max_) {
+    getErrorText(e_, r);
+    std::memmove(message, r.msg, r.len);
+    return MY_FALSE;
+  }
+  if (args->arg_type[LOG_FORMAT] != STRING_RESULT) {
+    getErrorText(ErrID::ERR_INVALID_TYPE_ARG, r);
+    std::sprintf(message, r.msg, 1, "String");
+    return MY_FALSE;
+  }
+  if (args->args[LOG_FORMAT] != nullptr &&
+      formatOf({ args->args[LOG_FORMAT], args->lengths[LOG_FORMAT] }) ==
+        LogFormat::Unknown) {
+    getErrorText(ErrID::ERR_INVALID_ARG, r);
+    std::sprintf(
+      message, r.msg, 1, "Valid are: squid|common|combined|referrer|useragent");
+    return MY_FALSE;
+  }
+  if (args->arg_type[LOG_LINE] != STRING_RESULT) {
+    getErrorText(ErrID::ERR_INVALID_TYPE_ARG, r);
+    std::sprintf(message, r.msg, 2, "Table field's name");
+    return MY_FALSE;
+  }
+  return MY_TRUE;
+}
+
 /*!
  * \internal
  * \brief Returns the text for the error that occurred.
@@ -144,6 +198,374 @@ Utilities::toLower(TString s_, TSize sz_) const
   return s_;
 }
 
+/*!
+ * \internal
+ * \brief Returns the parser of the statement, ready for a new log line.
+ * \param fmt_ Log format, as informed in the 1st argument.
+ * \param u_ UDF, to account the reuse of the parser.
+ * \return SquidLogParser&
+ */
+SquidLogParser&
+Utilities::ParserBuffer::get(std::string_view format_,
+                             [[maybe_unused]] SLPStats::Udf u_)
+{
+  SLP_STATS(udfCall(u_));
+  if (parser_ && format_ == fmt_) {
+    SLP_STATS(cacheHit(u_));
+    parser_->clear();
+  } else {
+    SLP_STATS(cacheMiss(u_));
+    fmt_ = format_;
+    std::string lower_(format_);
+    std::transform(lower_.begin(), lower_.end(), lower_.begin(), ::tolower);
+    parser_ = std::make_unique<SquidLogParser>(std::string_view{ lower_ });
+  }
+  return *parser_;
+}
+
+/*!
+ * \internal
+ * \brief Builds the scan of slp_file_agg() from its arguments:
+ * ("PATH", "LOG_FORMAT", "AGG", "FIELD-ID"[, "FILTER" ...]).
+ * \param err_ Text of the error, if any.
+ * \return false if an argument isn't valid.
+ */
+bool
+Utilities::bindFileAgg(UDF_ARGS* args,
+                       FileAggBuffer& b_,
+                       std::string& err_) const
+{
+  for (unsigned int i_ = 0; i_ < args->arg_count; ++i_) {
+    if (args->args[i_] == nullptr) {
+      err_ = "Invalid Arg #" + std::to_string(i_ + 1) + ": NULL.";
+      return false;
+    }
+  }
+  auto arg_ = [args](unsigned int i_) {
+    return std::string(args->args[i_], args->lengths[i_]);
+  };
+
+  const LogFormat fmt_ = formatOf(arg_(1));
+  if (fmt_ == LogFormat::Unknown) {
+    err_ = "Invalid Arg #2: Valid are: squid|common|combined|referrer|"
+           "useragent.";
+    return false;
+  }
+
+  const SLPFileAgg::Agg agg_ = SLPFileAgg::aggOf(arg_(2));
+  if (agg_ == SLPFileAgg::Agg::Unknown) {
+    err_ = "Invalid Arg #3: Valid are: count|sum|min|max|avg.";
+    return false;
+  }
+
+  // count takes any field, e.g. '*'.
+  const LogFields field_ = getFieldId(arg_(3));
+  if (agg_ != SLPFileAgg::Agg::Count && !SLPFileAgg::isNumeric(field_)) {
+    err_ = "Invalid Arg #4: Must be a numeric field: timestamp|"
+           "source_ip_address|response_time|http_status|total_size_reply.";
+    return false;
+  }
+
+  b_.agg_ = std::make_unique<SLPFileAgg>(fmt_, agg_, field_);
+  for (unsigned int i_ = 4; i_ < args->arg_count; ++i_) {
+    const std::string n_ = std::to_string(i_ + 1);
+    std::string name_, value_;
+    SLPFileFilter::Op op_;
+    if (!SLPFileFilter::split(arg_(i_), name_, op_, value_)) {
+      err_ = "Invalid Arg #" + n_ + ": Use: FIELD-ID =|!=|<|<=|>|>= VALUE.";
+      return false;
+    }
+    const LogFields f_ = getFieldId(name_);
+    if (f_ == LogFields::Unknown) {
+      err_ = "Invalid Arg #" + n_ + ": Unknown field '" + name_ + "'.";
+      return false;
+    }
+    if (!b_.agg_->addFilter(f_, op_, value_)) {
+      err_ = "Invalid Arg #" + n_ + ": " + b_.agg_->error() + ".";
+      return false;
+    }
+  }
+
+  b_.path_ = arg_(0);
+  return true;
+}
+
+/*!
+ * \internal
+ * \brief Parses the log line of the row, with the parser of the statement.
+ * \return nullptr if the line is empty or doesn't parse.
+ * \warning The line must not be NULL.
+ */
+SquidLogParser*
+Utilities::parseRow(UDF_ARGS* args, ParserBuffer& b_, SLPStats::Udf u_) const
+{
+  if (args->args[LOG_FORMAT] == nullptr || args->lengths[LOG_LINE] == 0) {
+    return nullptr;
+  }
+  SquidLogParser& p = b_.get(
+    { args->args[LOG_FORMAT], args->lengths[LOG_FORMAT] }, u_);
+  p.append(std::string(args->args[LOG_LINE], args->lengths[LOG_LINE]));
+  return p.errorNum() == SLPError::SLP_SUCCESS ? &p : nullptr;
+}
+
+/*!
+ * \internal
+ * \brief Checks the optional argument i_ of an aggregate, a constant that
+ * turns an option on, e.g. "bytes".
+ * \param valid_ Name of the option, in lower case.
+ * \param on_ true if the argument is present.
+ */
+my_bool
+Utilities::checkOption(UDF_ARGS* args,
+                       char* message,
+                       unsigned int i_,
+                       std::string_view valid_,
+                       bool& on_)
+{
+  on_ = false;
+  if (args->arg_count <= i_) {
+    return MY_TRUE;
+  }
+
+  UTIL::ResultErr r = {};
+  if (args->arg_type[i_] != STRING_RESULT || args->args[i_] == nullptr) {
+    getErrorText(ErrID::ERR_INVALID_TYPE_ARG, r);
+    std::sprintf(message, r.msg, i_ + 1, "(STRING) constant");
+    return MY_FALSE;
+  }
+  const std::string opt_(args->args[i_], args->lengths[i_]);
+  if (toLower(opt_) != valid_) {
+    getErrorText(ErrID::ERR_INVALID_ARG, r);
+    const std::string text_ = "Valid is: " + std::string(valid_);
+    std::sprintf(message, r.msg, i_ + 1, text_.c_str());
+    return MY_FALSE;
+  }
+  on_ = true;
+  return MY_TRUE;
+}
+
+/*!
+ * \internal
+ * \brief Checks and binds the arguments of slp_percentile() and
+ * slp_percentiles(): ("LOG_FORMAT", FIELD_NAME, "FIELD-ID", QUANTILE ...).
+ * The field and the quantiles must be constants.
+ * \param max_ Maximum number of arguments.
+ * \param field_, q_ The field and the quantiles, see PercentileBuffer.
+ */
+my_bool
+Utilities::bindPercentile(UDF_ARGS* args,
+                          char* message,
+                          unsigned int max_,
+                          LogFields& field_,
+                          std::vector<double>& q_)
+{
+  if (checkLineArgs(
+        args, message, 4, max_, ErrID::ERR_WRONG_NUM_ARGS_PERCENTILE) ==
+      MY_FALSE) {
+    return MY_FALSE;
+  }
+
+  UTIL::ResultErr r = {};
+  if (args->arg_type[LOG_PART] != STRING_RESULT ||
+      args->args[LOG_PART] == nullptr) {
+    getErrorText(ErrID::ERR_INVALID_TYPE_ARG, r);
+    std::sprintf(message, r.msg, 3, "(STRING) constant");
+    return MY_FALSE;
+  }
+  field_ =
+    getFieldId(std::string(args->args[LOG_PART], args->lengths[LOG_PART]));
+  if (field_ != LogFields::ResponseTime &&
+      field_ != LogFields::TotalSizeReply) {
+    getErrorText(ErrID::ERR_INVALID_ARG, r);
+    std::sprintf(
+      message, r.msg, 3, "Valid are: response_time|total_size_reply");
+    return MY_FALSE;
+  }
+
+  for (unsigned int i_ = URL_PART; i_ < args->arg_count; ++i_) {
+    double v_ = 0.0;
+    if (!constReal(args, i_, v_) || !(v_ >= 0.0 && v_ <= 1.0)) {
+      getErrorText(ErrID::ERR_INVALID_ARG, r);
+      std::sprintf(message, r.msg, i_ + 1, "Must be a constant in [0, 1]");
+      return MY_FALSE;
+    }
+    q_.push_back(v_);
+  }
+  return MY_TRUE;
+}
+
+/*!
+ * \internal
+ * \brief Checks and binds the field of the keys of an aggregate, the
+ * argument i_: a constant reserved word, but not a numeric field other than
+ * source_ip_address, or "domain", the domain of the URL.
+ */
+my_bool
+Utilities::bindKeyField(UDF_ARGS* args,
+                        char* message,
+                        unsigned int i_,
+                        KeyField& k_)
+{
+  UTIL::ResultErr r = {};
+  if (args->arg_type[i_] != STRING_RESULT || args->args[i_] == nullptr) {
+    getErrorText(ErrID::ERR_INVALID_TYPE_ARG, r);
+    std::sprintf(message, r.msg, i_ + 1, "(STRING) constant");
+    return MY_FALSE;
+  }
+
+  const std::string name_(args->args[i_], args->lengths[i_]);
+  k_.domain_ = toLower(name_) == "domain";
+  k_.field_ = k_.domain_ ? LogFields::ReqURL : getFieldId(name_);
+  if (k_.field_ == LogFields::Unknown ||
+      (SLPFileAgg::isNumeric(k_.field_) &&
+       k_.field_ != LogFields::CliSrcIpAddr)) {
+    getErrorText(ErrID::ERR_INVALID_ARG, r);
+    std::sprintf(message,
+                 r.msg,
+                 i_ + 1,
+                 "Use a text field, source_ip_address or domain");
+    return MY_FALSE;
+  }
+  return MY_TRUE;
+}
+
+/*!
+ * \internal
+ * \brief Key of the line just parsed.
+ * \return false if the line has no value of the field (empty or '-').
+ */
+bool
+Utilities::keyOf(const SquidLogParser& p,
+                 const KeyField& k_,
+                 std::string& key_)
+{
+  key_ = k_.domain_ ? SLPUrlParts(p.getPartStr(LogFields::ReqURL)).getDomain()
+                    : p.getPartStr(k_.field_);
+  return !key_.empty() && key_ != "-";
+}
+
+/*!
+ * \internal
+ * \brief Hash (SLPHash) of the key of the line just parsed. The address of
+ * the client is hashed as an integer, without formatting it.
+ * \param key_ Buffer of the key, to reuse its memory between the rows.
+ * \return 0 if the line has no value of the field.
+ */
+uint64_t
+Utilities::hashOf(const SquidLogParser& p,
+                  const KeyField& k_,
+                  std::string& key_)
+{
+  if (k_.field_ == LogFields::CliSrcIpAddr) {
+    const uint32_t ip_ = p.getPartUInt(LogFields::CliSrcIpAddr);
+    return ip_ ? SLPHash::of(uint64_t(ip_)) : 0;
+  }
+  return keyOf(p, k_, key_) ? SLPHash::of(key_) : 0;
+}
+
+/*!
+ * \internal
+ * \brief Checks and binds the arguments of slp_topk(): ("LOG_FORMAT",
+ * FIELD_NAME, "FIELD-ID", K[, "WEIGHT-FIELD-ID"]). All but the line must be
+ * constants.
+ * \param key_, k_, weight_ See TopKBuffer.
+ */
+my_bool
+Utilities::bindTopK(UDF_ARGS* args,
+                    char* message,
+                    KeyField& key_,
+                    size_t& k_,
+                    LogFields& weight_)
+{
+  if (checkLineArgs(args, message, 4, 5, ErrID::ERR_WRONG_NUM_ARGS_TOPK) ==
+        MY_FALSE ||
+      bindKeyField(args, message, LOG_PART, key_) == MY_FALSE) {
+    return MY_FALSE;
+  }
+
+  UTIL::ResultErr r = {};
+  double v_ = 0.0;
+  if (!constReal(args, URL_PART, v_) || v_ < 1.0 ||
+      v_ > static_cast<double>(TopKBuffer::maxK) || v_ != std::floor(v_)) {
+    getErrorText(ErrID::ERR_INVALID_ARG, r);
+    std::sprintf(message, r.msg, 4, "Must be a constant in [1, 1000]");
+    return MY_FALSE;
+  }
+  k_ = static_cast<size_t>(v_);
+
+  constexpr unsigned int w_ = URL_PART + 1;
+  weight_ = LogFields::Unknown;
+  if (args->arg_count <= w_) {
+    return MY_TRUE;
+  }
+  if (args->arg_type[w_] != STRING_RESULT || args->args[w_] == nullptr) {
+    getErrorText(ErrID::ERR_INVALID_TYPE_ARG, r);
+    std::sprintf(message, r.msg, w_ + 1, "(STRING) constant");
+    return MY_FALSE;
+  }
+  weight_ = getFieldId(std::string(args->args[w_], args->lengths[w_]));
+  if (weight_ != LogFields::ResponseTime &&
+      weight_ != LogFields::TotalSizeReply) {
+    getErrorText(ErrID::ERR_INVALID_ARG, r);
+    std::sprintf(
+      message, r.msg, w_ + 1, "Valid are: response_time|total_size_reply");
+    return MY_FALSE;
+  }
+  return MY_TRUE;
+}
+
+/*!
+ * \internal
+ * \brief Value of the constant argument i_, of any numeric type (a literal
+ * like 0.99 is a DECIMAL_RESULT, passed as a string).
+ * \return false if the argument isn't a constant or isn't a number.
+ */
+bool
+Utilities::constReal(UDF_ARGS* args, unsigned int i_, double& v_)
+{
+  if (args->args[i_] == nullptr) {
+    return false;
+  }
+  switch (args->arg_type[i_]) {
+    case REAL_RESULT:
+      v_ = *((double*)args->args[i_]);
+      return true;
+    case INT_RESULT:
+      v_ = static_cast<double>(*((long long*)args->args[i_]));
+      return true;
+    case DECIMAL_RESULT:
+    case STRING_RESULT: {
+      const std::string s_(args->args[i_], args->lengths[i_]);
+      char* end_ = nullptr;
+      v_ = std::strtod(s_.c_str(), &end_);
+      return !s_.empty() && *end_ == '\0';
+    }
+    default:
+      return false;
+  }
+}
+
+/*!
+ * \internal
+ * \brief Log format of its name, in any case.
+ * \return LogFormat::Unknown if the name isn't valid.
+ */
+LogFormat
+Utilities::formatOf(std::string_view name_)
+{
+  static const std::unordered_map<std::string_view, LogFormat> formats_ = {
+    { "squid", LogFormat::Squid },
+    { "common", LogFormat::Common },
+    { "combined", LogFormat::Combined },
+    { "referrer", LogFormat::Referrer },
+    { "useragent", LogFormat::UserAgent }
+  };
+  std::string lower_(name_);
+  std::transform(lower_.begin(), lower_.end(), lower_.begin(), ::tolower);
+  const auto it_ = formats_.find(lower_);
+  return it_ != formats_.end() ? it_->second : LogFormat::Unknown;
+}
+
 /* -------------------------------------------------------------------------- */
 
 #ifdef __cplusplus
@@ -159,14 +581,16 @@ extern "C"
     initid->decimals = 0;
     initid->max_length = 20;
 
-    return util.checkArgs(initid, args, message);
+    if (util.checkArgs(initid, args, message) == MY_FALSE) {
+      return MY_FALSE;
+    }
+    initid->ptr = (char*)new UTIL::ParserBuffer;
+    return MY_TRUE;
   }
 
-  void slp_int_deinit([[maybe_unused]] UDF_INIT* initid)
+  void slp_int_deinit(UDF_INIT* initid)
   {
-    if (initid->ptr != NULL) {
-      delete initid->ptr;
-    }
+    delete (UTIL::ParserBuffer*)initid->ptr;
   }
 
   /*!
@@ -178,7 +602,7 @@ extern "C"
    * \attention Returns the value std::numeric_limits<int64_t>::min() in case
    * there's an error in parsing the log line.
    */
-  int64_t slp_int([[maybe_unused]] UDF_INIT* initid,
+  int64_t slp_int(UDF_INIT* initid,
                   [[maybe_unused]] UDF_ARGS* args,
                   [[maybe_unused]] char* is_null,
                   [[maybe_unused]] char* error)
@@ -195,7 +619,8 @@ extern "C"
 
     UTIL util;
 
-    SquidLogParser p(util.toLower(log_fmt_));
+    SquidLogParser& p = ((UTIL::ParserBuffer*)initid->ptr)
+                          ->get(log_fmt_, SLPStats::Udf::Int);
     p.append(raw_log_);
     if (p.errorNum() != SLPError::SLP_SUCCESS) {
       return std::numeric_limits<int64_t>::min();
@@ -230,24 +655,24 @@ extern "C"
       return MY_FALSE;
     }
 
+    initid->ptr = (char*)new UTIL::ParserBuffer;
     return MY_TRUE;
   }
 
   void slp_toUnixTs_deinit(UDF_INIT* initid)
   {
-    if (initid->ptr != NULL) {
-      delete initid->ptr;
-    }
+    delete (UTIL::ParserBuffer*)initid->ptr;
   }
 
-  int64_t slp_toUnixTs([[maybe_unused]] UDF_INIT* initid,
+  int64_t slp_toUnixTs(UDF_INIT* initid,
                        UDF_ARGS* args,
                        [[maybe_unused]] char* is_null,
                        [[maybe_unused]] char* error)
   {
     const std::string ts_(args->args[ARG_DATA_0], args->lengths[ARG_DATA_0]);
 
-    SquidLogParser p;
+    SquidLogParser& p = ((UTIL::ParserBuffer*)initid->ptr)
+                          ->get("squid", SLPStats::Udf::ToUnixTs);
     int64_t result_ = static_cast<int64_t>(p.unixTimestamp(ts_));
 
     return result_;
@@ -260,14 +685,16 @@ extern "C"
 
     initid->maybe_null = 1;
 
-    return util.checkArgs(initid, args, message);
+    if (util.checkArgs(initid, args, message) == MY_FALSE) {
+      return MY_FALSE;
+    }
+    initid->ptr = (char*)new UTIL::ParserBuffer;
+    return MY_TRUE;
   }
 
-  void slp_str_deinit([[maybe_unused]] UDF_INIT* initid)
+  void slp_str_deinit(UDF_INIT* initid)
   {
-    if (initid->ptr != NULL) {
-      delete initid->ptr;
-    }
+    delete (UTIL::ParserBuffer*)initid->ptr;
   }
 
   /*!
@@ -280,7 +707,7 @@ extern "C"
    * This can happen, for example, if there're white spaces "%20" in the
    * formation of a URL after it has been decoded.
    */
-  char* slp_str([[maybe_unused]] UDF_INIT* initid,
+  char* slp_str(UDF_INIT* initid,
                 UDF_ARGS* args,
                 char* result,
                 unsigned long* length,
@@ -299,10 +726,11 @@ extern "C"
 
     UTIL util;
 
-    SquidLogParser* p = new SquidLogParser(util.toLower(log_fmt_));
+    SquidLogParser* p = &((UTIL::ParserBuffer*)initid->ptr)
+                           ->get(log_fmt_, SLPStats::Udf::Str);
     p->append(raw_log_);
     if (p->errorNum() != SLPError::SLP_SUCCESS) {
-      delete p;
+      SLP_STATS(fallback(SLPStats::Udf::Str));
       result = new char[raw_log_.size()];
       std::strncpy(result, raw_log_.c_str(), raw_log_.size());
       *length = static_cast<unsigned long>(raw_log_.size());
@@ -322,7 +750,6 @@ extern "C"
     } else {
       str_ = p->getPartStr(util.getFieldId(log_part_));
     }
-    delete p;
 
     result = new char[str_.size()];
     std::strncpy(result, str_.c_str(), str_.size());
@@ -376,6 +803,8 @@ extern "C"
                       [[maybe_unused]] char* is_null,
                       [[maybe_unused]] char* error)
   {
+    SLP_STATS(udfCall(SLPStats::Udf::UrlDecode));
+
     const std::string url_(args->args[ARG_DATA_0], args->lengths[ARG_DATA_0]);
 
     std::string tmp_;
@@ -451,6 +880,8 @@ extern "C"
                      [[maybe_unused]] char* is_null,
                      [[maybe_unused]] char* error)
   {
+    SLP_STATS(udfCall(SLPStats::Udf::UrlParts));
+
     const std::string url_(args->args[ARG_DATA_0], args->lengths[ARG_DATA_0]);
     const std::string part_(args->args[ARG_DATA_1], args->lengths[ARG_DATA_1]);
 
@@ -484,6 +915,107 @@ extern "C"
     return result;
   }
 
+  /*!
+   * \brief Returns the value of a query-string parameter of the URL.
+   * \param initid
+   * \param args URL, KEY [, KEY ...]
+   * \param message
+   * \return The decoded value of the first key found, or NULL.
+   */
+  my_bool slp_urlparam_init(UDF_INIT* initid, UDF_ARGS* args, char* message)
+  {
+    initid->maybe_null = 1;
+
+    UTIL util;
+
+    if (args->arg_count < 2 || args->arg_count > SLPUrlParam::maxKeys + 1) {
+      UTIL::ResultErr r;
+      util.getErrorText(ErrID::ERR_WRONG_NUM_ARGS_URLPARAM, r);
+      std::memmove(message, r.msg, r.len);
+      return MY_FALSE;
+    }
+
+    for (unsigned int i_ = 0; i_ < args->arg_count; ++i_) {
+      if (args->arg_type[i_] != STRING_RESULT) {
+        UTIL::ResultErr r;
+        util.getErrorText(ErrID::ERR_INVALID_TYPE_ARG, r);
+        std::sprintf(message,
+                     r.msg,
+                     i_ + 1,
+                     (i_ == ARG_DATA_0 ? "(STRING) URL" : "(STRING) Key"));
+        return MY_FALSE;
+      }
+    }
+
+    UTIL::UrlParamBuffer* buf_ = new UTIL::UrlParamBuffer;
+
+    // Constant keys are bound only once, here.
+    buf_->bound_ = true;
+    for (unsigned int i_ = ARG_DATA_1; i_ < args->arg_count; ++i_) {
+      if (args->args[i_] == nullptr) {
+        buf_->bound_ = false;
+        buf_->keys_.clear();
+        break;
+      }
+      buf_->keys_.bind(std::string_view(args->args[i_], args->lengths[i_]));
+    }
+
+    initid->ptr = (char*)buf_;
+
+    return MY_TRUE;
+  }
+
+  void slp_urlparam_deinit(UDF_INIT* initid)
+  {
+    delete (UTIL::UrlParamBuffer*)initid->ptr;
+  }
+
+  char* slp_urlparam(UDF_INIT* initid,
+                     UDF_ARGS* args,
+                     char* result,
+                     unsigned long* length,
+                     char* is_null,
+                     [[maybe_unused]] char* error)
+  {
+    SLP_STATS(udfCall(SLPStats::Udf::UrlParam));
+
+    UTIL::UrlParamBuffer* buf_ = (UTIL::UrlParamBuffer*)initid->ptr;
+
+    if (args->args[ARG_DATA_0] == nullptr) {
+      *is_null = 1;
+      return nullptr;
+    }
+
+    if (!buf_->bound_) {
+      buf_->keys_.clear();
+      for (unsigned int i_ = ARG_DATA_1; i_ < args->arg_count; ++i_) {
+        if (args->args[i_] != nullptr) {
+          buf_->keys_.bind(
+            std::string_view(args->args[i_], args->lengths[i_]));
+        }
+      }
+    }
+
+    std::string_view value_;
+    if (!buf_->keys_.find(
+          std::string_view(args->args[ARG_DATA_0], args->lengths[ARG_DATA_0]),
+          value_)) {
+      *is_null = 1;
+      return nullptr;
+    }
+
+    // The decoded value is never longer than the raw one.
+    char* out_ = result;
+    if (value_.size() > RESULT_BUFFER_SIZE) {
+      SLP_STATS(fallback(SLPStats::Udf::UrlParam));
+      buf_->out_.resize(value_.size());
+      out_ = buf_->out_.data();
+    }
+    *length = static_cast<unsigned long>(SLPUrlParam::decode(value_, out_));
+
+    return out_;
+  }
+
   my_bool slp_toSquidTs_init(UDF_INIT* initid, UDF_ARGS* args, char* message)
   {
     initid->maybe_null = 1;
@@ -505,17 +1037,16 @@ extern "C"
       std::memmove(message, r.msg, r.len);
       return MY_FALSE;
     }
+    initid->ptr = (char*)new UTIL::ParserBuffer;
     return MY_TRUE;
   }
 
   void slp_toSquidTs_deinit(UDF_INIT* initid)
   {
-    if (initid->ptr != NULL) {
-      delete initid->ptr;
-    }
+    delete (UTIL::ParserBuffer*)initid->ptr;
   }
 
-  char* slp_toSquidTs([[maybe_unused]] UDF_INIT* initid,
+  char* slp_toSquidTs(UDF_INIT* initid,
                       UDF_ARGS* args,
                       char* result,
                       unsigned long* length,
@@ -523,7 +1054,8 @@ extern "C"
                       [[maybe_unused]] char* error)
   {
     const int64_t ts_ = (*(int64_t*)args->args[ARG_DATA_0]);
-    SquidLogParser p;
+    SquidLogParser& p = ((UTIL::ParserBuffer*)initid->ptr)
+                          ->get("squid", SLPStats::Udf::ToSquidTs);
     std::string str_ = p.unixToSquidDate(ts_);
 
     result = new char[str_.size()];
@@ -533,45 +1065,231 @@ extern "C"
     return result;
   }
 
-  /* Aggregations ---------------------------------------------------------- */
+  /* Statistics ------------------------------------------------------------- */
 
-  my_bool slp_sum_init(UDF_INIT* initid, UDF_ARGS* args, char* message)
+  /*!
+   * \brief Returns the hot-path counters of the parser and of the UDF's, summed
+   * over all the threads of the server.
+   * \return JSON-formated string. See SLPStats::toJson().
+   */
+  my_bool slp_stats_init(UDF_INIT* initid, UDF_ARGS* args, char* message)
   {
-    int64_t* i_ptr_ = new int64_t;
-    *i_ptr_ = 0;
-    initid->ptr = (char*)i_ptr_;
-    initid->maybe_null = 0;
-
     UTIL util;
 
-    return util.checkArgs(initid, args, message);
-  }
+    if (args->arg_count != 0) {
+      UTIL::ResultErr r;
+      util.getErrorText(ErrID::ERR_WRONG_NUM_ARGS_0, r);
+      std::memmove(message, r.msg, r.len);
+      return MY_FALSE;
+    }
 
-  void slp_sum_deinit(UDF_INIT* initid) { delete (int64_t*)initid->ptr; }
+    initid->maybe_null = 0;
+    initid->const_item = 0;
+    initid->max_length = MAX_BLOB_WIDTH;
+    initid->ptr = (char*)new std::string;
 
-  void slp_sum_clear(UDF_INIT* initid,
-                     [[maybe_unused]] UDF_ARGS* args,
-                     [[maybe_unused]] char* is_null,
-                     [[maybe_unused]] char* error)
-  {
-    *((int64_t*)initid->ptr) = 0;
+    return MY_TRUE;
   }
 
-  void slp_sum_reset(UDF_INIT* initid,
-                     UDF_ARGS* args,
-                     char* is_null,
-                     char* error)
+  void slp_stats_deinit(UDF_INIT* initid)
   {
-    slp_sum_clear(initid, args, is_null, error);
-    slp_sum_add(initid, args, is_null, error);
+    delete (std::string*)initid->ptr;
   }
 
-  void slp_sum_add(UDF_INIT* initid,
-                   UDF_ARGS* args,
-                   [[maybe_unused]] char* is_null,
-                   char* error)
+  char* slp_stats(UDF_INIT* initid,
+                  [[maybe_unused]] UDF_ARGS* args,
+                  [[maybe_unused]] char* result,
+                  unsigned long* length,
+                  [[maybe_unused]] char* is_null,
+                  [[maybe_unused]] char* error)
   {
-    const std::string log_fmt_(args->args[LOG_FORMAT],
+    std::string* str_ = (std::string*)initid->ptr;
+    *str_ = SLPStats::toJson();
+    *length = static_cast<unsigned long>(str_->size());
+
+    return str_->data();
+  }
+
+  /*!
+   * \brief Zeroes the counters returned by slp_stats().
+   * \return 1 if the counters were reset, 0 if they weren't compiled in.
+   */
+  my_bool slp_stats_reset_init(UDF_INIT* initid,
+                               UDF_ARGS* args,
+                               char* message)
+  {
+    UTIL util;
+
+    if (args->arg_count != 0) {
+      UTIL::ResultErr r;
+      util.getErrorText(ErrID::ERR_WRONG_NUM_ARGS_0, r);
+      std::memmove(message, r.msg, r.len);
+      return MY_FALSE;
+    }
+
+    initid->maybe_null = 0;
+    initid->const_item = 0;
+
+    return MY_TRUE;
+  }
+
+  void slp_stats_reset_deinit([[maybe_unused]] UDF_INIT* initid) {}
+
+  int64_t slp_stats_reset([[maybe_unused]] UDF_INIT* initid,
+                          [[maybe_unused]] UDF_ARGS* args,
+                          [[maybe_unused]] char* is_null,
+                          [[maybe_unused]] char* error)
+  {
+    SLPStats::reset();
+    return SLPStats::enabled() ? 1 : 0;
+  }
+
+  /* Files ----------------------------------------------------------------- */
+
+  /*!
+   * \brief Aggregate computed straight over an access-log file, which is read
+   * in chunks and scanned in parallel, without loading it into a table.
+   *
+   * The chunks are read with pread(), not mapped: a log rotated by
+   * copytruncate while it's scanned would raise SIGBUS on the mapped pages
+   * past its new end, and kill the server. A file that shrinks during the
+   * scan is an error instead. No exception leaves the function: it returns
+   * NULL with the error flag.
+   * \return NULL if the file isn't allowed or can't be read, or if no line
+   * has the field (min, max and avg).
+   */
+  my_bool slp_file_agg_init(UDF_INIT* initid, UDF_ARGS* args, char* message)
+  {
+    UTIL util;
+
+    if (args->arg_count < 4) {
+      UTIL::ResultErr r;
+      util.getErrorText(ErrID::ERR_WRONG_NUM_ARGS_FILEAGG, r);
+      std::memmove(message, r.msg, r.len);
+      return MY_FALSE;
+    }
+
+    for (unsigned int i_ = 0; i_ < args->arg_count; ++i_) {
+      if (args->arg_type[i_] != STRING_RESULT) {
+        UTIL::ResultErr r;
+        util.getErrorText(ErrID::ERR_INVALID_TYPE_ARG, r);
+        std::sprintf(message, r.msg, i_ + 1, "String");
+        return MY_FALSE;
+      }
+    }
+
+    try {
+      // Constant arguments are bound only once, here, and their errors (and
+      // the path) reported before the statement runs.
+      UTIL::FileAggBuffer b_;
+      bool const_ = true;
+      for (unsigned int i_ = 0; i_ < args->arg_count; ++i_) {
+        const_ = const_ && args->args[i_] != nullptr;
+      }
+      if (const_) {
+        std::string err_, real_;
+        if (!util.bindFileAgg(args, b_, err_) ||
+            !SLPFileAgg::allowed(b_.path_, real_, err_)) {
+          std::snprintf(message, MYSQL_ERRMSG_SIZE, "%s", err_.c_str());
+          return MY_FALSE;
+        }
+        b_.bound_ = true;
+      }
+      initid->ptr = (char*)new UTIL::FileAggBuffer(std::move(b_));
+    } catch (const std::exception& e_) {
+      std::snprintf(message, MYSQL_ERRMSG_SIZE, "%s", e_.what());
+      return MY_FALSE;
+    }
+    initid->maybe_null = 1;
+    initid->decimals = 4;
+    initid->max_length = 32;
+
+    return MY_TRUE;
+  }
+
+  void slp_file_agg_deinit(UDF_INIT* initid)
+  {
+    delete (UTIL::FileAggBuffer*)initid->ptr;
+  }
+
+  double slp_file_agg(UDF_INIT* initid,
+                      UDF_ARGS* args,
+                      char* is_null,
+                      char* error)
+  {
+    SLP_STATS(udfCall(SLPStats::Udf::FileAgg));
+
+    UTIL::FileAggBuffer* buf_ = (UTIL::FileAggBuffer*)initid->ptr;
+
+    // An exception must not reach the server (e.g. std::bad_alloc, or
+    // std::system_error if the threads can't be started).
+    try {
+      if (!buf_->bound_) {
+        UTIL util;
+        std::string err_;
+        if (!util.bindFileAgg(args, *buf_, err_)) {
+          *error = 1;
+          return 0.0;
+        }
+      }
+
+      if (!buf_->agg_->run(buf_->path_)) {
+        *error = 1;
+        return 0.0;
+      }
+      if (buf_->agg_->isNull()) {
+        *is_null = 1;
+        return 0.0;
+      }
+      return buf_->agg_->value();
+    } catch (...) {
+      *is_null = 1;
+      *error = 1;
+      return 0.0;
+    }
+  }
+
+  /* Aggregations ---------------------------------------------------------- */
+
+  my_bool slp_sum_init(UDF_INIT* initid, UDF_ARGS* args, char* message)
+  {
+    UTIL util;
+
+    if (util.checkArgs(initid, args, message) == MY_FALSE) {
+      return MY_FALSE;
+    }
+
+    initid->ptr = (char*)new UTIL::Buffer;
+    initid->maybe_null = 0;
+
+    return MY_TRUE;
+  }
+
+  void slp_sum_deinit(UDF_INIT* initid) { delete (UTIL::Buffer*)initid->ptr; }
+
+  void slp_sum_clear(UDF_INIT* initid,
+                     [[maybe_unused]] UDF_ARGS* args,
+                     [[maybe_unused]] char* is_null,
+                     [[maybe_unused]] char* error)
+  {
+    ((UTIL::Buffer*)initid->ptr)->acc_ = 0;
+  }
+
+  void slp_sum_reset(UDF_INIT* initid,
+                     UDF_ARGS* args,
+                     char* is_null,
+                     char* error)
+  {
+    slp_sum_clear(initid, args, is_null, error);
+    slp_sum_add(initid, args, is_null, error);
+  }
+
+  void slp_sum_add(UDF_INIT* initid,
+                   UDF_ARGS* args,
+                   [[maybe_unused]] char* is_null,
+                   char* error)
+  {
+    const std::string log_fmt_(args->args[LOG_FORMAT],
                                args->lengths[LOG_FORMAT]);
     const std::string raw_log_(args->args[LOG_LINE], args->lengths[LOG_LINE]);
     const std::string log_part_(args->args[LOG_PART], args->lengths[LOG_PART]);
@@ -584,22 +1302,22 @@ extern "C"
 
     UTIL util;
 
-    SquidLogParser* p = new SquidLogParser(log_fmt_);
+    UTIL::Buffer* buf_ = (UTIL::Buffer*)initid->ptr;
+
+    SquidLogParser* p = &buf_->parser_.get(log_fmt_, SLPStats::Udf::Sum);
     p->append(raw_log_);
     if (p->errorNum() != SLPError::SLP_SUCCESS) {
-      delete p;
       *error = 1;
       return;
     }
 
     int64_t sum_ = p->getPartInt(util.getFieldId(log_part_));
-    delete p;
-    if (*((int64_t*)initid->ptr) > 0 &&
-        sum_ > std::numeric_limits<int64_t>::max() - *((int64_t*)initid->ptr)) {
+    if (buf_->acc_ > 0 &&
+        sum_ > std::numeric_limits<int64_t>::max() - buf_->acc_) {
       *error = 1; // overflow
     }
 
-    *((int64_t*)initid->ptr) += sum_;
+    buf_->acc_ += sum_;
   }
 
   int64_t slp_sum(UDF_INIT* initid,
@@ -607,7 +1325,7 @@ extern "C"
                   [[maybe_unused]] char* is_null,
                   [[maybe_unused]] char* error)
   {
-    return *((int64_t*)initid->ptr);
+    return ((UTIL::Buffer*)initid->ptr)->acc_;
   }
 
   /* ------------------------------------------------------------------------
@@ -616,14 +1334,6 @@ extern "C"
   my_bool slp_countbyrm_init(UDF_INIT* initid, UDF_ARGS* args, char* message)
   {
     UTIL util;
-    UTIL::Buffer* buf_ = new UTIL::Buffer;
-    buf_->value_ = 0;
-    buf_->acc_ = 0L;
-
-    initid->maybe_null = 1;
-    initid->decimals = 0;
-    initid->max_length = 20;
-    initid->ptr = (char*)buf_;
 
     if (args->arg_count >= 3) {
       UTIL::ResultErr r = {};
@@ -673,14 +1383,21 @@ extern "C"
       return MY_FALSE;
     }
 
+    UTIL::Buffer* buf_ = new UTIL::Buffer;
+    buf_->value_ = 0;
+    buf_->acc_ = 0L;
+
+    initid->maybe_null = 1;
+    initid->decimals = 0;
+    initid->max_length = 20;
+    initid->ptr = (char*)buf_;
+
     return MY_TRUE;
   }
 
   void slp_countbyrm_deinit(UDF_INIT* initid)
   {
-    if (initid->ptr != NULL) {
-      delete initid->ptr;
-    }
+    delete (UTIL::Buffer*)initid->ptr;
   }
 
   void slp_countbyrm_clear(UDF_INIT* initid,
@@ -724,7 +1441,7 @@ extern "C"
 
     UTIL util;
 
-    SquidLogParser p(util.toLower(log_fmt_));
+    SquidLogParser& p = buf_->parser_.get(log_fmt_, SLPStats::Udf::CountByRm);
     p.append(raw_log_);
     if (p.errorNum() != SLPError::SLP_SUCCESS) {
       *error = 1;
@@ -759,14 +1476,6 @@ extern "C"
                                    char* message)
   {
     UTIL util;
-    UTIL::Buffer* buf_ = new UTIL::Buffer;
-    buf_->value_ = 0;
-    buf_->acc_ = 0L;
-
-    initid->maybe_null = 1;
-    initid->decimals = 0;
-    initid->max_length = 20;
-    initid->ptr = (char*)buf_;
 
     if (args->arg_count >= 3) {
       UTIL::ResultErr r = {};
@@ -801,14 +1510,21 @@ extern "C"
       return MY_FALSE;
     }
 
+    UTIL::Buffer* buf_ = new UTIL::Buffer;
+    buf_->value_ = 0;
+    buf_->acc_ = 0L;
+
+    initid->maybe_null = 1;
+    initid->decimals = 0;
+    initid->max_length = 20;
+    initid->ptr = (char*)buf_;
+
     return MY_TRUE;
   }
 
   void slp_countbyhttpcode_deinit(UDF_INIT* initid)
   {
-    if (initid->ptr != NULL) {
-      delete initid->ptr;
-    }
+    delete (UTIL::Buffer*)initid->ptr;
   }
 
   void slp_countbyhttpcode_clear(UDF_INIT* initid,
@@ -848,9 +1564,8 @@ extern "C"
       return;
     }
 
-    UTIL util;
-
-    SquidLogParser p(util.toLower(log_fmt_));
+    SquidLogParser& p =
+      buf_->parser_.get(log_fmt_, SLPStats::Udf::CountByHttpCode);
     p.append(raw_log_);
     if (p.errorNum() != SLPError::SLP_SUCCESS) {
       *error = 1;
@@ -859,16 +1574,7 @@ extern "C"
 
     std::feclearexcept(FE_ALL_EXCEPT);
 
-    short code_;
-    if (util.toLower(log_fmt_) == "common" ||
-        util.toLower(log_fmt_) == "combined") {
-      code_ = std::move(p.getPartInt(SquidLogParser::Fields::HttpStatus));
-    } else {
-      code_ = std::move(std::stoi(p.strRight(
-        p.getPartStr(SquidLogParser::Fields::ReqStatusHierStatus), '/')));
-    }
-
-    if (code_ == log_part_) {
+    if (p.httpStatus() == log_part_) {
       ++buf_->acc_;
     }
 
@@ -886,6 +1592,1398 @@ extern "C"
     return buf_->acc_;
   }
 
+  /* ------------------------------------------------------------------------
+   */
+
+  /*!
+   * \brief Requests (and bytes) of every request method, in one scan.
+   * \return JSON-formated string. See SLPMethodHistogram::toJson().
+   */
+  my_bool slp_method_histogram_init(UDF_INIT* initid,
+                                    UDF_ARGS* args,
+                                    char* message)
+  {
+    UTIL util;
+
+    if (util.checkLineArgs(
+          args, message, 2, 3, ErrID::ERR_WRONG_NUM_ARGS_HISTOGRAM) ==
+        MY_FALSE) {
+      return MY_FALSE;
+    }
+
+    bool bytes_ = false;
+    if (util.checkOption(args, message, LOG_PART, "bytes", bytes_) ==
+        MY_FALSE) {
+      return MY_FALSE;
+    }
+
+    UTIL::MethodHistogramBuffer* buf_ = new UTIL::MethodHistogramBuffer;
+    buf_->bytes_ = bytes_;
+    initid->ptr = (char*)buf_;
+    initid->maybe_null = 0;
+    initid->const_item = 0;
+    initid->max_length = MAX_BLOB_WIDTH;
+
+    return MY_TRUE;
+  }
+
+  void slp_method_histogram_deinit(UDF_INIT* initid)
+  {
+    delete (UTIL::MethodHistogramBuffer*)initid->ptr;
+  }
+
+  void slp_method_histogram_clear(UDF_INIT* initid,
+                                  [[maybe_unused]] UDF_ARGS* args,
+                                  [[maybe_unused]] char* is_null,
+                                  [[maybe_unused]] char* error)
+  {
+    ((UTIL::MethodHistogramBuffer*)initid->ptr)->hist_.clear();
+  }
+
+  void slp_method_histogram_reset(UDF_INIT* initid,
+                                  UDF_ARGS* args,
+                                  char* is_null,
+                                  char* error)
+  {
+    slp_method_histogram_clear(initid, args, is_null, error);
+    slp_method_histogram_add(initid, args, is_null, error);
+  }
+
+  void slp_method_histogram_add(UDF_INIT* initid,
+                                UDF_ARGS* args,
+                                [[maybe_unused]] char* is_null,
+                                [[maybe_unused]] char* error)
+  {
+    if (args->args[LOG_LINE] == nullptr) {
+      return;
+    }
+
+    UTIL util;
+    UTIL::MethodHistogramBuffer* buf_ =
+      (UTIL::MethodHistogramBuffer*)initid->ptr;
+
+    // A line that doesn't parse is counted, not an error of the group.
+    SquidLogParser* p =
+      util.parseRow(args, buf_->parser_, SLPStats::Udf::MethodHistogram);
+    if (p == nullptr) {
+      buf_->hist_.reject();
+      return;
+    }
+
+    buf_->hist_.add(p->getPartStr(LogFields::ReqMethod),
+                    buf_->bytes_ ? p->getPartInt(LogFields::TotalSizeReply)
+                                 : 0);
+  }
+
+  char* slp_method_histogram(UDF_INIT* initid,
+                             [[maybe_unused]] UDF_ARGS* args,
+                             [[maybe_unused]] char* result,
+                             unsigned long* length,
+                             [[maybe_unused]] char* is_null,
+                             [[maybe_unused]] char* error)
+  {
+    UTIL::MethodHistogramBuffer* buf_ =
+      (UTIL::MethodHistogramBuffer*)initid->ptr;
+    buf_->out_ = buf_->hist_.toJson(buf_->bytes_);
+    *length = static_cast<unsigned long>(buf_->out_.size());
+
+    return buf_->out_.data();
+  }
+
+  /* ------------------------------------------------------------------------
+   */
+
+  /*!
+   * \brief Requests of every HTTP status (or status class), in one scan.
+   * \return JSON-formated string. See SLPStatusHistogram::toJson().
+   */
+  my_bool slp_status_histogram_init(UDF_INIT* initid,
+                                    UDF_ARGS* args,
+                                    char* message)
+  {
+    UTIL util;
+
+    if (util.checkLineArgs(
+          args, message, 2, 3, ErrID::ERR_WRONG_NUM_ARGS_HISTOGRAM) ==
+        MY_FALSE) {
+      return MY_FALSE;
+    }
+
+    bool byClass_ = false;
+    if (util.checkOption(args, message, LOG_PART, "class", byClass_) ==
+        MY_FALSE) {
+      return MY_FALSE;
+    }
+
+    UTIL::StatusHistogramBuffer* buf_ = new UTIL::StatusHistogramBuffer;
+    buf_->byClass_ = byClass_;
+    initid->ptr = (char*)buf_;
+    initid->maybe_null = 0;
+    initid->const_item = 0;
+    initid->max_length = MAX_BLOB_WIDTH;
+
+    return MY_TRUE;
+  }
+
+  void slp_status_histogram_deinit(UDF_INIT* initid)
+  {
+    delete (UTIL::StatusHistogramBuffer*)initid->ptr;
+  }
+
+  void slp_status_histogram_clear(UDF_INIT* initid,
+                                  [[maybe_unused]] UDF_ARGS* args,
+                                  [[maybe_unused]] char* is_null,
+                                  [[maybe_unused]] char* error)
+  {
+    ((UTIL::StatusHistogramBuffer*)initid->ptr)->hist_.clear();
+  }
+
+  void slp_status_histogram_reset(UDF_INIT* initid,
+                                  UDF_ARGS* args,
+                                  char* is_null,
+                                  char* error)
+  {
+    slp_status_histogram_clear(initid, args, is_null, error);
+    slp_status_histogram_add(initid, args, is_null, error);
+  }
+
+  void slp_status_histogram_add(UDF_INIT* initid,
+                                UDF_ARGS* args,
+                                [[maybe_unused]] char* is_null,
+                                [[maybe_unused]] char* error)
+  {
+    if (args->args[LOG_LINE] == nullptr) {
+      return;
+    }
+
+    UTIL util;
+    UTIL::StatusHistogramBuffer* buf_ =
+      (UTIL::StatusHistogramBuffer*)initid->ptr;
+
+    SquidLogParser* p =
+      util.parseRow(args, buf_->parser_, SLPStats::Udf::StatusHistogram);
+    if (p == nullptr) {
+      buf_->hist_.reject();
+      return;
+    }
+
+    buf_->hist_.add(p->httpStatus());
+  }
+
+  char* slp_status_histogram(UDF_INIT* initid,
+                             [[maybe_unused]] UDF_ARGS* args,
+                             [[maybe_unused]] char* result,
+                             unsigned long* length,
+                             [[maybe_unused]] char* is_null,
+                             [[maybe_unused]] char* error)
+  {
+    UTIL::StatusHistogramBuffer* buf_ =
+      (UTIL::StatusHistogramBuffer*)initid->ptr;
+    buf_->out_ = buf_->hist_.toJson(buf_->byClass_);
+    *length = static_cast<unsigned long>(buf_->out_.size());
+
+    return buf_->out_.data();
+  }
+
+  /* ------------------------------------------------------------------------
+   */
+
+  /*!
+   * \brief Request and byte hit ratios of the cache, in one scan. Only the
+   * squid format has the result codes.
+   * \return JSON-formated string. See SLPHitRatio::toJson().
+   */
+  my_bool slp_hit_ratio_init(UDF_INIT* initid, UDF_ARGS* args, char* message)
+  {
+    UTIL util;
+
+    if (util.checkLineArgs(
+          args, message, 2, 3, ErrID::ERR_WRONG_NUM_ARGS_HISTOGRAM) ==
+        MY_FALSE) {
+      return MY_FALSE;
+    }
+    if (args->args[LOG_FORMAT] != nullptr &&
+        util.formatOf({ args->args[LOG_FORMAT], args->lengths[LOG_FORMAT] }) !=
+          LogFormat::Squid) {
+      UTIL::ResultErr r = {};
+      util.getErrorText(ErrID::ERR_INVALID_ARG, r);
+      std::sprintf(message, r.msg, 1, "Valid is: squid");
+      return MY_FALSE;
+    }
+
+    bool bytes_ = false;
+    if (util.checkOption(args, message, LOG_PART, "bytes", bytes_) ==
+        MY_FALSE) {
+      return MY_FALSE;
+    }
+
+    UTIL::HitRatioBuffer* buf_ = new UTIL::HitRatioBuffer;
+    buf_->bytes_ = bytes_;
+    initid->ptr = (char*)buf_;
+    initid->maybe_null = 0;
+    initid->const_item = 0;
+    initid->max_length = MAX_BLOB_WIDTH;
+
+    return MY_TRUE;
+  }
+
+  void slp_hit_ratio_deinit(UDF_INIT* initid)
+  {
+    delete (UTIL::HitRatioBuffer*)initid->ptr;
+  }
+
+  void slp_hit_ratio_clear(UDF_INIT* initid,
+                           [[maybe_unused]] UDF_ARGS* args,
+                           [[maybe_unused]] char* is_null,
+                           [[maybe_unused]] char* error)
+  {
+    ((UTIL::HitRatioBuffer*)initid->ptr)->ratio_.clear();
+  }
+
+  void slp_hit_ratio_reset(UDF_INIT* initid,
+                           UDF_ARGS* args,
+                           char* is_null,
+                           char* error)
+  {
+    slp_hit_ratio_clear(initid, args, is_null, error);
+    slp_hit_ratio_add(initid, args, is_null, error);
+  }
+
+  void slp_hit_ratio_add(UDF_INIT* initid,
+                         UDF_ARGS* args,
+                         [[maybe_unused]] char* is_null,
+                         [[maybe_unused]] char* error)
+  {
+    if (args->args[LOG_LINE] == nullptr) {
+      return;
+    }
+
+    UTIL util;
+    UTIL::HitRatioBuffer* buf_ = (UTIL::HitRatioBuffer*)initid->ptr;
+
+    SquidLogParser* p =
+      util.parseRow(args, buf_->parser_, SLPStats::Udf::HitRatio);
+    if (p == nullptr) {
+      buf_->ratio_.reject();
+      return;
+    }
+
+    buf_->ratio_.add(p->getPartStr(LogFields::ReqStatusHierStatus),
+                     p->getPartInt(LogFields::TotalSizeReply));
+  }
+
+  char* slp_hit_ratio(UDF_INIT* initid,
+                      [[maybe_unused]] UDF_ARGS* args,
+                      [[maybe_unused]] char* result,
+                      unsigned long* length,
+                      [[maybe_unused]] char* is_null,
+                      [[maybe_unused]] char* error)
+  {
+    UTIL::HitRatioBuffer* buf_ = (UTIL::HitRatioBuffer*)initid->ptr;
+    buf_->out_ = buf_->ratio_.toJson(buf_->bytes_);
+    *length = static_cast<unsigned long>(buf_->out_.size());
+
+    return buf_->out_.data();
+  }
+
+  /* ------------------------------------------------------------------------
+   */
+
+  /*!
+   * \brief Quantile of response_time or total_size_reply, in one scan and a
+   * fixed memory. See SLPLogHistogram for the error.
+   * \return NULL if no line has the field.
+   */
+  my_bool slp_percentile_init(UDF_INIT* initid, UDF_ARGS* args, char* message)
+  {
+    UTIL util;
+
+    LogFields field_ = LogFields::Unknown;
+    std::vector<double> q_;
+    if (util.bindPercentile(args, message, 4, field_, q_) == MY_FALSE) {
+      return MY_FALSE;
+    }
+
+    UTIL::PercentileBuffer* buf_ = new UTIL::PercentileBuffer;
+    buf_->field_ = field_;
+    buf_->q_ = std::move(q_);
+    initid->ptr = (char*)buf_;
+    initid->maybe_null = 1;
+    initid->const_item = 0;
+    initid->decimals = 1;
+    initid->max_length = 24;
+
+    return MY_TRUE;
+  }
+
+  void slp_percentile_deinit(UDF_INIT* initid)
+  {
+    delete (UTIL::PercentileBuffer*)initid->ptr;
+  }
+
+  void slp_percentile_clear(UDF_INIT* initid,
+                            [[maybe_unused]] UDF_ARGS* args,
+                            [[maybe_unused]] char* is_null,
+                            [[maybe_unused]] char* error)
+  {
+    ((UTIL::PercentileBuffer*)initid->ptr)->hist_.clear();
+  }
+
+  void slp_percentile_reset(UDF_INIT* initid,
+                            UDF_ARGS* args,
+                            char* is_null,
+                            char* error)
+  {
+    slp_percentile_clear(initid, args, is_null, error);
+    slp_percentile_add(initid, args, is_null, error);
+  }
+
+  void slp_percentile_add(UDF_INIT* initid,
+                          UDF_ARGS* args,
+                          [[maybe_unused]] char* is_null,
+                          [[maybe_unused]] char* error)
+  {
+    if (args->args[LOG_LINE] == nullptr) {
+      return;
+    }
+
+    UTIL util;
+    UTIL::PercentileBuffer* buf_ = (UTIL::PercentileBuffer*)initid->ptr;
+
+    // The lines that don't parse have no value, like NULL.
+    if (SquidLogParser* p =
+          util.parseRow(args, buf_->parser_, SLPStats::Udf::Percentile);
+        p != nullptr) {
+      buf_->hist_.add(p->getPartInt(buf_->field_));
+    }
+  }
+
+  double slp_percentile(UDF_INIT* initid,
+                        [[maybe_unused]] UDF_ARGS* args,
+                        char* is_null,
+                        [[maybe_unused]] char* error)
+  {
+    UTIL::PercentileBuffer* buf_ = (UTIL::PercentileBuffer*)initid->ptr;
+    const double v_ = buf_->hist_.quantile(buf_->q_.front());
+    if (std::isnan(v_)) {
+      *is_null = 1;
+      return 0.0;
+    }
+    return v_;
+  }
+
+  /* ------------------------------------------------------------------------
+   */
+
+  /*!
+   * \brief Many quantiles of response_time or total_size_reply, from the
+   * same scan.
+   * \return JSON-formated string: {"count":n,"min":n,"max":n,
+   * "quantiles":{"0.5":x,...}}, the quantiles null if no line has the field.
+   */
+  my_bool slp_percentiles_init(UDF_INIT* initid,
+                               UDF_ARGS* args,
+                               char* message)
+  {
+    UTIL util;
+
+    LogFields field_ = LogFields::Unknown;
+    std::vector<double> q_;
+    if (util.bindPercentile(args,
+                            message,
+                            std::numeric_limits<unsigned int>::max(),
+                            field_,
+                            q_) == MY_FALSE) {
+      return MY_FALSE;
+    }
+
+    UTIL::PercentileBuffer* buf_ = new UTIL::PercentileBuffer;
+    buf_->field_ = field_;
+    buf_->q_ = std::move(q_);
+    initid->ptr = (char*)buf_;
+    initid->maybe_null = 0;
+    initid->const_item = 0;
+    initid->max_length = MAX_BLOB_WIDTH;
+
+    return MY_TRUE;
+  }
+
+  void slp_percentiles_deinit(UDF_INIT* initid)
+  {
+    slp_percentile_deinit(initid);
+  }
+
+  void slp_percentiles_clear(UDF_INIT* initid,
+                             UDF_ARGS* args,
+                             char* is_null,
+                             char* error)
+  {
+    slp_percentile_clear(initid, args, is_null, error);
+  }
+
+  void slp_percentiles_reset(UDF_INIT* initid,
+                             UDF_ARGS* args,
+                             char* is_null,
+                             char* error)
+  {
+    slp_percentile_reset(initid, args, is_null, error);
+  }
+
+  void slp_percentiles_add(UDF_INIT* initid,
+                           UDF_ARGS* args,
+                           char* is_null,
+                           char* error)
+  {
+    slp_percentile_add(initid, args, is_null, error);
+  }
+
+  char* slp_percentiles(UDF_INIT* initid,
+                        [[maybe_unused]] UDF_ARGS* args,
+                        [[maybe_unused]] char* result,
+                        unsigned long* length,
+                        [[maybe_unused]] char* is_null,
+                        [[maybe_unused]] char* error)
+  {
+    UTIL::PercentileBuffer* buf_ = (UTIL::PercentileBuffer*)initid->ptr;
+    const SLPLogHistogram& h_ = buf_->hist_;
+
+    std::stringstream ss;
+    ss << "{\"count\":" << h_.count() << ",\"min\":" << h_.min()
+       << ",\"max\":" << h_.max() << ",\"quantiles\":{";
+    for (size_t i_ = 0; i_ < buf_->q_.size(); ++i_) {
+      const double v_ = h_.quantile(buf_->q_[i_]);
+      ss << (i_ ? "," : "") << "\"" << buf_->q_[i_] << "\":";
+      if (std::isnan(v_)) {
+        ss << "null";
+      } else {
+        ss << std::fixed << std::setprecision(1) << v_ << std::defaultfloat
+           << std::setprecision(6);
+      }
+    }
+    ss << "}}";
+
+    buf_->out_ = ss.str();
+    *length = static_cast<unsigned long>(buf_->out_.size());
+
+    return buf_->out_.data();
+  }
+
+  /* ------------------------------------------------------------------------
+   */
+
+  /*!
+   * \brief Requests, bytes (total_size_reply), 4xx and 5xx statuses and the
+   * sum of the response times per interval of SECONDS, in one scan for a
+   * whole chart. See SLPTimeSeries.
+   * \return JSON-formated string: {"seconds":n,"series":[{"t":n,
+   * "requests":n,"bytes":n,"4xx":n,"5xx":n,"response_time":n},...],
+   * "dropped":n,"rejected":n}
+   */
+  my_bool slp_timeseries_init(UDF_INIT* initid, UDF_ARGS* args, char* message)
+  {
+    UTIL util;
+
+    if (util.checkLineArgs(
+          args, message, 3, 3, ErrID::ERR_WRONG_NUM_ARGS_TIMESERIES) ==
+        MY_FALSE) {
+      return MY_FALSE;
+    }
+
+    double s_ = 0.0;
+    if (!util.constReal(args, LOG_PART, s_) || s_ < 1.0 ||
+        s_ > UTIL::TimeSeriesBuffer::maxSeconds || s_ != std::floor(s_)) {
+      UTIL::ResultErr r = {};
+      util.getErrorText(ErrID::ERR_INVALID_ARG, r);
+      std::sprintf(message, r.msg, 3, "Must be a constant in [1, 604800]");
+      return MY_FALSE;
+    }
+
+    UTIL::TimeSeriesBuffer* buf_ = new UTIL::TimeSeriesBuffer;
+    buf_->series_.setSeconds(static_cast<uint32_t>(s_));
+    initid->ptr = (char*)buf_;
+    initid->maybe_null = 0;
+    initid->const_item = 0;
+    initid->max_length = MAX_BLOB_WIDTH;
+
+    return MY_TRUE;
+  }
+
+  void slp_timeseries_deinit(UDF_INIT* initid)
+  {
+    delete (UTIL::TimeSeriesBuffer*)initid->ptr;
+  }
+
+  void slp_timeseries_clear(UDF_INIT* initid,
+                            [[maybe_unused]] UDF_ARGS* args,
+                            [[maybe_unused]] char* is_null,
+                            [[maybe_unused]] char* error)
+  {
+    ((UTIL::TimeSeriesBuffer*)initid->ptr)->series_.clear();
+  }
+
+  void slp_timeseries_reset(UDF_INIT* initid,
+                            UDF_ARGS* args,
+                            char* is_null,
+                            char* error)
+  {
+    slp_timeseries_clear(initid, args, is_null, error);
+    slp_timeseries_add(initid, args, is_null, error);
+  }
+
+  void slp_timeseries_add(UDF_INIT* initid,
+                          UDF_ARGS* args,
+                          [[maybe_unused]] char* is_null,
+                          [[maybe_unused]] char* error)
+  {
+    if (args->args[LOG_LINE] == nullptr) {
+      return;
+    }
+
+    UTIL util;
+    UTIL::TimeSeriesBuffer* buf_ = (UTIL::TimeSeriesBuffer*)initid->ptr;
+
+    // A line without a valid date can't be binned.
+    SquidLogParser* p =
+      util.parseRow(args, buf_->parser_, SLPStats::Udf::TimeSeries);
+    if (p == nullptr || p->timestamp() == 0) {
+      buf_->series_.reject();
+      return;
+    }
+    buf_->series_.add(p->timestamp(),
+                      p->getPartInt(LogFields::TotalSizeReply),
+                      p->httpStatus(),
+                      p->getPartInt(LogFields::ResponseTime));
+  }
+
+  char* slp_timeseries(UDF_INIT* initid,
+                       [[maybe_unused]] UDF_ARGS* args,
+                       [[maybe_unused]] char* result,
+                       unsigned long* length,
+                       [[maybe_unused]] char* is_null,
+                       [[maybe_unused]] char* error)
+  {
+    UTIL::TimeSeriesBuffer* buf_ = (UTIL::TimeSeriesBuffer*)initid->ptr;
+    buf_->out_ = buf_->series_.toJson();
+    *length = static_cast<unsigned long>(buf_->out_.size());
+
+    return buf_->out_.data();
+  }
+
+  /* ------------------------------------------------------------------------
+   */
+
+  /*!
+   * \brief Sessions of the clients (source_ip_address, or the key field
+   * given), split by an idle gap of GAP_SECONDS, in one unsorted scan.
+   * See SLPSessions.
+   * \return JSON-formated string: {"sessions":n,"clients":n,
+   * "mean_duration":x,"requests_per_session":x,"bytes_per_session":x,
+   * "rejected":n}
+   */
+  my_bool slp_sessions_init(UDF_INIT* initid, UDF_ARGS* args, char* message)
+  {
+    UTIL util;
+
+    if (util.checkLineArgs(
+          args, message, 3, 4, ErrID::ERR_WRONG_NUM_ARGS_SESSIONS) ==
+        MY_FALSE) {
+      return MY_FALSE;
+    }
+
+    double gap_ = 0.0;
+    if (!util.constReal(args, LOG_PART, gap_) || gap_ < 1.0 ||
+        gap_ > UTIL::SessionsBuffer::maxGap || gap_ != std::floor(gap_)) {
+      UTIL::ResultErr r = {};
+      util.getErrorText(ErrID::ERR_INVALID_ARG, r);
+      std::sprintf(message, r.msg, 3, "Must be a constant in [1, 86400]");
+      return MY_FALSE;
+    }
+
+    UTIL::KeyField key_ = { LogFields::CliSrcIpAddr, false };
+    if (args->arg_count > URL_PART &&
+        util.bindKeyField(args, message, URL_PART, key_) == MY_FALSE) {
+      return MY_FALSE;
+    }
+
+    UTIL::SessionsBuffer* buf_ = new UTIL::SessionsBuffer;
+    buf_->key_ = key_;
+    buf_->sessions_.setGap(static_cast<uint32_t>(gap_));
+    initid->ptr = (char*)buf_;
+    initid->maybe_null = 0;
+    initid->const_item = 0;
+    initid->max_length = MAX_BLOB_WIDTH;
+
+    return MY_TRUE;
+  }
+
+  void slp_sessions_deinit(UDF_INIT* initid)
+  {
+    delete (UTIL::SessionsBuffer*)initid->ptr;
+  }
+
+  void slp_sessions_clear(UDF_INIT* initid,
+                          [[maybe_unused]] UDF_ARGS* args,
+                          [[maybe_unused]] char* is_null,
+                          [[maybe_unused]] char* error)
+  {
+    ((UTIL::SessionsBuffer*)initid->ptr)->sessions_.clear();
+  }
+
+  void slp_sessions_reset(UDF_INIT* initid,
+                          UDF_ARGS* args,
+                          char* is_null,
+                          char* error)
+  {
+    slp_sessions_clear(initid, args, is_null, error);
+    slp_sessions_add(initid, args, is_null, error);
+  }
+
+  void slp_sessions_add(UDF_INIT* initid,
+                        UDF_ARGS* args,
+                        [[maybe_unused]] char* is_null,
+                        [[maybe_unused]] char* error)
+  {
+    if (args->args[LOG_LINE] == nullptr) {
+      return;
+    }
+
+    UTIL util;
+    UTIL::SessionsBuffer* buf_ = (UTIL::SessionsBuffer*)initid->ptr;
+
+    // The lines without a valid date can't be placed in a session, and the
+    // ones without a client (e.g. the username '-') aren't of a client.
+    SquidLogParser* p =
+      util.parseRow(args, buf_->parser_, SLPStats::Udf::Sessions);
+    if (p == nullptr || p->timestamp() == 0) {
+      buf_->sessions_.reject();
+      return;
+    }
+    if (const uint64_t h_ = util.hashOf(*p, buf_->key_, buf_->out_); h_) {
+      buf_->sessions_.add(
+        h_, p->timestamp(), p->getPartInt(LogFields::TotalSizeReply));
+    }
+  }
+
+  char* slp_sessions(UDF_INIT* initid,
+                     [[maybe_unused]] UDF_ARGS* args,
+                     [[maybe_unused]] char* result,
+                     unsigned long* length,
+                     [[maybe_unused]] char* is_null,
+                     [[maybe_unused]] char* error)
+  {
+    UTIL::SessionsBuffer* buf_ = (UTIL::SessionsBuffer*)initid->ptr;
+    buf_->out_ = buf_->sessions_.toJson();
+    *length = static_cast<unsigned long>(buf_->out_.size());
+
+    return buf_->out_.data();
+  }
+
+  /* Sketches --------------------------------------------------------------- */
+
+  /*!
+   * \brief Approximate COUNT(DISTINCT ...) of a field, by a HyperLogLog of
+   * 16 KB. See SLPHyperLogLog for the error.
+   */
+  my_bool slp_approx_distinct_init(UDF_INIT* initid,
+                                   UDF_ARGS* args,
+                                   char* message)
+  {
+    UTIL util;
+
+    UTIL::KeyField key_;
+    if (util.checkLineArgs(args, message, 3, 3, ErrID::ERR_WRONG_NUM_ARGS) ==
+          MY_FALSE ||
+        util.bindKeyField(args, message, LOG_PART, key_) == MY_FALSE) {
+      return MY_FALSE;
+    }
+
+    UTIL::HllBuffer* buf_ = new UTIL::HllBuffer;
+    buf_->key_ = key_;
+    initid->ptr = (char*)buf_;
+    initid->maybe_null = 0;
+    initid->const_item = 0;
+
+    return MY_TRUE;
+  }
+
+  void slp_approx_distinct_deinit(UDF_INIT* initid)
+  {
+    delete (UTIL::HllBuffer*)initid->ptr;
+  }
+
+  void slp_approx_distinct_clear(UDF_INIT* initid,
+                                 [[maybe_unused]] UDF_ARGS* args,
+                                 [[maybe_unused]] char* is_null,
+                                 [[maybe_unused]] char* error)
+  {
+    ((UTIL::HllBuffer*)initid->ptr)->hll_.clear();
+  }
+
+  void slp_approx_distinct_reset(UDF_INIT* initid,
+                                 UDF_ARGS* args,
+                                 char* is_null,
+                                 char* error)
+  {
+    slp_approx_distinct_clear(initid, args, is_null, error);
+    slp_approx_distinct_add(initid, args, is_null, error);
+  }
+
+  void slp_approx_distinct_add(UDF_INIT* initid,
+                               UDF_ARGS* args,
+                               [[maybe_unused]] char* is_null,
+                               [[maybe_unused]] char* error)
+  {
+    if (args->args[LOG_LINE] == nullptr) {
+      return;
+    }
+
+    UTIL util;
+    UTIL::HllBuffer* buf_ = (UTIL::HllBuffer*)initid->ptr;
+
+    // The lines that don't parse and the empty keys aren't counted.
+    if (SquidLogParser* p =
+          util.parseRow(args, buf_->parser_, SLPStats::Udf::ApproxDistinct);
+        p != nullptr) {
+      if (const uint64_t h_ = util.hashOf(*p, buf_->key_, buf_->out_); h_) {
+        buf_->hll_.add(h_);
+      }
+    }
+  }
+
+  int64_t slp_approx_distinct(UDF_INIT* initid,
+                              [[maybe_unused]] UDF_ARGS* args,
+                              [[maybe_unused]] char* is_null,
+                              [[maybe_unused]] char* error)
+  {
+    return static_cast<int64_t>(
+      ((UTIL::HllBuffer*)initid->ptr)->hll_.estimate());
+  }
+
+  /* ------------------------------------------------------------------------
+   */
+
+  /*!
+   * \brief The HyperLogLog of slp_approx_distinct(), as a BLOB, to be
+   * merged later by slp_hll_merge() and counted by slp_hll_count().
+   */
+  my_bool slp_hll_export_init(UDF_INIT* initid, UDF_ARGS* args, char* message)
+  {
+    initid->max_length = SLPHyperLogLog::blobSize;
+    return slp_approx_distinct_init(initid, args, message);
+  }
+
+  void slp_hll_export_deinit(UDF_INIT* initid)
+  {
+    slp_approx_distinct_deinit(initid);
+  }
+
+  void slp_hll_export_clear(UDF_INIT* initid,
+                            UDF_ARGS* args,
+                            char* is_null,
+                            char* error)
+  {
+    slp_approx_distinct_clear(initid, args, is_null, error);
+  }
+
+  void slp_hll_export_reset(UDF_INIT* initid,
+                            UDF_ARGS* args,
+                            char* is_null,
+                            char* error)
+  {
+    slp_approx_distinct_reset(initid, args, is_null, error);
+  }
+
+  void slp_hll_export_add(UDF_INIT* initid,
+                          UDF_ARGS* args,
+                          char* is_null,
+                          char* error)
+  {
+    slp_approx_distinct_add(initid, args, is_null, error);
+  }
+
+  char* slp_hll_export(UDF_INIT* initid,
+                       [[maybe_unused]] UDF_ARGS* args,
+                       [[maybe_unused]] char* result,
+                       unsigned long* length,
+                       [[maybe_unused]] char* is_null,
+                       [[maybe_unused]] char* error)
+  {
+    UTIL::HllBuffer* buf_ = (UTIL::HllBuffer*)initid->ptr;
+    buf_->out_ = buf_->hll_.toBlob();
+    *length = static_cast<unsigned long>(buf_->out_.size());
+
+    return buf_->out_.data();
+  }
+
+  /* ------------------------------------------------------------------------
+   */
+
+  /*!
+   * \brief Merges the sketches of slp_hll_export() (or of slp_hll_merge()):
+   * the sketch of the union of their keys.
+   * \return NULL if a sketch isn't valid.
+   */
+  my_bool slp_hll_merge_init(UDF_INIT* initid, UDF_ARGS* args, char* message)
+  {
+    UTIL util;
+
+    if (args->arg_count != 1) {
+      UTIL::ResultErr r = {};
+      util.getErrorText(ErrID::ERR_WRONG_NUM_ARGS_1, r);
+      std::memmove(message, r.msg, r.len);
+      return MY_FALSE;
+    }
+    if (args->arg_type[ARG_DATA_0] != STRING_RESULT) {
+      UTIL::ResultErr r = {};
+      util.getErrorText(ErrID::ERR_INVALID_TYPE_ARG, r);
+      std::sprintf(message, r.msg, 1, "(BLOB) sketch");
+      return MY_FALSE;
+    }
+
+    initid->ptr = (char*)new UTIL::HllBuffer;
+    initid->maybe_null = 1;
+    initid->const_item = 0;
+    initid->max_length = SLPHyperLogLog::blobSize;
+
+    return MY_TRUE;
+  }
+
+  void slp_hll_merge_deinit(UDF_INIT* initid)
+  {
+    delete (UTIL::HllBuffer*)initid->ptr;
+  }
+
+  void slp_hll_merge_clear(UDF_INIT* initid,
+                           [[maybe_unused]] UDF_ARGS* args,
+                           [[maybe_unused]] char* is_null,
+                           [[maybe_unused]] char* error)
+  {
+    ((UTIL::HllBuffer*)initid->ptr)->hll_.clear();
+  }
+
+  void slp_hll_merge_reset(UDF_INIT* initid,
+                           UDF_ARGS* args,
+                           char* is_null,
+                           char* error)
+  {
+    slp_hll_merge_clear(initid, args, is_null, error);
+    slp_hll_merge_add(initid, args, is_null, error);
+  }
+
+  void slp_hll_merge_add(UDF_INIT* initid,
+                         UDF_ARGS* args,
+                         [[maybe_unused]] char* is_null,
+                         char* error)
+  {
+    if (args->args[ARG_DATA_0] == nullptr) {
+      return;
+    }
+    UTIL::HllBuffer* buf_ = (UTIL::HllBuffer*)initid->ptr;
+    if (!buf_->hll_.merge(
+          { args->args[ARG_DATA_0], args->lengths[ARG_DATA_0] })) {
+      *error = 1;
+    }
+  }
+
+  char* slp_hll_merge(UDF_INIT* initid,
+                      UDF_ARGS* args,
+                      char* result,
+                      unsigned long* length,
+                      char* is_null,
+                      char* error)
+  {
+    return slp_hll_export(initid, args, result, length, is_null, error);
+  }
+
+  /* ------------------------------------------------------------------------
+   */
+
+  /*!
+   * \brief Approximate number of distinct keys of a sketch of
+   * slp_hll_export() or slp_hll_merge().
+   * \return NULL if the sketch isn't valid.
+   */
+  my_bool slp_hll_count_init(UDF_INIT* initid, UDF_ARGS* args, char* message)
+  {
+    UTIL util;
+
+    if (args->arg_count != 1) {
+      UTIL::ResultErr r = {};
+      util.getErrorText(ErrID::ERR_WRONG_NUM_ARGS_1, r);
+      std::memmove(message, r.msg, r.len);
+      return MY_FALSE;
+    }
+    if (args->arg_type[ARG_DATA_0] != STRING_RESULT) {
+      UTIL::ResultErr r = {};
+      util.getErrorText(ErrID::ERR_INVALID_TYPE_ARG, r);
+      std::sprintf(message, r.msg, 1, "(BLOB) sketch");
+      return MY_FALSE;
+    }
+
+    initid->ptr = (char*)new SLPHyperLogLog;
+    initid->maybe_null = 1;
+    initid->decimals = 0;
+    initid->max_length = 20;
+
+    return MY_TRUE;
+  }
+
+  void slp_hll_count_deinit(UDF_INIT* initid)
+  {
+    delete (SLPHyperLogLog*)initid->ptr;
+  }
+
+  int64_t slp_hll_count(UDF_INIT* initid,
+                        UDF_ARGS* args,
+                        char* is_null,
+                        [[maybe_unused]] char* error)
+  {
+    SLPHyperLogLog* hll_ = (SLPHyperLogLog*)initid->ptr;
+    if (args->args[ARG_DATA_0] == nullptr ||
+        !hll_->fromBlob(
+          { args->args[ARG_DATA_0], args->lengths[ARG_DATA_0] })) {
+      *is_null = 1;
+      return 0;
+    }
+    return static_cast<int64_t>(hll_->estimate());
+  }
+
+  /* ------------------------------------------------------------------------
+   */
+
+  /*!
+   * \brief Count-Min sketch of the keys of a field, as a BLOB, to be merged
+   * later by slp_cms_merge() and queried by slp_cms_estimate().
+   * See SLPCountMin for the error.
+   */
+  my_bool slp_cms_build_init(UDF_INIT* initid, UDF_ARGS* args, char* message)
+  {
+    UTIL util;
+
+    UTIL::KeyField key_;
+    if (util.checkLineArgs(args, message, 3, 3, ErrID::ERR_WRONG_NUM_ARGS) ==
+          MY_FALSE ||
+        util.bindKeyField(args, message, LOG_PART, key_) == MY_FALSE) {
+      return MY_FALSE;
+    }
+
+    UTIL::CountMinBuffer* buf_ = new UTIL::CountMinBuffer;
+    buf_->key_ = key_;
+    initid->ptr = (char*)buf_;
+    initid->maybe_null = 0;
+    initid->const_item = 0;
+    initid->max_length = SLPCountMin::blobSize;
+
+    return MY_TRUE;
+  }
+
+  void slp_cms_build_deinit(UDF_INIT* initid)
+  {
+    delete (UTIL::CountMinBuffer*)initid->ptr;
+  }
+
+  void slp_cms_build_clear(UDF_INIT* initid,
+                           [[maybe_unused]] UDF_ARGS* args,
+                           [[maybe_unused]] char* is_null,
+                           [[maybe_unused]] char* error)
+  {
+    ((UTIL::CountMinBuffer*)initid->ptr)->cms_.clear();
+  }
+
+  void slp_cms_build_reset(UDF_INIT* initid,
+                           UDF_ARGS* args,
+                           char* is_null,
+                           char* error)
+  {
+    slp_cms_build_clear(initid, args, is_null, error);
+    slp_cms_build_add(initid, args, is_null, error);
+  }
+
+  void slp_cms_build_add(UDF_INIT* initid,
+                         UDF_ARGS* args,
+                         [[maybe_unused]] char* is_null,
+                         [[maybe_unused]] char* error)
+  {
+    if (args->args[LOG_LINE] == nullptr) {
+      return;
+    }
+
+    UTIL util;
+    UTIL::CountMinBuffer* buf_ = (UTIL::CountMinBuffer*)initid->ptr;
+
+    // The keys are hashed as text (also the addresses), as they're queried.
+    if (SquidLogParser* p =
+          util.parseRow(args, buf_->parser_, SLPStats::Udf::CountMin);
+        p != nullptr && util.keyOf(*p, buf_->key_, buf_->out_)) {
+      buf_->cms_.add(SLPHash::of(buf_->out_));
+    }
+  }
+
+  char* slp_cms_build(UDF_INIT* initid,
+                      [[maybe_unused]] UDF_ARGS* args,
+                      [[maybe_unused]] char* result,
+                      unsigned long* length,
+                      [[maybe_unused]] char* is_null,
+                      [[maybe_unused]] char* error)
+  {
+    UTIL::CountMinBuffer* buf_ = (UTIL::CountMinBuffer*)initid->ptr;
+    buf_->out_ = buf_->cms_.toBlob();
+    *length = static_cast<unsigned long>(buf_->out_.size());
+
+    return buf_->out_.data();
+  }
+
+  /* ------------------------------------------------------------------------
+   */
+
+  /*!
+   * \brief Merges the sketches of slp_cms_build() (or of slp_cms_merge()):
+   * the sketch of all their keys.
+   * \return NULL if a sketch isn't valid.
+   */
+  my_bool slp_cms_merge_init(UDF_INIT* initid, UDF_ARGS* args, char* message)
+  {
+    UTIL util;
+
+    if (args->arg_count != 1) {
+      UTIL::ResultErr r = {};
+      util.getErrorText(ErrID::ERR_WRONG_NUM_ARGS_1, r);
+      std::memmove(message, r.msg, r.len);
+      return MY_FALSE;
+    }
+    if (args->arg_type[ARG_DATA_0] != STRING_RESULT) {
+      UTIL::ResultErr r = {};
+      util.getErrorText(ErrID::ERR_INVALID_TYPE_ARG, r);
+      std::sprintf(message, r.msg, 1, "(BLOB) sketch");
+      return MY_FALSE;
+    }
+
+    initid->ptr = (char*)new UTIL::CountMinBuffer;
+    initid->maybe_null = 1;
+    initid->const_item = 0;
+    initid->max_length = SLPCountMin::blobSize;
+
+    return MY_TRUE;
+  }
+
+  void slp_cms_merge_deinit(UDF_INIT* initid)
+  {
+    slp_cms_build_deinit(initid);
+  }
+
+  void slp_cms_merge_clear(UDF_INIT* initid,
+                           UDF_ARGS* args,
+                           char* is_null,
+                           char* error)
+  {
+    slp_cms_build_clear(initid, args, is_null, error);
+  }
+
+  void slp_cms_merge_reset(UDF_INIT* initid,
+                           UDF_ARGS* args,
+                           char* is_null,
+                           char* error)
+  {
+    slp_cms_merge_clear(initid, args, is_null, error);
+    slp_cms_merge_add(initid, args, is_null, error);
+  }
+
+  void slp_cms_merge_add(UDF_INIT* initid,
+                         UDF_ARGS* args,
+                         [[maybe_unused]] char* is_null,
+                         char* error)
+  {
+    if (args->args[ARG_DATA_0] == nullptr) {
+      return;
+    }
+    UTIL::CountMinBuffer* buf_ = (UTIL::CountMinBuffer*)initid->ptr;
+    if (!buf_->cms_.merge(
+          { args->args[ARG_DATA_0], args->lengths[ARG_DATA_0] })) {
+      *error = 1;
+    }
+  }
+
+  char* slp_cms_merge(UDF_INIT* initid,
+                      UDF_ARGS* args,
+                      char* result,
+                      unsigned long* length,
+                      char* is_null,
+                      char* error)
+  {
+    return slp_cms_build(initid, args, result, length, is_null, error);
+  }
+
+  /* ------------------------------------------------------------------------
+   */
+
+  /*!
+   * \brief Approximate count of a key in a sketch of slp_cms_build() or
+   * slp_cms_merge(). It reads SLPCountMin::depth counters of the BLOB.
+   * \return NULL if the sketch isn't valid or the key is NULL.
+   */
+  my_bool slp_cms_estimate_init(UDF_INIT* initid,
+                                UDF_ARGS* args,
+                                char* message)
+  {
+    UTIL util;
+
+    if (args->arg_count != 2) {
+      UTIL::ResultErr r = {};
+      util.getErrorText(ErrID::ERR_WRONG_NUM_ARGS_2, r);
+      std::memmove(message, r.msg, r.len);
+      return MY_FALSE;
+    }
+    if (args->arg_type[ARG_DATA_0] != STRING_RESULT) {
+      UTIL::ResultErr r = {};
+      util.getErrorText(ErrID::ERR_INVALID_TYPE_ARG, r);
+      std::sprintf(message, r.msg, 1, "(BLOB) sketch");
+      return MY_FALSE;
+    }
+    // The key can be of any type, e.g. an integer: it's hashed as text.
+    args->arg_type[ARG_DATA_0 + 1] = STRING_RESULT;
+
+    initid->ptr = nullptr;
+    initid->maybe_null = 1;
+    initid->decimals = 0;
+    initid->max_length = 20;
+
+    return MY_TRUE;
+  }
+
+  void slp_cms_estimate_deinit([[maybe_unused]] UDF_INIT* initid) {}
+
+  int64_t slp_cms_estimate([[maybe_unused]] UDF_INIT* initid,
+                           UDF_ARGS* args,
+                           char* is_null,
+                           [[maybe_unused]] char* error)
+  {
+    constexpr unsigned int key_ = ARG_DATA_0 + 1;
+    uint64_t n_ = 0;
+    if (args->args[ARG_DATA_0] == nullptr || args->args[key_] == nullptr ||
+        !SLPCountMin::estimate(
+          { args->args[ARG_DATA_0], args->lengths[ARG_DATA_0] },
+          SLPHash::of({ args->args[key_], args->lengths[key_] }),
+          n_)) {
+      *is_null = 1;
+      return 0;
+    }
+    return static_cast<int64_t>(n_);
+  }
+
+  /* Summaries -------------------------------------------------------------- */
+
+  /*!
+   * \brief The k keys of a field with the most rows, or with the highest sum
+   * of a weight (e.g. bytes), in a bounded memory (see SLPSpaceSaving).
+   * \return JSON-formated string: [{"key":"...","count":n,"error":n},...],
+   * in descending order of the count, which is over-estimated by at most its
+   * error.
+   */
+  my_bool slp_topk_init(UDF_INIT* initid, UDF_ARGS* args, char* message)
+  {
+    UTIL util;
+
+    UTIL::KeyField key_;
+    size_t k_ = 0;
+    LogFields weight_ = LogFields::Unknown;
+    if (util.bindTopK(args, message, key_, k_, weight_) == MY_FALSE) {
+      return MY_FALSE;
+    }
+
+    UTIL::TopKBuffer* buf_ = new UTIL::TopKBuffer;
+    buf_->key_ = key_;
+    buf_->k_ = k_;
+    buf_->weight_ = weight_;
+    buf_->summary_.reserve(
+      std::max(k_ * UTIL::TopKBuffer::countersPerKey,
+               UTIL::TopKBuffer::minCounters));
+    initid->ptr = (char*)buf_;
+    initid->maybe_null = 0;
+    initid->const_item = 0;
+    initid->max_length = MAX_BLOB_WIDTH;
+
+    return MY_TRUE;
+  }
+
+  void slp_topk_deinit(UDF_INIT* initid)
+  {
+    delete (UTIL::TopKBuffer*)initid->ptr;
+  }
+
+  void slp_topk_clear(UDF_INIT* initid,
+                      [[maybe_unused]] UDF_ARGS* args,
+                      [[maybe_unused]] char* is_null,
+                      [[maybe_unused]] char* error)
+  {
+    ((UTIL::TopKBuffer*)initid->ptr)->summary_.clear();
+  }
+
+  void slp_topk_reset(UDF_INIT* initid,
+                      UDF_ARGS* args,
+                      char* is_null,
+                      char* error)
+  {
+    slp_topk_clear(initid, args, is_null, error);
+    slp_topk_add(initid, args, is_null, error);
+  }
+
+  void slp_topk_add(UDF_INIT* initid,
+                    UDF_ARGS* args,
+                    [[maybe_unused]] char* is_null,
+                    [[maybe_unused]] char* error)
+  {
+    if (args->args[LOG_LINE] == nullptr) {
+      return;
+    }
+
+    UTIL util;
+    UTIL::TopKBuffer* buf_ = (UTIL::TopKBuffer*)initid->ptr;
+
+    // The lines that don't parse and the empty keys aren't counted.
+    SquidLogParser* p =
+      util.parseRow(args, buf_->parser_, SLPStats::Udf::TopK);
+    if (p == nullptr || !util.keyOf(*p, buf_->key_, buf_->out_)) {
+      return;
+    }
+    const int64_t w_ =
+      buf_->weight_ == LogFields::Unknown ? 1 : p->getPartInt(buf_->weight_);
+    if (w_ > 0) {
+      buf_->summary_.add(
+        buf_->out_, SLPHash::of(buf_->out_), static_cast<uint64_t>(w_));
+    }
+  }
+
+  char* slp_topk(UDF_INIT* initid,
+                 [[maybe_unused]] UDF_ARGS* args,
+                 [[maybe_unused]] char* result,
+                 unsigned long* length,
+                 [[maybe_unused]] char* is_null,
+                 [[maybe_unused]] char* error)
+  {
+    UTIL::TopKBuffer* buf_ = (UTIL::TopKBuffer*)initid->ptr;
+    buf_->out_ = buf_->summary_.toJson(buf_->k_);
+    *length = static_cast<unsigned long>(buf_->out_.size());
+
+    return buf_->out_.data();
+  }
+
+  /* ------------------------------------------------------------------------
+   */
+
+  /*!
+   * \brief Bytes and requests per key of a field (e.g. mimetype,
+   * source_ip_address, username), in exact 64-bit totals, in one pass. See
+   * SLPBytesBy.
+   * \return JSON-formated string: {"keys":n,"bytes":n,"requests":n,
+   * "top":[{"key":"...","bytes":n,"requests":n},...],
+   * "other":{"keys":n,"bytes":n,"requests":n},
+   * "overflow":{"bytes":n,"requests":n},"rejected":n}, the TOP_N keys (100
+   * by default) of the most bytes, in descending order.
+   */
+  my_bool slp_bytes_by_init(UDF_INIT* initid, UDF_ARGS* args, char* message)
+  {
+    UTIL util;
+
+    if (util.checkLineArgs(
+          args, message, 3, 4, ErrID::ERR_WRONG_NUM_ARGS_BYTESBY) ==
+        MY_FALSE) {
+      return MY_FALSE;
+    }
+
+    UTIL::KeyField key_;
+    if (util.bindKeyField(args, message, LOG_PART, key_) == MY_FALSE) {
+      return MY_FALSE;
+    }
+    size_t top_ = UTIL::BytesByBuffer::defaultTop;
+    if (args->arg_count > URL_PART) {
+      double n_ = 0.0;
+      if (!util.constReal(args, URL_PART, n_) || n_ < 1.0 ||
+          n_ > static_cast<double>(UTIL::BytesByBuffer::maxTop) ||
+          n_ != std::floor(n_)) {
+        UTIL::ResultErr r = {};
+        util.getErrorText(ErrID::ERR_INVALID_ARG, r);
+        std::sprintf(message, r.msg, 4, "Must be a constant in [1, 1000]");
+        return MY_FALSE;
+      }
+      top_ = static_cast<size_t>(n_);
+    }
+
+    UTIL::BytesByBuffer* buf_ = new UTIL::BytesByBuffer;
+    buf_->key_ = key_;
+    buf_->top_ = top_;
+    buf_->table_.reserve(UTIL::BytesByBuffer::maxKeys);
+    initid->ptr = (char*)buf_;
+    initid->maybe_null = 0;
+    initid->const_item = 0;
+    initid->max_length = MAX_BLOB_WIDTH;
+
+    return MY_TRUE;
+  }
+
+  void slp_bytes_by_deinit(UDF_INIT* initid)
+  {
+    delete (UTIL::BytesByBuffer*)initid->ptr;
+  }
+
+  void slp_bytes_by_clear(UDF_INIT* initid,
+                          [[maybe_unused]] UDF_ARGS* args,
+                          [[maybe_unused]] char* is_null,
+                          [[maybe_unused]] char* error)
+  {
+    ((UTIL::BytesByBuffer*)initid->ptr)->table_.clear();
+  }
+
+  void slp_bytes_by_reset(UDF_INIT* initid,
+                          UDF_ARGS* args,
+                          char* is_null,
+                          char* error)
+  {
+    slp_bytes_by_clear(initid, args, is_null, error);
+    slp_bytes_by_add(initid, args, is_null, error);
+  }
+
+  void slp_bytes_by_add(UDF_INIT* initid,
+                        UDF_ARGS* args,
+                        [[maybe_unused]] char* is_null,
+                        [[maybe_unused]] char* error)
+  {
+    if (args->args[LOG_LINE] == nullptr) {
+      return;
+    }
+
+    UTIL util;
+    UTIL::BytesByBuffer* buf_ = (UTIL::BytesByBuffer*)initid->ptr;
+
+    // The lines without a key (empty or '-') are counted under '-', so the
+    // bytes of the keys add up to the bytes of the rows.
+    SquidLogParser* p =
+      util.parseRow(args, buf_->parser_, SLPStats::Udf::BytesBy);
+    if (p == nullptr) {
+      buf_->table_.reject();
+      return;
+    }
+    if (!util.keyOf(*p, buf_->key_, buf_->out_)) {
+      buf_->out_ = "-";
+    }
+    buf_->table_.add(buf_->out_,
+                     SLPHash::of(buf_->out_),
+                     p->getPartInt(LogFields::TotalSizeReply));
+  }
+
+  char* slp_bytes_by(UDF_INIT* initid,
+                     [[maybe_unused]] UDF_ARGS* args,
+                     [[maybe_unused]] char* result,
+                     unsigned long* length,
+                     [[maybe_unused]] char* is_null,
+                     [[maybe_unused]] char* error)
+  {
+    UTIL::BytesByBuffer* buf_ = (UTIL::BytesByBuffer*)initid->ptr;
+    buf_->out_ = buf_->table_.toJson(buf_->top_);
+    *length = static_cast<unsigned long>(buf_->out_.size());
+
+    return buf_->out_.data();
+  }
+
 #ifdef __cplusplus
 }
 #endif
@@ -65,16 +65,24 @@
 #include <cfenv>  // floating-point exceptions
 #include <cmath>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <exception>
+#include <iomanip>
 #include <iostream>
 #include <limits>
+#include <memory>
 #include <sstream>
 #include <string>
 #include <string_view>
 #include <unordered_map>
+#include <vector>
 
 #ifdef HAVE_DLOPEN
 
+#include "slpaggs.h"
+#include "slpfileagg.h"
+#include "slpstats.h"
 #include "squidlogparser.h"
 using namespace squidlogparser;
 
@@ -104,13 +112,195 @@ constexpr int URL_PART = 3;
 constexpr int ARG_DATA_0 = 0;
 constexpr int ARG_DATA_1 = 1;
 
+/*! \brief Size of the buffer that the server passes as 'result'. */
+constexpr size_t RESULT_BUFFER_SIZE = 255;
+
 /* Utilities ---------------------------------------------------------------- */
 struct VCPSQUIDLOGPARSER_EXPORT Utilities
 {
+  /*!
+   * \brief Keeps the parser between the rows of a statement, so that it (and
+   * its regular expressions) is only constructed again if the log format
+   * changes.
+   */
+  struct ParserBuffer
+  {
+    std::unique_ptr<SquidLogParser> parser_ = {};
+    std::string fmt_ = {};
+
+    SquidLogParser& get(std::string_view format_, SLPStats::Udf u_);
+
+    ~ParserBuffer() { SLP_ERROR_LOG(flush()); }
+  };
+
   struct Buffer
   {
     double value_ = 0.0;
     int64_t acc_ = 0L;
+    ParserBuffer parser_ = {};
+  };
+
+  /*!
+   * \brief State of slp_urlparam(). The keys are bound in _init when they are
+   * constants, otherwise they're bound on each row.
+   */
+  struct UrlParamBuffer
+  {
+    SLPUrlParam keys_;
+    bool bound_ = false;
+    std::string out_ = {}; // Only used when the value doesn't fit in 'result'
+  };
+
+  /*!
+   * \brief State of slp_file_agg(). The scan is bound in _init when all the
+   * arguments are constants, otherwise it's bound on each row.
+   */
+  struct FileAggBuffer
+  {
+    std::unique_ptr<SLPFileAgg> agg_ = {};
+    std::string path_ = {};
+    bool bound_ = false;
+  };
+
+  /*!
+   * \brief State of slp_method_histogram().
+   */
+  struct MethodHistogramBuffer
+  {
+    ParserBuffer parser_ = {};
+    SLPMethodHistogram hist_ = {};
+    bool bytes_ = false;
+    std::string out_ = {};
+  };
+
+  /*!
+   * \brief State of slp_status_histogram().
+   */
+  struct StatusHistogramBuffer
+  {
+    ParserBuffer parser_ = {};
+    SLPStatusHistogram hist_ = {};
+    bool byClass_ = false;
+    std::string out_ = {};
+  };
+
+  /*!
+   * \brief State of slp_hit_ratio().
+   */
+  struct HitRatioBuffer
+  {
+    ParserBuffer parser_ = {};
+    SLPHitRatio ratio_ = {};
+    bool bytes_ = false;
+    std::string out_ = {};
+  };
+
+  /*!
+   * \brief Field whose values are the keys of an aggregate: a reserved word
+   * or "domain", the domain of the URL.
+   */
+  struct KeyField
+  {
+    LogFields field_ = LogFields::Unknown;
+    bool domain_ = false;
+  };
+
+  /*!
+   * \brief State of slp_percentile() and slp_percentiles().
+   */
+  struct PercentileBuffer
+  {
+    ParserBuffer parser_ = {};
+    SLPLogHistogram hist_ = {};
+    LogFields field_ = LogFields::Unknown;
+    std::vector<double> q_ = {};
+    std::string out_ = {};
+  };
+
+  /*!
+   * \brief State of slp_timeseries().
+   */
+  struct TimeSeriesBuffer
+  {
+    static constexpr uint32_t maxSeconds = 604800; // a week
+
+    ParserBuffer parser_ = {};
+    SLPTimeSeries series_ = {};
+    std::string out_ = {};
+  };
+
+  /*!
+   * \brief State of slp_sessions(). The clients are the source addresses,
+   * unless another key field is given.
+   */
+  struct SessionsBuffer
+  {
+    static constexpr uint32_t maxGap = 86400;
+
+    ParserBuffer parser_ = {};
+    KeyField key_ = { LogFields::CliSrcIpAddr, false };
+    SLPSessions sessions_ = {};
+    std::string out_ = {};
+  };
+
+  /*!
+   * \brief State of slp_approx_distinct(), slp_hll_export() and
+   * slp_hll_merge().
+   */
+  struct HllBuffer
+  {
+    ParserBuffer parser_ = {};
+    KeyField key_ = {};
+    SLPHyperLogLog hll_ = {};
+    std::string out_ = {};
+  };
+
+  /*!
+   * \brief State of slp_cms_build() and slp_cms_merge().
+   */
+  struct CountMinBuffer
+  {
+    ParserBuffer parser_ = {};
+    KeyField key_ = {};
+    SLPCountMin cms_ = {};
+    std::string out_ = {};
+  };
+
+  /*!
+   * \brief State of slp_topk(). The summary keeps countersPerKey counters
+   * per key returned, and at least minCounters (about 320 KB), so the counts
+   * are over-estimated by at most 1/4096 of the total (see SLPSpaceSaving).
+   */
+  struct TopKBuffer
+  {
+    static constexpr size_t maxK = 1000;
+    static constexpr size_t countersPerKey = 8;
+    static constexpr size_t minCounters = 4096;
+
+    ParserBuffer parser_ = {};
+    KeyField key_ = {};
+    LogFields weight_ = LogFields::Unknown; // Unknown: counts the rows
+    size_t k_ = 0;
+    SLPSpaceSaving summary_ = {};
+    std::string out_ = {};
+  };
+
+  /*!
+   * \brief State of slp_bytes_by(). The totals are exact for the first
+   * maxKeys keys (a /16 of clients); the rows of the keys after them go to
+   * the overflow (see SLPBytesBy).
+   */
+  struct BytesByBuffer
+  {
+    static constexpr size_t maxKeys = 65536;
+    static constexpr size_t maxTop = 1000;
+    static constexpr size_t defaultTop = 100;
+
+    ParserBuffer parser_ = {};
+    KeyField key_ = {};
+    size_t top_ = defaultTop;
+    SLPBytesBy table_ = {};
+    std::string out_ = {};
   };
 
   enum class ErrorID
@@ -118,7 +308,17 @@ struct VCPSQUIDLOGPARSER_EXPORT Utilities
     ERR_INVALID_TYPE_ARG = 0x00,
     ERR_INVALID_ARG,
     ERR_WRONG_NUM_ARGS,
+    ERR_WRONG_NUM_ARGS_0,
     ERR_WRONG_NUM_ARGS_1,
+    ERR_WRONG_NUM_ARGS_2,
+    ERR_WRONG_NUM_ARGS_URLPARAM,
+    ERR_WRONG_NUM_ARGS_FILEAGG,
+    ERR_WRONG_NUM_ARGS_HISTOGRAM,
+    ERR_WRONG_NUM_ARGS_PERCENTILE,
+    ERR_WRONG_NUM_ARGS_TIMESERIES,
+    ERR_WRONG_NUM_ARGS_SESSIONS,
+    ERR_WRONG_NUM_ARGS_TOPK,
+    ERR_WRONG_NUM_ARGS_BYTESBY,
     ERR_UNKNOWN
   };
 
@@ -128,7 +328,31 @@ struct VCPSQUIDLOGPARSER_EXPORT Utilities
     { ErrorID::ERR_INVALID_ARG, "Invalid Arg #%d: %s." },
     { ErrorID::ERR_WRONG_NUM_ARGS,
       "Wrong number of arguments: (\"LOG_FORMAT\", FIELD_NAME, \"FIELD-ID\")" },
+    { ErrorID::ERR_WRONG_NUM_ARGS_0, "This function takes no arguments." },
     { ErrorID::ERR_WRONG_NUM_ARGS_1, "Number of valid arguments: [ 1 ]." },
+    { ErrorID::ERR_WRONG_NUM_ARGS_2, "Number of valid arguments: [ 2 ]." },
+    { ErrorID::ERR_WRONG_NUM_ARGS_URLPARAM,
+      "Wrong number of arguments: (URL, \"KEY\"[, \"KEY\" ...]) up to 16 "
+      "keys" },
+    { ErrorID::ERR_WRONG_NUM_ARGS_FILEAGG,
+      "Wrong number of arguments: (\"PATH\", \"LOG_FORMAT\", \"AGG\", "
+      "\"FIELD-ID\"[, \"FILTER\" ...])" },
+    { ErrorID::ERR_WRONG_NUM_ARGS_HISTOGRAM,
+      "Wrong number of arguments: (\"LOG_FORMAT\", FIELD_NAME[, \"OPTION\"])" },
+    { ErrorID::ERR_WRONG_NUM_ARGS_PERCENTILE,
+      "Wrong number of arguments: (\"LOG_FORMAT\", FIELD_NAME, \"FIELD-ID\", "
+      "QUANTILE[, QUANTILE ...])" },
+    { ErrorID::ERR_WRONG_NUM_ARGS_TIMESERIES,
+      "Wrong number of arguments: (\"LOG_FORMAT\", FIELD_NAME, SECONDS)" },
+    { ErrorID::ERR_WRONG_NUM_ARGS_SESSIONS,
+      "Wrong number of arguments: (\"LOG_FORMAT\", FIELD_NAME, GAP_SECONDS[, "
+      "\"FIELD-ID\"])" },
+    { ErrorID::ERR_WRONG_NUM_ARGS_TOPK,
+      "Wrong number of arguments: (\"LOG_FORMAT\", FIELD_NAME, \"FIELD-ID\", "
+      "K[, \"WEIGHT-FIELD-ID\"])" },
+    { ErrorID::ERR_WRONG_NUM_ARGS_BYTESBY,
+      "Wrong number of arguments: (\"LOG_FORMAT\", FIELD_NAME, \"FIELD-ID\"[, "
+      "TOP_N])" },
     { ErrorID::ERR_UNKNOWN, "Unknown Error." }
   };
 
@@ -153,6 +377,11 @@ struct VCPSQUIDLOGPARSER_EXPORT Utilities
   };
 
   my_bool checkArgs(UDF_INIT* initid, UDF_ARGS* args, char* message);
+  my_bool checkLineArgs(UDF_ARGS* args,
+                        char* message,
+                        unsigned int min_,
+                        unsigned int max_,
+                        ErrorID e_);
 
   struct ResultErr
   {
@@ -161,6 +390,42 @@ struct VCPSQUIDLOGPARSER_EXPORT Utilities
   };
   void getErrorText(ErrorID e_, ResultErr& r_);
 
+  bool bindFileAgg(UDF_ARGS* args, FileAggBuffer& b_, std::string& err_) const;
+
+  SquidLogParser* parseRow(UDF_ARGS* args,
+                           ParserBuffer& b_,
+                           SLPStats::Udf u_) const;
+  my_bool checkOption(UDF_ARGS* args,
+                      char* message,
+                      unsigned int i_,
+                      std::string_view valid_,
+                      bool& on_);
+
+  my_bool bindPercentile(UDF_ARGS* args,
+                         char* message,
+                         unsigned int max_,
+                         LogFields& field_,
+                         std::vector<double>& q_);
+
+  my_bool bindKeyField(UDF_ARGS* args,
+                       char* message,
+                       unsigned int i_,
+                       KeyField& k_);
+  static bool keyOf(const SquidLogParser& p,
+                    const KeyField& k_,
+                    std::string& key_);
+  static uint64_t hashOf(const SquidLogParser& p,
+                         const KeyField& k_,
+                         std::string& key_);
+  my_bool bindTopK(UDF_ARGS* args,
+                   char* message,
+                   KeyField& key_,
+                   size_t& k_,
+                   LogFields& weight_);
+
+  static LogFormat formatOf(std::string_view name_);
+  static bool constReal(UDF_ARGS* args, unsigned int i_, double& v_);
+
   inline LogFields getFieldId(const std::string arg_ = std::string()) const;
 
   template<typename TString = std::string, typename TSize = size_t>
@@ -227,6 +492,17 @@ extern "C"
                                               char* is_null,
                                               char* error);
 
+  VCPSQUIDLOGPARSER_EXPORT my_bool slp_urlparam_init(UDF_INIT* initid,
+                                                     UDF_ARGS* args,
+                                                     char* message);
+  VCPSQUIDLOGPARSER_EXPORT void slp_urlparam_deinit(UDF_INIT* initid);
+  VCPSQUIDLOGPARSER_EXPORT char* slp_urlparam(UDF_INIT* initid,
+                                              UDF_ARGS* args,
+                                              char* result,
+                                              unsigned long* length,
+                                              char* is_null,
+                                              char* error);
+
   VCPSQUIDLOGPARSER_EXPORT my_bool slp_toSquidTs_init(UDF_INIT* initid,
                                                       UDF_ARGS* args,
                                                       char* message);
@@ -238,6 +514,37 @@ extern "C"
                                                char* is_null,
                                                char* error);
 
+  /* Statistics ------------------------------------------------------------- */
+  VCPSQUIDLOGPARSER_EXPORT my_bool slp_stats_init(UDF_INIT* initid,
+                                                  UDF_ARGS* args,
+                                                  char* message);
+  VCPSQUIDLOGPARSER_EXPORT void slp_stats_deinit(UDF_INIT* initid);
+  VCPSQUIDLOGPARSER_EXPORT char* slp_stats(UDF_INIT* initid,
+                                           UDF_ARGS* args,
+                                           char* result,
+                                           unsigned long* length,
+                                           char* is_null,
+                                           char* error);
+
+  VCPSQUIDLOGPARSER_EXPORT my_bool slp_stats_reset_init(UDF_INIT* initid,
+                                                        UDF_ARGS* args,
+                                                        char* message);
+  VCPSQUIDLOGPARSER_EXPORT void slp_stats_reset_deinit(UDF_INIT* initid);
+  VCPSQUIDLOGPARSER_EXPORT int64_t slp_stats_reset(UDF_INIT* initid,
+                                                   UDF_ARGS* args,
+                                                   char* is_null,
+                                                   char* error);
+
+  /* Files ------------------------------------------------------------------ */
+  VCPSQUIDLOGPARSER_EXPORT my_bool slp_file_agg_init(UDF_INIT* initid,
+                                                     UDF_ARGS* args,
+                                                     char* message);
+  VCPSQUIDLOGPARSER_EXPORT void slp_file_agg_deinit(UDF_INIT* initid);
+  VCPSQUIDLOGPARSER_EXPORT double slp_file_agg(UDF_INIT* initid,
+                                               UDF_ARGS* args,
+                                               char* is_null,
+                                               char* error);
+
   /* Aggregations ----------------------------------------------------------- */
   VCPSQUIDLOGPARSER_EXPORT my_bool slp_sum_init(UDF_INIT* initid,
                                                 UDF_ARGS* args,
@@ -298,10 +605,354 @@ extern "C"
                                                         UDF_ARGS* args,
                                                         char* is_null,
                                                         char* error);
-  VCPSQUIDLOGPARSER_EXPORT int64_t slp_countbyrhttpcode(UDF_INIT* initid,
+  VCPSQUIDLOGPARSER_EXPORT int64_t slp_countbyhttpcode(UDF_INIT* initid,
+                                                       UDF_ARGS* args,
+                                                       char* is_null,
+                                                       char* error);
+
+  /* ------------------------------------------------------------------------ */
+  VCPSQUIDLOGPARSER_EXPORT my_bool slp_method_histogram_init(UDF_INIT* initid,
+                                                             UDF_ARGS* args,
+                                                             char* message);
+  VCPSQUIDLOGPARSER_EXPORT void slp_method_histogram_deinit(UDF_INIT* initid);
+  VCPSQUIDLOGPARSER_EXPORT void slp_method_histogram_clear(UDF_INIT* initid,
+                                                           UDF_ARGS* args,
+                                                           char* is_null,
+                                                           char* error);
+  VCPSQUIDLOGPARSER_EXPORT void slp_method_histogram_reset(UDF_INIT* initid,
+                                                           UDF_ARGS* args,
+                                                           char* is_null,
+                                                           char* error);
+  VCPSQUIDLOGPARSER_EXPORT void slp_method_histogram_add(UDF_INIT* initid,
+                                                         UDF_ARGS* args,
+                                                         char* is_null,
+                                                         char* error);
+  VCPSQUIDLOGPARSER_EXPORT char* slp_method_histogram(UDF_INIT* initid,
+                                                      UDF_ARGS* args,
+                                                      char* result,
+                                                      unsigned long* length,
+                                                      char* is_null,
+                                                      char* error);
+
+  /* ------------------------------------------------------------------------ */
+  VCPSQUIDLOGPARSER_EXPORT my_bool slp_status_histogram_init(UDF_INIT* initid,
+                                                             UDF_ARGS* args,
+                                                             char* message);
+  VCPSQUIDLOGPARSER_EXPORT void slp_status_histogram_deinit(UDF_INIT* initid);
+  VCPSQUIDLOGPARSER_EXPORT void slp_status_histogram_clear(UDF_INIT* initid,
+                                                           UDF_ARGS* args,
+                                                           char* is_null,
+                                                           char* error);
+  VCPSQUIDLOGPARSER_EXPORT void slp_status_histogram_reset(UDF_INIT* initid,
+                                                           UDF_ARGS* args,
+                                                           char* is_null,
+                                                           char* error);
+  VCPSQUIDLOGPARSER_EXPORT void slp_status_histogram_add(UDF_INIT* initid,
+                                                         UDF_ARGS* args,
+                                                         char* is_null,
+                                                         char* error);
+  VCPSQUIDLOGPARSER_EXPORT char* slp_status_histogram(UDF_INIT* initid,
+                                                      UDF_ARGS* args,
+                                                      char* result,
+                                                      unsigned long* length,
+                                                      char* is_null,
+                                                      char* error);
+
+  /* ------------------------------------------------------------------------ */
+  VCPSQUIDLOGPARSER_EXPORT my_bool slp_hit_ratio_init(UDF_INIT* initid,
+                                                      UDF_ARGS* args,
+                                                      char* message);
+  VCPSQUIDLOGPARSER_EXPORT void slp_hit_ratio_deinit(UDF_INIT* initid);
+  VCPSQUIDLOGPARSER_EXPORT void slp_hit_ratio_clear(UDF_INIT* initid,
+                                                    UDF_ARGS* args,
+                                                    char* is_null,
+                                                    char* error);
+  VCPSQUIDLOGPARSER_EXPORT void slp_hit_ratio_reset(UDF_INIT* initid,
+                                                    UDF_ARGS* args,
+                                                    char* is_null,
+                                                    char* error);
+  VCPSQUIDLOGPARSER_EXPORT void slp_hit_ratio_add(UDF_INIT* initid,
+                                                  UDF_ARGS* args,
+                                                  char* is_null,
+                                                  char* error);
+  VCPSQUIDLOGPARSER_EXPORT char* slp_hit_ratio(UDF_INIT* initid,
+                                               UDF_ARGS* args,
+                                               char* result,
+                                               unsigned long* length,
+                                               char* is_null,
+                                               char* error);
+
+  /* ------------------------------------------------------------------------ */
+  VCPSQUIDLOGPARSER_EXPORT my_bool slp_percentile_init(UDF_INIT* initid,
+                                                       UDF_ARGS* args,
+                                                       char* message);
+  VCPSQUIDLOGPARSER_EXPORT void slp_percentile_deinit(UDF_INIT* initid);
+  VCPSQUIDLOGPARSER_EXPORT void slp_percentile_clear(UDF_INIT* initid,
+                                                     UDF_ARGS* args,
+                                                     char* is_null,
+                                                     char* error);
+  VCPSQUIDLOGPARSER_EXPORT void slp_percentile_reset(UDF_INIT* initid,
+                                                     UDF_ARGS* args,
+                                                     char* is_null,
+                                                     char* error);
+  VCPSQUIDLOGPARSER_EXPORT void slp_percentile_add(UDF_INIT* initid,
+                                                   UDF_ARGS* args,
+                                                   char* is_null,
+                                                   char* error);
+  VCPSQUIDLOGPARSER_EXPORT double slp_percentile(UDF_INIT* initid,
+                                                 UDF_ARGS* args,
+                                                 char* is_null,
+                                                 char* error);
+
+  /* ------------------------------------------------------------------------ */
+  VCPSQUIDLOGPARSER_EXPORT my_bool slp_percentiles_init(UDF_INIT* initid,
+                                                        UDF_ARGS* args,
+                                                        char* message);
+  VCPSQUIDLOGPARSER_EXPORT void slp_percentiles_deinit(UDF_INIT* initid);
+  VCPSQUIDLOGPARSER_EXPORT void slp_percentiles_clear(UDF_INIT* initid,
+                                                      UDF_ARGS* args,
+                                                      char* is_null,
+                                                      char* error);
+  VCPSQUIDLOGPARSER_EXPORT void slp_percentiles_reset(UDF_INIT* initid,
+                                                      UDF_ARGS* args,
+                                                      char* is_null,
+                                                      char* error);
+  VCPSQUIDLOGPARSER_EXPORT void slp_percentiles_add(UDF_INIT* initid,
+                                                    UDF_ARGS* args,
+                                                    char* is_null,
+                                                    char* error);
+  VCPSQUIDLOGPARSER_EXPORT char* slp_percentiles(UDF_INIT* initid,
+                                                 UDF_ARGS* args,
+                                                 char* result,
+                                                 unsigned long* length,
+                                                 char* is_null,
+                                                 char* error);
+
+  /* ------------------------------------------------------------------------ */
+  VCPSQUIDLOGPARSER_EXPORT my_bool slp_timeseries_init(UDF_INIT* initid,
+                                                       UDF_ARGS* args,
+                                                       char* message);
+  VCPSQUIDLOGPARSER_EXPORT void slp_timeseries_deinit(UDF_INIT* initid);
+  VCPSQUIDLOGPARSER_EXPORT void slp_timeseries_clear(UDF_INIT* initid,
+                                                     UDF_ARGS* args,
+                                                     char* is_null,
+                                                     char* error);
+  VCPSQUIDLOGPARSER_EXPORT void slp_timeseries_reset(UDF_INIT* initid,
+                                                     UDF_ARGS* args,
+                                                     char* is_null,
+                                                     char* error);
+  VCPSQUIDLOGPARSER_EXPORT void slp_timeseries_add(UDF_INIT* initid,
+                                                   UDF_ARGS* args,
+                                                   char* is_null,
+                                                   char* error);
+  VCPSQUIDLOGPARSER_EXPORT char* slp_timeseries(UDF_INIT* initid,
+                                                UDF_ARGS* args,
+                                                char* result,
+                                                unsigned long* length,
+                                                char* is_null,
+                                                char* error);
+
+  /* ------------------------------------------------------------------------ */
+  VCPSQUIDLOGPARSER_EXPORT my_bool slp_sessions_init(UDF_INIT* initid,
+                                                     UDF_ARGS* args,
+                                                     char* message);
+  VCPSQUIDLOGPARSER_EXPORT void slp_sessions_deinit(UDF_INIT* initid);
+  VCPSQUIDLOGPARSER_EXPORT void slp_sessions_clear(UDF_INIT* initid,
+                                                   UDF_ARGS* args,
+                                                   char* is_null,
+                                                   char* error);
+  VCPSQUIDLOGPARSER_EXPORT void slp_sessions_reset(UDF_INIT* initid,
+                                                   UDF_ARGS* args,
+                                                   char* is_null,
+                                                   char* error);
+  VCPSQUIDLOGPARSER_EXPORT void slp_sessions_add(UDF_INIT* initid,
+                                                 UDF_ARGS* args,
+                                                 char* is_null,
+                                                 char* error);
+  VCPSQUIDLOGPARSER_EXPORT char* slp_sessions(UDF_INIT* initid,
+                                              UDF_ARGS* args,
+                                              char* result,
+                                              unsigned long* length,
+                                              char* is_null,
+                                              char* error);
+
+  /* Sketches --------------------------------------------------------------- */
+  VCPSQUIDLOGPARSER_EXPORT my_bool slp_approx_distinct_init(UDF_INIT* initid,
+                                                            UDF_ARGS* args,
+                                                            char* message);
+  VCPSQUIDLOGPARSER_EXPORT void slp_approx_distinct_deinit(UDF_INIT* initid);
+  VCPSQUIDLOGPARSER_EXPORT void slp_approx_distinct_clear(UDF_INIT* initid,
+                                                          UDF_ARGS* args,
+                                                          char* is_null,
+                                                          char* error);
+  VCPSQUIDLOGPARSER_EXPORT void slp_approx_distinct_reset(UDF_INIT* initid,
+                                                          UDF_ARGS* args,
+                                                          char* is_null,
+                                                          char* error);
+  VCPSQUIDLOGPARSER_EXPORT void slp_approx_distinct_add(UDF_INIT* initid,
                                                         UDF_ARGS* args,
                                                         char* is_null,
                                                         char* error);
+  VCPSQUIDLOGPARSER_EXPORT int64_t slp_approx_distinct(UDF_INIT* initid,
+                                                       UDF_ARGS* args,
+                                                       char* is_null,
+                                                       char* error);
+  /* ------------------------------------------------------------------------ */
+  VCPSQUIDLOGPARSER_EXPORT my_bool slp_hll_export_init(UDF_INIT* initid,
+                                                       UDF_ARGS* args,
+                                                       char* message);
+  VCPSQUIDLOGPARSER_EXPORT void slp_hll_export_deinit(UDF_INIT* initid);
+  VCPSQUIDLOGPARSER_EXPORT void slp_hll_export_clear(UDF_INIT* initid,
+                                                     UDF_ARGS* args,
+                                                     char* is_null,
+                                                     char* error);
+  VCPSQUIDLOGPARSER_EXPORT void slp_hll_export_reset(UDF_INIT* initid,
+                                                     UDF_ARGS* args,
+                                                     char* is_null,
+                                                     char* error);
+  VCPSQUIDLOGPARSER_EXPORT void slp_hll_export_add(UDF_INIT* initid,
+                                                   UDF_ARGS* args,
+                                                   char* is_null,
+                                                   char* error);
+  VCPSQUIDLOGPARSER_EXPORT char* slp_hll_export(UDF_INIT* initid,
+                                                UDF_ARGS* args,
+                                                char* result,
+                                                unsigned long* length,
+                                                char* is_null,
+                                                char* error);
+  /* ------------------------------------------------------------------------ */
+  VCPSQUIDLOGPARSER_EXPORT my_bool slp_hll_merge_init(UDF_INIT* initid,
+                                                      UDF_ARGS* args,
+                                                      char* message);
+  VCPSQUIDLOGPARSER_EXPORT void slp_hll_merge_deinit(UDF_INIT* initid);
+  VCPSQUIDLOGPARSER_EXPORT void slp_hll_merge_clear(UDF_INIT* initid,
+                                                    UDF_ARGS* args,
+                                                    char* is_null,
+                                                    char* error);
+  VCPSQUIDLOGPARSER_EXPORT void slp_hll_merge_reset(UDF_INIT* initid,
+                                                    UDF_ARGS* args,
+                                                    char* is_null,
+                                                    char* error);
+  VCPSQUIDLOGPARSER_EXPORT void slp_hll_merge_add(UDF_INIT* initid,
+                                                  UDF_ARGS* args,
+                                                  char* is_null,
+                                                  char* error);
+  VCPSQUIDLOGPARSER_EXPORT char* slp_hll_merge(UDF_INIT* initid,
+                                               UDF_ARGS* args,
+                                               char* result,
+                                               unsigned long* length,
+                                               char* is_null,
+                                               char* error);
+  /* ------------------------------------------------------------------------ */
+  VCPSQUIDLOGPARSER_EXPORT my_bool slp_hll_count_init(UDF_INIT* initid,
+                                                      UDF_ARGS* args,
+                                                      char* message);
+  VCPSQUIDLOGPARSER_EXPORT void slp_hll_count_deinit(UDF_INIT* initid);
+  VCPSQUIDLOGPARSER_EXPORT int64_t slp_hll_count(UDF_INIT* initid,
+                                                 UDF_ARGS* args,
+                                                 char* is_null,
+                                                 char* error);
+  /* ------------------------------------------------------------------------ */
+  VCPSQUIDLOGPARSER_EXPORT my_bool slp_cms_build_init(UDF_INIT* initid,
+                                                      UDF_ARGS* args,
+                                                      char* message);
+  VCPSQUIDLOGPARSER_EXPORT void slp_cms_build_deinit(UDF_INIT* initid);
+  VCPSQUIDLOGPARSER_EXPORT void slp_cms_build_clear(UDF_INIT* initid,
+                                                    UDF_ARGS* args,
+                                                    char* is_null,
+                                                    char* error);
+  VCPSQUIDLOGPARSER_EXPORT void slp_cms_build_reset(UDF_INIT* initid,
+                                                    UDF_ARGS* args,
+                                                    char* is_null,
+                                                    char* error);
+  VCPSQUIDLOGPARSER_EXPORT void slp_cms_build_add(UDF_INIT* initid,
+                                                  UDF_ARGS* args,
+                                                  char* is_null,
+                                                  char* error);
+  VCPSQUIDLOGPARSER_EXPORT char* slp_cms_build(UDF_INIT* initid,
+                                               UDF_ARGS* args,
+                                               char* result,
+                                               unsigned long* length,
+                                               char* is_null,
+                                               char* error);
+  /* ------------------------------------------------------------------------ */
+  VCPSQUIDLOGPARSER_EXPORT my_bool slp_cms_merge_init(UDF_INIT* initid,
+                                                      UDF_ARGS* args,
+                                                      char* message);
+  VCPSQUIDLOGPARSER_EXPORT void slp_cms_merge_deinit(UDF_INIT* initid);
+  VCPSQUIDLOGPARSER_EXPORT void slp_cms_merge_clear(UDF_INIT* initid,
+                                                    UDF_ARGS* args,
+                                                    char* is_null,
+                                                    char* error);
+  VCPSQUIDLOGPARSER_EXPORT void slp_cms_merge_reset(UDF_INIT* initid,
+                                                    UDF_ARGS* args,
+                                                    char* is_null,
+                                                    char* error);
+  VCPSQUIDLOGPARSER_EXPORT void slp_cms_merge_add(UDF_INIT* initid,
+                                                  UDF_ARGS* args,
+                                                  char* is_null,
+                                                  char* error);
+  VCPSQUIDLOGPARSER_EXPORT char* slp_cms_merge(UDF_INIT* initid,
+                                               UDF_ARGS* args,
+                                               char* result,
+                                               unsigned long* length,
+                                               char* is_null,
+                                               char* error);
+  /* ------------------------------------------------------------------------ */
+  VCPSQUIDLOGPARSER_EXPORT my_bool slp_cms_estimate_init(UDF_INIT* initid,
+                                                         UDF_ARGS* args,
+                                                         char* message);
+  VCPSQUIDLOGPARSER_EXPORT void slp_cms_estimate_deinit(UDF_INIT* initid);
+  VCPSQUIDLOGPARSER_EXPORT int64_t slp_cms_estimate(UDF_INIT* initid,
+                                                    UDF_ARGS* args,
+                                                    char* is_null,
+                                                    char* error);
+  /* ------------------------------------------------------------------------ */
+  VCPSQUIDLOGPARSER_EXPORT my_bool slp_topk_init(UDF_INIT* initid,
+                                                 UDF_ARGS* args,
+                                                 char* message);
+  VCPSQUIDLOGPARSER_EXPORT void slp_topk_deinit(UDF_INIT* initid);
+  VCPSQUIDLOGPARSER_EXPORT void slp_topk_clear(UDF_INIT* initid,
+                                               UDF_ARGS* args,
+                                               char* is_null,
+                                               char* error);
+  VCPSQUIDLOGPARSER_EXPORT void slp_topk_reset(UDF_INIT* initid,
+                                               UDF_ARGS* args,
+                                               char* is_null,
+                                               char* error);
+  VCPSQUIDLOGPARSER_EXPORT void slp_topk_add(UDF_INIT* initid,
+                                             UDF_ARGS* args,
+                                             char* is_null,
+                                             char* error);
+  VCPSQUIDLOGPARSER_EXPORT char* slp_topk(UDF_INIT* initid,
+                                          UDF_ARGS* args,
+                                          char* result,
+                                          unsigned long* length,
+                                          char* is_null,
+                                          char* error);
+  /* ------------------------------------------------------------------------ */
+  VCPSQUIDLOGPARSER_EXPORT my_bool slp_bytes_by_init(UDF_INIT* initid,
+                                                     UDF_ARGS* args,
+                                                     char* message);
+  VCPSQUIDLOGPARSER_EXPORT void slp_bytes_by_deinit(UDF_INIT* initid);
+  VCPSQUIDLOGPARSER_EXPORT void slp_bytes_by_clear(UDF_INIT* initid,
+                                                   UDF_ARGS* args,
+                                                   char* is_null,
+                                                   char* error);
+  VCPSQUIDLOGPARSER_EXPORT void slp_bytes_by_reset(UDF_INIT* initid,
+                                                   UDF_ARGS* args,
+                                                   char* is_null,
+                                                   char* error);
+  VCPSQUIDLOGPARSER_EXPORT void slp_bytes_by_add(UDF_INIT* initid,
+                                                 UDF_ARGS* args,
+                                                 char* is_null,
+                                                 char* error);
+  VCPSQUIDLOGPARSER_EXPORT char* slp_bytes_by(UDF_INIT* initid,
+                                              UDF_ARGS* args,
+                                              char* result,
+                                              unsigned long* length,
+                                              char* is_null,
+                                              char* error);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,622 @@
+/***************************************************************************
+ * Copyright (c) 2020-22                                                   *
+ *      Volnei Cervi Puttini.  All rights reserved.                        *
+ *      vcputtini@gmail.com
+ *                                                                         *
+ * Redistribution and use in source and binary forms, with or without      *
+ * modification, are permitted provided that the following conditions      *
+ * are met:                                                                *
+ * 1. Redistributions of source code must retain the above copyright       *
+ *    notice, this list of conditions and the following disclaimer.        *
+ * 2. Redistributions in binary form must reproduce the above copyright    *
+ *    notice, this list of conditions and the following disclaimer in the  *
+ *    documentation and/or other materials provided with the distribution. *
+ * 4. Neither the name of the Author     nor the names of its contributors *
+ *    may be used to endorse or promote products derived from this software*
+ *    without specific prior written permission.                           *
+ *                                                                         *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND *
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR      *
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS  *
+ * BE LIABLEFOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   *
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF    *
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS*
+ * INTERRUPTION)                                                           *
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,     *
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING   *
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE      *
+ * POSSIBILITY OFSUCH DAMAGE.                                              *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*!
+ * \brief How this file is organized:
+ *
+ * Tests of the BLOB's of the sketches (slpaggs.h), which are stored by the
+ * users and merged later: export -> merge -> estimate round trips, and the
+ * BLOB's that are rejected (truncated, of another sketch, precision, width
+ * or depth).
+ *
+ * Tests of the summaries: the counts of SLPSpaceSaving against the exact
+ * ones, with keys evicted from clusters of its hash table, and the totals of
+ * SLPBytesBy, which stay exact after its table is full.
+ *
+ * Tests of the breakdowns: the intervals of SLPTimeSeries, up to its cap,
+ * and the sessions of SLPSessions, through the growth of its table.
+ */
+
+#include "slpaggs.h"
+
+#include <map>
+#include <string>
+
+#include "slptest.h"
+
+using namespace squidlogparser;
+using namespace squidlogparser::test;
+
+namespace {
+
+uint64_t
+keyHash(uint64_t k_)
+{
+  return SLPHash::of("client-" + std::to_string(k_));
+}
+
+/*!
+ * \brief true if the estimate e_ is within 3% of n_ (the standard error of
+ * the HyperLogLog is 0.81%).
+ */
+bool
+near(uint64_t e_, uint64_t n_)
+{
+  const double d_ = static_cast<double>(e_) - static_cast<double>(n_);
+  return d_ < 0.03 * n_ && -d_ < 0.03 * n_;
+}
+
+/* SLPHyperLogLog ----------------------------------------------------------- */
+
+void
+hllRoundTrip()
+{
+  // Keys [0, 10000) and [5000, 15000): 15000 distinct keys in both.
+  SLPHyperLogLog a_, b_;
+  for (uint64_t k_ = 0; k_ < 10000; ++k_) {
+    a_.add(keyHash(k_));
+    b_.add(keyHash(k_ + 5000));
+  }
+  SLP_CHECK(near(a_.estimate(), 10000));
+
+  const std::string blobA_ = a_.toBlob();
+  const std::string blobB_ = b_.toBlob();
+  SLP_CHECK(blobA_.size() == SLPHyperLogLog::blobSize);
+  SLP_CHECK(blobA_.compare(0, 4, "SLPH") == 0);
+
+  // export -> count.
+  SLPHyperLogLog c_;
+  SLP_CHECK(c_.fromBlob(blobA_));
+  SLP_CHECK(c_.estimate() == a_.estimate());
+  SLP_CHECK(c_.toBlob() == blobA_);
+
+  // export -> merge -> count: the union, once.
+  SLPHyperLogLog m_;
+  SLP_CHECK(m_.merge(blobA_));
+  SLP_CHECK(m_.merge(blobB_));
+  SLP_CHECK(near(m_.estimate(), 15000));
+  const uint64_t union_ = m_.estimate();
+  SLP_CHECK(m_.merge(blobA_));
+  SLP_CHECK(m_.estimate() == union_);
+
+  // The same as merging the sketches, or counting all the keys in one.
+  a_.merge(b_);
+  SLP_CHECK(a_.toBlob() == m_.toBlob());
+  SLPHyperLogLog all_;
+  for (uint64_t k_ = 0; k_ < 15000; ++k_) {
+    all_.add(keyHash(k_));
+  }
+  SLP_CHECK(all_.toBlob() == m_.toBlob());
+
+  // An empty sketch counts 0.
+  SLPHyperLogLog empty_;
+  SLP_CHECK(empty_.fromBlob(SLPHyperLogLog().toBlob()));
+  SLP_CHECK(empty_.estimate() == 0);
+}
+
+void
+hllRejects()
+{
+  SLPHyperLogLog a_;
+  for (uint64_t k_ = 0; k_ < 1000; ++k_) {
+    a_.add(keyHash(k_));
+  }
+  const std::string good_ = a_.toBlob();
+  const uint64_t before_ = a_.estimate();
+
+  std::string bad_[6];
+  bad_[0] = good_.substr(0, good_.size() - 1); // truncated
+  bad_[1] = good_ + '\0';                      // too long
+  bad_[2] = good_;
+  bad_[2][3] = 'C'; // another sketch
+  bad_[3] = good_;
+  bad_[3][4] = 2; // another version
+  bad_[4] = good_;
+  bad_[4][5] = 12; // another precision
+  bad_[5] = good_;
+  bad_[5][SLPHyperLogLog::headerSize] = 60; // a register out of range
+
+  for (const std::string& b_ : bad_) {
+    SLP_CHECK(!a_.merge(b_));
+    SLP_CHECK(!a_.fromBlob(b_));
+  }
+  SLP_CHECK(!a_.merge(std::string_view()));
+  SLP_CHECK(!a_.fromBlob(SLPCountMin().toBlob()));
+
+  // A rejected BLOB doesn't change the sketch.
+  SLP_CHECK(a_.estimate() == before_);
+  SLP_CHECK(a_.toBlob() == good_);
+}
+
+/* SLPCountMin -------------------------------------------------------------- */
+
+/*!
+ * \brief Counts key k_ k_ + 1 times, e.g. the key 99 100 times.
+ */
+void
+cmsFill(SLPCountMin& s_, uint64_t from_, uint64_t to_)
+{
+  for (uint64_t k_ = from_; k_ < to_; ++k_) {
+    s_.add(keyHash(k_), k_ + 1);
+  }
+}
+
+void
+cmsRoundTrip()
+{
+  // Keys [0, 100) and [50, 150): the keys [50, 100) are in both.
+  SLPCountMin a_, b_;
+  cmsFill(a_, 0, 100);
+  cmsFill(b_, 50, 150);
+
+  const std::string blobA_ = a_.toBlob();
+  SLP_CHECK(blobA_.size() == SLPCountMin::blobSize);
+  SLP_CHECK(blobA_.compare(0, 4, "SLPC") == 0);
+
+  // build -> estimate: never under the count, and with 100 keys in 4096
+  // counters per row, exact.
+  uint64_t n_ = 0;
+  SLP_CHECK(SLPCountMin::estimate(blobA_, keyHash(99), n_) && n_ == 100);
+  SLP_CHECK(SLPCountMin::estimate(blobA_, keyHash(1000), n_) && n_ == 0);
+
+  // build -> merge -> estimate: the counts of both.
+  SLPCountMin m_;
+  SLP_CHECK(m_.merge(blobA_));
+  SLP_CHECK(m_.merge(b_.toBlob()));
+  SLP_CHECK(m_.total() == a_.total() + b_.total());
+  const std::string blobM_ = m_.toBlob();
+  bool exact_ = true;
+  for (uint64_t k_ = 0; k_ < 150; ++k_) {
+    const uint64_t count_ = (k_ >= 50 && k_ < 100 ? 2 : 1) * (k_ + 1);
+    exact_ = exact_ && SLPCountMin::estimate(blobM_, keyHash(k_), n_) &&
+             n_ == count_ && m_.estimate(keyHash(k_)) == count_;
+  }
+  SLP_CHECK(exact_);
+}
+
+void
+cmsRejects()
+{
+  SLPCountMin a_;
+  cmsFill(a_, 0, 10);
+  const std::string good_ = a_.toBlob();
+  const uint64_t total_ = a_.total();
+
+  std::string bad_[6];
+  bad_[0] = good_.substr(0, good_.size() - 8); // truncated
+  bad_[1] = good_ + std::string(8, '\0');      // a counter too many
+  bad_[2] = good_;
+  bad_[2][3] = 'H'; // another sketch
+  bad_[3] = good_;
+  bad_[3][4] = 2; // another version
+  bad_[4] = good_;
+  bad_[4][5] = SLPCountMin::depth - 1; // another depth
+  bad_[5] = good_;
+  bad_[5][6] = SLPCountMin::widthBits + 1; // another width
+
+  uint64_t n_ = 0;
+  for (const std::string& b_ : bad_) {
+    SLP_CHECK(!a_.merge(b_));
+    SLP_CHECK(!SLPCountMin::estimate(b_, keyHash(1), n_));
+  }
+  SLP_CHECK(!a_.merge(SLPHyperLogLog().toBlob()));
+  SLP_CHECK(!SLPCountMin::estimate(std::string_view(), keyHash(1), n_));
+
+  // A rejected BLOB doesn't change the sketch.
+  SLP_CHECK(a_.total() == total_);
+  SLP_CHECK(a_.toBlob() == good_);
+}
+
+/* SLPSpaceSaving ----------------------------------------------------------- */
+
+const SLPSpaceSaving::Counter*
+counterOf(const SLPSpaceSaving& s_, const std::string& key_)
+{
+  for (const SLPSpaceSaving::Counter* c_ : s_.top(s_.size())) {
+    if (c_->key_ == key_) {
+      return c_;
+    }
+  }
+  return nullptr;
+}
+
+void
+topKExact()
+{
+  // Fewer keys than the capacity: exact, in descending order of the count
+  // and then of the key.
+  SLPSpaceSaving s_;
+  s_.reserve(8);
+  const std::pair<const char*, uint64_t> keys_[] = {
+    { "b", 3 }, { "a", 5 }, { "c", 3 }, { "d", 1 }, { "a", 2 }, { "e", 0 },
+  };
+  for (const auto& [key_, weight_] : keys_) {
+    s_.add(key_, SLPHash::of(key_), weight_);
+  }
+  SLP_CHECK(s_.size() == 4 && s_.total() == 14);
+  const auto top_ = s_.top(3);
+  SLP_CHECK(top_.size() == 3);
+  if (top_.size() == 3) {
+    SLP_CHECK(top_[0]->key_ == "a" && top_[0]->count_ == 7);
+    SLP_CHECK(top_[1]->key_ == "b" && top_[2]->key_ == "c");
+    SLP_CHECK(top_[0]->error_ == 0 && top_[2]->error_ == 0);
+  }
+  SLP_CHECK(s_.toJson(2) == "[{\"key\":\"a\",\"count\":7,\"error\":0},"
+                            "{\"key\":\"b\",\"count\":3,\"error\":0}]");
+
+  s_.clear();
+  SLP_CHECK(s_.size() == 0 && s_.total() == 0 && s_.toJson(10) == "[]");
+  s_.add("a", SLPHash::of("a"), 1);
+  SLP_CHECK(s_.size() == 1 && counterOf(s_, "a")->count_ == 1);
+
+  SLPSpaceSaving none_;
+  none_.add("a", 1, 1);
+  SLP_CHECK(none_.size() == 0 && none_.total() == 0);
+}
+
+void
+topKEvicts()
+{
+  // Capacity 4 (a table of 8 slots), a to d in one cluster from the slot 3,
+  // and the keys that replace them homed at the slot 0: the hole of a key
+  // evicted must be shifted back for the keys after it to be found.
+  SLPSpaceSaving s_;
+  s_.reserve(4);
+  auto add_ = [&s_](const std::string& key_, uint64_t weight_) {
+    s_.add(key_, 8 * (key_[0] - 'a') + (key_ < "e" ? 3 : 0), weight_);
+  };
+  add_("a", 5);
+  add_("b", 4);
+  add_("c", 2); // the lowest, in the middle of the cluster
+  add_("d", 3);
+
+  // e replaces c, with its count as the error.
+  add_("e", 1);
+  SLP_CHECK(s_.size() == 4 && s_.total() == 15);
+  SLP_CHECK(counterOf(s_, "c") == nullptr);
+  const SLPSpaceSaving::Counter* e_ = counterOf(s_, "e");
+  SLP_CHECK(e_ != nullptr && e_->count_ == 3 && e_->error_ == 2);
+
+  // The keys after the hole are still found: counted, not evicted.
+  add_("d", 10);
+  add_("a", 1);
+  SLP_CHECK(counterOf(s_, "d") && counterOf(s_, "d")->count_ == 13);
+  SLP_CHECK(counterOf(s_, "a") && counterOf(s_, "a")->count_ == 6);
+  SLP_CHECK(counterOf(s_, "d")->error_ == 0 && counterOf(s_, "e") != nullptr);
+
+  // The lowest is now e (3), and f takes its place.
+  add_("f", 1);
+  SLP_CHECK(counterOf(s_, "e") == nullptr && counterOf(s_, "b") != nullptr);
+  SLP_CHECK(counterOf(s_, "f") && counterOf(s_, "f")->count_ == 4);
+
+  // The heap follows the counts that grow: the lowest (a) becomes the
+  // highest, and the next key replaces b.
+  SLPSpaceSaving h_;
+  h_.reserve(4);
+  for (const char* key_ :
+       { "a", "b", "c", "d", "b", "c", "c", "d", "d", "d" }) {
+    h_.add(key_, SLPHash::of(key_), 1); // 1, 2, 3 and 4
+  }
+  h_.add("a", SLPHash::of("a"), 10);
+  h_.add("e", SLPHash::of("e"), 1);
+  SLP_CHECK(counterOf(h_, "a") && counterOf(h_, "a")->count_ == 11);
+  SLP_CHECK(counterOf(h_, "b") == nullptr);
+  SLP_CHECK(counterOf(h_, "e") && counterOf(h_, "e")->error_ == 2);
+}
+
+void
+topKBounds()
+{
+  // A skewed stream of 200 keys in a summary of 32, the hashes colliding:
+  // count_ - error_ <= real count <= count_, the counts sum to the total,
+  // and every key of more than total / capacity is in the summary.
+  constexpr size_t capacity_ = 32;
+  SLPSpaceSaving s_;
+  s_.reserve(capacity_);
+  std::map<std::string, uint64_t> real_;
+  uint64_t x_ = 12345;
+  for (int i_ = 0; i_ < 20000; ++i_) {
+    x_ = x_ * 6364136223846793005ULL + 1442695040888963407ULL;
+    const uint64_t r_ = (x_ >> 33) % 1000;
+    const uint64_t k_ = r_ < 500 ? r_ % 5 : r_ % 200; // half to 5 keys
+    const std::string key_ = "k" + std::to_string(k_);
+    const uint64_t weight_ = 1 + (x_ >> 60);
+    s_.add(key_, SLPHash::mix(k_ % 17), weight_);
+    real_[key_] += weight_;
+  }
+
+  SLP_CHECK(s_.size() == capacity_);
+  uint64_t sum_ = 0;
+  bool bounded_ = true;
+  for (const SLPSpaceSaving::Counter* c_ : s_.top(capacity_)) {
+    sum_ += c_->count_;
+    const uint64_t n_ = real_[c_->key_];
+    bounded_ = bounded_ && c_->count_ - c_->error_ <= n_ && n_ <= c_->count_;
+  }
+  SLP_CHECK(bounded_);
+  SLP_CHECK(sum_ == s_.total());
+
+  bool heavy_ = true;
+  for (const auto& [key_, n_] : real_) {
+    if (n_ > s_.total() / capacity_) {
+      heavy_ = heavy_ && counterOf(s_, key_) != nullptr;
+    }
+  }
+  SLP_CHECK(heavy_);
+  const auto top_ = s_.top(5);
+  bool five_ = top_.size() == 5;
+  for (size_t i_ = 0; five_ && i_ < 5; ++i_) {
+    five_ = top_[i_]->key_.size() == 2 && top_[i_]->key_[1] < '5' &&
+            top_[i_]->error_ == 0;
+  }
+  SLP_CHECK(five_); // k0 .. k4, never evicted
+}
+
+/* SLPTimeSeries ------------------------------------------------------------ */
+
+size_t
+count(const std::string& s_, const std::string& what_)
+{
+  size_t n_ = 0;
+  for (size_t i_ = s_.find(what_); i_ != std::string::npos;
+       i_ = s_.find(what_, i_ + what_.size())) {
+    ++n_;
+  }
+  return n_;
+}
+
+void
+timeSeries()
+{
+  SLPTimeSeries t_;
+  t_.setSeconds(60);
+  t_.add(1200, 100, 200, 10);
+  t_.add(1259, 50, 404, 20);
+  t_.add(1380, -1, 503, -5); // a gap of two intervals, negatives as 0
+  t_.add(1140, 7, 200, 1);   // before the first interval
+  t_.reject();
+  SLP_CHECK(t_.toJson() ==
+            "{\"seconds\":60,\"series\":["
+            "{\"t\":1140,\"requests\":1,\"bytes\":7,\"4xx\":0,\"5xx\":0,"
+            "\"response_time\":1},"
+            "{\"t\":1200,\"requests\":2,\"bytes\":150,\"4xx\":1,\"5xx\":0,"
+            "\"response_time\":30},"
+            "{\"t\":1260,\"requests\":0,\"bytes\":0,\"4xx\":0,\"5xx\":0,"
+            "\"response_time\":0},"
+            "{\"t\":1320,\"requests\":0,\"bytes\":0,\"4xx\":0,\"5xx\":0,"
+            "\"response_time\":0},"
+            "{\"t\":1380,\"requests\":1,\"bytes\":0,\"4xx\":0,\"5xx\":1,"
+            "\"response_time\":0}],\"dropped\":0,\"rejected\":1}");
+
+  t_.clear();
+  SLP_CHECK(t_.seconds() == 60 && t_.rejected() == 0);
+  SLP_CHECK(t_.toJson() ==
+            "{\"seconds\":60,\"series\":[],\"dropped\":0,\"rejected\":0}");
+
+  // At least 1 s.
+  t_.setSeconds(0);
+  SLP_CHECK(t_.seconds() == 1);
+}
+
+void
+timeSeriesCap()
+{
+  // At most maxBuckets intervals, after the first or before the last.
+  constexpr uint32_t n_ = SLPTimeSeries::maxBuckets;
+  SLPTimeSeries t_;
+  t_.setSeconds(1);
+  t_.add(1000000, 1, 200, 1);
+  t_.add(1000000 + n_ - 1, 1, 200, 1); // the last one that fits
+  t_.add(1000000 + n_, 1, 200, 1);
+  t_.add(999999, 1, 200, 1);
+  t_.add(UINT32_MAX, 1, 200, 1);
+  SLP_CHECK(t_.dropped() == 3);
+  std::string json_ = t_.toJson();
+  SLP_CHECK(count(json_, "{\"t\":") == n_);
+  SLP_CHECK(count(json_, "\"requests\":1,") == 2);
+
+  // Growing backwards, up to the cap too.
+  t_.clear();
+  t_.add(1000000, 1, 200, 1);
+  t_.add(1000000 - n_ + 1, 1, 200, 1);
+  t_.add(1000000 - n_, 1, 200, 1);
+  t_.add(0, 1, 200, 1);
+  SLP_CHECK(t_.dropped() == 2);
+  json_ = t_.toJson();
+  SLP_CHECK(count(json_, "{\"t\":") == n_);
+  const std::string first_ = "{\"seconds\":1,\"series\":[{\"t\":900001,";
+  SLP_CHECK(json_.compare(0, first_.size(), first_) == 0);
+}
+
+/* SLPSessions -------------------------------------------------------------- */
+
+void
+sessions()
+{
+  SLPSessions s_;
+  SLP_CHECK(s_.toJson() == "{\"sessions\":0,\"clients\":0,"
+                           "\"mean_duration\":null,"
+                           "\"requests_per_session\":null,"
+                           "\"bytes_per_session\":null,\"rejected\":0}");
+
+  s_.setGap(10);
+  s_.add(1, 0, 10);
+  s_.add(1, 5, 10);
+  s_.add(1, 20, 10); // idle for 15 s: a new session
+  s_.add(2, 3, 100);
+  s_.add(2, 2, -1); // out of order, in the same session
+  s_.add(1, 15, 10); // older than the last request: the current session
+  s_.add(0, 21, 0);  // the hash 0 is the hash 1
+  s_.reject();
+  // Sessions [0, 5], [15, 21] and [2, 3]: 12 s, 7 requests, 140 bytes.
+  SLP_CHECK(s_.clients() == 2 && s_.rejected() == 1);
+  SLP_CHECK(s_.toJson() == "{\"sessions\":3,\"clients\":2,"
+                           "\"mean_duration\":4.0,"
+                           "\"requests_per_session\":2.3,"
+                           "\"bytes_per_session\":46.7,\"rejected\":1}");
+
+  s_.clear();
+  SLP_CHECK(s_.clients() == 0 && s_.gap() == 10);
+  const std::string none_ = "{\"sessions\":0,\"clients\":0,";
+  SLP_CHECK(s_.toJson().compare(0, none_.size(), none_) == 0);
+}
+
+void
+sessionsGrow()
+{
+  // 5000 clients double the table from 1024 to 16384 slots, half of them
+  // with the same low 16 bits (one cluster): each one must still be found
+  // after each growth, or it would be counted twice.
+  constexpr uint64_t n_ = 5000;
+  SLPSessions s_;
+  s_.setGap(50);
+  auto hash_ = [](uint64_t k_) {
+    return k_ % 2 ? (k_ << 16) | 7 : SLPHash::mix(k_ + 1);
+  };
+  for (uint32_t ts_ : { 0, 100, 120 }) {
+    for (uint64_t k_ = 0; k_ < n_; ++k_) {
+      s_.add(hash_(k_), ts_, 1);
+    }
+  }
+  // Two sessions per client: [0, 0] and [100, 120].
+  SLP_CHECK(s_.clients() == n_);
+  SLP_CHECK(s_.toJson() == "{\"sessions\":10000,\"clients\":5000,"
+                           "\"mean_duration\":10.0,"
+                           "\"requests_per_session\":1.5,"
+                           "\"bytes_per_session\":1.5,\"rejected\":0}");
+}
+
+/* SLPBytesBy --------------------------------------------------------------- */
+
+void
+bytesBy()
+{
+  SLPBytesBy b_;
+  b_.reserve(16);
+  const std::pair<const char*, int64_t> rows_[] = {
+    { "text/html", 100 }, { "image/png", 300 }, { "text/html", 50 },
+    { "text/css", 10 },   { "image/png", -1 },  { "a\"b", 10 },
+  };
+  for (const auto& [key_, bytes_] : rows_) {
+    b_.add(key_, SLPHash::of(key_), bytes_);
+  }
+  b_.reject();
+  SLP_CHECK(b_.size() == 4);
+  // The ties by the key; the keys after the top in "other".
+  SLP_CHECK(b_.toJson(3) ==
+            "{\"keys\":4,\"bytes\":470,\"requests\":6,\"top\":["
+            "{\"key\":\"image/png\",\"bytes\":300,\"requests\":2},"
+            "{\"key\":\"text/html\",\"bytes\":150,\"requests\":2},"
+            "{\"key\":\"a\\\"b\",\"bytes\":10,\"requests\":1}],"
+            "\"other\":{\"keys\":1,\"bytes\":10,\"requests\":1},"
+            "\"overflow\":{\"bytes\":0,\"requests\":0},\"rejected\":1}");
+
+  b_.clear();
+  SLP_CHECK(b_.size() == 0 && b_.capacity() == 16);
+  b_.add("x", SLPHash::of("x"), 1);
+  SLP_CHECK(b_.toJson(0) ==
+            "{\"keys\":1,\"bytes\":1,\"requests\":1,\"top\":[],"
+            "\"other\":{\"keys\":1,\"bytes\":1,\"requests\":1},"
+            "\"overflow\":{\"bytes\":0,\"requests\":0},\"rejected\":0}");
+}
+
+void
+bytesByOverflow()
+{
+  // The capacity of slp_bytes_by(): 65536 keys, the table growing from 256
+  // slots. The keys past it go to the overflow bucket, but the keys in the
+  // table are still counted in the table.
+  constexpr uint64_t n_ = 65536;
+  constexpr uint64_t more_ = 4464;
+  SLPBytesBy b_;
+  b_.reserve(n_);
+  uint64_t all_ = 0;
+  for (uint64_t k_ = 0; k_ < n_ + more_; ++k_) {
+    const std::string key_ = "k" + std::to_string(k_);
+    b_.add(key_, SLPHash::of(key_), static_cast<int64_t>(k_));
+    all_ += k_;
+  }
+  SLP_CHECK(b_.size() == n_);
+  b_.add("k0", SLPHash::of("k0"), 1000000);
+  b_.add("k65535", SLPHash::of("k65535"), 1);
+  b_.add("k65536", SLPHash::of("k65536"), 1);
+  all_ += 1000002;
+
+  uint64_t overflow_ = 0; // keys [n_, n_ + more_) and k65536 again
+  for (uint64_t k_ = n_; k_ < n_ + more_; ++k_) {
+    overflow_ += k_;
+  }
+  const std::string json_ = b_.toJson(2);
+  SLP_CHECK(json_ ==
+            "{\"keys\":65536,\"bytes\":" + std::to_string(all_) +
+              ",\"requests\":70003,\"top\":["
+              "{\"key\":\"k0\",\"bytes\":1000000,\"requests\":2},"
+              "{\"key\":\"k65535\",\"bytes\":65536,\"requests\":2}],"
+              "\"other\":{\"keys\":65534,\"bytes\":" +
+              std::to_string(all_ - 1000000 - 65536 - overflow_ - 1) +
+              ",\"requests\":65534},\"overflow\":{\"bytes\":" +
+              std::to_string(overflow_ + 1) +
+              ",\"requests\":4465},\"rejected\":0}");
+
+  // clear() keeps the counters for the next group, which starts over.
+  b_.clear();
+  b_.add("k70000", SLPHash::of("k70000"), 5);
+  SLP_CHECK(b_.size() == 1);
+  const std::string one_ =
+    "{\"keys\":1,\"bytes\":5,\"requests\":1,\"top\":[{\"key\":\"k70000\"";
+  SLP_CHECK(b_.toJson(1).compare(0, one_.size(), one_) == 0);
+}
+
+} // namespace
+
+int
+main()
+{
+  hllRoundTrip();
+  hllRejects();
+  cmsRoundTrip();
+  cmsRejects();
+  topKExact();
+  topKEvicts();
+  topKBounds();
+  timeSeries();
+  timeSeriesCap();
+  sessions();
+  sessionsGrow();
+  bytesBy();
+  bytesByOverflow();
+  return result("slpaggs_test");
+}
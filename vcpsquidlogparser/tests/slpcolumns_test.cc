@@ -0,0 +1,231 @@
+/***************************************************************************
+ * Copyright (c) 2020-22                                                   *
+ *      Volnei Cervi Puttini.  All rights reserved.                        *
+ *      vcputtini@gmail.com
+ *                                                                         *
+ * Redistribution and use in source and binary forms, with or without      *
+ * modification, are permitted provided that the following conditions      *
+ * are met:                                                                *
+ * 1. Redistributions of source code must retain the above copyright       *
+ *    notice, this list of conditions and the following disclaimer.        *
+ * 2. Redistributions in binary form must reproduce the above copyright    *
+ *    notice, this list of conditions and the following disclaimer in the  *
+ *    documentation and/or other materials provided with the distribution. *
+ * 4. Neither the name of the Author     nor the names of its contributors *
+ *    may be used to endorse or promote products derived from this software*
+ *    without specific prior written permission.                           *
+ *                                                                         *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND *
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR      *
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS  *
+ * BE LIABLEFOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   *
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF    *
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS*
+ * INTERRUPTION)                                                           *
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,     *
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING   *
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE      *
+ * POSSIBILITY OFSUCH DAMAGE.                                              *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*!
+ * \brief How this file is organized:
+ *
+ * Tests of the column store file (SLPColumnStore): append() -> save() ->
+ * load() round trip, and load() rejecting the files that are corrupted, in
+ * particular the codes that aren't in the dictionary of their column.
+ */
+
+#include "slpcolumns.h"
+
+#include <cstring>
+
+#include "slptest.h"
+
+using namespace squidlogparser;
+using namespace squidlogparser::test;
+
+using LogFormat = SquidLogData::LogFormat;
+using Column = SLPColumnStore::Column;
+
+namespace {
+
+// Layout of the file, see slpcolumns.h
+constexpr size_t formatAt = 8;    // uint32_t format_ in the header
+constexpr size_t rowsAt = 16;     // uint64_t rows_ in the header
+constexpr size_t sectionsAt = 24; // Section sections_[] in the header
+constexpr size_t sectionSize = 16;
+constexpr size_t nNumeric = 5;
+constexpr size_t nColumns = SLPColumnStore::nColumns;
+constexpr size_t alignment = 64;
+
+const char* const lines[] = {
+  "1286536309.000    134 10.0.1.64 TCP_MISS/503 10173 POST "
+  "http://www.lnvzmrx.io/wj4y - HIER_DIRECT/203.0.113.91 text/css",
+  "1286536309.002     84 10.0.3.138 TCP_MISS/200 1477 GET "
+  "https://www.sqgtaxjjwmx.com.br/at9xek admin HIER_DIRECT/203.0.113.58 "
+  "text/html",
+  "1286536310.004    310 10.0.3.241 TCP_MISS/200 1345 GET "
+  "http://www.kazguud.com.br/rg4y - HIER_DIRECT/203.0.113.247 image/png",
+};
+
+SLPColumnStore
+sample()
+{
+  SLPColumnStore s_(LogFormat::Squid);
+  SLPRowParser p_(LogFormat::Squid);
+  for (const char* l_ : lines) {
+    SLP_CHECK(p_.parse(l_));
+    s_.append(p_);
+  }
+  return s_;
+}
+
+uint64_t
+get64(const std::string& data_, size_t at_)
+{
+  uint64_t v_ = 0;
+  std::memcpy(&v_, data_.data() + at_, sizeof(v_));
+  return v_;
+}
+
+template<typename T>
+void
+patch(std::string& data_, size_t at_, T v_)
+{
+  std::memcpy(data_.data() + at_, &v_, sizeof(v_));
+}
+
+/*!
+ * \brief Offset in the file of the codes of column c_.
+ */
+size_t
+codesOf(const std::string& data_, Column c_)
+{
+  const size_t s_ = nNumeric + 3 * static_cast<size_t>(c_);
+  return static_cast<size_t>(get64(data_, sectionsAt + s_ * sectionSize));
+}
+
+/*!
+ * \brief Writes data_ to path_ and loads it.
+ */
+bool
+loads(const std::string& path_, const std::string& data_)
+{
+  SLPTestDir::write(path_, data_);
+  SLPColumnStore s_;
+  return s_.load(path_) && s_.size() == 3;
+}
+
+void
+roundTrip(const std::string& path_)
+{
+  SLPColumnStore w_ = sample();
+  SLP_CHECK(w_.size() == 3 && w_.sorted());
+  SLP_CHECK(w_.save(path_));
+
+  SLPColumnStore r_(LogFormat::Common);
+  SLP_CHECK(r_.load(path_));
+  SLP_CHECK(r_.mapped() && r_.sorted());
+  SLP_CHECK(r_.format() == LogFormat::Squid);
+  SLP_CHECK(r_.size() == 3);
+  if (r_.size() != 3) {
+    return;
+  }
+  SLP_CHECK(r_.timestamp(0) == 1286536309 && r_.timestamp(2) == 1286536310);
+  SLP_CHECK(r_.responseTime(1) == 84);
+  SLP_CHECK(r_.httpStatus(0) == 503 && r_.httpStatus(2) == 200);
+  SLP_CHECK(r_.totalSizeReply(0) == 10173);
+  SLP_CHECK(r_.str(Column::Method, 0) == "POST");
+  SLP_CHECK(r_.str(Column::Method, 2) == "GET");
+  SLP_CHECK(r_.str(Column::Url, 2) == "http://www.kazguud.com.br/rg4y");
+  SLP_CHECK(r_.str(Column::MimeType, 1) == "text/html");
+
+  // The repeated values are kept once.
+  SLP_CHECK(r_.cardinality(Column::Method) == 2);
+  uint32_t get_ = 0;
+  SLP_CHECK(r_.find(Column::Method, "GET", get_));
+  SLP_CHECK(r_.codes(Column::Method)[1] == get_);
+  SLP_CHECK(!r_.find(Column::Method, "PUT", get_));
+
+  const auto rows_ = r_.range(1286536310, 1286536310);
+  SLP_CHECK(rows_.first == 2 && rows_.second == 3);
+}
+
+void
+rejects(const std::string& path_)
+{
+  SLP_CHECK(sample().save(path_));
+  const std::string good_ = SLPTestDir::read(path_);
+  SLP_CHECK(loads(path_, good_));
+
+  // Not a column store.
+  std::string bad_ = good_;
+  bad_[0] = 'X';
+  SLP_CHECK(!loads(path_, bad_));
+  SLP_CHECK(!loads(path_, good_.substr(0, 16)));
+
+  // Truncated: the last sections are past the end.
+  SLP_CHECK(!loads(path_, good_.substr(0, good_.size() - 1)));
+
+  // A code that isn't in the dictionary of its column (2 methods), in the
+  // first and the last row.
+  bad_ = good_;
+  patch<uint32_t>(bad_, codesOf(good_, Column::Method), 2);
+  SLP_CHECK(!loads(path_, bad_));
+  bad_ = good_;
+  patch<uint32_t>(bad_, codesOf(good_, Column::UserAgent) + 8, 0xffffffff);
+  SLP_CHECK(!loads(path_, bad_));
+
+  // A section that isn't aligned.
+  bad_ = good_;
+  patch<uint64_t>(bad_, sectionsAt, get64(good_, sectionsAt) + 4);
+  SLP_CHECK(!loads(path_, bad_));
+
+  // A hostile rows_: each width (2, 4 or 8 bytes) times 2^63 wraps to 0, so
+  // the numeric sections and the codes are made empty, the codes pointing at
+  // a tail of zeros (valid codes) that ends long before the rows.
+  bad_ = good_ + std::string(alignment - good_.size() % alignment, '\0');
+  const uint64_t tail_ = bad_.size();
+  bad_ += std::string(4096, '\0');
+  patch<uint64_t>(bad_, rowsAt, uint64_t(1) << 63);
+  for (size_t s_ = 0; s_ < nNumeric + 3 * nColumns; ++s_) {
+    const bool codes_ = s_ >= nNumeric && (s_ - nNumeric) % 3 == 0;
+    if (s_ < nNumeric || codes_) {
+      const size_t at_ = sectionsAt + s_ * sectionSize;
+      patch<uint64_t>(bad_, at_, codes_ ? tail_ : get64(good_, at_));
+      patch<uint64_t>(bad_, at_ + 8, 0);
+    }
+  }
+  SLP_CHECK(!loads(path_, bad_));
+
+  // An unknown log format.
+  bad_ = good_;
+  patch<uint32_t>(bad_, formatAt, 0x7f);
+  SLP_CHECK(!loads(path_, bad_));
+
+  // A rejected file leaves the store empty.
+  SLPTestDir::write(path_, bad_);
+  SLPColumnStore s_;
+  SLP_CHECK(!s_.load(path_) && s_.empty() && !s_.mapped());
+  SLP_CHECK(!s_.error().empty());
+}
+
+} // namespace
+
+int
+main()
+{
+  SLPTestDir dir_;
+  const std::string path_ = dir_.file("access.slpc");
+
+  roundTrip(path_);
+  rejects(path_);
+  return result("slpcolumns_test");
+}
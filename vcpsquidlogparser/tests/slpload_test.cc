@@ -0,0 +1,144 @@
+/***************************************************************************
+ * Copyright (c) 2020-22                                                   *
+ *      Volnei Cervi Puttini.  All rights reserved.                        *
+ *      vcputtini@gmail.com
+ *                                                                         *
+ * Redistribution and use in source and binary forms, with or without      *
+ * modification, are permitted provided that the following conditions      *
+ * are met:                                                                *
+ * 1. Redistributions of source code must retain the above copyright       *
+ *    notice, this list of conditions and the following disclaimer.        *
+ * 2. Redistributions in binary form must reproduce the above copyright    *
+ *    notice, this list of conditions and the following disclaimer in the  *
+ *    documentation and/or other materials provided with the distribution. *
+ * 4. Neither the name of the Author     nor the names of its contributors *
+ *    may be used to endorse or promote products derived from this software*
+ *    without specific prior written permission.                           *
+ *                                                                         *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND *
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR      *
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS  *
+ * BE LIABLEFOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   *
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF    *
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS*
+ * INTERRUPTION)                                                           *
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,     *
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING   *
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE      *
+ * POSSIBILITY OFSUCH DAMAGE.                                              *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*!
+ * \brief How this file is organized:
+ *
+ * Tests of the bulk loader (SLPLoader): a read error in one source ends the
+ * run with the error, with as many readers as sources, instead of leaving the
+ * readers of the other sources waiting for slots that are never recycled.
+ */
+
+#include "slpload.h"
+
+#include <zlib.h>
+
+#include "slptest.h"
+
+using namespace squidlogparser;
+using namespace squidlogparser::test;
+
+namespace {
+
+std::string
+lines(size_t n_)
+{
+  std::string out_;
+  char buf_[256];
+  for (size_t i_ = 0; i_ < n_; ++i_) {
+    std::snprintf(buf_,
+                  sizeof(buf_),
+                  "%zu.%03zu %zu 10.0.%zu.%zu TCP_MISS/200 %zu GET "
+                  "http://www.example.com/p/%zu - DIRECT/10.1.0.1 "
+                  "text/html\n",
+                  1600000000 + i_ / 100,
+                  i_ % 1000,
+                  i_ % 900,
+                  i_ % 7,
+                  i_ % 250,
+                  512 + i_ % 4096,
+                  i_);
+    out_ += buf_;
+  }
+  return out_;
+}
+
+bool
+gzip(const std::string& path_, const std::string& data_)
+{
+  gzFile f_ = gzopen(path_.c_str(), "wb");
+  if (f_ == nullptr) {
+    return false;
+  }
+  const int n_ = gzwrite(f_, data_.data(), static_cast<unsigned>(data_.size()));
+  return gzclose(f_) == Z_OK && n_ == static_cast<int>(data_.size());
+}
+
+bool
+load(const std::vector<std::string>& files_, size_t readers_, std::string& e_)
+{
+  SLPLoadConfig cfg_;
+  cfg_.threads_ = 2;
+  cfg_.readers_ = readers_;
+  cfg_.blockSize_ = 4096; // many blocks, few slots
+  cfg_.slots_ = 1;
+  FILE* out_ = std::fopen("/dev/null", "w");
+  if (out_ == nullptr) {
+    return false;
+  }
+  SLPLoader l_(cfg_);
+  const bool ok_ = l_.run(files_, out_);
+  std::fclose(out_);
+  e_ = l_.error();
+  return ok_;
+}
+
+/*!
+ * \brief A .gz corrupted 3/4 of the way in, and a valid one. The reader of
+ * the valid one fills its slots long before the other one fails.
+ */
+void
+readError(const SLPTestDir& dir_)
+{
+  const std::string good_ = dir_.file("good.log.gz");
+  const std::string bad_ = dir_.file("bad.log.gz");
+  SLP_CHECK(gzip(good_, lines(20000)));
+  SLP_CHECK(gzip(bad_, lines(20000)));
+
+  std::string gz_ = SLPTestDir::read(bad_);
+  for (size_t i_ = gz_.size() * 3 / 4; i_ < gz_.size() * 3 / 4 + 64; ++i_) {
+    gz_[i_] = static_cast<char>(gz_[i_] ^ 0x5a);
+  }
+  SLPTestDir::write(bad_, gz_);
+
+  std::string e_;
+  SLP_CHECK(load({ good_, good_ }, 2, e_));
+  SLP_CHECK(e_.empty());
+  for (const size_t readers_ : { 1, 2 }) {
+    SLP_CHECK(!load({ bad_, good_ }, readers_, e_));
+    SLP_CHECK(e_.compare(0, bad_.size(), bad_) == 0);
+  }
+}
+
+} // namespace
+
+int
+main()
+{
+  SLPTestDir dir_;
+  readError(dir_);
+  return result("slpload_test");
+}
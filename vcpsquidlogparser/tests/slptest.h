@@ -0,0 +1,133 @@
+/***************************************************************************
+ * Copyright (c) 2020-22                                                   *
+ *      Volnei Cervi Puttini.  All rights reserved.                        *
+ *      vcputtini@gmail.com
+ *                                                                         *
+ * Redistribution and use in source and binary forms, with or without      *
+ * modification, are permitted provided that the following conditions      *
+ * are met:                                                                *
+ * 1. Redistributions of source code must retain the above copyright       *
+ *    notice, this list of conditions and the following disclaimer.        *
+ * 2. Redistributions in binary form must reproduce the above copyright    *
+ *    notice, this list of conditions and the following disclaimer in the  *
+ *    documentation and/or other materials provided with the distribution. *
+ * 4. Neither the name of the Author     nor the names of its contributors *
+ *    may be used to endorse or promote products derived from this software*
+ *    without specific prior written permission.                           *
+ *                                                                         *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND *
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR      *
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS  *
+ * BE LIABLEFOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   *
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF    *
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS*
+ * INTERRUPTION)                                                           *
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,     *
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING   *
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE      *
+ * POSSIBILITY OFSUCH DAMAGE.                                              *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*!
+ * \brief How this file is organized:
+ *
+ * Checks shared by the tests (tests/), which need no framework: each test is
+ * an executable that returns non-zero if a check failed, run by ctest.
+ *
+ * SLP_CHECK(cond): counts and reports a failed condition, and goes on.
+ * class SLPTestDir: temporary directory of the files of a test, removed
+ *                   with its files at the end.
+ */
+
+#ifndef SLPTEST_H
+#define SLPTEST_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <unistd.h>
+
+namespace squidlogparser::test {
+
+inline int&
+failures() noexcept
+{
+  static int n_ = 0;
+  return n_;
+}
+
+inline bool
+check(bool ok_, const char* what_, const char* file_, int line_) noexcept
+{
+  if (!ok_) {
+    ++failures();
+    std::fprintf(stderr, "%s:%d: check failed: %s\n", file_, line_, what_);
+  }
+  return ok_;
+}
+
+/*!
+ * \brief Exit status of the test: 0 if no check failed.
+ */
+inline int
+result(const char* name_) noexcept
+{
+  std::printf("%s: %d check(s) failed\n", name_, failures());
+  return failures() == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+class SLPTestDir
+{
+public:
+  SLPTestDir()
+  {
+    const char* tmp_ = std::getenv("TMPDIR");
+    std::string t_ = std::string(tmp_ ? tmp_ : "/tmp") + "/slptest.XXXXXX";
+    if (::mkdtemp(t_.data()) != nullptr) {
+      path_ = t_;
+    }
+  }
+  ~SLPTestDir()
+  {
+    if (!path_.empty()) {
+      std::system(("rm -rf '" + path_ + "'").c_str());
+    }
+  }
+
+  SLPTestDir(const SLPTestDir&) = delete;
+  SLPTestDir& operator=(const SLPTestDir&) = delete;
+
+  std::string file(const std::string& name_) const
+  {
+    return path_ + "/" + name_;
+  }
+
+  static void write(const std::string& path_, const std::string& data_)
+  {
+    std::ofstream(path_, std::ios::binary | std::ios::trunc) << data_;
+  }
+
+  static std::string read(const std::string& path_)
+  {
+    std::ifstream in_(path_, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in_), {});
+  }
+
+private:
+  std::string path_ = {};
+};
+
+} // namespace squidlogparser::test
+
+#define SLP_CHECK(cond_)                                                       \
+  squidlogparser::test::check((cond_), #cond_, __FILE__, __LINE__)
+
+#endif // SLPTEST_H
@@ -0,0 +1,182 @@
+/***************************************************************************
+ * Copyright (c) 2020-22                                                   *
+ *      Volnei Cervi Puttini.  All rights reserved.                        *
+ *      vcputtini@gmail.com
+ *                                                                         *
+ * Redistribution and use in source and binary forms, with or without      *
+ * modification, are permitted provided that the following conditions      *
+ * are met:                                                                *
+ * 1. Redistributions of source code must retain the above copyright       *
+ *    notice, this list of conditions and the following disclaimer.        *
+ * 2. Redistributions in binary form must reproduce the above copyright    *
+ *    notice, this list of conditions and the following disclaimer in the  *
+ *    documentation and/or other materials provided with the distribution. *
+ * 4. Neither the name of the Author     nor the names of its contributors *
+ *    may be used to endorse or promote products derived from this software*
+ *    without specific prior written permission.                           *
+ *                                                                         *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND *
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR      *
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS  *
+ * BE LIABLEFOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   *
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF    *
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS*
+ * INTERRUPTION)                                                           *
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,     *
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING   *
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE      *
+ * POSSIBILITY OFSUCH DAMAGE.                                              *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*!
+ * \brief How this file is organized:
+ *
+ * Tests of the zone-map sidecar (SLPZoneMap): save() -> load() round trip,
+ * and load() rejecting the sidecars that are stale or corrupted, without
+ * allocating what a corrupted header asks for.
+ */
+
+#include "slpzonemap.h"
+
+#include <cstring>
+#include <unistd.h>
+
+#include "slptest.h"
+
+using namespace squidlogparser;
+using namespace squidlogparser::test;
+
+using LogFormat = SquidLogData::LogFormat;
+
+namespace {
+
+// Layout of the sidecar, see slpzonemap.h
+constexpr size_t headerSize = 48;
+constexpr size_t zonesAt = 16;   // uint64_t zones_ in the header
+constexpr size_t coveredAt = 24; // uint64_t covered_ in the header
+constexpr size_t zoneSize = 32;
+
+SLPZoneMap
+sample()
+{
+  SLPZoneMap m_(LogFormat::Squid);
+  m_.add({ 0, 550, 50, 100, 200, 0 });
+  m_.add({ 550, 550, 50, 300, 400, 0 });
+  return m_;
+}
+
+void
+patch64(std::string& data_, size_t at_, uint64_t v_)
+{
+  std::memcpy(data_.data() + at_, &v_, sizeof(v_));
+}
+
+/*!
+ * \brief Writes data_ as the sidecar of log_ and loads it.
+ */
+bool
+loads(const std::string& log_, const std::string& data_)
+{
+  SLPTestDir::write(SLPZoneMap::sidecarOf(log_), data_);
+  SLPZoneMap m_(LogFormat::Squid);
+  return m_.load(log_) && m_.zones().size() == 2;
+}
+
+void
+roundTrip(const std::string& log_)
+{
+  SLPZoneMap w_ = sample();
+  SLP_CHECK(w_.save(log_));
+  SLP_CHECK(SLPTestDir::read(SLPZoneMap::sidecarOf(log_)).size() ==
+            headerSize + 2 * zoneSize);
+
+  SLPZoneMap r_(LogFormat::Squid);
+  SLP_CHECK(r_.load(log_));
+  SLP_CHECK(r_.covered() == 1100);
+  SLP_CHECK(r_.zones().size() == 2);
+  if (r_.zones().size() == 2) {
+    const SLPZoneMap::Zone& z_ = r_.zones()[1];
+    SLP_CHECK(z_.offset_ == 550 && z_.bytes_ == 550 && z_.lines_ == 50);
+    SLP_CHECK(z_.minTs_ == 300 && z_.maxTs_ == 400);
+  }
+
+  // Only the second zone meets the window, and nothing was appended.
+  const auto ranges_ = r_.ranges(250, 350, 1100);
+  SLP_CHECK(ranges_.size() == 1 && ranges_[0].offset_ == 550 &&
+            ranges_[0].bytes_ == 550);
+  // The bytes appended after the zone map are always read.
+  const auto more_ = r_.ranges(150, 150, 1200);
+  SLP_CHECK(more_.size() == 2 && more_[1].offset_ == 1100 &&
+            more_[1].bytes_ == 100);
+}
+
+void
+rejects(const std::string& log_)
+{
+  SLP_CHECK(sample().save(log_));
+  const std::string good_ = SLPTestDir::read(SLPZoneMap::sidecarOf(log_));
+  SLP_CHECK(loads(log_, good_));
+
+  // A zone count that the file doesn't have: huge (hostile) or off by one.
+  std::string bad_ = good_;
+  patch64(bad_, zonesAt, uint64_t(1) << 60);
+  SLP_CHECK(!loads(log_, bad_));
+  patch64(bad_, zonesAt, 3);
+  SLP_CHECK(!loads(log_, bad_));
+
+  // Truncated, or with bytes after the last zone.
+  SLP_CHECK(!loads(log_, good_.substr(0, good_.size() - 8)));
+  SLP_CHECK(!loads(log_, good_.substr(0, 20)));
+  SLP_CHECK(!loads(log_, good_ + std::string(zoneSize, '\0')));
+
+  // Not a zone map.
+  bad_ = good_;
+  bad_[0] = 'X';
+  SLP_CHECK(!loads(log_, bad_));
+
+  // Zones that don't tile [0, covered).
+  bad_ = good_;
+  patch64(bad_, headerSize + zoneSize, 560);
+  SLP_CHECK(!loads(log_, bad_));
+
+  // Of another format.
+  SLPTestDir::write(SLPZoneMap::sidecarOf(log_), good_);
+  SLPZoneMap common_(LogFormat::Common);
+  SLP_CHECK(!common_.load(log_));
+
+  // A hostile header that passes the other checks: as many zones as the
+  // bytes of a (sparse) 1 TB log, i.e. 32 TB of zones.
+  const std::string big_ = log_ + ".big";
+  const uint64_t tb_ = uint64_t(1) << 40;
+  SLPTestDir::write(big_, "");
+  SLP_CHECK(::truncate(big_.c_str(), static_cast<off_t>(tb_)) == 0);
+  SLP_CHECK(sample().save(big_));
+  bad_ = SLPTestDir::read(SLPZoneMap::sidecarOf(big_));
+  patch64(bad_, zonesAt, tb_);
+  patch64(bad_, coveredAt, tb_);
+  SLP_CHECK(!loads(big_, bad_));
+
+  // Stale: the log no longer has the bytes covered.
+  SLP_CHECK(::truncate(log_.c_str(), 1000) == 0);
+  SLP_CHECK(!loads(log_, good_));
+}
+
+} // namespace
+
+int
+main()
+{
+  SLPTestDir dir_;
+  const std::string log_ = dir_.file("access.log");
+  SLPTestDir::write(log_, std::string(1100, 'x'));
+
+  roundTrip(log_);
+  rejects(log_);
+  return result("slpzonemap_test");
+}
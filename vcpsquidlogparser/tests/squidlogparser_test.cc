@@ -0,0 +1,223 @@
+/***************************************************************************
+ * Copyright (c) 2020-22                                                   *
+ *      Volnei Cervi Puttini.  All rights reserved.                        *
+ *      vcputtini@gmail.com
+ *                                                                         *
+ * Redistribution and use in source and binary forms, with or without      *
+ * modification, are permitted provided that the following conditions      *
+ * are met:                                                                *
+ * 1. Redistributions of source code must retain the above copyright       *
+ *    notice, this list of conditions and the following disclaimer.        *
+ * 2. Redistributions in binary form must reproduce the above copyright    *
+ *    notice, this list of conditions and the following disclaimer in the  *
+ *    documentation and/or other materials provided with the distribution. *
+ * 4. Neither the name of the Author     nor the names of its contributors *
+ *    may be used to endorse or promote products derived from this software*
+ *    without specific prior written permission.                           *
+ *                                                                         *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND *
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR      *
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS  *
+ * BE LIABLEFOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   *
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF    *
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS*
+ * INTERRUPTION)                                                           *
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,     *
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING   *
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE      *
+ * POSSIBILITY OFSUCH DAMAGE.                                              *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*!
+ * \brief How this file is organized:
+ *
+ * Tests of the lookups of SquidLogParser over the entries it keeps: range()
+ * by time window, and byClient() with the index of indexClients(), with
+ * duplicated and out of order timestamps, after clear() and after a move.
+ */
+
+#include "squidlogparser.h"
+
+#include <vector>
+
+#include "slptest.h"
+
+using namespace squidlogparser;
+using namespace squidlogparser::test;
+
+namespace {
+
+std::string
+line(uint32_t ts_, int client_, int64_t size_)
+{
+  return std::to_string(ts_) + ".000 12 10.0.0." + std::to_string(client_) +
+         " TCP_MISS/200 " + std::to_string(size_) +
+         " GET http://www.example.com/ - HIER_DIRECT/203.0.113.1 text/html";
+}
+
+uint32_t
+ipOf(int client_)
+{
+  SquidLogParser p_;
+  return p_.addrToNumeric("10.0.0." + std::to_string(client_));
+}
+
+/*!
+ * \brief The lines of the tests: the sizes identify them. Two clients, three
+ * lines in the same second and two lines out of time order.
+ */
+void
+fill(SquidLogParser& p_)
+{
+  const std::pair<uint32_t, int> lines_[] = {
+    { 100, 1 }, { 100, 2 }, { 100, 1 }, { 102, 1 }, { 101, 1 }, { 99, 2 },
+  };
+  int64_t size_ = 0;
+  for (const auto& [ts_, client_] : lines_) {
+    p_.append(line(ts_, client_, ++size_));
+    SLP_CHECK(p_.errorNum() == SquidLogParser::SLPError::SLP_SUCCESS);
+  }
+}
+
+template<typename It>
+std::vector<int64_t>
+sizes(It first_, It last_)
+{
+  std::vector<int64_t> out_;
+  for (; first_ != last_; ++first_) {
+    if constexpr (std::is_same_v<It, SquidLogParser::Entry>) {
+      out_.push_back(first_->second.totalSizeReply);
+    } else {
+      out_.push_back((*first_)->second.totalSizeReply);
+    }
+  }
+  return out_;
+}
+
+template<typename Range>
+std::vector<int64_t>
+sizes(const Range& r_)
+{
+  return sizes(r_.first, r_.second);
+}
+
+using Sizes = std::vector<int64_t>;
+
+void
+range()
+{
+  SquidLogParser p_;
+  fill(p_);
+  SLP_CHECK(p_.size() == 6);
+
+  // In timestamp order, and in the order of append() within a second.
+  SLP_CHECK(sizes(p_.range(0, UINT32_MAX)) == Sizes({ 6, 1, 2, 3, 5, 4 }));
+  SLP_CHECK(sizes(p_.range(100, 100)) == Sizes({ 1, 2, 3 }));
+  SLP_CHECK(sizes(p_.range(101, 102)) == Sizes({ 5, 4 }));
+
+  // Empty windows: before, after, between and reversed.
+  SLP_CHECK(sizes(p_.range(0, 98)).empty());
+  SLP_CHECK(sizes(p_.range(103, UINT32_MAX)).empty());
+  SLP_CHECK(sizes(p_.range(102, 101)).empty());
+
+  SquidLogParser none_;
+  SLP_CHECK(sizes(none_.range(0, UINT32_MAX)).empty());
+}
+
+void
+byClient()
+{
+  const uint32_t one_ = ipOf(1);
+  const uint32_t two_ = ipOf(2);
+
+  // The index is off by default.
+  SquidLogParser off_;
+  fill(off_);
+  SLP_CHECK(!off_.indexingClients() && off_.clients() == 0);
+  SLP_CHECK(sizes(off_.byClient(one_)).empty());
+
+  // Kept by append(), the lines out of order inserted in their place, and
+  // built by indexClients() from the entries kept: the same postings.
+  SquidLogParser before_;
+  before_.indexClients(true);
+  fill(before_);
+  SquidLogParser after_;
+  fill(after_);
+  after_.indexClients(true);
+  for (SquidLogParser* p_ : { &before_, &after_ }) {
+    SLP_CHECK(p_->clients() == 2);
+    SLP_CHECK(sizes(p_->byClient(one_)) == Sizes({ 1, 3, 5, 4 }));
+    SLP_CHECK(sizes(p_->byClient(two_)) == Sizes({ 6, 2 }));
+    SLP_CHECK(sizes(p_->byClient(one_, 100, 100)) == Sizes({ 1, 3 }));
+    SLP_CHECK(sizes(p_->byClient(one_, 101, 200)) == Sizes({ 5, 4 }));
+    SLP_CHECK(sizes(p_->byClient(two_, 100, 102)) == Sizes({ 2 }));
+
+    // Empty windows and an unknown client.
+    SLP_CHECK(sizes(p_->byClient(one_, 103, UINT32_MAX)).empty());
+    SLP_CHECK(sizes(p_->byClient(one_, 0, 99)).empty());
+    SLP_CHECK(sizes(p_->byClient(one_, 101, 100)).empty());
+    SLP_CHECK(sizes(p_->byClient(ipOf(3))).empty());
+  }
+
+  // Turned off, the index is dropped.
+  after_.indexClients(false);
+  SLP_CHECK(after_.clients() == 0 && sizes(after_.byClient(one_)).empty());
+}
+
+void
+clear()
+{
+  SquidLogParser p_;
+  p_.indexClients(true);
+  fill(p_);
+  p_.clear();
+  SLP_CHECK(p_.size() == 0 && p_.clients() == 0);
+  SLP_CHECK(sizes(p_.byClient(ipOf(1))).empty());
+
+  // Still indexing: only the entries appended since clear().
+  SLP_CHECK(p_.indexingClients());
+  p_.append(line(100, 1, 7));
+  SLP_CHECK(p_.clients() == 1);
+  SLP_CHECK(sizes(p_.byClient(ipOf(1))) == Sizes({ 7 }));
+}
+
+void
+moved()
+{
+  SquidLogParser from_;
+  from_.indexClients(true);
+  fill(from_);
+
+  // The postings point into the entries, which move with the parser.
+  SquidLogParser to_(std::move(from_));
+  SLP_CHECK(to_.size() == 6 && to_.clients() == 2);
+  SLP_CHECK(sizes(to_.byClient(ipOf(1))) == Sizes({ 1, 3, 5, 4 }));
+  SLP_CHECK(sizes(to_.range(100, 100)) == Sizes({ 1, 2, 3 }));
+  to_.append(line(101, 2, 8));
+  SLP_CHECK(sizes(to_.byClient(ipOf(2))) == Sizes({ 6, 2, 8 }));
+
+  // The parser moved from can be cleared and used again.
+  from_.clear();
+  SLP_CHECK(from_.size() == 0 && from_.clients() == 0);
+  from_.indexClients(true);
+  fill(from_);
+  SLP_CHECK(sizes(from_.byClient(ipOf(1))) == Sizes({ 1, 3, 5, 4 }));
+}
+
+} // namespace
+
+int
+main()
+{
+  range();
+  byClient();
+  clear();
+  moved();
+  return result("squidlogparser_test");
+}
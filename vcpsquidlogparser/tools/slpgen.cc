@@ -0,0 +1,606 @@
+/***************************************************************************
+ * Copyright (c) 2020-22                                                   *
+ *      Volnei Cervi Puttini.  All rights reserved.                        *
+ *      vcputtini@gmail.com
+ *                                                                         *
+ * Redistribution and use in source and binary forms, with or without      *
+ * modification, are permitted provided that the following conditions      *
+ * are met:                                                                *
+ * 1. Redistributions of source code must retain the above copyright       *
+ *    notice, this list of conditions and the following disclaimer.        *
+ * 2. Redistributions in binary form must reproduce the above copyright    *
+ *    notice, this list of conditions and the following disclaimer in the  *
+ *    documentation and/or other materials provided with the distribution. *
+ * 4. Neither the name of the Author     nor the names of its contributors *
+ *    may be used to endorse or promote products derived from this software*
+ *    without specific prior written permission.                           *
+ *                                                                         *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND *
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR      *
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS  *
+ * BE LIABLEFOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   *
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF    *
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS*
+ * INTERRUPTION)                                                           *
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,     *
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING   *
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE      *
+ * POSSIBILITY OFSUCH DAMAGE.                                              *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "slpgen.h"
+
+namespace squidlogparser {
+
+/* SLPRandom ---------------------------------------------------------------- */
+
+/*!
+ * \brief The state is seeded with splitmix64, so that any seed (even 0)
+ * produces a valid state.
+ * \param seed_
+ */
+SLPRandom::SLPRandom(uint64_t seed_)
+{
+  for (uint64_t& s_ : this->s_) {
+    seed_ += 0x9e3779b97f4a7c15ULL;
+    uint64_t z_ = seed_;
+    z_ = (z_ ^ (z_ >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z_ = (z_ ^ (z_ >> 27)) * 0x94d049bb133111ebULL;
+    s_ = z_ ^ (z_ >> 31);
+  }
+}
+
+/*!
+ * \brief Uniform integer in [0, n_). The modulo bias is negligible for the
+ * small ranges used by the generator.
+ */
+uint64_t
+SLPRandom::below(uint64_t n_) noexcept
+{
+  return n_ == 0 ? 0 : next() % n_;
+}
+
+/*!
+ * \brief Uniform double in [0, 1), with 53 bits.
+ */
+double
+SLPRandom::unit() noexcept
+{
+  return static_cast<double>(next() >> 11) * 0x1.0p-53;
+}
+
+bool
+SLPRandom::chance(double p_) noexcept
+{
+  return p_ > 0.0 && unit() < p_;
+}
+
+/*!
+ * \brief Exponential distribution starting at 'min_', with mean 'mean_' and
+ * truncated at 'max_'. Used for the lengths, which have a long tail.
+ */
+size_t
+SLPRandom::exponential(size_t min_, size_t mean_, size_t max_) noexcept
+{
+  if (mean_ <= min_) {
+    return std::min(min_, max_);
+  }
+  const double x_ = -std::log(1.0 - unit()) * static_cast<double>(mean_ - min_);
+  return std::min(min_ + static_cast<size_t>(x_), std::max(min_, max_));
+}
+
+/* SLPGenConfig ------------------------------------------------------------- */
+
+namespace {
+
+template<typename TFunc>
+bool
+parseList(const std::string& text_, TFunc&& add_)
+{
+  std::stringstream ss_(text_);
+  std::string item_;
+  while (std::getline(ss_, item_, ',')) {
+    const size_t colon_ = item_.find(':');
+    if (colon_ == std::string::npos || colon_ == 0) {
+      return false;
+    }
+    char* end_ = nullptr;
+    const unsigned long w_ =
+      std::strtoul(item_.c_str() + colon_ + 1, &end_, 10);
+    if (*end_ != '\0' || w_ == 0) {
+      return false;
+    }
+    if (!add_(item_.substr(0, colon_), static_cast<uint32_t>(w_))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+/*!
+ * \brief Parses a list of weights, e.g. "200:70,304:10,404:5".
+ * \return bool false if the list is malformed.
+ */
+bool
+SLPGenConfig::parseWeights(const std::string& text_, Weights<int>& out_)
+{
+  Weights<int> w_;
+  const bool ok_ = parseList(text_, [&w_](const std::string& k_, uint32_t n_) {
+    char* end_ = nullptr;
+    const long code_ = std::strtol(k_.c_str(), &end_, 10);
+    if (*end_ != '\0' || code_ < 100 || code_ > 599) {
+      return false;
+    }
+    w_.emplace_back(static_cast<int>(code_), n_);
+    return true;
+  });
+  if (!ok_ || w_.empty()) {
+    return false;
+  }
+  out_ = std::move(w_);
+  return true;
+}
+
+/*!
+ * \brief Parses a list of weights, e.g. "GET:80,POST:15,CONNECT:5".
+ * \return bool false if the list is malformed.
+ */
+bool
+SLPGenConfig::parseWeights(const std::string& text_,
+                           Weights<std::string>& out_)
+{
+  Weights<std::string> w_;
+  const bool ok_ = parseList(text_, [&w_](const std::string& k_, uint32_t n_) {
+    if (k_.find_first_of(" \t\"") != std::string::npos) {
+      return false;
+    }
+    w_.emplace_back(k_, n_);
+    return true;
+  });
+  if (!ok_ || w_.empty()) {
+    return false;
+  }
+  out_ = std::move(w_);
+  return true;
+}
+
+/* SLPLogGenerator ---------------------------------------------------------- */
+
+namespace {
+
+constexpr char alphabet_[] = "abcdefghijklmnopqrstuvwxyz0123456789-_";
+constexpr size_t alphabetSize_ = sizeof(alphabet_) - 1;
+constexpr char hex_[] = "0123456789ABCDEF";
+
+constexpr const char* tlds_[] = { "com", "net", "org", "com.br", "io" };
+constexpr const char* mimes_[] = { "text/html",
+                                   "application/json",
+                                   "image/png",
+                                   "application/javascript",
+                                   "text/css",
+                                   "application/octet-stream" };
+constexpr const char* users_[] = { "john", "mary", "proxyuser", "admin" };
+constexpr const char* params_[] = { "q",    "id",  "page",       "lang",
+                                    "sort", "ref", "utm_source", "search" };
+constexpr const char* agents_[] = {
+  "Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, "
+  "like Gecko) Chrome/120.0.0.0 Safari/537.36",
+  "Mozilla/5.0 (X11; Linux x86_64; rv:121.0) Gecko/20100101 Firefox/121.0",
+  "Mozilla/5.0 (iPhone; CPU iPhone OS 17_1 like Mac OS X) AppleWebKit/605.1.15"
+  " (KHTML, like Gecko) Version/17.1 Mobile/15E148 Safari/604.1",
+  "Wget/1.21.3",
+  "curl/8.4.0",
+  "Microsoft-CryptoAPI/10.0"
+};
+
+template<typename T, size_t N>
+constexpr size_t
+countOf(const T (&)[N])
+{
+  return N;
+}
+
+} // namespace
+
+SLPLogGenerator::SLPLogGenerator(const SLPGenConfig& cfg_)
+  : cfg_(cfg_)
+  , rnd_(cfg_.seed_)
+{
+  std::vector<uint32_t> w_;
+  for (const auto& s_ : cfg_.status_) {
+    w_.push_back(s_.second);
+  }
+  statusCdf_ = cdf(w_);
+
+  w_.clear();
+  for (const auto& m_ : cfg_.methods_) {
+    w_.push_back(m_.second);
+  }
+  methodCdf_ = cdf(w_);
+
+  const uint32_t nDomains_ = std::max<uint32_t>(cfg_.domains_, 1);
+  domains_.reserve(nDomains_);
+  for (uint32_t i_ = 0; i_ < nDomains_; ++i_) {
+    std::string d_ = rnd_.chance(0.5) ? "www." : "";
+    const size_t n_ = 4 + rnd_.below(9);
+    for (size_t j_ = 0; j_ < n_; ++j_) {
+      d_ += alphabet_[rnd_.below(26)];
+    }
+    d_ += '.';
+    d_ += tlds_[rnd_.below(countOf(tlds_))];
+    domains_.push_back(std::move(d_));
+  }
+
+  const uint32_t nClients_ = std::min<uint32_t>(
+    std::max<uint32_t>(cfg_.clients_, 1), 0xffffff);
+  clients_.reserve(nClients_);
+  for (uint32_t i_ = 0; i_ < nClients_; ++i_) {
+    clients_.push_back("10." + std::to_string((i_ >> 16) & 0xff) + "." +
+                       std::to_string((i_ >> 8) & 0xff) + "." +
+                       std::to_string(i_ & 0xff));
+  }
+}
+
+/*!
+ * \brief Appends one line, terminated by '\\n', to 'out_'.
+ */
+void
+SLPLogGenerator::next(std::string& out_)
+{
+  const size_t begin_ = out_.size();
+
+  uint32_t sec_ = 0;
+  uint32_t msec_ = 0;
+  timestamp(sec_, msec_);
+
+  const std::string& ip_ = clients_[rnd_.below(clients_.size())];
+  const int status_ = cfg_.status_[pick(statusCdf_)].first;
+  const std::string& method_ = cfg_.methods_[pick(methodCdf_)].first;
+  const bool hit_ = status_ == 304 || (status_ == 200 && rnd_.chance(0.3));
+  const char* result_ = status_ == 304   ? "TCP_REFRESH_UNMODIFIED"
+                        : status_ == 403 ? "TCP_DENIED"
+                        : hit_           ? "TCP_HIT"
+                                         : "TCP_MISS";
+  const uint64_t bytes_ = rnd_.exponential(200, 8192, 64 << 20);
+  const char* user_ = rnd_.chance(0.8) ? "-" : users_[rnd_.below(4)];
+
+  auto url_ = [&]() {
+    if (method_ == "CONNECT") {
+      out_ += domains_[rnd_.below(domains_.size())];
+      out_ += ":443";
+    } else {
+      appendUrl(out_);
+    }
+  };
+  auto referrer_ = [&]() {
+    if (rnd_.chance(0.3)) {
+      out_ += '-';
+    } else {
+      out_ += "http://";
+      out_ += domains_[rnd_.below(domains_.size())];
+      out_ += '/';
+    }
+  };
+  auto hier_ = [&]() {
+    if (hit_ || status_ == 403) {
+      out_ += "HIER_NONE";
+    } else {
+      out_ += "HIER_DIRECT";
+    }
+  };
+
+  switch (cfg_.format_) {
+    case LogFormat::Squid: {
+      // %ts.%03tu %6tr %>a %Ss/%03>Hs %<st %rm %ru %[un %Sh/%<a %mt
+      appendUInt(out_, sec_);
+      out_ += '.';
+      appendUInt(out_, msec_, 3);
+      out_ += ' ';
+      const uint64_t elapsed_ = rnd_.exponential(0, 250, 600000);
+      for (uint64_t n_ = 10; n_ <= 100000; n_ *= 10) {
+        if (elapsed_ < n_) {
+          out_ += ' '; // %6tr
+        }
+      }
+      appendUInt(out_, elapsed_);
+      out_ += ' ';
+      out_ += ip_;
+      out_ += ' ';
+      out_ += result_;
+      out_ += '/';
+      appendUInt(out_, static_cast<uint64_t>(status_), 3);
+      out_ += ' ';
+      appendUInt(out_, bytes_);
+      out_ += ' ';
+      out_ += method_;
+      out_ += ' ';
+      url_();
+      out_ += ' ';
+      out_ += user_;
+      out_ += ' ';
+      hier_();
+      if (hit_ || status_ == 403) {
+        out_ += "/-";
+      } else {
+        out_ += "/203.0.113.";
+        appendUInt(out_, rnd_.below(254) + 1);
+      }
+      out_ += ' ';
+      out_ += mimes_[rnd_.below(countOf(mimes_))];
+      break;
+    }
+    case LogFormat::Common:
+    case LogFormat::Combined: {
+      // %>a %[ui %[un [%tl] "%rm %ru HTTP/%rv" %>Hs %<st
+      //   ["%{Referer}>h" "%{User-Agent}>h"] %Ss:%Sh
+      out_ += ip_;
+      out_ += " - ";
+      out_ += user_;
+      out_ += " [";
+      out_ += localTime(sec_);
+      out_ += "] \"";
+      out_ += method_;
+      out_ += ' ';
+      url_();
+      out_ += " HTTP/1.1\" ";
+      appendUInt(out_, static_cast<uint64_t>(status_));
+      out_ += ' ';
+      appendUInt(out_, bytes_);
+      if (cfg_.format_ == LogFormat::Combined) {
+        out_ += " \"";
+        referrer_();
+        out_ += "\" \"";
+        appendUserAgent(out_);
+        out_ += '"';
+      }
+      out_ += ' ';
+      out_ += result_;
+      out_ += ':';
+      hier_();
+      break;
+    }
+    case LogFormat::Referrer: {
+      // %ts.%03tu %>a %{Referer}>h %ru
+      appendUInt(out_, sec_);
+      out_ += '.';
+      appendUInt(out_, msec_, 3);
+      out_ += ' ';
+      out_ += ip_;
+      out_ += ' ';
+      referrer_();
+      out_ += ' ';
+      url_();
+      break;
+    }
+    case LogFormat::UserAgent: {
+      // %>a [%tl] "%{User-Agent}>h"
+      out_ += ip_;
+      out_ += " [";
+      out_ += localTime(sec_);
+      out_ += "] \"";
+      appendUserAgent(out_);
+      out_ += '"';
+      break;
+    }
+    default: {
+      break;
+    }
+  }
+
+  if (rnd_.chance(cfg_.malformed_)) {
+    std::string line_ = out_.substr(begin_);
+    out_.resize(begin_);
+    breakLine(line_);
+    out_ += line_;
+    ++malformed_;
+  }
+  out_ += '\n';
+  ++lines_;
+}
+
+/*!
+ * \brief Appends lines to 'out_' until it has at least 'bytes_' bytes.
+ * \return size_t Number of lines appended.
+ */
+size_t
+SLPLogGenerator::fill(std::string& out_, size_t bytes_)
+{
+  size_t n_ = 0;
+  while (out_.size() < bytes_) {
+    next(out_);
+    ++n_;
+  }
+  return n_;
+}
+
+/* private ------------------------------------------------------------------ */
+
+std::vector<uint32_t>
+SLPLogGenerator::cdf(const std::vector<uint32_t>& w_)
+{
+  std::vector<uint32_t> cdf_;
+  uint32_t sum_ = 0;
+  for (uint32_t x_ : w_) {
+    sum_ += x_;
+    cdf_.push_back(sum_);
+  }
+  return cdf_;
+}
+
+/*!
+ * \brief Weighted choice: index of the cumulative weight reached.
+ */
+size_t
+SLPLogGenerator::pick(const std::vector<uint32_t>& cdf_)
+{
+  const uint32_t r_ = static_cast<uint32_t>(rnd_.below(cdf_.back()));
+  return static_cast<size_t>(
+    std::upper_bound(cdf_.begin(), cdf_.end(), r_) - cdf_.begin());
+}
+
+/*!
+ * \brief The log time advances 'linesPerSecond_' lines per second.
+ */
+void
+SLPLogGenerator::timestamp(uint32_t& sec_, uint32_t& msec_)
+{
+  const uint32_t lps_ = std::max<uint32_t>(cfg_.linesPerSecond_, 1);
+  sec_ = cfg_.start_ + static_cast<uint32_t>(lines_ / lps_);
+  msec_ = static_cast<uint32_t>((lines_ % lps_) * 1000 / lps_);
+}
+
+/*!
+ * \brief %tl in UTC, e.g. 13/Oct/2010:08:31:49 +0000. Formated once per
+ * second of log time.
+ */
+const std::string&
+SLPLogGenerator::localTime(uint32_t sec_)
+{
+  if (sec_ != second_ || localTime_.empty()) {
+    const std::time_t t_ = static_cast<std::time_t>(sec_);
+    std::tm tm_ = {};
+    ::gmtime_r(&t_, &tm_);
+    char buf_[32];
+    ::strftime(buf_, sizeof(buf_), "%d/%b/%Y:%H:%M:%S +0000", &tm_);
+    localTime_ = buf_;
+    second_ = sec_;
+  }
+  return localTime_;
+}
+
+void
+SLPLogGenerator::appendUInt(std::string& out_, uint64_t v_, int width_)
+{
+  char buf_[24];
+  int n_ = 0;
+  do {
+    buf_[n_++] = static_cast<char>('0' + v_ % 10);
+    v_ /= 10;
+  } while (v_ != 0);
+  while (n_ < width_) {
+    buf_[n_++] = '0';
+  }
+  while (n_ > 0) {
+    out_ += buf_[--n_];
+  }
+}
+
+/*!
+ * \brief Appends 'n_' characters of the URL alphabet. Each one is replaced by
+ * a %XX escape with the probability 'pctDensity_'.
+ */
+void
+SLPLogGenerator::appendWord(std::string& out_, size_t n_)
+{
+  const uint64_t limit_ =
+    static_cast<uint64_t>(cfg_.pctDensity_ * 65536.0 + 0.5);
+  for (size_t i_ = 0; i_ < n_; ++i_) {
+    const uint64_t r_ = rnd_.next();
+    if ((r_ & 0xffff) < limit_) {
+      const unsigned char c_ = static_cast<unsigned char>(r_ >> 32);
+      out_ += '%';
+      out_ += hex_[c_ >> 4];
+      out_ += hex_[c_ & 0x0f];
+    } else {
+      out_ += alphabet_[(r_ >> 16) % alphabetSize_];
+    }
+  }
+}
+
+/*!
+ * \brief scheme://domain/path[?query]. The length of the URL follows the
+ * exponential distribution of 'urlLenMean_'. Half of the names of the query
+ * are common ones (q, id, utm_source, ...), so they can be looked up.
+ */
+void
+SLPLogGenerator::appendUrl(std::string& out_)
+{
+  const size_t begin_ = out_.size();
+  out_ += rnd_.chance(0.6) ? "https://" : "http://";
+  out_ += domains_[rnd_.below(domains_.size())];
+
+  const size_t len_ =
+    rnd_.exponential(out_.size() - begin_ + 1, cfg_.urlLenMean_,
+                     cfg_.urlLenMax_);
+  const bool query_ = rnd_.chance(0.4);
+  const size_t pathEnd_ = begin_ + (query_ ? len_ * 2 / 3 : len_);
+
+  do {
+    out_ += '/';
+    const size_t n_ = 1 + rnd_.below(12);
+    appendWord(out_, std::min(n_, pathEnd_ > out_.size()
+                                    ? pathEnd_ - out_.size()
+                                    : size_t{ 1 }));
+  } while (out_.size() < pathEnd_);
+
+  if (query_) {
+    char sep_ = '?';
+    do {
+      out_ += sep_;
+      if (rnd_.chance(0.5)) {
+        out_ += params_[rnd_.below(countOf(params_))];
+      } else {
+        appendWord(out_, 1 + rnd_.below(8));
+      }
+      out_ += '=';
+      appendWord(out_, 1 + rnd_.below(16));
+      sep_ = '&';
+    } while (out_.size() < begin_ + len_);
+  }
+}
+
+/*!
+ * \brief A common User-Agent, extended with tokens up to the length drawn
+ * from the distribution of 'uaLenMean_'.
+ */
+void
+SLPLogGenerator::appendUserAgent(std::string& out_)
+{
+  const size_t begin_ = out_.size();
+  out_ += agents_[rnd_.below(countOf(agents_))];
+  const size_t len_ =
+    rnd_.exponential(out_.size() - begin_, cfg_.uaLenMean_, cfg_.uaLenMax_);
+  while (out_.size() < begin_ + len_) {
+    out_ += ' ';
+    appendWord(out_, 1 + rnd_.below(10));
+    out_ += '/';
+    appendUInt(out_, rnd_.below(100));
+    out_ += ".0";
+  }
+}
+
+/*!
+ * \brief Damages a line: it's truncated, its first field is replaced or it's
+ * replaced by garbage. Some of them may still match the permissive regular
+ * expressions (e.g. of the referrer format).
+ */
+void
+SLPLogGenerator::breakLine(std::string& line_)
+{
+  switch (rnd_.below(3)) {
+    case 0: {
+      line_.resize(1 + rnd_.below(std::max<size_t>(line_.size() / 2, 1)));
+      break;
+    }
+    case 1: {
+      const size_t sp_ = line_.find(' ');
+      line_.replace(0, sp_ == std::string::npos ? line_.size() : sp_, "x#?");
+      break;
+    }
+    default: {
+      line_.clear();
+      appendWord(line_, 8 + rnd_.below(32));
+      break;
+    }
+  }
+}
+
+} // namespace squidlogparser
@@ -0,0 +1,171 @@
+/***************************************************************************
+ * Copyright (c) 2020-22                                                   *
+ *      Volnei Cervi Puttini.  All rights reserved.                        *
+ *      vcputtini@gmail.com
+ *                                                                         *
+ * Redistribution and use in source and binary forms, with or without      *
+ * modification, are permitted provided that the following conditions      *
+ * are met:                                                                *
+ * 1. Redistributions of source code must retain the above copyright       *
+ *    notice, this list of conditions and the following disclaimer.        *
+ * 2. Redistributions in binary form must reproduce the above copyright    *
+ *    notice, this list of conditions and the following disclaimer in the  *
+ *    documentation and/or other materials provided with the distribution. *
+ * 4. Neither the name of the Author     nor the names of its contributors *
+ *    may be used to endorse or promote products derived from this software*
+ *    without specific prior written permission.                           *
+ *                                                                         *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND *
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR      *
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS  *
+ * BE LIABLEFOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   *
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF    *
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS*
+ * INTERRUPTION)                                                           *
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,     *
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING   *
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE      *
+ * POSSIBILITY OFSUCH DAMAGE.                                              *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*!
+ * \brief How this file is organized:
+ *
+ * Deterministic generator of synthetic Squid access-log lines, used to drive
+ * the benchmarks and the bulk loader without production logs.
+ *
+ * class SLPRandom: xoshiro256** seeded with splitmix64. The distributions are
+ *                  implemented here (not with <random>), so the same seed
+ *                  produces the same lines on any platform and library.
+ * struct SLPGenConfig: distributions of the generated fields.
+ * class SLPLogGenerator: produces the lines of one log format.
+ */
+
+#ifndef SLPGEN_H
+#define SLPGEN_H
+
+#include "squidlogparser.h"
+
+namespace squidlogparser {
+
+/* SLPRandom ---------------------------------------------------------------- */
+
+class SLPRandom
+{
+public:
+  explicit SLPRandom(uint64_t seed_);
+
+  inline uint64_t next() noexcept
+  {
+    const uint64_t r_ = rotl(s_[1] * 5, 7) * 9;
+    const uint64_t t_ = s_[1] << 17;
+    s_[2] ^= s_[0];
+    s_[3] ^= s_[1];
+    s_[1] ^= s_[2];
+    s_[0] ^= s_[3];
+    s_[2] ^= t_;
+    s_[3] = rotl(s_[3], 45);
+    return r_;
+  }
+
+  uint64_t below(uint64_t n_) noexcept; // [0, n_)
+  double unit() noexcept;               // [0, 1)
+  bool chance(double p_) noexcept;
+  size_t exponential(size_t min_, size_t mean_, size_t max_) noexcept;
+
+private:
+  std::array<uint64_t, 4> s_ = {};
+
+  static inline uint64_t rotl(uint64_t x_, int k_) noexcept
+  {
+    return (x_ << k_) | (x_ >> (64 - k_));
+  }
+};
+
+/* SLPGenConfig ------------------------------------------------------------- */
+
+struct SLPGenConfig
+{
+  using LogFormat = SquidLogData::LogFormat;
+  template<typename T>
+  using Weights = std::vector<std::pair<T, uint32_t>>;
+
+  LogFormat format_ = LogFormat::Squid;
+  uint64_t seed_ = 1;
+
+  size_t urlLenMean_ = 64;   // exponential, starting at the domain
+  size_t urlLenMax_ = 4096;
+  double pctDensity_ = 0.02; // probability of each URL char being %XX
+  size_t uaLenMean_ = 110;   // exponential
+  size_t uaLenMax_ = 2048;
+  double malformed_ = 0.0;   // fraction of malformed lines
+
+  Weights<int> status_ = { { 200, 70 }, { 304, 10 }, { 302, 6 },
+                           { 404, 8 },  { 403, 3 },  { 500, 2 },
+                           { 503, 1 } };
+  Weights<std::string> methods_ = { { "GET", 80 },     { "POST", 12 },
+                                    { "CONNECT", 5 },  { "HEAD", 2 },
+                                    { "PUT", 1 } };
+
+  uint32_t clients_ = 1024; // distinct client IP addresses
+  uint32_t domains_ = 512;  // distinct domains
+  uint32_t start_ = 1286536309;   // Unix timestamp of the first line
+  uint32_t linesPerSecond_ = 500; // of log time
+
+  static bool parseWeights(const std::string& text_, Weights<int>& out_);
+  static bool parseWeights(const std::string& text_,
+                           Weights<std::string>& out_);
+};
+
+/* SLPLogGenerator ---------------------------------------------------------- */
+
+class SLPLogGenerator
+{
+public:
+  using LogFormat = SquidLogData::LogFormat;
+
+  explicit SLPLogGenerator(const SLPGenConfig& cfg_);
+
+  void next(std::string& out_);
+  size_t fill(std::string& out_, size_t bytes_);
+
+  uint64_t lines() const noexcept { return lines_; }
+  uint64_t malformed() const noexcept { return malformed_; }
+
+private:
+  SLPGenConfig cfg_;
+  SLPRandom rnd_;
+
+  std::vector<uint32_t> statusCdf_ = {};
+  std::vector<uint32_t> methodCdf_ = {};
+  std::vector<std::string> domains_ = {};
+  std::vector<std::string> clients_ = {};
+
+  uint64_t lines_ = 0;
+  uint64_t malformed_ = 0;
+
+  uint32_t second_ = 0;          // cached localtime of 'second_'
+  std::string localTime_ = {};
+
+  static std::vector<uint32_t> cdf(const std::vector<uint32_t>& w_);
+  size_t pick(const std::vector<uint32_t>& cdf_);
+
+  void timestamp(uint32_t& sec_, uint32_t& msec_);
+  const std::string& localTime(uint32_t sec_);
+
+  void appendUInt(std::string& out_, uint64_t v_, int width_ = 0);
+  void appendWord(std::string& out_, size_t n_);
+  void appendUrl(std::string& out_);
+  void appendUserAgent(std::string& out_);
+  void breakLine(std::string& line_);
+};
+
+} // namespace squidlogparser
+
+#endif // SLPGEN_H
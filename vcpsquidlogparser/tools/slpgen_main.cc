@@ -0,0 +1,254 @@
+/***************************************************************************
+ * Copyright (c) 2020-22                                                   *
+ *      Volnei Cervi Puttini.  All rights reserved.                        *
+ *      vcputtini@gmail.com
+ *                                                                         *
+ * Redistribution and use in source and binary forms, with or without      *
+ * modification, are permitted provided that the following conditions      *
+ * are met:                                                                *
+ * 1. Redistributions of source code must retain the above copyright       *
+ *    notice, this list of conditions and the following disclaimer.        *
+ * 2. Redistributions in binary form must reproduce the above copyright    *
+ *    notice, this list of conditions and the following disclaimer in the  *
+ *    documentation and/or other materials provided with the distribution. *
+ * 4. Neither the name of the Author     nor the names of its contributors *
+ *    may be used to endorse or promote products derived from this software*
+ *    without specific prior written permission.                           *
+ *                                                                         *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND *
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR      *
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS  *
+ * BE LIABLEFOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   *
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF    *
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS*
+ * INTERRUPTION)                                                           *
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,     *
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING   *
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE      *
+ * POSSIBILITY OFSUCH DAMAGE.                                              *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*!
+ * \brief slpgen: writes synthetic Squid access-log lines to a file or stdout.
+ *
+ * The same options and seed always produce the same output.
+ */
+
+#include "slpgen.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+using namespace squidlogparser;
+
+namespace {
+
+void
+usage()
+{
+  std::fprintf(
+    stderr,
+    "Usage: slpgen [options]\n"
+    "  --format F         squid | common | combined | referrer | useragent\n"
+    "                     (default: squid)\n"
+    "  --lines N          number of lines (default: 1000)\n"
+    "  --bytes SIZE       stop after SIZE bytes instead, e.g. 512M, 2G\n"
+    "  --seed N           seed (default: 1)\n"
+    "  --output FILE      default: stdout\n"
+    "  --url-len MEAN[:MAX]   URL length (default: 64:4096)\n"
+    "  --pct-density P    probability of %%XX per URL char (default: 0.02)\n"
+    "  --ua-len MEAN[:MAX]    User-Agent length (default: 110:2048)\n"
+    "  --status LIST      e.g. 200:70,304:10,404:8,500:2\n"
+    "  --methods LIST     e.g. GET:80,POST:12,CONNECT:5\n"
+    "  --malformed P      fraction of malformed lines (default: 0)\n"
+    "  --clients N        distinct client addresses (default: 1024)\n"
+    "  --domains N        distinct domains (default: 512)\n"
+    "  --start TS         Unix timestamp of the first line\n"
+    "  --rate N           lines per second of log time (default: 500)\n"
+    "  --verbose          print lines, bytes and MB/s to stderr\n");
+}
+
+bool
+parseSize(const char* s_, uint64_t& out_)
+{
+  char* end_ = nullptr;
+  out_ = std::strtoull(s_, &end_, 10);
+  switch (*end_) {
+    case 'G':
+    case 'g':
+      out_ <<= 10;
+      [[fallthrough]];
+    case 'M':
+    case 'm':
+      out_ <<= 10;
+      [[fallthrough]];
+    case 'K':
+    case 'k':
+      out_ <<= 10;
+      ++end_;
+      break;
+    default:
+      break;
+  }
+  return *end_ == '\0' && out_ > 0;
+}
+
+bool
+parseLength(const char* s_, size_t& mean_, size_t& max_)
+{
+  char* end_ = nullptr;
+  mean_ = std::strtoul(s_, &end_, 10);
+  if (*end_ == ':') {
+    max_ = std::strtoul(end_ + 1, &end_, 10);
+  }
+  return *end_ == '\0' && mean_ > 0 && max_ >= mean_;
+}
+
+bool
+parseFraction(const char* s_, double& out_)
+{
+  char* end_ = nullptr;
+  out_ = std::strtod(s_, &end_);
+  return *end_ == '\0' && out_ >= 0.0 && out_ <= 1.0;
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+  using LogFormat = SquidLogData::LogFormat;
+
+  SLPGenConfig cfg_;
+  uint64_t lines_ = 1000;
+  uint64_t bytes_ = 0;
+  std::string output_ = {};
+  bool verbose_ = false;
+
+  for (int i_ = 1; i_ < argc; ++i_) {
+    const std::string arg_ = argv[i_];
+    const char* val_ = i_ + 1 < argc ? argv[i_ + 1] : nullptr;
+    bool ok_ = true;
+
+    if (arg_ == "--verbose") {
+      verbose_ = true;
+      continue;
+    }
+    if (val_ == nullptr) {
+      usage();
+      return EXIT_FAILURE;
+    }
+    ++i_;
+
+    if (arg_ == "--format") {
+      const std::string f_ = val_;
+      cfg_.format_ = f_ == "squid"       ? LogFormat::Squid
+                     : f_ == "common"    ? LogFormat::Common
+                     : f_ == "combined"  ? LogFormat::Combined
+                     : f_ == "referrer"  ? LogFormat::Referrer
+                     : f_ == "useragent" ? LogFormat::UserAgent
+                                         : LogFormat::Unknown;
+      ok_ = cfg_.format_ != LogFormat::Unknown;
+    } else if (arg_ == "--lines") {
+      lines_ = std::strtoull(val_, nullptr, 10);
+      ok_ = lines_ > 0;
+    } else if (arg_ == "--bytes") {
+      ok_ = parseSize(val_, bytes_);
+    } else if (arg_ == "--seed") {
+      cfg_.seed_ = std::strtoull(val_, nullptr, 10);
+    } else if (arg_ == "--output") {
+      output_ = val_;
+    } else if (arg_ == "--url-len") {
+      ok_ = parseLength(val_, cfg_.urlLenMean_, cfg_.urlLenMax_);
+    } else if (arg_ == "--pct-density") {
+      ok_ = parseFraction(val_, cfg_.pctDensity_);
+    } else if (arg_ == "--ua-len") {
+      ok_ = parseLength(val_, cfg_.uaLenMean_, cfg_.uaLenMax_);
+    } else if (arg_ == "--status") {
+      ok_ = SLPGenConfig::parseWeights(val_, cfg_.status_);
+    } else if (arg_ == "--methods") {
+      ok_ = SLPGenConfig::parseWeights(val_, cfg_.methods_);
+    } else if (arg_ == "--malformed") {
+      ok_ = parseFraction(val_, cfg_.malformed_);
+    } else if (arg_ == "--clients") {
+      cfg_.clients_ = static_cast<uint32_t>(std::strtoul(val_, nullptr, 10));
+    } else if (arg_ == "--domains") {
+      cfg_.domains_ = static_cast<uint32_t>(std::strtoul(val_, nullptr, 10));
+    } else if (arg_ == "--start") {
+      cfg_.start_ = static_cast<uint32_t>(std::strtoul(val_, nullptr, 10));
+    } else if (arg_ == "--rate") {
+      cfg_.linesPerSecond_ =
+        static_cast<uint32_t>(std::strtoul(val_, nullptr, 10));
+    } else {
+      ok_ = false;
+    }
+
+    if (!ok_) {
+      std::fprintf(stderr, "slpgen: invalid option: %s %s\n", arg_.c_str(),
+                   val_);
+      usage();
+      return EXIT_FAILURE;
+    }
+  }
+
+  FILE* out_ = stdout;
+  if (!output_.empty()) {
+    out_ = std::fopen(output_.c_str(), "wb");
+    if (out_ == nullptr) {
+      std::fprintf(stderr, "slpgen: can't open %s\n", output_.c_str());
+      return EXIT_FAILURE;
+    }
+  }
+
+  SLPLogGenerator gen_(cfg_);
+  constexpr size_t chunk_ = 4 << 20;
+  std::string buf_;
+  buf_.reserve(chunk_ + 8192);
+  uint64_t written_ = 0;
+  const auto start_ = std::chrono::steady_clock::now();
+
+  for (;;) {
+    buf_.clear();
+    if (bytes_ > 0) {
+      gen_.fill(buf_, std::min<uint64_t>(chunk_, bytes_ - written_));
+    } else {
+      while (buf_.size() < chunk_ && gen_.lines() < lines_) {
+        gen_.next(buf_);
+      }
+    }
+    if (std::fwrite(buf_.data(), 1, buf_.size(), out_) != buf_.size()) {
+      std::fprintf(stderr, "slpgen: write error\n");
+      return EXIT_FAILURE;
+    }
+    written_ += buf_.size();
+    if (bytes_ > 0 ? written_ >= bytes_ : gen_.lines() >= lines_) {
+      break;
+    }
+  }
+
+  if (out_ != stdout) {
+    std::fclose(out_);
+  } else {
+    std::fflush(out_);
+  }
+
+  if (verbose_) {
+    const double s_ = std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - start_)
+                        .count();
+    std::fprintf(stderr,
+                 "slpgen: %llu lines (%llu malformed), %llu bytes, "
+                 "%.1f MB/s\n",
+                 static_cast<unsigned long long>(gen_.lines()),
+                 static_cast<unsigned long long>(gen_.malformed()),
+                 static_cast<unsigned long long>(written_),
+                 s_ > 0 ? static_cast<double>(written_) / s_ / 1e6 : 0.0);
+  }
+  return EXIT_SUCCESS;
+}
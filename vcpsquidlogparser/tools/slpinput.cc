@@ -0,0 +1,364 @@
+/***************************************************************************
+ * Copyright (c) 2020-22                                                   *
+ *      Volnei Cervi Puttini.  All rights reserved.                        *
+ *      vcputtini@gmail.com
+ *                                                                         *
+ * Redistribution and use in source and binary forms, with or without      *
+ * modification, are permitted provided that the following conditions      *
+ * are met:                                                                *
+ * 1. Redistributions of source code must retain the above copyright       *
+ *    notice, this list of conditions and the following disclaimer.        *
+ * 2. Redistributions in binary form must reproduce the above copyright    *
+ *    notice, this list of conditions and the following disclaimer in the  *
+ *    documentation and/or other materials provided with the distribution. *
+ * 4. Neither the name of the Author     nor the names of its contributors *
+ *    may be used to endorse or promote products derived from this software*
+ *    without specific prior written permission.                           *
+ *                                                                         *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND *
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR      *
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS  *
+ * BE LIABLEFOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   *
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF    *
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS*
+ * INTERRUPTION)                                                           *
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,     *
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING   *
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE      *
+ * POSSIBILITY OFSUCH DAMAGE.                                              *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "slpinput.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <zlib.h>
+#ifdef SLP_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+namespace squidlogparser {
+
+/* SLPInput ----------------------------------------------------------------- */
+
+/*!
+ * \brief Codec of the file by its magic number, not by its name: logrotate
+ * may or may not add the extension.
+ */
+SLPInput::Codec
+SLPInput::codecOf(const std::string& path_)
+{
+  unsigned char m_[4] = {};
+  const int fd_ = ::open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd_ < 0) {
+    return Codec::Plain; // the error is reported when it's read
+  }
+  const ssize_t n_ = ::pread(fd_, m_, sizeof(m_), 0);
+  ::close(fd_);
+
+  if (n_ >= 2 && m_[0] == 0x1f && m_[1] == 0x8b) {
+    return Codec::Gzip;
+  }
+  if (n_ == 4 && m_[0] == 0x28 && m_[1] == 0xb5 && m_[2] == 0x2f &&
+      m_[3] == 0xfd) {
+    return Codec::Zstd;
+  }
+  return Codec::Plain;
+}
+
+const char*
+SLPInput::nameOf(Codec c_) noexcept
+{
+  switch (c_) {
+    case Codec::Gzip: {
+      return "gzip";
+    }
+    case Codec::Zstd: {
+      return "zstd";
+    }
+    default: {
+      return "plain";
+    }
+  }
+}
+
+bool
+SLPInput::supported(Codec c_) noexcept
+{
+#ifdef SLP_WITH_ZSTD
+  (void)c_;
+  return true;
+#else
+  return c_ != Codec::Zstd;
+#endif
+}
+
+/* SLPFileInput ------------------------------------------------------------- */
+
+/*!
+ * \brief With direct_ the file is opened with O_DIRECT, or normally if the
+ * file system doesn't support it. The buffers and the sizes given to read()
+ * must then be aligned to the page.
+ */
+SLPFileInput::SLPFileInput(const std::string& path_, bool direct_)
+{
+#ifdef O_DIRECT
+  if (direct_) {
+    fd_ = ::open(path_.c_str(), O_RDONLY | O_CLOEXEC | O_DIRECT);
+    this->direct_ = fd_ >= 0;
+  }
+#endif
+  if (fd_ < 0) {
+    fd_ = ::open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ >= 0) {
+      ::posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+  }
+  if (fd_ < 0) {
+    error_ = path_ + ": " + std::strerror(errno);
+  }
+}
+
+SLPFileInput::~SLPFileInput()
+{
+  if (fd_ >= 0) {
+    ::close(fd_);
+  }
+}
+
+/*!
+ * \brief pread() can return fewer bytes than asked before the end (NFS, FUSE,
+ * signals), so it's repeated until n_ bytes or the end. With O_DIRECT only
+ * the end of the file is read short, and the offset after it wouldn't be
+ * aligned for another pread().
+ */
+ssize_t
+SLPFileInput::read(char* dst_, size_t n_)
+{
+  size_t got_ = 0;
+  while (got_ < n_) {
+    const ssize_t r_ = ::pread(fd_, dst_ + got_, n_ - got_, offset_);
+    if (r_ < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      error_ = std::strerror(errno);
+      return -1;
+    }
+    if (r_ == 0) {
+      break;
+    }
+    const bool short_ = static_cast<size_t>(r_) < n_ - got_;
+    got_ += static_cast<size_t>(r_);
+    offset_ += r_;
+    consumed_ += static_cast<uint64_t>(r_);
+    if (direct_ && short_) {
+      break;
+    }
+  }
+  return static_cast<ssize_t>(got_);
+}
+
+/* SLPGzipInput ------------------------------------------------------------- */
+
+struct SLPGzipInput::Stream
+{
+  z_stream s_ = {};
+};
+
+SLPGzipInput::SLPGzipInput(std::string_view data_)
+  : z_(std::make_unique<Stream>())
+  , data_(data_)
+{
+  // 15 + 32: window of 32K, gzip or zlib header detected automatically.
+  if (inflateInit2(&z_->s_, 15 + 32) != Z_OK) {
+    error_ = "inflateInit2() failed";
+    end_ = true;
+  }
+}
+
+SLPGzipInput::~SLPGzipInput()
+{
+  inflateEnd(&z_->s_);
+}
+
+/*!
+ * \brief Inflates into dst_ until it's full or the input ends. The input is
+ * given to zlib in pieces of up to 1G, as avail_in is 32 bits.
+ */
+ssize_t
+SLPGzipInput::read(char* dst_, size_t n_)
+{
+  z_stream& z_ = this->z_->s_;
+  z_.next_out = reinterpret_cast<Bytef*>(dst_);
+  z_.avail_out = static_cast<uInt>(std::min<size_t>(n_, UINT_MAX));
+
+  while (z_.avail_out > 0 && !end_) {
+    if (z_.avail_in == 0 && pos_ < data_.size()) {
+      const size_t in_ = std::min<size_t>(data_.size() - pos_, 1 << 30);
+      z_.next_in =
+        reinterpret_cast<Bytef*>(const_cast<char*>(data_.data() + pos_));
+      z_.avail_in = static_cast<uInt>(in_);
+      pos_ += in_;
+    }
+
+    const uInt before_ = z_.avail_in;
+    const int rc_ = inflate(&z_, Z_NO_FLUSH);
+    consumed_ += before_ - z_.avail_in;
+
+    if (rc_ == Z_STREAM_END) {
+      // A .gz may have many members (e.g. cat a.gz b.gz).
+      if (z_.avail_in == 0 && pos_ == data_.size()) {
+        end_ = true;
+      } else if (inflateReset(&z_) != Z_OK) {
+        error_ = "inflateReset() failed";
+        return -1;
+      }
+    } else if (rc_ == Z_BUF_ERROR ||
+               (rc_ == Z_OK && z_.avail_in == 0 && z_.avail_out > 0)) {
+      // No input left and the stream isn't over.
+      if (z_.avail_in == 0 && pos_ == data_.size()) {
+        error_ = "truncated gzip stream";
+        return -1;
+      }
+    } else if (rc_ != Z_OK) {
+      error_ = z_.msg != nullptr ? z_.msg : "inflate() failed";
+      return -1;
+    }
+  }
+  return static_cast<ssize_t>(n_ - z_.avail_out);
+}
+
+/* SLPZstdInput ------------------------------------------------------------- */
+
+#ifdef SLP_WITH_ZSTD
+
+struct SLPZstdInput::Stream
+{
+  ZSTD_DStream* s_ = ZSTD_createDStream();
+  ~Stream() { ZSTD_freeDStream(s_); }
+};
+
+SLPZstdInput::SLPZstdInput(std::string_view data_)
+  : z_(std::make_unique<Stream>())
+  , data_(data_)
+{
+  if (z_->s_ == nullptr || ZSTD_isError(ZSTD_initDStream(z_->s_))) {
+    error_ = "ZSTD_initDStream() failed";
+    end_ = true;
+  }
+}
+
+SLPZstdInput::~SLPZstdInput() = default;
+
+/*!
+ * \brief Decompresses into dst_ until it's full or the input ends. The
+ * frames one after the other are decompressed in sequence.
+ */
+ssize_t
+SLPZstdInput::read(char* dst_, size_t n_)
+{
+  ZSTD_outBuffer out_ = { dst_, n_, 0 };
+
+  while (out_.pos < out_.size && !end_) {
+    ZSTD_inBuffer in_ = { data_.data(), data_.size(), pos_ };
+    const size_t before_ = out_.pos;
+    const size_t hint_ = ZSTD_decompressStream(z_->s_, &out_, &in_);
+    if (ZSTD_isError(hint_)) {
+      error_ = ZSTD_getErrorName(hint_);
+      return -1;
+    }
+    const bool progress_ = in_.pos != pos_ || out_.pos != before_;
+    consumed_ += in_.pos - pos_;
+    pos_ = in_.pos;
+
+    if (pos_ == data_.size() && out_.pos < out_.size) {
+      // All the input was given and all the output flushed: the last frame
+      // must be complete.
+      if (hint_ != 0) {
+        error_ = "truncated zstd frame";
+        return -1;
+      }
+      end_ = true;
+    } else if (!progress_) {
+      error_ = "zstd stream doesn't progress";
+      return -1;
+    }
+  }
+  return static_cast<ssize_t>(out_.pos);
+}
+
+/*!
+ * \brief Splits data_ at frame boundaries in pieces of at least target_
+ * bytes, which decompress independently of each other.
+ *
+ * A file compressed by 'zstd -T' is a single frame, while pzstd, or .zst
+ * files concatenated, have many frames. If the frames can't be walked, the
+ * whole data_ is one piece and the error is reported by read().
+ */
+std::vector<std::string_view>
+SLPZstdInput::pieces(std::string_view data_, size_t target_)
+{
+  std::vector<std::string_view> out_;
+  size_t begin_ = 0;
+  size_t pos_ = 0;
+
+  while (pos_ < data_.size()) {
+    const size_t n_ =
+      ZSTD_findFrameCompressedSize(data_.data() + pos_, data_.size() - pos_);
+    if (ZSTD_isError(n_)) {
+      pos_ = data_.size();
+      break;
+    }
+    pos_ += n_;
+    if (pos_ - begin_ >= target_) {
+      out_.emplace_back(data_.substr(begin_, pos_ - begin_));
+      begin_ = pos_;
+    }
+  }
+  if (begin_ < data_.size() || out_.empty()) {
+    out_.emplace_back(data_.substr(begin_));
+  }
+  return out_;
+}
+
+#else // SLP_WITH_ZSTD
+
+struct SLPZstdInput::Stream
+{};
+
+SLPZstdInput::SLPZstdInput(std::string_view data_)
+  : data_(data_)
+{
+  error_ = "built without zstd";
+  end_ = true;
+}
+
+SLPZstdInput::~SLPZstdInput() = default;
+
+ssize_t
+SLPZstdInput::read(char*, size_t)
+{
+  return -1;
+}
+
+std::vector<std::string_view>
+SLPZstdInput::pieces(std::string_view data_, size_t)
+{
+  return { data_ };
+}
+
+#endif // SLP_WITH_ZSTD
+
+} // namespace squidlogparser
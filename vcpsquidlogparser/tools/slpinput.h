@@ -0,0 +1,156 @@
+/***************************************************************************
+ * Copyright (c) 2020-22                                                   *
+ *      Volnei Cervi Puttini.  All rights reserved.                        *
+ *      vcputtini@gmail.com
+ *                                                                         *
+ * Redistribution and use in source and binary forms, with or without      *
+ * modification, are permitted provided that the following conditions      *
+ * are met:                                                                *
+ * 1. Redistributions of source code must retain the above copyright       *
+ *    notice, this list of conditions and the following disclaimer.        *
+ * 2. Redistributions in binary form must reproduce the above copyright    *
+ *    notice, this list of conditions and the following disclaimer in the  *
+ *    documentation and/or other materials provided with the distribution. *
+ * 4. Neither the name of the Author     nor the names of its contributors *
+ *    may be used to endorse or promote products derived from this software*
+ *    without specific prior written permission.                           *
+ *                                                                         *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND *
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR      *
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS  *
+ * BE LIABLEFOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   *
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF    *
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS*
+ * INTERRUPTION)                                                           *
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,     *
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING   *
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE      *
+ * POSSIBILITY OFSUCH DAMAGE.                                              *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*!
+ * \brief How this file is organized:
+ *
+ * Inputs of the bulk loader. Each one is read as a stream of uncompressed
+ * bytes, so the rotated access.log.N.gz and .zst files are decompressed
+ * straight into the blocks of the parsers, never to disk.
+ *
+ * class SLPInput: base class, the codec is detected by the magic number.
+ * class SLPFileInput: plain file, page-aligned pread() (O_DIRECT optional).
+ * class SLPGzipInput: gzip (or zlib) over the mapped file, with zlib. The
+ *                     members of a concatenated .gz are read in sequence.
+ * class SLPZstdInput: zstd over the mapped file. A file of many frames
+ *                     (e.g. written by pzstd) is split at frame boundaries
+ *                     into pieces that decompress independently.
+ *                     Compiled only if SLP_WITH_ZSTD is defined.
+ */
+
+#ifndef SLPINPUT_H
+#define SLPINPUT_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <sys/types.h> // ssize_t
+#include <vector>
+
+namespace squidlogparser {
+
+/* SLPInput ----------------------------------------------------------------- */
+
+class SLPInput
+{
+public:
+  enum class Codec
+  {
+    Plain = 0x00,
+    Gzip,
+    Zstd
+  };
+
+  virtual ~SLPInput() = default;
+
+  /*!
+   * \brief Fills dst_ with n_ bytes, fewer only at the end of the input.
+   * \return bytes read, 0 at the end, -1 on error (see error()).
+   */
+  virtual ssize_t read(char* dst_, size_t n_) = 0;
+
+  uint64_t consumed() const noexcept { return consumed_; } // from the disk
+  const std::string& error() const noexcept { return error_; }
+
+  static Codec codecOf(const std::string& path_);
+  static const char* nameOf(Codec c_) noexcept;
+  static bool supported(Codec c_) noexcept;
+
+protected:
+  uint64_t consumed_ = 0;
+  std::string error_ = {};
+};
+
+/* SLPFileInput ------------------------------------------------------------- */
+
+class SLPFileInput : public SLPInput
+{
+public:
+  explicit SLPFileInput(const std::string& path_, bool direct_ = false);
+  ~SLPFileInput() override;
+
+  bool isOpen() const noexcept { return fd_ >= 0; }
+  ssize_t read(char* dst_, size_t n_) override;
+
+private:
+  int fd_ = -1;
+  off_t offset_ = 0;
+  bool direct_ = false; // opened with O_DIRECT
+};
+
+/* SLPGzipInput ------------------------------------------------------------- */
+
+class SLPGzipInput : public SLPInput
+{
+public:
+  explicit SLPGzipInput(std::string_view data_);
+  ~SLPGzipInput() override;
+
+  ssize_t read(char* dst_, size_t n_) override;
+
+private:
+  struct Stream; // z_stream, zlib.h isn't exposed
+  std::unique_ptr<Stream> z_;
+  std::string_view data_;
+  size_t pos_ = 0;
+  bool end_ = false;
+};
+
+/* SLPZstdInput ------------------------------------------------------------- */
+
+class SLPZstdInput : public SLPInput
+{
+public:
+  explicit SLPZstdInput(std::string_view data_);
+  ~SLPZstdInput() override;
+
+  ssize_t read(char* dst_, size_t n_) override;
+
+  static std::vector<std::string_view> pieces(std::string_view data_,
+                                              size_t target_);
+
+private:
+  struct Stream; // ZSTD_DStream
+  std::unique_ptr<Stream> z_;
+  std::string_view data_;
+  size_t pos_ = 0;
+  bool end_ = false;
+};
+
+} // namespace squidlogparser
+
+#endif // SLPINPUT_H
@@ -0,0 +1,967 @@
+/***************************************************************************
+ * Copyright (c) 2020-22                                                   *
+ *      Volnei Cervi Puttini.  All rights reserved.                        *
+ *      vcputtini@gmail.com
+ *                                                                         *
+ * Redistribution and use in source and binary forms, with or without      *
+ * modification, are permitted provided that the following conditions      *
+ * are met:                                                                *
+ * 1. Redistributions of source code must retain the above copyright       *
+ *    notice, this list of conditions and the following disclaimer.        *
+ * 2. Redistributions in binary form must reproduce the above copyright    *
+ *    notice, this list of conditions and the following disclaimer in the  *
+ *    documentation and/or other materials provided with the distribution. *
+ * 4. Neither the name of the Author     nor the names of its contributors *
+ *    may be used to endorse or promote products derived from this software*
+ *    without specific prior written permission.                           *
+ *                                                                         *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND *
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR      *
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS  *
+ * BE LIABLEFOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   *
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF    *
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS*
+ * INTERRUPTION)                                                           *
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,     *
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING   *
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE      *
+ * POSSIBILITY OFSUCH DAMAGE.                                              *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "slpload.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <new>
+
+namespace squidlogparser {
+
+/* SLPCsvFormat ------------------------------------------------------------- */
+
+SLPCsvFormat::SLPCsvFormat(LogFormat f_, bool ipText_)
+  : ipText_(ipText_)
+{
+  const char* ip_ = ipText_ ? "VARCHAR(15)" : "INT UNSIGNED";
+  const Column ts_ = { "ts", "INT UNSIGNED", Kind::Timestamp,
+                       Fields::Timestamp };
+  const Column cli_ = { "client_ip", ip_, Kind::Ip, Fields::CliSrcIpAddr };
+  const Column method_ = { "method", "VARCHAR(16)", Kind::Str,
+                           Fields::ReqMethod };
+  const Column url_ = { "url", "TEXT", Kind::Str, Fields::ReqURL };
+  const Column user_ = { "user_name", "VARCHAR(128)", Kind::Str,
+                         Fields::UserName };
+  const Column size_ = { "size", "BIGINT", Kind::Int, Fields::TotalSizeReply };
+  const Column http_ = { "http_status", "SMALLINT", Kind::Int,
+                         Fields::HttpStatus };
+
+  switch (f_) {
+    case LogFormat::Squid: {
+      columns_ = {
+        ts_,
+        { "response_time", "INT", Kind::Int, Fields::ResponseTime },
+        cli_,
+        { "req_status", "VARCHAR(64)", Kind::Str,
+          Fields::ReqStatusHierStatus },
+        { "http_status", "SMALLINT", Kind::SquidStatus,
+          Fields::ReqStatusHierStatus },
+        size_,
+        method_,
+        url_,
+        user_,
+        { "hier_status", "VARCHAR(128)", Kind::Str,
+          Fields::HierStatusIpAddress },
+        { "mime_type", "VARCHAR(128)", Kind::Str, Fields::MimeContentType },
+      };
+      break;
+    }
+    case LogFormat::Common:
+    case LogFormat::Combined: {
+      columns_ = {
+        ts_,
+        cli_,
+        { "user_ident", "VARCHAR(128)", Kind::Str, Fields::UserNameIdent },
+        user_,
+        method_,
+        url_,
+        { "proto_version", "VARCHAR(16)", Kind::Str,
+          Fields::ReqProtoVersion },
+        http_,
+        size_,
+      };
+      if (f_ == LogFormat::Combined) {
+        columns_.push_back({ "referrer", "TEXT", Kind::Str, Fields::Referrer });
+        columns_.push_back(
+          { "user_agent", "TEXT", Kind::Str, Fields::UserAgent });
+      }
+      columns_.push_back({ "req_status", "VARCHAR(64)", Kind::Str,
+                           Fields::ReqStatusHierStatus });
+      break;
+    }
+    case LogFormat::Referrer: {
+      columns_ = {
+        ts_,
+        cli_,
+        { "referrer", "TEXT", Kind::Str, Fields::Referrer },
+        url_,
+      };
+      break;
+    }
+    case LogFormat::UserAgent: {
+      columns_ = {
+        ts_,
+        cli_,
+        { "user_agent", "TEXT", Kind::Str, Fields::UserAgent },
+      };
+      break;
+    }
+    default: {
+      break;
+    }
+  }
+}
+
+void
+SLPCsvFormat::header(std::string& out_) const
+{
+  for (size_t i_ = 0; i_ < columns_.size(); ++i_) {
+    if (i_ > 0) {
+      out_ += ',';
+    }
+    out_ += columns_[i_].name_;
+  }
+  out_ += '\n';
+}
+
+/*!
+ * \brief Appends the CSV row of the line just parsed by p_.
+ *
+ * The numbers are written bare and the strings enclosed by '"', with '"' and
+ * '\\' escaped by '\\'. The "-" of the empty Squid fields is written as \N
+ * (NULL), which LOAD DATA reads only when it's not enclosed.
+ */
+void
+SLPCsvFormat::row(std::string& out_, const SLPRowParser& p_) const
+{
+  for (size_t i_ = 0; i_ < columns_.size(); ++i_) {
+    const Column& c_ = columns_[i_];
+    if (i_ > 0) {
+      out_ += ',';
+    }
+    switch (c_.kind_) {
+      case Kind::Timestamp: {
+        appendUInt(out_, p_.timestamp());
+        break;
+      }
+      case Kind::Int: {
+        appendInt(out_, p_.getPartInt(c_.field_));
+        break;
+      }
+      case Kind::Ip: {
+        const uint32_t ip_ = p_.getPartUInt(c_.field_);
+        if (ipText_) {
+          appendQuoted(out_, p_.numericToAddr(std::move(ip_)));
+        } else {
+          appendUInt(out_, ip_);
+        }
+        break;
+      }
+      case Kind::Str: {
+        appendQuoted(out_, p_.getPartStr(c_.field_));
+        break;
+      }
+      case Kind::SquidStatus: {
+        // TCP_MISS/200
+        const int code_ = p_.httpStatus();
+        if (code_ >= 0) {
+          appendInt(out_, code_);
+        } else {
+          out_ += "\\N";
+        }
+        break;
+      }
+    }
+  }
+  out_ += '\n';
+}
+
+/*!
+ * \brief CREATE TABLE and LOAD DATA statements for the CSV of this format.
+ */
+std::string
+SLPCsvFormat::sql(const std::string& table_, const std::string& file_) const
+{
+  std::string out_ = "CREATE TABLE IF NOT EXISTS " + table_ + " (\n";
+  for (size_t i_ = 0; i_ < columns_.size(); ++i_) {
+    out_ += "  ";
+    out_ += columns_[i_].name_;
+    out_ += ' ';
+    out_ += columns_[i_].sqlType_;
+    out_ += columns_[i_].kind_ == Kind::Str ||
+                columns_[i_].kind_ == Kind::SquidStatus
+              ? " NULL"
+              : " NOT NULL";
+    out_ += i_ + 1 < columns_.size() ? ",\n" : "\n";
+  }
+  out_ += ");\n\n";
+
+  out_ += "LOAD DATA LOCAL INFILE '" + file_ + "'\n  INTO TABLE " + table_ +
+          "\n  FIELDS TERMINATED BY ',' OPTIONALLY ENCLOSED BY '\"' "
+          "ESCAPED BY '\\\\'\n  LINES TERMINATED BY '\\n'\n  (";
+  for (size_t i_ = 0; i_ < columns_.size(); ++i_) {
+    out_ += i_ > 0 ? ", " : "";
+    out_ += columns_[i_].name_;
+  }
+  out_ += ");\n";
+  return out_;
+}
+
+void
+SLPCsvFormat::appendQuoted(std::string& out_, std::string_view s_)
+{
+  if (s_ == "-") {
+    out_ += "\\N";
+    return;
+  }
+  out_ += '"';
+  for (const char c_ : s_) {
+    if (c_ == '"' || c_ == '\\') {
+      out_ += '\\';
+    }
+    out_ += c_;
+  }
+  out_ += '"';
+}
+
+void
+SLPCsvFormat::appendUInt(std::string& out_, uint64_t v_)
+{
+  char buf_[20];
+  char* p_ = buf_ + sizeof(buf_);
+  do {
+    *--p_ = static_cast<char>('0' + v_ % 10);
+    v_ /= 10;
+  } while (v_ != 0);
+  out_.append(p_, buf_ + sizeof(buf_) - p_);
+}
+
+void
+SLPCsvFormat::appendInt(std::string& out_, int64_t v_)
+{
+  if (v_ < 0) {
+    out_ += '-';
+    appendUInt(out_, 0 - static_cast<uint64_t>(v_));
+  } else {
+    appendUInt(out_, static_cast<uint64_t>(v_));
+  }
+}
+
+/* SLPLoadStats ------------------------------------------------------------- */
+
+/*!
+ * \brief Totals and, per stage, its throughput while busy (what one thread of
+ * the stage can do) and how much of the run it was busy, waiting for the
+ * stage before or blocked by the stage after it.
+ */
+std::string
+SLPLoadStats::toText() const
+{
+  const double mb_ = static_cast<double>(bytes_) / 1e6;
+  char buf_[1024];
+  int n_ = std::snprintf(
+    buf_,
+    sizeof(buf_),
+    "files %llu, %.1f MB, %llu lines, %llu rows, %llu rejected\n"
+    "blocks %llu, %.3f s, %.1f MB/s, %.0f lines/s\n",
+    static_cast<unsigned long long>(files_),
+    mb_,
+    static_cast<unsigned long long>(lines_),
+    static_cast<unsigned long long>(rows_),
+    static_cast<unsigned long long>(rejected_),
+    static_cast<unsigned long long>(blocks_),
+    seconds_,
+    seconds_ > 0 ? mb_ / seconds_ : 0.0,
+    seconds_ > 0 ? static_cast<double>(lines_) / seconds_ : 0.0);
+  if (stored_ > 0) {
+    n_ += std::snprintf(buf_ + n_,
+                        sizeof(buf_) - static_cast<size_t>(n_),
+                        "column store %llu rows\n",
+                        static_cast<unsigned long long>(stored_));
+  }
+  if (zoneMaps_ > 0) {
+    n_ += std::snprintf(buf_ + n_,
+                        sizeof(buf_) - static_cast<size_t>(n_),
+                        "zone maps %llu\n",
+                        static_cast<unsigned long long>(zoneMaps_));
+  }
+  if (compressed_ > 0) {
+    n_ += std::snprintf(buf_ + n_,
+                        sizeof(buf_) - static_cast<size_t>(n_),
+                        "compressed %.1f MB (%.1fx), %llu sources\n",
+                        static_cast<double>(compressed_) / 1e6,
+                        static_cast<double>(bytes_) /
+                          static_cast<double>(compressed_),
+                        static_cast<unsigned long long>(sources_));
+  }
+
+  const std::pair<const char*, const Stage*> stages_[] = {
+    { "read", &read_ }, { "parse", &parse_ }, { "write", &write_ }
+  };
+  for (const auto& [name_, s_] : stages_) {
+    const double all_ = seconds_ * static_cast<double>(s_->threads_);
+    n_ += std::snprintf(
+      buf_ + n_,
+      sizeof(buf_) - static_cast<size_t>(n_),
+      "  %-5s %2zu thr %9.1f MB  %8.1f MB/s/thr  busy %5.1f%%  wait %5.1f%%\n",
+      name_,
+      s_->threads_,
+      static_cast<double>(s_->bytes_) / 1e6,
+      s_->busy_ > 0 ? static_cast<double>(s_->bytes_) / 1e6 / s_->busy_ : 0.0,
+      all_ > 0 ? 100.0 * s_->busy_ / all_ : 0.0,
+      all_ > 0 ? 100.0 * s_->wait_ / all_ : 0.0);
+  }
+  return buf_;
+}
+
+/* SLPLoader ---------------------------------------------------------------- */
+
+namespace {
+
+double
+since(std::chrono::steady_clock::time_point t_)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t_)
+    .count();
+}
+
+} // namespace
+
+SLPLoader::SLPLoader(const SLPLoadConfig& cfg_)
+  : cfg_(cfg_)
+  , csv_(cfg_.format_, cfg_.ipText_)
+  , zoneMap_(cfg_.format_)
+  , store_(cfg_.format_)
+{
+  if (this->cfg_.threads_ == 0) {
+    this->cfg_.threads_ =
+      std::max<size_t>(std::thread::hardware_concurrency(), 1);
+  }
+  // The reads are aligned: whole pages into a page-aligned buffer.
+  this->cfg_.blockSize_ =
+    std::max((this->cfg_.blockSize_ + pageSize - 1) / pageSize, size_t(1)) *
+    pageSize;
+  this->cfg_.slots_ = std::max<size_t>(this->cfg_.slots_, 1);
+}
+
+/*!
+ * \brief Parses the files and writes their rows to out_, in the order of the
+ * files and of their lines. The lines that don't parse go to rejects_.
+ *
+ * The readers and the parsers (cfg_.threads_) are threads of their own and
+ * the caller is the writer. Without cfg_.readers_ there's one reader for the
+ * plain files, which are limited by the disk, and one per compressed source,
+ * up to half of the parsers, which are limited by the CPU.
+ */
+bool
+SLPLoader::run(const std::vector<std::string>& files_,
+               FILE* out_,
+               FILE* rejects_)
+{
+  const auto start_ = std::chrono::steady_clock::now();
+  stats_ = {};
+  error_.clear();
+  abort_ = false;
+  this->files_ = files_;
+
+  if (!plan()) {
+    return false;
+  }
+
+  size_t nr_ = cfg_.readers_;
+  if (nr_ == 0) {
+    const size_t compressed_ = static_cast<size_t>(
+      std::count_if(sources_.begin(), sources_.end(), [](const Source& s_) {
+        return s_.codec_ != Codec::Plain;
+      }));
+    nr_ = std::min(compressed_, cfg_.threads_ / 2);
+  }
+  nr_ = std::clamp<size_t>(nr_, 1, std::max<size_t>(sources_.size(), 1));
+
+  const size_t np_ = cfg_.threads_;
+  const size_t perReader_ =
+    std::max<size_t>((np_ * cfg_.slots_ + 2 + nr_ - 1) / nr_, 2);
+  const bool buffers_ =
+    std::any_of(sources_.begin(), sources_.end(), [](const Source& s_) {
+      return !s_.mapped_ || s_.codec_ != Codec::Plain;
+    });
+
+  readers_.clear();
+  for (size_t r_ = 0; r_ < nr_; ++r_) {
+    auto rd_ = std::make_unique<Reader>();
+    rd_->slots_.resize(perReader_);
+    rd_->free_ = std::make_unique<SLPSpscRing<Slot*>>(perReader_);
+    rd_->pending_.assign(perReader_, nullptr);
+    for (Slot& s_ : rd_->slots_) {
+      s_.reader_ = r_;
+      if (buffers_) {
+        s_.buf_.reset(static_cast<char*>(::operator new(
+          2 * cfg_.blockSize_, std::align_val_t(pageSize))));
+      }
+      s_.rows_.reserve(cfg_.blockSize_ + cfg_.blockSize_ / 4);
+      s_.batch_ = SLPColumnStore(cfg_.format_);
+      rd_->free_->push(&s_);
+    }
+    readers_.push_back(std::move(rd_));
+  }
+
+  while (parsers_.size() < np_ + 1) { // + 1: lines completed by the writer
+    parsers_.push_back(std::make_unique<SLPRowParser>(cfg_.format_));
+  }
+  parserStats_.assign(np_, {});
+
+  // Each ring can hold all the slots and the sentinels (nullptr) that end
+  // the parsers and the writer, so only the free_ rings ever block.
+  const size_t all_ = perReader_ * nr_ + np_;
+  full_ = std::make_unique<SLPMpmcRing<Slot*>>(all_);
+  parsed_ = std::make_unique<SLPMpmcRing<Slot*>>(all_);
+
+  store_.clear();
+
+  if (cfg_.header_) {
+    std::string h_;
+    csv_.header(h_);
+    std::fwrite(h_.data(), 1, h_.size(), out_);
+  }
+
+  nextSource_ = 0;
+  readersDone_ = 0;
+  std::vector<std::thread> threads_;
+  for (size_t i_ = 0; i_ < nr_; ++i_) {
+    threads_.emplace_back(&SLPLoader::reader, this, i_);
+  }
+  for (size_t i_ = 0; i_ < np_; ++i_) {
+    threads_.emplace_back(&SLPLoader::parser, this, i_);
+  }
+
+  const bool written_ = writer(out_, rejects_);
+
+  for (auto& t_ : threads_) {
+    t_.join();
+  }
+  maps_.clear();
+  if (!written_) {
+    setError("write error");
+  }
+  if (!cfg_.store_.empty() && error_.empty()) {
+    store_.sort();
+    if (!store_.save(cfg_.store_)) {
+      setError(store_.error());
+    }
+    stats_.stored_ = store_.size();
+  }
+  store_.clear();
+
+  stats_.read_.threads_ = nr_;
+  for (const auto& r_ : readers_) {
+    stats_.read_.bytes_ += r_->stats_.bytes_;
+    stats_.read_.busy_ += r_->stats_.busy_;
+    stats_.read_.wait_ += r_->stats_.wait_;
+    stats_.compressed_ += r_->compressed_;
+    stats_.blocks_ += r_->seq_;
+  }
+  stats_.parse_.threads_ = np_;
+  for (const auto& p_ : parserStats_) {
+    stats_.parse_.bytes_ += p_.bytes_;
+    stats_.parse_.busy_ += p_.busy_;
+    stats_.parse_.wait_ += p_.wait_;
+  }
+  stats_.files_ = files_.size();
+  stats_.sources_ = sources_.size();
+  stats_.bytes_ = stats_.read_.bytes_;
+  stats_.seconds_ = since(start_);
+
+  return error_.empty();
+}
+
+/*!
+ * \internal
+ * \brief Makes the list of sources. The compressed files (and the plain ones
+ * with --mmap) are mapped; a .zst of many frames is split in pieces of about
+ * cfg_.pieceSize_ bytes at frame boundaries.
+ */
+bool
+SLPLoader::plan()
+{
+  maps_.clear();
+  sources_.clear();
+  maps_.reserve(files_.size());
+
+  for (size_t f_ = 0; f_ < files_.size(); ++f_) {
+    const Codec c_ = SLPInput::codecOf(files_[f_]);
+    if (!SLPInput::supported(c_)) {
+      error_ = files_[f_] + ": " + SLPInput::nameOf(c_) +
+               " isn't supported by this build";
+      return false;
+    }
+
+    Source src_;
+    src_.file_ = f_;
+    src_.codec_ = c_;
+    if (c_ == Codec::Plain && !cfg_.mmap_) {
+      sources_.push_back(src_);
+      continue;
+    }
+
+    maps_.emplace_back();
+    if (!maps_.back().open(files_[f_])) {
+      error_ = maps_.back().error();
+      return false;
+    }
+    src_.data_ = maps_.back().view();
+    src_.mapped_ = true;
+
+    if (c_ != Codec::Zstd) {
+      sources_.push_back(src_);
+      continue;
+    }
+    const auto pieces_ = SLPZstdInput::pieces(src_.data_, cfg_.pieceSize_);
+    for (size_t i_ = 0; i_ < pieces_.size(); ++i_) {
+      src_.data_ = pieces_[i_];
+      src_.first_ = i_ == 0;
+      src_.last_ = i_ + 1 == pieces_.size();
+      sources_.push_back(src_);
+    }
+  }
+
+  readerOf_ = std::make_unique<std::atomic<int>[]>(sources_.size());
+  for (size_t i_ = 0; i_ < sources_.size(); ++i_) {
+    readerOf_[i_].store(-1, std::memory_order_relaxed);
+  }
+  return true;
+}
+
+void
+SLPLoader::setError(const std::string& e_)
+{
+  std::lock_guard<std::mutex> guard_(errorLock_);
+  if (error_.empty()) {
+    error_ = e_;
+  }
+}
+
+/* readers ------------------------------------------------------------------ */
+
+/*!
+ * \internal
+ * \brief Takes the sources in order until there are no more. The last reader
+ * to end ends the parsers.
+ */
+void
+SLPLoader::reader(size_t id_)
+{
+  Reader& r_ = *readers_[id_];
+  while (!abort_) {
+    const size_t src_ = nextSource_++;
+    if (src_ >= sources_.size()) {
+      break;
+    }
+    readerOf_[src_].store(static_cast<int>(id_), std::memory_order_release);
+    const bool ok_ = sources_[src_].mapped_ &&
+                         sources_[src_].codec_ == Codec::Plain
+                       ? readMapped(r_, src_)
+                       : readSource(r_, src_);
+    if (!ok_) {
+      abort_ = true;
+    }
+  }
+
+  if (++readersDone_ == readers_.size()) {
+    for (size_t i_ = 0; i_ < cfg_.threads_; ++i_) {
+      full_->push(nullptr);
+    }
+  }
+}
+
+/*!
+ * \internal
+ * \brief Waits for a slot written by the writer (back-pressure), or returns
+ * nullptr after an error: the writer is then stuck at the source that failed
+ * and won't recycle the slots of the next ones.
+ */
+SLPLoader::Slot*
+SLPLoader::acquire(Reader& r_)
+{
+  const auto t_ = std::chrono::steady_clock::now();
+  Slot* s_ = nullptr;
+  SLPBackoff b_;
+  while (!r_.free_->tryPop(s_)) {
+    if (abort_) {
+      r_.stats_.wait_ += since(t_);
+      return nullptr;
+    }
+    b_.pause();
+  }
+  r_.stats_.wait_ += since(t_);
+
+  s_->head_.clear();
+  s_->headEnd_ = false;
+  s_->tail_.clear();
+  return s_;
+}
+
+/*!
+ * \internal
+ * \brief Hands the slot to the parsers.
+ */
+void
+SLPLoader::release(Reader& r_, Slot* s_, size_t source_, bool end_)
+{
+  s_->source_ = source_;
+  s_->end_ = end_;
+  s_->seq_ = r_.seq_++;
+  full_->push(s_);
+}
+
+/*!
+ * \internal
+ * \brief Reads (or decompresses) the source in blocks of cfg_.blockSize_
+ * bytes into the second half of the buffer of a slot. The plain files are
+ * read at aligned offsets. The partial line at the end of a block is copied
+ * just before the next block, in the first half, so no line is split between
+ * two slots.
+ *
+ * The carry is never longer than a block: a line longer than a block is
+ * split (and rejected).
+ */
+bool
+SLPLoader::readSource(Reader& r_, size_t source_)
+{
+  const Source& so_ = sources_[source_];
+  std::unique_ptr<SLPInput> in_;
+  switch (so_.codec_) {
+    case Codec::Gzip: {
+      in_ = std::make_unique<SLPGzipInput>(so_.data_);
+      break;
+    }
+    case Codec::Zstd: {
+      in_ = std::make_unique<SLPZstdInput>(so_.data_);
+      break;
+    }
+    default: {
+      auto f_ = std::make_unique<SLPFileInput>(files_[so_.file_], cfg_.direct_);
+      if (!f_->isOpen()) {
+        setError(f_->error());
+        return false;
+      }
+      in_ = std::move(f_);
+    }
+  }
+
+  std::string carry_;
+  bool head_ = !so_.first_; // a piece begins in the middle of a line
+  bool eof_ = false;
+
+  while (!eof_) {
+    Slot* s_ = abort_ ? nullptr : acquire(r_);
+    if (s_ == nullptr) {
+      return true; // another reader failed
+    }
+    const auto t_ = std::chrono::steady_clock::now();
+    char* dst_ = s_->buf_.get() + cfg_.blockSize_;
+
+    const ssize_t n_ = in_->read(dst_, cfg_.blockSize_);
+    if (n_ < 0) {
+      setError(files_[so_.file_] + ": " + in_->error());
+      r_.free_->push(s_);
+      return false;
+    }
+    eof_ = static_cast<size_t>(n_) < cfg_.blockSize_;
+
+    char* begin_ = dst_ - carry_.size();
+    std::memcpy(begin_, carry_.data(), carry_.size());
+    std::string_view text_(begin_, carry_.size() + static_cast<size_t>(n_));
+
+    if (head_) {
+      const size_t nl_ = text_.find('\n');
+      s_->head_.assign(text_.substr(0, nl_));
+      s_->headEnd_ = nl_ != std::string_view::npos;
+      head_ = !s_->headEnd_;
+      text_.remove_prefix(std::min(text_.size(), nl_ + 1));
+    }
+
+    size_t cut_ = text_.size();
+    if (!eof_ || !so_.last_) {
+      const void* nl_ = ::memrchr(text_.data(), '\n', text_.size());
+      if (nl_ != nullptr) {
+        cut_ = static_cast<size_t>(static_cast<const char*>(nl_) -
+                                   text_.data()) +
+               1;
+      } else if (eof_ || text_.size() <= cfg_.blockSize_) {
+        cut_ = 0; // all of it goes to tail_ or to the next block
+      }
+    }
+    if (eof_) {
+      s_->tail_.assign(text_.substr(cut_)); // empty for the last piece
+      carry_.clear();
+    } else {
+      carry_.assign(text_.substr(cut_));
+    }
+    s_->text_ = text_.substr(0, cut_);
+
+    r_.stats_.bytes_ += static_cast<uint64_t>(n_);
+    r_.stats_.busy_ += since(t_);
+    release(r_, s_, source_, eof_);
+  }
+
+  if (so_.codec_ != Codec::Plain) {
+    r_.compressed_ += in_->consumed();
+  }
+  return true;
+}
+
+/*!
+ * \internal
+ * \brief --mmap: the slots point into the mapping, which is split at newline
+ * boundaries, and nothing is copied.
+ */
+bool
+SLPLoader::readMapped(Reader& r_, size_t source_)
+{
+  const auto t_ = std::chrono::steady_clock::now();
+  const auto chunks_ =
+    SLPMappedFile::split(sources_[source_].data_, cfg_.blockSize_);
+  r_.stats_.busy_ += since(t_);
+
+  if (chunks_.empty()) {
+    Slot* s_ = acquire(r_);
+    if (s_ != nullptr) {
+      s_->text_ = {};
+      release(r_, s_, source_, true);
+    }
+  }
+  for (size_t i_ = 0; i_ < chunks_.size() && !abort_; ++i_) {
+    Slot* s_ = acquire(r_);
+    if (s_ == nullptr) {
+      break;
+    }
+    s_->text_ = chunks_[i_];
+    r_.stats_.bytes_ += chunks_[i_].size();
+    release(r_, s_, source_, i_ + 1 == chunks_.size());
+  }
+  return true;
+}
+
+/* parsers ------------------------------------------------------------------ */
+
+void
+SLPLoader::parser(size_t id_)
+{
+  SLPRowParser& p_ = *parsers_[id_];
+  SLPLoadStats::Stage& st_ = parserStats_[id_];
+
+  for (;;) {
+    auto t_ = std::chrono::steady_clock::now();
+    Slot* s_ = nullptr;
+    full_->pop(s_);
+    st_.wait_ += since(t_);
+    if (s_ == nullptr) {
+      break;
+    }
+
+    t_ = std::chrono::steady_clock::now();
+    parseSlot(*s_, p_);
+    st_.bytes_ += s_->text_.size();
+    st_.busy_ += since(t_);
+    parsed_->push(s_);
+  }
+  parsed_->push(nullptr);
+}
+
+/*!
+ * \internal
+ * \brief Parses the lines of one slot into its CSV, with the parser of the
+ * thread.
+ */
+void
+SLPLoader::parseSlot(Slot& s_, SLPRowParser& p_) const
+{
+  s_.rows_.clear();
+  s_.rejects_.clear();
+  s_.lines_ = s_.written_ = s_.rejected_ = 0;
+  s_.minTs_ = std::numeric_limits<uint32_t>::max();
+  s_.maxTs_ = 0;
+  const bool store_ = !cfg_.store_.empty();
+  if (store_) {
+    s_.batch_.clear();
+  }
+
+  std::string_view rest_ = s_.text_;
+  std::string_view line_;
+  while (SLPMappedFile::nextLine(rest_, line_)) {
+    if (line_.empty()) {
+      continue;
+    }
+    ++s_.lines_;
+    if (p_.parse(line_)) {
+      csv_.row(s_.rows_, p_);
+      ++s_.written_;
+      s_.minTs_ = std::min(s_.minTs_, p_.timestamp());
+      s_.maxTs_ = std::max(s_.maxTs_, p_.timestamp());
+      if (store_) {
+        s_.batch_.append(p_);
+      }
+    } else {
+      s_.rejects_.append(line_.data(), line_.size());
+      s_.rejects_ += '\n';
+      ++s_.rejected_;
+    }
+  }
+}
+
+/* writer ------------------------------------------------------------------- */
+
+/*!
+ * \internal
+ * \brief Writes the sources in order and the slots of each one in the order
+ * they were read.
+ *
+ * The sequence numbers of a reader in flight are never more than its number
+ * of slots apart, so a slot waiting for the ones before it has a place of its
+ * own in pending_. The writer stops when all the sources are written or, after
+ * an error, when the parsers have ended: a reader that fails never ends its
+ * source, and the others stop waiting for slots (see acquire()), so all the
+ * readers end and then the parsers.
+ */
+bool
+SLPLoader::writer(FILE* out_, FILE* rejects_)
+{
+  SLPRowParser& stitcher_ = *parsers_.back();
+  std::string stitch_;
+  std::string row_;
+  size_t src_ = 0;
+  size_t ended_ = 0;
+  bool ok_ = true;
+
+  auto write_ = [&](std::string_view rows_, std::string_view rejects_text_) {
+    if (ok_ && std::fwrite(rows_.data(), 1, rows_.size(), out_) !=
+                 rows_.size()) {
+      ok_ = false;
+      abort_ = true;
+    }
+    if (ok_ && rejects_ != nullptr) {
+      std::fwrite(rejects_text_.data(), 1, rejects_text_.size(), rejects_);
+    }
+    stats_.write_.bytes_ += rows_.size();
+  };
+
+  // A line split between two pieces of a .zst.
+  auto stitched_ = [&]() {
+    std::string_view line_ = stitch_;
+    if (!line_.empty() && line_.back() == '\r') {
+      line_.remove_suffix(1);
+    }
+    if (!line_.empty()) {
+      ++stats_.lines_;
+      row_.clear();
+      if (stitcher_.parse(line_)) {
+        csv_.row(row_, stitcher_);
+        ++stats_.rows_;
+        write_(row_, {});
+        if (!cfg_.store_.empty()) {
+          store_.append(stitcher_);
+        }
+      } else {
+        stitch_ += '\n';
+        ++stats_.rejected_;
+        write_({}, stitch_);
+      }
+    }
+    stitch_.clear();
+  };
+
+  while (src_ < sources_.size() && ended_ < cfg_.threads_) {
+    auto t_ = std::chrono::steady_clock::now();
+    Slot* s_ = nullptr;
+    parsed_->pop(s_);
+    stats_.write_.wait_ += since(t_);
+    if (s_ == nullptr) {
+      ++ended_;
+    } else {
+      Reader& r_ = *readers_[s_->reader_];
+      r_.pending_[s_->seq_ % r_.pending_.size()] = s_;
+    }
+
+    t_ = std::chrono::steady_clock::now();
+    while (src_ < sources_.size()) {
+      const int id_ = readerOf_[src_].load(std::memory_order_acquire);
+      if (id_ < 0) {
+        break;
+      }
+      Reader& r_ = *readers_[static_cast<size_t>(id_)];
+      Slot*& p_ = r_.pending_[r_.next_ % r_.pending_.size()];
+      if (p_ == nullptr) {
+        break;
+      }
+
+      stitch_ += p_->head_;
+      if (p_->headEnd_) {
+        stitched_();
+      }
+      write_(p_->rows_, p_->rejects_);
+      if (!cfg_.store_.empty()) {
+        store_.append(p_->batch_);
+      }
+      stats_.lines_ += p_->lines_;
+      stats_.rows_ += p_->written_;
+      stats_.rejected_ += p_->rejected_;
+      stitch_ += p_->tail_;
+
+      const Source& so_ = sources_[src_];
+      if (cfg_.zoneMap_ && so_.codec_ == Codec::Plain &&
+          !p_->text_.empty()) {
+        SLPZoneMap::Zone z_;
+        z_.offset_ = zoneMap_.covered();
+        z_.bytes_ = p_->text_.size();
+        z_.lines_ = static_cast<uint32_t>(p_->lines_);
+        z_.minTs_ = p_->minTs_;
+        z_.maxTs_ = p_->maxTs_;
+        zoneMap_.add(z_);
+      }
+
+      if (p_->end_) {
+        if (so_.last_ && !stitch_.empty()) {
+          stitched_(); // the file ends in a piece without '\n'
+        }
+        if (cfg_.zoneMap_ && so_.codec_ == Codec::Plain) {
+          if (zoneMap_.save(files_[so_.file_])) {
+            ++stats_.zoneMaps_;
+          } else {
+            setError(zoneMap_.error()); // the CSV is still complete
+          }
+          zoneMap_.clear();
+        }
+        ++src_;
+      }
+      r_.free_->push(p_);
+      p_ = nullptr;
+      ++r_.next_;
+    }
+    stats_.write_.busy_ += since(t_);
+  }
+
+  const auto t_ = std::chrono::steady_clock::now();
+  if (std::fflush(out_) != 0) {
+    ok_ = false;
+  }
+  stats_.write_.busy_ += since(t_);
+  return ok_;
+}
+
+} // namespace squidlogparser
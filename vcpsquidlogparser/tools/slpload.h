@@ -0,0 +1,304 @@
+/***************************************************************************
+ * Copyright (c) 2020-22                                                   *
+ *      Volnei Cervi Puttini.  All rights reserved.                        *
+ *      vcputtini@gmail.com
+ *                                                                         *
+ * Redistribution and use in source and binary forms, with or without      *
+ * modification, are permitted provided that the following conditions      *
+ * are met:                                                                *
+ * 1. Redistributions of source code must retain the above copyright       *
+ *    notice, this list of conditions and the following disclaimer.        *
+ * 2. Redistributions in binary form must reproduce the above copyright    *
+ *    notice, this list of conditions and the following disclaimer in the  *
+ *    documentation and/or other materials provided with the distribution. *
+ * 4. Neither the name of the Author     nor the names of its contributors *
+ *    may be used to endorse or promote products derived from this software*
+ *    without specific prior written permission.                           *
+ *                                                                         *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND *
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR      *
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS  *
+ * BE LIABLEFOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   *
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF    *
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS*
+ * INTERRUPTION)                                                           *
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,     *
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING   *
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE      *
+ * POSSIBILITY OFSUCH DAMAGE.                                              *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*!
+ * \brief How this file is organized:
+ *
+ * Bulk loader: parses whole access-log files once, outside of the server,
+ * and writes typed CSV for LOAD DATA INFILE.
+ *
+ * class SLPCsvFormat: columns of each log format, the CSV rows and the SQL
+ *                     (CREATE TABLE and LOAD DATA) that reads them.
+ * struct SLPLoadConfig, SLPLoadStats
+ * class SLPLoader: reads (or decompresses) the files, parses them on a pool
+ *                  of threads and writes the rows in the order of the
+ *                  input.
+ */
+
+#ifndef SLPLOAD_H
+#define SLPLOAD_H
+
+#include <cstdio>
+
+#include "slpcolumns.h"
+#include "slpinput.h"
+#include "slpscan.h"
+#include "slpzonemap.h"
+#include "squidlogparser.h"
+
+namespace squidlogparser {
+
+/* SLPCsvFormat ------------------------------------------------------------- */
+
+class SLPCsvFormat
+{
+public:
+  using LogFormat = SquidLogData::LogFormat;
+  using Fields = SquidLogData::Fields;
+
+  /*!
+   * \brief How a column is taken from the parser and written.
+   */
+  enum class Kind
+  {
+    Timestamp = 0x00, // Unix timestamp (also of the formats with %tl)
+    Int,              // getPartInt()
+    Ip,               // number, or text with ipText_
+    Str,              // quoted, "-" is NULL
+    SquidStatus       // HTTP status of %Ss/%03>Hs (squid)
+  };
+
+  struct Column
+  {
+    const char* name_;
+    const char* sqlType_;
+    Kind kind_;
+    Fields field_;
+  };
+
+  explicit SLPCsvFormat(LogFormat f_, bool ipText_ = false);
+
+  const std::vector<Column>& columns() const noexcept { return columns_; }
+
+  void header(std::string& out_) const;
+  void row(std::string& out_, const SLPRowParser& p_) const;
+  std::string sql(const std::string& table_, const std::string& file_) const;
+
+  static void appendQuoted(std::string& out_, std::string_view s_);
+  static void appendUInt(std::string& out_, uint64_t v_);
+  static void appendInt(std::string& out_, int64_t v_);
+
+private:
+  std::vector<Column> columns_ = {};
+  bool ipText_ = false;
+};
+
+/* SLPLoader ---------------------------------------------------------------- */
+
+struct SLPLoadConfig
+{
+  using LogFormat = SquidLogData::LogFormat;
+
+  LogFormat format_ = LogFormat::Squid;
+  size_t threads_ = 0;          // parsers, 0: hardware_concurrency()
+  size_t readers_ = 0;          // 0: see SLPLoader::run()
+  size_t blockSize_ = 1 << 20;  // bytes per read, multiple of the page
+  size_t slots_ = 4;            // blocks in flight per parser
+  size_t pieceSize_ = 16 << 20; // compressed bytes per piece of a .zst
+  bool mmap_ = false;           // map the plain files instead of reading
+  bool direct_ = false;         // O_DIRECT, if the file system supports it
+  bool ipText_ = false;
+  bool header_ = false;
+  bool zoneMap_ = false; // write FILE.slpz of each plain file, see SLPZoneMap
+  std::string store_ = {}; // also write the rows as a SLPColumnStore
+};
+
+struct SLPLoadStats
+{
+  /*!
+   * \brief Time of one stage: busy doing its work or waiting for the stage
+   * before (empty ring) or after it (full ring).
+   */
+  struct Stage
+  {
+    uint64_t bytes_ = 0;
+    double busy_ = 0.0; // summed over the threads of the stage
+    double wait_ = 0.0;
+    size_t threads_ = 1;
+  };
+
+  uint64_t files_ = 0;
+  uint64_t bytes_ = 0;      // uncompressed
+  uint64_t compressed_ = 0; // read from the compressed files
+  uint64_t lines_ = 0;      // not empty
+  uint64_t rows_ = 0;       // written
+  uint64_t rejected_ = 0;   // didn't parse
+  uint64_t sources_ = 0;    // files and pieces of .zst files
+  uint64_t blocks_ = 0;
+  uint64_t zoneMaps_ = 0;
+  uint64_t stored_ = 0; // rows of the column store
+  double seconds_ = 0.0;
+
+  Stage read_ = {}; // read and decompress
+  Stage parse_ = {};
+  Stage write_ = {};
+
+  std::string toText() const;
+};
+
+/*!
+ * \brief Three stages connected by bounded rings:
+ *
+ * \verbatim
+ * readers --full_ (MPMC)--> parsers --parsed_ (MPMC)--> writer
+ *    ^                                                     |
+ *    +----------------- free_ (SPSC, per reader) ----------+
+ * \endverbatim
+ *
+ * The input is a list of sources: the files, and the pieces of the .zst files
+ * of many frames. The readers take the sources in order and read (or
+ * decompress) each one into the slots of the reader, in blocks cut at newline
+ * boundaries. A slot carries a block of the input and its CSV.
+ *
+ * The slots are only recycled by the writer, which writes the sources in
+ * order. So the slots of a reader bound both its memory and the distance
+ * between its oldest block not written and its newest one read, and a reader
+ * ahead of the others can't take the slots of the source being written.
+ *
+ * A line split between two pieces of a .zst is completed and parsed by the
+ * writer: the first piece leaves its last partial line in tail_, the next one
+ * its first partial line in head_.
+ *
+ * The writer also builds the zone map of the plain files: the slots of a
+ * plain file cover it in order and without gaps, so each one is a zone. And
+ * it appends the batches of columns of the slots to the column store, which
+ * is sorted and saved at the end (so it's kept in memory until then).
+ */
+class SLPLoader
+{
+public:
+  explicit SLPLoader(const SLPLoadConfig& cfg_);
+
+  SLPLoader(const SLPLoader&) = delete;
+  SLPLoader& operator=(const SLPLoader&) = delete;
+
+  bool run(const std::vector<std::string>& files_,
+           FILE* out_,
+           FILE* rejects_ = nullptr);
+
+  const SLPLoadStats& stats() const noexcept { return stats_; }
+  const std::string& error() const noexcept { return error_; }
+
+  static constexpr size_t pageSize = 4096; // alignment of the reads
+
+private:
+  using Codec = SLPInput::Codec;
+
+  struct Source
+  {
+    size_t file_ = 0;
+    Codec codec_ = Codec::Plain;
+    std::string_view data_ = {}; // mapped; empty for the plain files read
+    bool mapped_ = false;
+    bool first_ = true; // first piece of the file
+    bool last_ = true;  // last piece of the file
+  };
+
+  struct AlignedDelete
+  {
+    void operator()(char* p_) const
+    {
+      ::operator delete(p_, std::align_val_t(pageSize));
+    }
+  };
+
+  struct Slot
+  {
+    size_t reader_ = 0;
+    uint64_t seq_ = 0; // of the reader
+    size_t source_ = 0;
+    bool end_ = false; // last slot of the source
+
+    // 2 * blockSize_: carry of the last line + read
+    std::unique_ptr<char, AlignedDelete> buf_ = {};
+    std::string_view text_ = {};
+
+    std::string head_ = {}; // pieces of a .zst, see above
+    bool headEnd_ = false;
+    std::string tail_ = {};
+
+    std::string rows_ = {};
+    std::string rejects_ = {};
+    uint64_t lines_ = 0;
+    uint64_t written_ = 0;
+    uint64_t rejected_ = 0;
+    uint32_t minTs_ = 0; // of the lines parsed, for the zone map
+    uint32_t maxTs_ = 0;
+    SLPColumnStore batch_; // rows of the slot, for cfg_.store_
+  };
+
+  struct Reader
+  {
+    std::vector<Slot> slots_ = {};
+    std::unique_ptr<SLPSpscRing<Slot*>> free_ = {};
+    uint64_t seq_ = 0;
+    SLPLoadStats::Stage stats_ = {};
+    uint64_t compressed_ = 0;
+
+    std::vector<Slot*> pending_ = {}; // writer: slots by seq_
+    uint64_t next_ = 0;               // writer: next seq_ to write
+  };
+
+  SLPLoadConfig cfg_;
+  SLPCsvFormat csv_;
+  SLPLoadStats stats_ = {};
+  std::string error_ = {};
+  std::mutex errorLock_;
+  std::atomic<bool> abort_ = { false };
+
+  std::vector<std::string> files_ = {};
+  std::vector<SLPMappedFile> maps_ = {};
+  std::vector<Source> sources_ = {};
+  std::unique_ptr<std::atomic<int>[]> readerOf_ = {};
+  std::atomic<size_t> nextSource_ = { 0 };
+  std::atomic<size_t> readersDone_ = { 0 };
+
+  std::vector<std::unique_ptr<Reader>> readers_ = {};
+  std::vector<std::unique_ptr<SLPRowParser>> parsers_ = {};
+  std::vector<SLPLoadStats::Stage> parserStats_ = {};
+  std::unique_ptr<SLPMpmcRing<Slot*>> full_ = {};
+  std::unique_ptr<SLPMpmcRing<Slot*>> parsed_ = {};
+  SLPZoneMap zoneMap_; // of the file being written
+  SLPColumnStore store_;
+
+  bool plan();
+  void setError(const std::string& e_);
+
+  void reader(size_t id_);
+  bool readSource(Reader& r_, size_t source_);
+  bool readMapped(Reader& r_, size_t source_);
+  Slot* acquire(Reader& r_);
+  void release(Reader& r_, Slot* s_, size_t source_, bool end_);
+
+  void parser(size_t id_);
+  void parseSlot(Slot& s_, SLPRowParser& p_) const;
+
+  bool writer(FILE* out_, FILE* rejects_);
+};
+
+} // namespace squidlogparser
+
+#endif // SLPLOAD_H
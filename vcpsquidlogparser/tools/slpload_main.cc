@@ -0,0 +1,322 @@
+/***************************************************************************
+ * Copyright (c) 2020-22                                                   *
+ *      Volnei Cervi Puttini.  All rights reserved.                        *
+ *      vcputtini@gmail.com
+ *                                                                         *
+ * Redistribution and use in source and binary forms, with or without      *
+ * modification, are permitted provided that the following conditions      *
+ * are met:                                                                *
+ * 1. Redistributions of source code must retain the above copyright       *
+ *    notice, this list of conditions and the following disclaimer.        *
+ * 2. Redistributions in binary form must reproduce the above copyright    *
+ *    notice, this list of conditions and the following disclaimer in the  *
+ *    documentation and/or other materials provided with the distribution. *
+ * 4. Neither the name of the Author     nor the names of its contributors *
+ *    may be used to endorse or promote products derived from this software*
+ *    without specific prior written permission.                           *
+ *                                                                         *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND *
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR      *
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS  *
+ * BE LIABLEFOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   *
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF    *
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS*
+ * INTERRUPTION)                                                           *
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,     *
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING   *
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE      *
+ * POSSIBILITY OFSUCH DAMAGE.                                              *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*!
+ * \brief slpload: parses access-log files in parallel and writes typed CSV
+ * for LOAD DATA INFILE. With --follow, it follows a live log instead.
+ */
+
+#include "slpload.h"
+#include "slptail.h"
+
+#include <csignal>
+#include <cstdlib>
+
+using namespace squidlogparser;
+
+namespace {
+
+void
+usage()
+{
+  std::fprintf(
+    stderr,
+    "Usage: slpload [options] FILE...\n"
+    "       slpload [options] --follow FILE\n"
+    "  FILE may be plain, gzip or zstd compressed (by its magic number)\n"
+    "  --format F         squid | common | combined | referrer | useragent\n"
+    "                     (default: squid)\n"
+    "  --output FILE      CSV, default: stdout\n"
+    "  --rejects FILE     lines that don't parse\n"
+    "  --threads N        parser threads, default: number of cores\n"
+    "  --readers N        reader/decompressor threads (default: 1 for\n"
+    "                     plain files, 1 per compressed file up to half\n"
+    "                     of the parser threads)\n"
+    "  --block SIZE       bytes per read, e.g. 4M (default: 1M)\n"
+    "  --slots N          blocks in flight per parser (default: 4)\n"
+    "  --piece SIZE       split .zst files of many frames in pieces of\n"
+    "                     SIZE compressed bytes (default: 16M)\n"
+    "  --mmap             map the plain files instead of reading them\n"
+    "  --direct           read with O_DIRECT (bypass the page cache)\n"
+    "  --zonemap          write FILE.slpz, the min/max time of each block\n"
+    "                     of each plain FILE, for the scans of a time window\n"
+    "  --store FILE       also write the rows to FILE as a column store,\n"
+    "                     sorted by time (see slpcolumns.h)\n"
+    "  --ip-text          client_ip as a.b.c.d instead of a number\n"
+    "  --header           first row with the names of the columns\n"
+    "  --sql TABLE        print CREATE TABLE and LOAD DATA and exit\n"
+    "Follow mode:\n"
+    "  --follow FILE      parse what's appended to FILE, across rotations\n"
+    "  --checkpoint FILE  offset of the last batch, to resume from\n"
+    "  --batch-dir DIR    one CSV file per batch instead of --output\n"
+    "                     (--output may be a file or a fifo)\n"
+    "  --interval MS      maximum lag of a batch (default: 1000)\n"
+    "  --max-batch SIZE   CSV bytes that end a batch (default: 16M)\n"
+    "  --from-end         without checkpoint, skip what's in FILE\n"
+    "  --verbose          print the counters and the throughput of the\n"
+    "                     read, parse and write stages to stderr\n");
+}
+
+std::atomic<bool> stop_ = { false };
+
+void
+onSignal(int)
+{
+  stop_ = true;
+}
+
+bool
+parseSize(const char* s_, uint64_t& out_)
+{
+  char* end_ = nullptr;
+  out_ = std::strtoull(s_, &end_, 10);
+  switch (*end_) {
+    case 'G':
+    case 'g':
+      out_ <<= 10;
+      [[fallthrough]];
+    case 'M':
+    case 'm':
+      out_ <<= 10;
+      [[fallthrough]];
+    case 'K':
+    case 'k':
+      out_ <<= 10;
+      ++end_;
+      break;
+    default:
+      break;
+  }
+  return *end_ == '\0' && out_ > 0;
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+  using LogFormat = SquidLogData::LogFormat;
+
+  SLPLoadConfig cfg_;
+  std::vector<std::string> files_;
+  std::string output_ = {};
+  std::string rejects_ = {};
+  std::string table_ = {};
+  SLPTailConfig tail_;
+  bool verbose_ = false;
+
+  for (int i_ = 1; i_ < argc; ++i_) {
+    const std::string arg_ = argv[i_];
+    if (arg_.rfind("--", 0) != 0) {
+      files_.push_back(arg_);
+      continue;
+    }
+    if (arg_ == "--verbose") {
+      verbose_ = true;
+      continue;
+    }
+    if (arg_ == "--ip-text") {
+      cfg_.ipText_ = true;
+      continue;
+    }
+    if (arg_ == "--header") {
+      cfg_.header_ = true;
+      continue;
+    }
+    if (arg_ == "--mmap") {
+      cfg_.mmap_ = true;
+      continue;
+    }
+    if (arg_ == "--direct") {
+      cfg_.direct_ = true;
+      continue;
+    }
+    if (arg_ == "--zonemap") {
+      cfg_.zoneMap_ = true;
+      continue;
+    }
+    if (arg_ == "--from-end") {
+      tail_.fromEnd_ = true;
+      continue;
+    }
+    const char* val_ = i_ + 1 < argc ? argv[i_ + 1] : nullptr;
+    if (val_ == nullptr) {
+      usage();
+      return EXIT_FAILURE;
+    }
+    ++i_;
+    bool ok_ = true;
+    uint64_t n_ = 0;
+
+    if (arg_ == "--format") {
+      const std::string f_ = val_;
+      cfg_.format_ = f_ == "squid"       ? LogFormat::Squid
+                     : f_ == "common"    ? LogFormat::Common
+                     : f_ == "combined"  ? LogFormat::Combined
+                     : f_ == "referrer"  ? LogFormat::Referrer
+                     : f_ == "useragent" ? LogFormat::UserAgent
+                                         : LogFormat::Unknown;
+      ok_ = cfg_.format_ != LogFormat::Unknown;
+    } else if (arg_ == "--output") {
+      output_ = val_;
+    } else if (arg_ == "--store") {
+      cfg_.store_ = val_;
+    } else if (arg_ == "--rejects") {
+      rejects_ = val_;
+    } else if (arg_ == "--threads") {
+      cfg_.threads_ = std::strtoul(val_, nullptr, 10);
+      ok_ = cfg_.threads_ > 0;
+    } else if (arg_ == "--readers") {
+      cfg_.readers_ = std::strtoul(val_, nullptr, 10);
+      ok_ = cfg_.readers_ > 0;
+    } else if (arg_ == "--piece") {
+      ok_ = parseSize(val_, n_);
+      cfg_.pieceSize_ = n_;
+    } else if (arg_ == "--block") {
+      ok_ = parseSize(val_, n_);
+      cfg_.blockSize_ = n_;
+    } else if (arg_ == "--slots") {
+      cfg_.slots_ = std::strtoul(val_, nullptr, 10);
+      ok_ = cfg_.slots_ > 0;
+    } else if (arg_ == "--sql") {
+      table_ = val_;
+    } else if (arg_ == "--follow") {
+      tail_.path_ = val_;
+    } else if (arg_ == "--checkpoint") {
+      tail_.checkpoint_ = val_;
+    } else if (arg_ == "--batch-dir") {
+      tail_.batchDir_ = val_;
+    } else if (arg_ == "--interval") {
+      tail_.intervalMs_ =
+        static_cast<unsigned>(std::strtoul(val_, nullptr, 10));
+      ok_ = tail_.intervalMs_ > 0;
+    } else if (arg_ == "--max-batch") {
+      ok_ = parseSize(val_, n_);
+      tail_.maxBatch_ = n_;
+    } else {
+      ok_ = false;
+    }
+
+    if (!ok_) {
+      std::fprintf(stderr, "slpload: invalid option: %s %s\n", arg_.c_str(),
+                   val_);
+      usage();
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (!table_.empty()) {
+    const std::string sql_ = SLPCsvFormat(cfg_.format_, cfg_.ipText_)
+                               .sql(table_, output_.empty() ? "-" : output_);
+    std::fputs(sql_.c_str(), stdout);
+    return EXIT_SUCCESS;
+  }
+
+  if (!tail_.path_.empty()) {
+    if (!files_.empty()) {
+      usage();
+      return EXIT_FAILURE;
+    }
+    tail_.format_ = cfg_.format_;
+    tail_.ipText_ = cfg_.ipText_;
+    tail_.output_ = output_;
+    tail_.rejects_ = rejects_;
+    tail_.verbose_ = verbose_;
+
+    struct sigaction sa_ = {};
+    sa_.sa_handler = onSignal; // no SA_RESTART: poll() returns
+    ::sigaction(SIGINT, &sa_, nullptr);
+    ::sigaction(SIGTERM, &sa_, nullptr);
+
+    SLPTailer tailer_(tail_);
+    if (!tailer_.run(stop_)) {
+      std::fprintf(stderr, "slpload: %s\n", tailer_.error().c_str());
+      return EXIT_FAILURE;
+    }
+    if (verbose_) {
+      const SLPTailStats& st_ = tailer_.stats();
+      std::fprintf(stderr,
+                   "slpload: %llu batches, %llu lines, %llu rows, "
+                   "%llu rejected, %llu rotations\n",
+                   static_cast<unsigned long long>(st_.batches_),
+                   static_cast<unsigned long long>(st_.lines_),
+                   static_cast<unsigned long long>(st_.rows_),
+                   static_cast<unsigned long long>(st_.rejected_),
+                   static_cast<unsigned long long>(st_.rotations_));
+    }
+    return EXIT_SUCCESS;
+  }
+
+  if (files_.empty()) {
+    usage();
+    return EXIT_FAILURE;
+  }
+
+  FILE* out_ = stdout;
+  if (!output_.empty()) {
+    out_ = std::fopen(output_.c_str(), "wb");
+    if (out_ == nullptr) {
+      std::fprintf(stderr, "slpload: can't open %s\n", output_.c_str());
+      return EXIT_FAILURE;
+    }
+  }
+  FILE* rej_ = nullptr;
+  if (!rejects_.empty()) {
+    rej_ = std::fopen(rejects_.c_str(), "wb");
+    if (rej_ == nullptr) {
+      std::fprintf(stderr, "slpload: can't open %s\n", rejects_.c_str());
+      return EXIT_FAILURE;
+    }
+  }
+
+  SLPLoader loader_(cfg_);
+  const bool ok_ = loader_.run(files_, out_, rej_);
+
+  if (out_ != stdout) {
+    std::fclose(out_);
+  }
+  if (rej_ != nullptr) {
+    std::fclose(rej_);
+  }
+  if (!ok_) {
+    std::fprintf(stderr, "slpload: %s\n", loader_.error().c_str());
+    return EXIT_FAILURE;
+  }
+  if (verbose_) {
+    std::fprintf(stderr, "slpload: %s", loader_.stats().toText().c_str());
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,535 @@
+/***************************************************************************
+ * Copyright (c) 2020-22                                                   *
+ *      Volnei Cervi Puttini.  All rights reserved.                        *
+ *      vcputtini@gmail.com
+ *                                                                         *
+ * Redistribution and use in source and binary forms, with or without      *
+ * modification, are permitted provided that the following conditions      *
+ * are met:                                                                *
+ * 1. Redistributions of source code must retain the above copyright       *
+ *    notice, this list of conditions and the following disclaimer.        *
+ * 2. Redistributions in binary form must reproduce the above copyright    *
+ *    notice, this list of conditions and the following disclaimer in the  *
+ *    documentation and/or other materials provided with the distribution. *
+ * 4. Neither the name of the Author     nor the names of its contributors *
+ *    may be used to endorse or promote products derived from this software*
+ *    without specific prior written permission.                           *
+ *                                                                         *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND *
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR      *
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS  *
+ * BE LIABLEFOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   *
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF    *
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS*
+ * INTERRUPTION)                                                           *
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,     *
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING   *
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE      *
+ * POSSIBILITY OFSUCH DAMAGE.                                              *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "slptail.h"
+
+#include <cerrno>
+#include <cinttypes>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace squidlogparser {
+
+namespace {
+
+std::string
+dirOf(const std::string& path_)
+{
+  const size_t slash_ = path_.rfind('/');
+  if (slash_ == std::string::npos) {
+    return ".";
+  }
+  return slash_ == 0 ? "/" : path_.substr(0, slash_);
+}
+
+} // namespace
+
+SLPTailer::SLPTailer(const SLPTailConfig& cfg_)
+  : cfg_(cfg_)
+  , parser_(cfg_.format_)
+  , csv_(cfg_.format_, cfg_.ipText_)
+  , buf_(1 << 20)
+{}
+
+SLPTailer::~SLPTailer()
+{
+  closeLog();
+  for (const int f_ : { inotify_, out_, rejectsFd_ }) {
+    if (f_ > STDERR_FILENO) {
+      ::close(f_);
+    }
+  }
+}
+
+/*!
+ * \brief Follows the log until stop_ is set (e.g. by SIGTERM), then reads
+ * what's left, writes the last batch and checkpoints it.
+ *
+ * The batches are written at least once: a crash between a batch and its
+ * checkpoint writes that batch again after the restart.
+ */
+bool
+SLPTailer::run(const std::atomic<bool>& stop_)
+{
+  if (!start()) {
+    return false;
+  }
+
+  auto flushed_ = std::chrono::steady_clock::now();
+  while (!stop_) {
+    bool more_ = false;
+    if (!follow(more_)) {
+      return false;
+    }
+
+    const auto now_ = std::chrono::steady_clock::now();
+    const auto interval_ = std::chrono::milliseconds(cfg_.intervalMs_);
+    const bool due_ = batchLines_ > 0 ? now_ - first_ >= interval_
+                                      : pending_ && now_ - flushed_ >= interval_;
+    if (due_ || rows_.size() >= cfg_.maxBatch_) {
+      if (!flush()) {
+        return false;
+      }
+      flushed_ = now_;
+    }
+    if (more_) {
+      continue; // a backlog: read on without waiting
+    }
+
+    // Until the log changes or the batch is due.
+    int timeout_ = static_cast<int>(cfg_.intervalMs_);
+    if (batchLines_ > 0) {
+      const auto left_ = std::chrono::duration_cast<std::chrono::milliseconds>(
+        first_ + interval_ - now_);
+      timeout_ = static_cast<int>(std::max<int64_t>(left_.count(), 1));
+    }
+    if (inotify_ >= 0) {
+      struct pollfd p_ = { inotify_, POLLIN, 0 };
+      if (::poll(&p_, 1, timeout_) > 0) {
+        alignas(struct inotify_event) char ev_[4096];
+        while (::read(inotify_, ev_, sizeof(ev_)) > 0) {
+          // Only that something changed matters, follow() finds out what.
+        }
+      }
+    } else {
+      ::poll(nullptr, 0, std::min(timeout_, 200));
+    }
+  }
+
+  bool more_ = true;
+  while (more_) {
+    if (!readNew(more_) || !flush()) {
+      return false;
+    }
+  }
+  return flush();
+}
+
+/*!
+ * \internal
+ * \brief Opens the outputs and the log, at the checkpoint if there's one.
+ *
+ * If the log was rotated while slpload was down, the file of the checkpoint
+ * is looked for as <log>.1, read to its end and then the new log is read.
+ */
+bool
+SLPTailer::start()
+{
+  if (cfg_.batchDir_.empty()) {
+    out_ = cfg_.output_.empty()
+             ? STDOUT_FILENO
+             : ::open(cfg_.output_.c_str(),
+                      O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC,
+                      0644);
+    if (out_ < 0) {
+      error_ = cfg_.output_ + ": " + std::strerror(errno);
+      return false;
+    }
+  }
+  if (!cfg_.rejects_.empty()) {
+    rejectsFd_ = ::open(cfg_.rejects_.c_str(),
+                        O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC,
+                        0644);
+    if (rejectsFd_ < 0) {
+      error_ = cfg_.rejects_ + ": " + std::strerror(errno);
+      return false;
+    }
+  }
+
+  // The directory is watched, not the file: the rotation replaces the file.
+  inotify_ = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (inotify_ >= 0 &&
+      ::inotify_add_watch(inotify_,
+                          dirOf(cfg_.path_).c_str(),
+                          IN_MODIFY | IN_CREATE | IN_MOVED_TO | IN_MOVED_FROM |
+                            IN_DELETE | IN_CLOSE_WRITE) < 0) {
+    ::close(inotify_);
+    inotify_ = -1; // polled instead
+  }
+
+  struct stat st_ = {};
+  const bool exists_ = ::stat(cfg_.path_.c_str(), &st_) == 0;
+  Checkpoint c_;
+  if (loadCheckpoint(c_)) {
+    batch_ = c_.batch_;
+    struct stat old_ = {};
+    const std::string rotated_ = cfg_.path_ + ".1";
+    if (exists_ && st_.st_dev == c_.dev_ && st_.st_ino == c_.ino_) {
+      // Shorter than the checkpoint: truncated in place while down.
+      return openLog(cfg_.path_, c_.offset_ <= st_.st_size ? c_.offset_ : 0);
+    }
+    if (::stat(rotated_.c_str(), &old_) == 0 && old_.st_dev == c_.dev_ &&
+        old_.st_ino == c_.ino_) {
+      return openLog(rotated_, c_.offset_); // follow() moves to the log
+    }
+  }
+  if (!exists_) {
+    return true; // follow() opens it when it's created
+  }
+  return openLog(cfg_.path_, cfg_.fromEnd_ ? st_.st_size : 0);
+}
+
+bool
+SLPTailer::openLog(const std::string& path_, off_t offset_)
+{
+  closeLog();
+  fd_ = ::open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat st_ = {};
+  if (fd_ < 0 || ::fstat(fd_, &st_) != 0) {
+    error_ = path_ + ": " + std::strerror(errno);
+    return false;
+  }
+  dev_ = st_.st_dev;
+  ino_ = st_.st_ino;
+  this->offset_ = offset_;
+  carry_.clear();
+  return true;
+}
+
+void
+SLPTailer::closeLog() noexcept
+{
+  if (fd_ >= 0) {
+    ::close(fd_);
+  }
+  fd_ = -1;
+}
+
+/*!
+ * \internal
+ * \brief Reads and parses what was appended to the log. Stops early, with
+ * more_ set, when the batch is full.
+ */
+bool
+SLPTailer::readNew(bool& more_)
+{
+  more_ = false;
+  while (fd_ >= 0) {
+    const ssize_t n_ = ::pread(fd_, buf_.data(), buf_.size(), offset_);
+    if (n_ < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      error_ = cfg_.path_ + ": " + std::strerror(errno);
+      return false;
+    }
+    if (n_ == 0) {
+      break;
+    }
+    offset_ += n_;
+    stats_.bytes_ += static_cast<uint64_t>(n_);
+    pending_ = true;
+    consume(std::string_view(buf_.data(), static_cast<size_t>(n_)), false);
+    if (rows_.size() >= cfg_.maxBatch_) {
+      more_ = true;
+      break;
+    }
+  }
+  return true;
+}
+
+/*!
+ * \internal
+ * \brief Reads the new bytes and checks the path: a new inode is a rotation
+ * and a file shorter than what was read was truncated (copytruncate).
+ */
+bool
+SLPTailer::follow(bool& more_)
+{
+  if (!readNew(more_)) {
+    return false;
+  }
+  if (more_) {
+    return true;
+  }
+
+  struct stat st_ = {};
+  if (::stat(cfg_.path_.c_str(), &st_) != 0) {
+    return true; // moved and not created yet: keep reading the old one
+  }
+  if (fd_ < 0) {
+    return openLog(cfg_.path_, 0);
+  }
+
+  if (st_.st_dev != dev_ || st_.st_ino != ino_) {
+    // The old file is over. Its last line may have no '\n'.
+    do {
+      if (!readNew(more_) || !flush()) {
+        return false;
+      }
+    } while (more_);
+    consume({}, true);
+    if (!flush() || !openLog(cfg_.path_, 0)) {
+      return false;
+    }
+    ++stats_.rotations_;
+    pending_ = true; // checkpoint the new inode
+    more_ = true;
+  } else if (st_.st_size < offset_) {
+    carry_.clear();
+    offset_ = 0;
+    ++stats_.rotations_;
+    pending_ = true;
+    more_ = true;
+  }
+  return true;
+}
+
+/*!
+ * \internal
+ * \brief Splits data_ in lines; the partial line at its end waits in carry_
+ * for the rest, unless end_ (the file is over).
+ */
+void
+SLPTailer::consume(std::string_view data_, bool end_)
+{
+  size_t pos_ = 0;
+  if (!carry_.empty()) {
+    const size_t nl_ = data_.find('\n');
+    carry_.append(data_.substr(0, nl_));
+    if (nl_ == std::string_view::npos) {
+      pos_ = data_.size();
+    } else {
+      parseLine(carry_);
+      carry_.clear();
+      pos_ = nl_ + 1;
+    }
+  }
+  while (pos_ < data_.size()) {
+    const size_t nl_ = data_.find('\n', pos_);
+    if (nl_ == std::string_view::npos) {
+      carry_.assign(data_.substr(pos_));
+      break;
+    }
+    parseLine(data_.substr(pos_, nl_ - pos_));
+    pos_ = nl_ + 1;
+  }
+  if (end_ && !carry_.empty()) {
+    parseLine(carry_);
+    carry_.clear();
+  }
+}
+
+void
+SLPTailer::parseLine(std::string_view line_)
+{
+  if (!line_.empty() && line_.back() == '\r') {
+    line_.remove_suffix(1);
+  }
+  if (line_.empty()) {
+    return;
+  }
+  if (batchLines_++ == 0) {
+    first_ = std::chrono::steady_clock::now();
+  }
+  if (parser_.parse(line_)) {
+    csv_.row(rows_, parser_);
+    ++batchRows_;
+  } else {
+    rejects_.append(line_.data(), line_.size());
+    rejects_ += '\n';
+    ++batchRejected_;
+  }
+}
+
+/*!
+ * \internal
+ * \brief Writes the batch, then checkpoints the offset just after its last
+ * complete line.
+ */
+bool
+SLPTailer::flush()
+{
+  if (!pending_) {
+    return true;
+  }
+  if (!writeBatch() || !saveCheckpoint()) {
+    return false;
+  }
+
+  stats_.lines_ += batchLines_;
+  stats_.rows_ += batchRows_;
+  stats_.rejected_ += batchRejected_;
+  if (batchLines_ > 0) {
+    ++stats_.batches_;
+    if (cfg_.verbose_) {
+      std::fprintf(stderr,
+                   "slpload: batch %" PRIu64 ": %" PRIu64 " rows, %" PRIu64
+                   " rejected, offset %lld\n",
+                   stats_.batches_,
+                   batchRows_,
+                   batchRejected_,
+                   static_cast<long long>(offset_ - carry_.size()));
+    }
+  }
+
+  rows_.clear();
+  rejects_.clear();
+  batchLines_ = batchRows_ = batchRejected_ = 0;
+  pending_ = false;
+  return true;
+}
+
+/*!
+ * \internal
+ * \brief With a directory, each batch is a file of its own, written under a
+ * temporary name and renamed, so a loader only sees complete batches.
+ */
+bool
+SLPTailer::writeBatch()
+{
+  if (!rows_.empty()) {
+    if (!cfg_.batchDir_.empty()) {
+      char name_[64];
+      std::snprintf(name_, sizeof(name_), "batch-%010" PRIu64 ".csv", batch_);
+      const std::string file_ = cfg_.batchDir_ + "/" + name_;
+      const std::string tmp_ = cfg_.batchDir_ + "/." + name_ + ".tmp";
+
+      const int b_ =
+        ::open(tmp_.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+      const bool ok_ = b_ >= 0 && writeAll(b_, rows_) && ::fsync(b_) == 0;
+      if (b_ >= 0) {
+        ::close(b_);
+      }
+      if (!ok_ || ::rename(tmp_.c_str(), file_.c_str()) != 0) {
+        error_ = file_ + ": " + std::strerror(errno);
+        return false;
+      }
+      ++batch_;
+    } else {
+      struct stat st_ = {};
+      if (!writeAll(out_, rows_) ||
+          (::fstat(out_, &st_) == 0 && S_ISREG(st_.st_mode) &&
+           ::fdatasync(out_) != 0)) {
+        error_ = (cfg_.output_.empty() ? "stdout" : cfg_.output_) + ": " +
+                 std::strerror(errno);
+        return false;
+      }
+    }
+  }
+  if (rejectsFd_ >= 0 && !rejects_.empty() && !writeAll(rejectsFd_, rejects_)) {
+    error_ = cfg_.rejects_ + ": " + std::strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+bool
+SLPTailer::loadCheckpoint(Checkpoint& c_) const
+{
+  if (cfg_.checkpoint_.empty()) {
+    return false;
+  }
+  FILE* f_ = std::fopen(cfg_.checkpoint_.c_str(), "r");
+  if (f_ == nullptr) {
+    return false;
+  }
+  unsigned long long dev_ = 0;
+  unsigned long long ino_ = 0;
+  long long offset_ = 0;
+  unsigned long long batch_ = 0;
+  const int n_ = std::fscanf(
+    f_, "slpload 1 %llu %llu %lld %llu", &dev_, &ino_, &offset_, &batch_);
+  std::fclose(f_);
+  if (n_ != 4 || offset_ < 0) {
+    return false;
+  }
+  c_.dev_ = static_cast<dev_t>(dev_);
+  c_.ino_ = static_cast<ino_t>(ino_);
+  c_.offset_ = static_cast<off_t>(offset_);
+  c_.batch_ = batch_;
+  return true;
+}
+
+/*!
+ * \internal
+ * \brief Writes the checkpoint under a temporary name and renames it, so it's
+ * always either the old or the new one.
+ */
+bool
+SLPTailer::saveCheckpoint()
+{
+  if (cfg_.checkpoint_.empty() || fd_ < 0) {
+    return true;
+  }
+  char text_[128];
+  const int n_ = std::snprintf(
+    text_,
+    sizeof(text_),
+    "slpload 1 %llu %llu %lld %llu\n",
+    static_cast<unsigned long long>(dev_),
+    static_cast<unsigned long long>(ino_),
+    static_cast<long long>(offset_ - static_cast<off_t>(carry_.size())),
+    static_cast<unsigned long long>(batch_));
+
+  const std::string tmp_ = cfg_.checkpoint_ + ".tmp";
+  const int cp_ =
+    ::open(tmp_.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  const bool ok_ =
+    cp_ >= 0 &&
+    writeAll(cp_, std::string_view(text_, static_cast<size_t>(n_))) &&
+    ::fsync(cp_) == 0;
+  if (cp_ >= 0) {
+    ::close(cp_);
+  }
+  if (!ok_ || ::rename(tmp_.c_str(), cfg_.checkpoint_.c_str()) != 0) {
+    error_ = cfg_.checkpoint_ + ": " + std::strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+bool
+SLPTailer::writeAll(int fd_, std::string_view data_)
+{
+  while (!data_.empty()) {
+    const ssize_t n_ = ::write(fd_, data_.data(), data_.size());
+    if (n_ < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data_.remove_prefix(static_cast<size_t>(n_));
+  }
+  return true;
+}
+
+} // namespace squidlogparser
@@ -0,0 +1,168 @@
+/***************************************************************************
+ * Copyright (c) 2020-22                                                   *
+ *      Volnei Cervi Puttini.  All rights reserved.                        *
+ *      vcputtini@gmail.com
+ *                                                                         *
+ * Redistribution and use in source and binary forms, with or without      *
+ * modification, are permitted provided that the following conditions      *
+ * are met:                                                                *
+ * 1. Redistributions of source code must retain the above copyright       *
+ *    notice, this list of conditions and the following disclaimer.        *
+ * 2. Redistributions in binary form must reproduce the above copyright    *
+ *    notice, this list of conditions and the following disclaimer in the  *
+ *    documentation and/or other materials provided with the distribution. *
+ * 4. Neither the name of the Author     nor the names of its contributors *
+ *    may be used to endorse or promote products derived from this software*
+ *    without specific prior written permission.                           *
+ *                                                                         *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND *
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR      *
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS  *
+ * BE LIABLEFOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   *
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF    *
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS*
+ * INTERRUPTION)                                                           *
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,     *
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING   *
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE      *
+ * POSSIBILITY OFSUCH DAMAGE.                                              *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*!
+ * \brief How this file is organized:
+ *
+ * Follow mode of the bulk loader (slpload --follow): near-real-time
+ * ingestion of a live access.log.
+ *
+ * struct SLPTailConfig, SLPTailStats
+ * class SLPTailer: waits on inotify for the directory of the log, parses
+ *                  only the bytes appended since the last read (one
+ *                  long-lived parser) and writes the rows in micro-batches
+ *                  to a file, a fifo or a directory of batch files. After
+ *                  each batch its offset is checkpointed, so a restart
+ *                  resumes where the last batch ended.
+ *
+ * Rotation is detected by the change of the inode behind the path: the old
+ * file is read to its end before the new one is opened. A file truncated in
+ * place (copytruncate) is read again from its start.
+ */
+
+#ifndef SLPTAIL_H
+#define SLPTAIL_H
+
+#include <atomic>
+#include <chrono>
+#include <sys/types.h>
+
+#include "slpload.h"
+
+namespace squidlogparser {
+
+struct SLPTailConfig
+{
+  using LogFormat = SquidLogData::LogFormat;
+
+  LogFormat format_ = LogFormat::Squid;
+  bool ipText_ = false;
+
+  std::string path_ = {};       // the live log
+  std::string checkpoint_ = {}; // offset of the last batch written
+  std::string output_ = {};     // appended: file or fifo; empty: stdout
+  std::string batchDir_ = {};   // or one file per batch
+  std::string rejects_ = {};
+
+  unsigned intervalMs_ = 1000;   // maximum lag of a batch
+  size_t maxBatch_ = 16 << 20;   // bytes of CSV that force a batch
+  bool fromEnd_ = false;         // without checkpoint, skip what's there
+  bool verbose_ = false;         // a line per batch to stderr
+};
+
+struct SLPTailStats
+{
+  uint64_t batches_ = 0;
+  uint64_t bytes_ = 0; // of the log
+  uint64_t lines_ = 0;
+  uint64_t rows_ = 0;
+  uint64_t rejected_ = 0;
+  uint64_t rotations_ = 0;
+};
+
+class SLPTailer
+{
+public:
+  explicit SLPTailer(const SLPTailConfig& cfg_);
+  ~SLPTailer();
+
+  SLPTailer(const SLPTailer&) = delete;
+  SLPTailer& operator=(const SLPTailer&) = delete;
+
+  bool run(const std::atomic<bool>& stop_);
+
+  const SLPTailStats& stats() const noexcept { return stats_; }
+  const std::string& error() const noexcept { return error_; }
+
+private:
+  /*!
+   * \brief Position of the log: the file by its device and inode and the
+   * offset just after the last complete line of the last batch written.
+   */
+  struct Checkpoint
+  {
+    dev_t dev_ = 0;
+    ino_t ino_ = 0;
+    off_t offset_ = 0;
+    uint64_t batch_ = 0; // number of the next batch file
+  };
+
+  SLPTailConfig cfg_;
+  SLPTailStats stats_ = {};
+  std::string error_ = {};
+
+  SLPRowParser parser_;
+  SLPCsvFormat csv_;
+
+  int fd_ = -1; // the log being read
+  dev_t dev_ = 0;
+  ino_t ino_ = 0;
+  off_t offset_ = 0;        // read up to here
+  std::string carry_ = {};  // partial line at offset_
+  std::vector<char> buf_ = {};
+
+  int inotify_ = -1;
+  int out_ = -1;
+  int rejectsFd_ = -1;
+
+  std::string rows_ = {}; // the batch
+  std::string rejects_ = {};
+  uint64_t batchLines_ = 0;
+  uint64_t batchRows_ = 0;
+  uint64_t batchRejected_ = 0;
+  uint64_t batch_ = 0;
+  bool pending_ = false; // something to checkpoint
+  std::chrono::steady_clock::time_point first_ = {};
+
+  bool start();
+  bool openLog(const std::string& path_, off_t offset_);
+  void closeLog() noexcept;
+  bool readNew(bool& more_);
+  void consume(std::string_view data_, bool end_);
+  void parseLine(std::string_view line_);
+  bool follow(bool& more_);
+
+  bool flush();
+  bool writeBatch();
+  bool loadCheckpoint(Checkpoint& c_) const;
+  bool saveCheckpoint();
+
+  static bool writeAll(int fd_, std::string_view data_);
+};
+
+} // namespace squidlogparser
+
+#endif // SLPTAIL_H